@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Append-only completion log for CLI batch runs. Each processed image adds one
+// line (input, content hash, output, status, timing, shard) written with a single
+// write() and fsync'd, and each line carries its own checksum, so a worker killed
+// mid-write loses at most the record it was writing. Restarting with the same
+// journal skips inputs whose last record succeeded for the same content.
+class BatchJournal {
+public:
+    struct Record {
+        std::string input;          // Path relative to the batch directory
+        uint64_t inputHash = 0;     // Content hash of the input file
+        std::string output;
+        int32_t status = 0;         // PrintTraceResult
+        double elapsedMs = 0.0;
+        int64_t timestampMs = 0;    // Unix epoch
+        std::string shard;          // "i/n", empty when unsharded
+    };
+
+    BatchJournal() = default;
+    ~BatchJournal();
+    BatchJournal(const BatchJournal&) = delete;
+    BatchJournal& operator=(const BatchJournal&) = delete;
+
+    // Creates the journal or appends to an existing one
+    bool open(const std::string& path);
+    bool append(const Record& record);
+    void close();
+
+    // Torn or corrupt lines are skipped and counted
+    static bool read(const std::string& path, std::vector<Record>& records, size_t* skipped = nullptr);
+
+    // 64-bit FNV-1a; deterministic across machines and builds
+    static uint64_t hashString(const std::string& text);
+    // Content hash of a file, the same XXH64 the result cache keys inputs by
+    static bool hashFile(const std::string& path, uint64_t& hash);
+
+    // Shard assignment by path hash: stable for a given relative path and shard count
+    static bool inShard(const std::string& relativePath, int index, int count);
+
+private:
+    int m_fd = -1;
+};
+
+} // namespace PrintTrace
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace PrintTrace {
+
+// XXH64-compatible content hash. Kept free of OpenCV so the CLI can build it
+// alongside the library: the result cache keys inputs by it and the batch
+// journal records it, and the two must agree.
+class ContentHash {
+public:
+    static uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+};
+
+} // namespace PrintTrace
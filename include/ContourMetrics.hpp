@@ -0,0 +1,37 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace PrintTrace {
+
+// Boundary distances between closed outlines, used to check that faster modes
+// still produce the same outline.
+class ContourMetrics {
+public:
+    struct Distance {
+        double hausdorffMM = 0.0;      // Symmetric Hausdorff distance
+        double meanMM = 0.0;           // Symmetric mean boundary distance
+        double areaRatio = 0.0;        // area(candidate) / area(reference)
+    };
+
+    // Both outlines are closed polygons in mm. Boundaries are resampled every
+    // sampleStepMM so long straight edges are weighted by length, not vertex count.
+    static Distance compare(const std::vector<cv::Point2d>& candidateMM,
+                            const std::vector<cv::Point2d>& referenceMM,
+                            double sampleStepMM = 0.1);
+
+    // Pipeline contour (warped px) to mm. The warp maps the lightbox corners to
+    // (0,0) and (W-1,H-1), hence the -1.
+    static std::vector<cv::Point2d> pixelsToMM(const std::vector<cv::Point>& contourPx,
+                                               int lightboxWidthPx, int lightboxHeightPx,
+                                               double lightboxWidthMM, double lightboxHeightMM);
+    // Same, for a run whose warp resolution is only known as its pixels per mm
+    static std::vector<cv::Point2d> pixelsToMM(const std::vector<cv::Point>& contourPx, double pixelsPerMM);
+
+private:
+    static std::vector<cv::Point2d> resample(const std::vector<cv::Point2d>& polygon, double stepMM);
+    static double distanceToPolygon(const cv::Point2d& point, const std::vector<cv::Point2d>& polygon);
+};
+
+} // namespace PrintTrace
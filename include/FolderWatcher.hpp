@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Reports files that appear in watched directories once they have stopped
+// changing, so a photo still being copied in is never picked up half written.
+// On Linux the directories are watched with inotify and never rescanned;
+// elsewhere each poll rescans them.
+class FolderWatcher {
+public:
+    struct Ready {
+        size_t folder;              // Index in add() order
+        std::filesystem::path path;
+    };
+
+    // accept filters file names (e.g. image extensions); settleSeconds is how long
+    // size and modification time must stay unchanged
+    FolderWatcher(std::function<bool(const std::filesystem::path&)> accept, double settleSeconds);
+    ~FolderWatcher();
+    FolderWatcher(const FolderWatcher&) = delete;
+    FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+    // Starts watching; files already present are reported too
+    bool add(const std::string& directory);
+
+    // Waits up to timeoutMs for changes and returns files that have settled
+    std::vector<Ready> poll(int timeoutMs);
+
+private:
+    struct Pending {
+        size_t folder = 0;
+        uintmax_t size = 0;
+        std::filesystem::file_time_type modified;
+        std::chrono::steady_clock::time_point changed;
+    };
+
+    void touch(size_t folder, const std::filesystem::path& path);
+    void scan(size_t folder);
+    void readEvents(int timeoutMs);
+
+    std::function<bool(const std::filesystem::path&)> m_accept;
+    std::chrono::duration<double> m_settle;
+    std::vector<std::filesystem::path> m_folders;
+    std::map<std::filesystem::path, Pending> m_pending;
+    std::map<std::filesystem::path, std::filesystem::file_time_type> m_seen;  // Rescan mode: last reported state
+    std::map<int, size_t> m_watches;    // inotify watch descriptor -> folder
+    int m_fd = -1;
+};
+
+} // namespace PrintTrace
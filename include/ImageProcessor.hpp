@@ -2,6 +2,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/photo.hpp>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -45,6 +46,7 @@ public:
 
         // Object detection parameters
         bool useAdaptiveThreshold = true;
+        bool autoThreshold        = false; // Pick the threshold by candidate scoring (overrides the others)
         double manualThreshold    = 0.0;  // 0 = auto
         double thresholdOffset    = 0.0;  // Offset from auto threshold
 
@@ -66,9 +68,24 @@ public:
         int  cornerWinSize           = 5;
         int  cornerZeroZone          = -1;
 
+        // Lightbox corner detection
+        int    cornerDetectionMode  = 0;    // 0 = boundary fit, 1 = race all detectors, 2 = scanline search
+        double cornerMinConfidence  = 0.8;  // Edge support a raced result needs to win early
+
+        // Early image-quality gate (thumbnail pre-check before the full decode)
+        bool   enableQualityGate    = false;
+        double minSharpness         = 10.0; // Minimum Laplacian-of-Gaussian variance on the thumbnail
+
+        // Bounded-memory lightbox detection for very large photos
+        int tileMemoryLimitMB = 0;          // > 0: build the boundary mask in stripes within this budget
+        int maxMemoryMB       = 0;          // > 0: planMemory picks decode and warp sizes that fit
+        int decodeReduction   = 1;          // Decode the input at 1/n scale (1, 2, 4 or 8)
+        double targetToleranceMM = 0.0;     // > 0: size the warp from source density and this tolerance
+
         // Validation parameters
         bool validateClosedContour = true;
         double minPerimeter        = 100.0;
+        bool repairSelfIntersections = true;  // Cut loops out of the final contour before validation
 
         // Tolerance/dilation for 3D printing
         double dilationAmountMM  = 0.0;
@@ -88,9 +105,57 @@ public:
         
         // Debug image stack (for automatic numbering)
         mutable std::vector<std::pair<cv::Mat, std::string>> debugImageStack;
+
+        // Wall time per stage of the last processImageToStage call (stage name, ms)
+        mutable std::vector<std::pair<std::string, double>> stageTimingsMs;
+
+        // Called after each timed stage (time spent in it is not counted); the job
+        // queue uses it to let a batch job give way to an interactive one
+        std::function<void(const char* stage)> onStageBoundary;
+    };
+
+    // Output of stage 1 (perspective correction); every later stage depends only on this
+    struct LightboxStage {
+        cv::Mat warped;                    // Perspective-corrected grayscale lightbox
+        std::vector<cv::Point2f> corners;  // Refined lightbox corners in the source image (TL, TR, BR, BL)
+        cv::Mat homography;                // Source image px -> warped px (3x3, CV_64F)
+        double pixelsPerMM = 0.0;
     };
 
-    static cv::Mat loadImage(const std::string& path);
+    // Measurements of the thumbnail pre-check
+    struct QualityReport {
+        double sharpness = 0.0;         // Variance of the Laplacian of the lightly smoothed thumbnail
+        int darkLevel = 0;              // 5th percentile gray level
+        int brightLevel = 0;            // 99th percentile gray level
+        double lightboxFraction = 0.0;  // Share of the frame covered by the bright quadrilateral (0 = none found)
+    };
+
+    // Decode reduction and warp size chosen to keep a run within maxMemoryMB
+    struct MemoryPlan {
+        cv::Size sourceSize;        // Full-resolution input size (empty if the header could not be read)
+        int decodeReduction = 1;
+        cv::Size warpSize;
+        double peakMB = 0.0;        // Estimated peak working set with these sizes
+        bool fits = true;
+    };
+
+    static cv::Mat loadImage(const std::string& path, int decodeReduction = 1);
+    // Decodes a grayscale thumbnail (longest side ~512 px), using the decoder's reduced-size
+    // mode so large JPEGs are never decoded in full. Empty if the file cannot be read.
+    static cv::Mat loadQualityThumbnail(const std::string& path);
+    static QualityReport assessImageQuality(const cv::Mat& grayThumbnail, const ProcessingParams& params);
+    // Throws a specific error for blurred, badly exposed or lightbox-less photos
+    static void checkImageQuality(const std::string& path, const ProcessingParams& params);
+    // Reads the image size from the JPEG or PNG header without decoding pixels
+    static bool probeImageSize(const std::string& path, cv::Size& size);
+    // Estimates per-stage peak memory from the header size and shrinks first whichever
+    // of decode and warp resolution dominates until the estimate fits maxMemoryMB
+    static MemoryPlan planMemory(const std::string& path, const ProcessingParams& params);
+    // Resolves params for this file the way every entry point must before running the
+    // pipeline on it: with maxMemoryMB set, applies planMemory's decode and warp sizes
+    // (leaving params unchanged if the plan does not fit). The returned plan always has
+    // the header size (empty if unreadable); its warpSize bounds tolerance mode's warp.
+    static MemoryPlan resolveForImage(const std::string& path, ProcessingParams& params);
     static cv::Mat convertToGrayscale(const cv::Mat& img);
     
     // New streamlined corner detection pipeline methods
@@ -107,14 +172,42 @@ public:
     
     // Master streamlined corner detection function
     static std::vector<cv::Point2f> detectLightboxCorners(const cv::Mat& bgrImg, const ProcessingParams& params);
+    // Runs the scanline, boundary fit, Lab mask contour and Hough line detectors
+    // concurrently on one downscaled copy; the first to validate with
+    // cornerMinConfidence wins and the others stop at their next phase boundary.
+    // Returns ordered full-resolution corners (TL, TR, BR, BL); throws if no
+    // detector finds a quadrilateral.
+    static std::vector<cv::Point2f> raceCornerDetectors(const cv::Mat& bgrImg, const ProcessingParams& params);
+    // Casts sparse scanlines from the image centre towards each border, locates the
+    // outermost bright-to-dark transition on each by 1D gradient analysis and fits
+    // the four sides to those samples. Cost grows with the number of scanlines and
+    // the image's linear size, not its area. Returns ordered corners (TL, TR, BR, BL)
+    // or empty if too few scanlines see an edge.
+    static std::vector<cv::Point2f> detectCornersFromScanlines(const cv::Mat& grayImg, const ProcessingParams& params);
+    // Fraction of samples along the quadrilateral's sides that sit on a strong gradient
+    static double cornerConfidence(const std::vector<cv::Point2f>& corners, const cv::Mat& gradientMagnitude);
     
     static cv::Mat normalizeLighting(const cv::Mat& inputImg, const ProcessingParams& params);
     static cv::Mat detectEdges(const cv::Mat& normalizedImg, const cv::Mat& originalImg, const ProcessingParams& params);
+    // The two halves of detectEdges, so the colour mask can run alongside lighting normalisation
+    static cv::Mat labPaperMask(const cv::Mat& colorImg, const ProcessingParams& params);
+    static cv::Mat detectEdgesFromMask(const cv::Mat& paperMask, const ProcessingParams& params);
     static cv::Mat detectLightboxBoundary(const cv::Mat& grayImg, const ProcessingParams& params);
+    // detectEdges in full-width stripes: colour mask and morphology run per stripe with
+    // enough halo rows to be exact, and rows stream into a run-length connected component
+    // labeller, so no full-size mask is ever allocated. Working memory stays within
+    // tileMemoryLimitMB. Returns the four corners of the largest region, or empty.
+    static std::vector<cv::Point2f> detectCornersStriped(const cv::Mat& image, const ProcessingParams& params);
     static std::vector<cv::Point> findBoundaryContour(const cv::Mat& edgeImg, const ProcessingParams& params);
     static std::vector<cv::Point2f> refineCorners(const std::vector<cv::Point>& corners,
                                                   const cv::Mat& grayImg,
                                                   const ProcessingParams& params);
+    static std::vector<cv::Point2f> refineCorners(const std::vector<cv::Point2f>& corners,
+                                                  const cv::Mat& grayImg,
+                                                  const ProcessingParams& params);
+    // Smallest warp that holds targetToleranceMM without exceeding the pixel density
+    // the source offers on the lightbox (no point upsampling past it)
+    static cv::Size chooseWarpSize(const std::vector<cv::Point2f>& corners, const ProcessingParams& params);
     static std::pair<cv::Mat, double> warpImage(const cv::Mat& originalImg,
                                                const std::vector<cv::Point2f>& corners,
                                                const cv::Size& targetSize, double realWorldWidthMM, double realWorldHeightMM);
@@ -122,6 +215,9 @@ public:
                                                const std::vector<cv::Point>& approx,
                                                int side, double realWorldSizeMM);
     static std::vector<cv::Point> findObjectContour(const cv::Mat& warpedImg, const ProcessingParams& params);
+    // Evaluates candidate thresholds in parallel on a reduced copy of the preprocessed
+    // object image and returns the one whose main blob is most stable, solid and dominant
+    static double selectAutoThreshold(const cv::Mat& gray, const ProcessingParams& params);
     static std::vector<cv::Point> mergeNearbyContours(const std::vector<std::vector<cv::Point>>& contours,
                                                       double mergeDistancePx, const ProcessingParams& params);
     static std::vector<cv::Point2f> refineContour(const std::vector<cv::Point>& contour,
@@ -140,6 +236,11 @@ public:
                                                               double smoothingMM, double pixelsPerMM,
                                                               const ProcessingParams& params);
     static bool validateContour(const std::vector<cv::Point>& contour, const ProcessingParams& params);
+    // Sweep-line test over the contour's edges, O(n log n); touching or folded-back
+    // edges count as intersections since slicers reject those too
+    static bool hasSelfIntersection(const std::vector<cv::Point>& contour);
+    // Removes loops one crossing at a time, keeping the larger-area side of each cut
+    static std::vector<cv::Point> repairSelfIntersections(const std::vector<cv::Point>& contour);
     static void saveDebugImage(const cv::Mat& image, const std::string& filename, const ProcessingParams& params);
     static void saveDebugImageWithContours(const cv::Mat& image, const std::vector<std::vector<cv::Point>>& contours,
                                           const std::string& filename, const ProcessingParams& params);
@@ -157,6 +258,11 @@ public:
     static std::vector<cv::Point> findLargestContour(const cv::Mat& binaryImg);
     static std::vector<cv::Point> approximatePolygon(const std::vector<cv::Point>& contour,
                                                      double epsilonFactor = 0.02);
+    // Single-pass quadrilateral fit: splits the boundary into four runs by tangent
+    // direction, fits a robust (Huber) line to each and intersects neighbours.
+    // Returns four sub-pixel corners in boundary order, or empty if the boundary
+    // is not recognisably four-sided.
+    static std::vector<cv::Point2f> fitQuadrilateral(const std::vector<cv::Point>& boundary);
     static cv::Mat removeNoise(const cv::Mat& binaryImg, int kernelSize = 21,
                               int blurSize = 101, int thresholdValue = 127);
     static std::vector<cv::Point> findMainContour(const cv::Mat& binaryImg);
@@ -168,6 +274,34 @@ public:
     static std::pair<cv::Mat, std::vector<cv::Point>> processImageToStage(
         const std::string& inputPath,
         const ProcessingParams& params,
+        int target_stage,
+        LightboxStage* lightbox = nullptr  // Filled once stage 1 completes (optional)
+    );
+
+    // Runs stages 2..target_stage from a previously computed stage 1 result
+    // (e.g. a stage snapshot); target stages 0 and 1 return the warped image
+    static std::pair<cv::Mat, std::vector<cv::Point>> processFromLightbox(
+        const LightboxStage& lightbox,
+        const ProcessingParams& params,
+        int target_stage
+    );
+
+    // Runs stages 5..target_stage (smooth, dilate, validate) on a stage 4 contour
+    static std::vector<cv::Point> processFromObjectContour(
+        const LightboxStage& lightbox,
+        const std::vector<cv::Point>& objectContour,
+        const ProcessingParams& params,
+        int target_stage
+    );
+
+    // Canonical text of every parameter stages 0-1 read; two parameter sets with
+    // the same signature produce the same LightboxStage for the same input
+    static std::string lightboxStageSignature(const ProcessingParams& params);
+
+private:
+    static std::pair<cv::Mat, std::vector<cv::Point>> runStagesFromLightbox(
+        const LightboxStage& lightbox,
+        const ProcessingParams& params,
         int target_stage
     );
 };
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace PrintTrace {
+
+// Queue of whole processing jobs in front of the WorkerPool. At most
+// maxConcurrent() jobs run at a time, so a burst of submissions waits here
+// instead of flooding the pool's task queues; the steps inside each job still run
+// in parallel on the pool. Interactive jobs start before batch jobs; a batch job
+// that has waited longer than the aging limit is treated as interactive, so bulk
+// work is never starved. With preemption on, a running batch job gives its slot
+// to a waiting interactive job at the next stage boundary, runs it on its own
+// thread, and resumes afterwards.
+// With a memory budget, a job also waits until its estimated peak fits next to
+// the jobs already admitted (a job runs anyway when nothing else is running).
+class JobQueue {
+public:
+    using JobId = uint64_t;
+
+    enum class Priority { Interactive = 0, Batch = 1 };
+    static const int kPriorityCount = 2;
+
+    static JobQueue& shared();
+
+    JobQueue() = default;
+    // Waits for every submitted job
+    ~JobQueue();
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    // The job receives its own id; memoryMB is its estimated peak working set
+    JobId submit(std::function<void(JobId)> job, Priority priority = Priority::Batch, double memoryMB = 0.0);
+    void waitIdle();
+
+    // jobs <= 0: one job per pool thread (at least one)
+    void setMaxConcurrent(int jobs);
+    int maxConcurrent() const;
+
+    // batchAgingMs <= 0 never promotes batch jobs
+    void setScheduling(int batchAgingMs, bool preemptBatch);
+
+    // budgetMB <= 0 admits jobs regardless of memory
+    void setMemoryBudget(double budgetMB);
+    double memoryBudget() const;
+    // Estimated peak of the running and preempted jobs
+    double admittedMemory() const;
+
+    // Called by a running job between stages: a batch job yields here while an
+    // interactive job waits for a slot. No-op outside queue jobs.
+    static void stageBoundary();
+
+    size_t queued() const;
+    size_t queued(Priority priority) const;
+    size_t running() const;
+    size_t preempted() const;
+
+private:
+    struct Job {
+        JobId id = 0;
+        Priority priority = Priority::Batch;
+        std::function<void(JobId)> run;
+        std::chrono::steady_clock::time_point submitted;
+        double memoryMB = 0.0;
+    };
+
+    bool takeLocked(Job& job);
+    void dispatch();
+    bool start(Job& job);
+    void execute(Job& job, bool startNext);
+    void yieldSlot();
+    int limitLocked() const;
+    bool fitsLocked(const Job& job) const;
+    size_t queuedLocked() const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::deque<Job> m_queues[kPriorityCount];
+    size_t m_running = 0;
+    size_t m_preempted = 0;             // Batch jobs that gave up their slot and wait to resume
+    int m_maxConcurrent = 0;
+    std::chrono::milliseconds m_batchAging{10000};
+    bool m_preemptBatch = false;
+    double m_memoryBudgetMB = 0.0;
+    double m_admittedMB = 0.0;
+    JobId m_nextId = 1;
+};
+
+} // namespace PrintTrace
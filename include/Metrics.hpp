@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace PrintTrace {
+
+// Process-wide counters and latency histograms in Prometheus text format. Each
+// thread records into its own shard with plain relaxed stores (no locks, no
+// shared cache lines); a scrape sums the shards and adds the current job queue
+// and worker pool gauges. Shards of exited threads are folded into a total.
+class Metrics {
+public:
+    // Recording; cheap enough for every image and every pool task
+    static void recordImage(int32_t result, double seconds);
+    static void recordStages(const std::vector<std::pair<std::string, double>>& stageTimingsMs);
+    static void recordCacheHit();
+    static void recordPoolTask(double busySeconds);
+    // priority is a JobQueue::Priority value
+    static void recordJobWait(int priority, double seconds);
+    static void recordPreemption();
+
+    static std::string render();
+
+    // Serves GET /metrics on "host:port" (host defaults to 127.0.0.1) or
+    // "unix:/path/to.sock"; an empty address stops the server
+    static bool serve(const std::string& address);
+
+    // Rewrites path (atomically, for node-exporter's textfile collector) every
+    // intervalSeconds; an empty path writes a last snapshot and stops
+    static bool writeFilePeriodically(const std::string& path, double intervalSeconds);
+};
+
+} // namespace PrintTrace
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ImageProcessor.hpp"
+#include "PrintTraceAPI.h"
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Canonical text form of PrintTraceParams ("name=value" per line, declaration
+// order, round-trip exact) and name-based access to individual fields. Used
+// wherever parameters have to be stored, hashed or set from the command line.
+class ParamCodec {
+public:
+    static std::string encode(const PrintTraceParams& params);
+
+    // Starts from the library defaults; fails on unknown names or bad values
+    static bool decode(const std::string& text, PrintTraceParams& params, std::string* error = nullptr);
+
+    static bool set(PrintTraceParams& params, const std::string& name, const std::string& value);
+    static bool get(const PrintTraceParams& params, const std::string& name, std::string& value);
+    static std::vector<std::string> names();
+
+    // C parameters to the C++ pipeline parameters (NULL = C++ defaults)
+    static ImageProcessor::ProcessingParams toProcessingParams(const PrintTraceParams* params);
+};
+
+} // namespace PrintTrace
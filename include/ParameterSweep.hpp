@@ -0,0 +1,55 @@
+#pragma once
+
+#include "PrintTraceAPI.h"
+#include "ImageProcessor.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Runs every combination of a set of parameter axes on one image as a tree that
+// shares pipeline prefixes: stages 0-1 (decode, boundary, warp) once per distinct
+// lightbox signature, stages 2-4 (object detection) once per distinct detection
+// parameters, then stages 5-7 (smooth, dilate, validate) per combination. Nodes
+// of each level run in parallel.
+class ParameterSweep {
+public:
+    struct Axis {
+        std::string name;                   // PrintTraceParams field name (ParamCodec)
+        std::vector<std::string> values;    // Text values as accepted by ParamCodec::set
+    };
+
+    struct Run {
+        PrintTraceParams params;
+        int32_t resultCode = 0;             // PrintTraceResult; PROCESSING_FAILED carries error
+        std::string error;
+        std::vector<cv::Point> contour;     // Warped px
+        double pixelsPerMM = 0.0;
+        double areaMM2 = 0.0;
+        double perimeterMM = 0.0;
+        double solidity = 0.0;
+        double elapsedMs = 0.0;             // Stage time along this combination's path
+    };
+
+    struct Stats {
+        size_t combinations = 0;
+        size_t lightboxRuns = 0;            // Stage 0-1 executions
+        size_t objectRuns = 0;              // Stage 2-4 executions
+        size_t finishRuns = 0;              // Stage 5-7 executions
+        double wallMs = 0.0;
+    };
+
+    // Cartesian product of the axes applied to base, first axis varying slowest
+    static bool expand(const PrintTraceParams& base, const std::vector<Axis>& axes,
+                       std::vector<PrintTraceParams>& combinations, std::string* error = nullptr);
+
+    // One Run per combination, in expand() order. At most `threads` combinations run
+    // at once on the shared WorkerPool (<= 0: all hardware threads). Debug output is
+    // always disabled. Fails only on invalid axes.
+    static bool run(const std::string& inputPath, const PrintTraceParams& base,
+                    const std::vector<Axis>& axes, int threads, std::vector<Run>& runs,
+                    Stats* stats = nullptr, std::string* error = nullptr);
+};
+
+} // namespace PrintTrace
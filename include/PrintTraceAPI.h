@@ -25,7 +25,10 @@ typedef enum {
     PRINT_TRACE_ERROR_NO_OBJECT = -7,
     PRINT_TRACE_ERROR_DXF_WRITE_FAILED = -8,
     PRINT_TRACE_ERROR_INVALID_PARAMETERS = -9,
-    PRINT_TRACE_ERROR_PROCESSING_FAILED = -10
+    PRINT_TRACE_ERROR_PROCESSING_FAILED = -10,
+    PRINT_TRACE_ERROR_IMAGE_BLURRY = -11,
+    PRINT_TRACE_ERROR_IMAGE_BAD_EXPOSURE = -12,
+    PRINT_TRACE_ERROR_NO_LIGHTBOX = -13
 } PrintTraceResult;
 
 // Processing parameters structure (CAD-optimized)
@@ -88,6 +91,25 @@ typedef struct {
     
     // Debug visualization
     bool enable_debug_output;       // Enable debug image output (default: false)
+    
+    // Fields added since the 1.x layout (library major version 2). Later fields
+    // are appended here; sizeof(PrintTraceParams) still grows with each one, so
+    // any addition needs a major version (SOVERSION) bump.
+    bool auto_threshold;            // Score candidate thresholds and pick the most stable one (overrides manual/adaptive, default: false)
+    bool repair_self_intersections; // Cut self-intersecting loops out of the final contour (default: true)
+    
+    // Lightbox corner detection
+    int32_t corner_detection_mode;  // 0 = boundary fit, 1 = race all detectors in parallel, 2 = scanline search (default: 0)
+    double corner_min_confidence;   // Edge support a raced result needs to win early (range: 0.0-1.0, default: 0.8)
+    
+    // Early image-quality gate (checked on a thumbnail before the full decode)
+    bool enable_quality_gate;       // Reject blurred, badly exposed or lightbox-less photos up front (default: false)
+    double min_sharpness;           // Minimum thumbnail Laplacian variance (range: 0.0-200.0, default: 10.0)
+    
+    // Large-image memory bound
+    int32_t tile_memory_limit_mb;   // Working memory for striped lightbox detection, 0 = whole frame (range: 0-4096, default: 0)
+    int32_t max_memory_mb;          // Peak memory budget; picks decode reduction and warp size to fit, 0 = unlimited (range: 0-65536, default: 0)
+    double target_tolerance_mm;     // Size the warp per image for this outline tolerance instead of lightbox_*_px, 0 = off (range: 0.0-5.0, default: 0.0)
 } PrintTraceParams;
 
 // Parameter ranges structure for UI slider configuration
@@ -154,6 +176,25 @@ typedef struct {
     double smoothing_amount_mm_max; // 2.0
     int32_t smoothing_mode_min;     // 0 (morphological)
     int32_t smoothing_mode_max;     // 1 (curvature-based)
+    
+    // Ranges of fields added since the original layout (appended, like PrintTraceParams)
+    // Corner detection ranges
+    int32_t corner_detection_mode_min; // 0 (boundary fit)
+    int32_t corner_detection_mode_max; // 2 (scanline search)
+    double corner_min_confidence_min;  // 0.0
+    double corner_min_confidence_max;  // 1.0
+    
+    // Quality gate ranges
+    double min_sharpness_min;       // 0.0
+    double min_sharpness_max;       // 200.0
+    
+    // Large-image ranges
+    int32_t tile_memory_limit_mb_min; // 0 (whole frame)
+    int32_t tile_memory_limit_mb_max; // 4096
+    int32_t max_memory_mb_min;      // 0 (unlimited)
+    int32_t max_memory_mb_max;      // 65536
+    double target_tolerance_mm_min; // 0.0 (fixed warp size)
+    double target_tolerance_mm_max; // 5.0
 } PrintTraceParamRanges;
 
 // Point structure for contour data
@@ -166,7 +207,7 @@ typedef struct {
 typedef struct {
     PrintTracePoint* points;
     int32_t point_count;
-    double pixels_per_mm;
+    double pixels_per_mm;       // Of the warp actually used (per image with target_tolerance_mm)
 } PrintTraceContour;
 
 // Image data structure for Swift integration
@@ -178,6 +219,58 @@ typedef struct {
     int32_t bytes_per_row;      // Number of bytes per row (including padding)
 } PrintTraceImageData;
 
+// Resolution choices for a memory budget (see print_trace_plan_memory)
+typedef struct {
+    int32_t source_width;       // Input size from the file header (0 if unreadable)
+    int32_t source_height;
+    int32_t decode_reduction;   // Input decoded at 1/n scale (1, 2, 4 or 8)
+    int32_t lightbox_width_px;  // Warp resolution used in place of the requested one
+    int32_t lightbox_height_px;
+    double estimated_peak_mb;   // Estimated peak working set with these choices
+    bool fits;                  // False if even the smallest choices exceed max_memory_mb
+} PrintTraceMemoryPlan;
+
+// Thread pool shared by all processing calls (see print_trace_configure_thread_pool)
+typedef struct {
+    int32_t worker_threads;     // Pool threads, 0 for hardware threads - 1 (the calling thread also works)
+    int32_t opencv_threads;     // Process-wide cv::setNumThreads, applied once when configuring: 0 splits the cores across pool threads,
+                                // -1 leaves the current OpenCV setting (including one from an earlier call) in place
+    int32_t max_job_parallelism; // Pool tasks one processing call keeps in flight, 0 for no cap
+    const int32_t* cpu_affinity; // CPUs the pool threads may run on (Linux only), NULL for any
+    int32_t cpu_affinity_count;
+} PrintTraceThreadConfig;
+
+// Priority of an asynchronous job
+typedef enum {
+    PRINT_TRACE_PRIORITY_INTERACTIVE = 0,   // Someone is waiting for it: starts before batch jobs
+    PRINT_TRACE_PRIORITY_BATCH = 1          // Bulk work
+} PrintTraceJobPriority;
+
+// Scheduling of asynchronous jobs (see print_trace_configure_scheduler)
+typedef struct {
+    int32_t batch_aging_ms;     // A batch job queued this long starts ahead of interactive ones, 0 never (default 10000)
+    bool preempt_batch;         // Running batch jobs yield their slot to waiting interactive jobs between stages
+    double memory_budget_mb;    // Start jobs only while their estimated peaks sum to at most this, 0 for no limit
+} PrintTraceSchedulerConfig;
+
+// One axis of a parameter sweep
+typedef struct {
+    const char* name;           // PrintTraceParams field name, e.g. "threshold_offset"
+    const double* values;       // Values to try (integer and bool fields need whole numbers / 0 or 1)
+    int32_t value_count;
+} PrintTraceSweepAxis;
+
+// Result of one parameter combination in a sweep
+typedef struct {
+    PrintTraceParams params;    // Resolved parameters of this combination
+    PrintTraceResult result;
+    PrintTraceContour contour;  // Final contour (points NULL on failure)
+    double area_mm2;
+    double perimeter_mm;
+    double solidity;            // Contour area / convex hull area
+    double elapsed_ms;          // Stage time along this combination's path, shared stages counted in full
+} PrintTraceSweepResult;
+
 // Processing pipeline stages
 typedef enum {
     PRINT_TRACE_STAGE_LOADED = 0,            // Image loaded and converted to grayscale
@@ -198,6 +291,10 @@ typedef void (*PrintTraceProgressCallback)(double progress, const char* stage, v
 // Error callback function type for detailed error reporting
 typedef void (*PrintTraceErrorCallback)(PrintTraceResult error_code, const char* error_message, void* user_data);
 
+// Completion callback of an asynchronous job, called on a worker thread
+typedef void (*PrintTraceJobCallback)(uint64_t job_id, PrintTraceResult result, const char* input_path,
+                                      const char* output_path, double elapsed_ms, void* user_data);
+
 // Core API Functions
 
 /**
@@ -219,6 +316,30 @@ void print_trace_get_param_ranges(PrintTraceParamRanges* ranges);
  */
 PrintTraceResult print_trace_validate_params(const PrintTraceParams* params);
 
+/**
+ * Set one parameter by its PrintTraceParams field name, e.g. ("threshold_offset", "12")
+ * @param params Parameters to modify
+ * @param name Field name
+ * @param value Value as text (booleans as 0/1 or true/false)
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_PARAMETERS for an unknown name or bad value
+ */
+PrintTraceResult print_trace_set_param(PrintTraceParams* params, const char* name, const char* value);
+
+/**
+ * Plan decode and warp resolution for an image under params->max_memory_mb
+ * Reads only the file header. Processing calls apply the same plan automatically;
+ * with max_memory_mb = 0 the plan reports the requested sizes and their estimate.
+ * @param input_path Path to input image file (JPEG or PNG header)
+ * @param params Processing parameters (use print_trace_get_default_params if NULL)
+ * @param plan Pointer to plan structure to fill
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_PARAMETERS if the budget cannot be met
+ */
+PrintTraceResult print_trace_plan_memory(
+    const char* input_path,
+    const PrintTraceParams* params,
+    PrintTraceMemoryPlan* plan
+);
+
 /**
  * Process image to extract contour with progress reporting
  * @param input_path Path to input image file
@@ -295,6 +416,81 @@ PrintTraceResult print_trace_process_image_to_dxf(
     void* user_data
 );
 
+/**
+ * Run every combination of the given parameter axes on one image. Combinations
+ * share pipeline prefixes: the image is decoded, its boundary found and warped once
+ * per distinct lightbox setting, object detection runs once per distinct detection
+ * setting, and only smoothing/dilation/validation run per combination. Independent
+ * branches run in parallel. Debug output is disabled for sweeps.
+ * @param input_path Path to input image file
+ * @param base_params Parameters shared by all combinations (defaults if NULL)
+ * @param axes Parameters to vary; the first axis varies slowest in the results
+ * @param axis_count Number of axes
+ * @param max_threads Worker threads, 0 for all hardware threads
+ * @param results Receives an array of result_count results (caller must free with print_trace_free_sweep_results)
+ * @param result_count Receives the number of combinations
+ * @param error_callback Optional error callback
+ * @param user_data User context data passed to error callback
+ * @return PRINT_TRACE_SUCCESS if the sweep ran (per-combination failures are in each result's result code)
+ */
+PrintTraceResult print_trace_sweep(
+    const char* input_path,
+    const PrintTraceParams* base_params,
+    const PrintTraceSweepAxis* axes,
+    int32_t axis_count,
+    int32_t max_threads,
+    PrintTraceSweepResult** results,
+    int32_t* result_count,
+    PrintTraceErrorCallback error_callback,
+    void* user_data
+);
+
+
+// Asynchronous jobs
+
+/**
+ * Queue an image for conversion to DXF and return immediately. Jobs run on the
+ * shared worker pool, at most print_trace_set_max_concurrent_jobs at a time:
+ * interactive jobs first, then batch jobs, each in submission order. The job's
+ * peak memory is estimated from the image header for the scheduler's memory budget.
+ * Call print_trace_wait_for_jobs before unloading the library or exiting.
+ * @param input_path Path to input image file
+ * @param output_path Path for output DXF file
+ * @param params Processing parameters (copied; defaults if NULL)
+ * @param priority PRINT_TRACE_PRIORITY_INTERACTIVE or PRINT_TRACE_PRIORITY_BATCH
+ * @param callback Optional completion callback, called on a worker thread
+ * @param user_data User context data passed to the callback
+ * @param job_id Optional, receives the job id passed to the callback
+ * @return PRINT_TRACE_SUCCESS if queued, error code otherwise
+ */
+PrintTraceResult print_trace_submit_dxf_job(
+    const char* input_path,
+    const char* output_path,
+    const PrintTraceParams* params,
+    PrintTraceJobPriority priority,
+    PrintTraceJobCallback callback,
+    void* user_data,
+    uint64_t* job_id
+);
+
+/**
+ * Block until every submitted job has finished
+ */
+void print_trace_wait_for_jobs(void);
+
+/**
+ * Limit how many jobs run at once
+ * @param jobs Concurrent jobs, 0 for one per worker pool thread
+ */
+void print_trace_set_max_concurrent_jobs(int32_t jobs);
+
+/**
+ * Configure how interactive and batch jobs share the concurrent job slots.
+ * Per-priority queue times are exported as printtrace_job_queue_seconds.
+ * @param config Scheduler settings
+ */
+void print_trace_configure_scheduler(const PrintTraceSchedulerConfig* config);
+
 
 // Memory management functions
 
@@ -310,6 +506,13 @@ void print_trace_free_contour(PrintTraceContour* contour);
  */
 void print_trace_free_image_data(PrintTraceImageData* image_data);
 
+/**
+ * Free sweep results returned by print_trace_sweep, including their contours
+ * @param results Result array to free
+ * @param result_count Number of results in the array
+ */
+void print_trace_free_sweep_results(PrintTraceSweepResult* results, int32_t result_count);
+
 
 // Utility functions
 
@@ -334,12 +537,123 @@ const char* print_trace_get_version(void);
 bool print_trace_is_valid_image_file(const char* file_path);
 
 /**
- * Get estimated processing time based on image size
+ * Get estimated processing time based on image size, with default parameters
+ * (see print_trace_estimate_processing_time_with_params)
  * @param image_path Path to image file
  * @return Estimated processing time in seconds, or -1.0 if image cannot be analyzed
  */
 double print_trace_estimate_processing_time(const char* image_path);
 
+/**
+ * Estimate the processing time of an image without decoding it: the size comes
+ * from the JPEG/PNG header, and each stage's cost from a per-stage fit over the
+ * timings of earlier runs (see print_trace_set_time_calibration). Until a
+ * variant has a few runs recorded, built-in defaults are used.
+ * @param image_path Path to image file
+ * @param params Processing parameters (defaults if NULL)
+ * @return Estimated processing time in seconds, or -1.0 if the header cannot be read or params are invalid
+ */
+double print_trace_estimate_processing_time_with_params(const char* image_path, const PrintTraceParams* params);
+
+/**
+ * Use a calibration file for the processing-time estimate. Its per-stage timing
+ * sums are loaded now; runs made by this process are added to the estimate
+ * immediately and written to the file by print_trace_refresh_time_calibration.
+ * @param path Calibration file (need not exist yet), NULL or "" to keep calibration in memory only
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the file exists but is not a calibration file
+ */
+PrintTraceResult print_trace_set_time_calibration(const char* path);
+
+/**
+ * Merge the stage timings recorded since the last refresh into the calibration
+ * file. The file is re-read under a lock first, so processes sharing it pool
+ * their runs; older runs are gradually down-weighted so the fit tracks hardware
+ * and library changes.
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the file cannot be read or written
+ */
+PrintTraceResult print_trace_refresh_time_calibration(void);
+
+
+
+// Diagnostics
+
+/**
+ * Record every subsequent processing run to a compact archive for offline replay
+ * (input bytes, resolved parameters, library version, per-stage timings, contour).
+ * One run_*.ptrec file is written per call; replay them with printtrace_replay.
+ * @param directory Directory for archives (created if missing), NULL or "" to disable
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the directory cannot be created
+ */
+PrintTraceResult print_trace_set_recorder(const char* directory);
+
+/**
+ * Enable the on-disk result cache. FINAL-stage results (contour, DXF, lightbox
+ * homography and warped image) are stored under a hash of the input file bytes
+ * and the parameters, so reprocessing an identical image with identical
+ * parameters returns in milliseconds without decoding it. Runs with debug output
+ * enabled bypass the cache. The directory may be shared between processes;
+ * least-recently-used entries are evicted once it grows past max_bytes.
+ * @param directory Cache directory (created if missing), NULL or "" to disable
+ * @param max_bytes Size bound in bytes, 0 for unbounded
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the directory cannot be created
+ */
+PrintTraceResult print_trace_set_result_cache(const char* directory, uint64_t max_bytes);
+
+/**
+ * Enable stage snapshots for batch re-tuning. After stage 1 (decode, boundary
+ * detection, perspective warp) each run saves the warped lightbox, corners and
+ * pixels-per-mm; later runs of the same image whose stage 0-1 parameters are
+ * unchanged load the snapshot and start at stage 2. Runs with debug output
+ * enabled bypass snapshots.
+ * @param directory Snapshot directory (created if missing), NULL or "" to disable
+ * @param compress Store the warped image as lossless PNG (about half the size, slower to load)
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the directory cannot be created
+ */
+PrintTraceResult print_trace_set_stage_snapshots(const char* directory, bool compress);
+
+/**
+ * Render the process-wide metrics in Prometheus text format: images processed by
+ * result code, per-image and per-stage latency histograms, result cache hits, job
+ * queue depth and worker pool utilisation. Recording is per thread and lock-free.
+ * @param buffer Receives the NUL-terminated text (NULL to query the length)
+ * @param buffer_size Size of buffer in bytes
+ * @return Length of the text without the terminator; truncated if >= buffer_size
+ */
+int32_t print_trace_get_metrics(char* buffer, int32_t buffer_size);
+
+/**
+ * Serve the metrics for Prometheus scrapes (GET /metrics) from a background thread
+ * @param address "host:port" (":9464" binds 127.0.0.1) or "unix:/path/to.sock"; NULL or "" stops serving
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the address cannot be bound
+ */
+PrintTraceResult print_trace_serve_metrics(const char* address);
+
+/**
+ * Rewrite a metrics file periodically for node-exporter's textfile collector
+ * (written to <path>.tmp and renamed, so the collector never reads a partial file)
+ * @param path Output file, e.g. /var/lib/node_exporter/printtrace.prom; NULL or "" writes a final snapshot and stops
+ * @param interval_seconds Seconds between rewrites
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_INPUT if the file cannot be written
+ */
+PrintTraceResult print_trace_write_metrics_file(const char* path, double interval_seconds);
+
+// Threading
+
+/**
+ * Get the thread pool configuration in effect
+ * @param config Pointer to configuration structure to fill (cpu_affinity is set to NULL)
+ */
+void print_trace_get_thread_config(PrintTraceThreadConfig* config);
+
+/**
+ * Configure the worker pool that runs the parallel pipeline steps and sweeps.
+ * Many concurrent jobs favour a few tasks per job and sequential
+ * OpenCV (max_job_parallelism small, opencv_threads 1); a single large image
+ * favours the opposite. Calls already running finish on the previous pool.
+ * @param config Pool configuration (NULL restores the defaults)
+ * @return PRINT_TRACE_SUCCESS, or PRINT_TRACE_ERROR_INVALID_PARAMETERS for out-of-range values
+ */
+PrintTraceResult print_trace_configure_thread_pool(const PrintTraceThreadConfig* config);
 
 /**
  * Get human-readable name for processing stage
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Content-addressed on-disk cache of FINAL-stage results. The key is a fast hash
+// of the encoded input bytes plus the canonical parameter text and library version,
+// so a hit never needs to decode the image. Each entry is a directory holding the
+// contour, lightbox corners and homography (result.bin), the warped lightbox
+// (warped.png) and, once written, the DXF (output.dxf). Entries are published with
+// an atomic rename and evicted least-recently-used once the cache exceeds its size
+// bound, so several processes can share one cache directory.
+class ResultCache {
+public:
+    struct Entry {
+        std::vector<cv::Point> contour;         // Warped px
+        double pixelsPerMM = 0.0;
+        std::vector<cv::Point2f> corners;       // Lightbox corners in the source image (TL, TR, BR, BL)
+        cv::Mat homography;                     // Source px -> warped px (3x3, CV_64F)
+        std::string path;                       // Entry directory, filled by lookup()
+    };
+
+    // Empty directory disables the cache. maxBytes == 0 means unbounded. Thread-safe.
+    static bool configure(const std::string& directory, uint64_t maxBytes);
+    static bool enabled();
+
+    // 32 hex digits: content hash + parameter hash. canonicalParams is ParamCodec::encode
+    // of the resolved parameters followed by anything else that changes the result
+    // (the library version).
+    static std::string makeKey(const std::vector<uchar>& inputBytes, const std::string& canonicalParams);
+
+    // Reads result.bin only and marks the entry as recently used
+    static bool lookup(const std::string& key, Entry& entry);
+    static cv::Mat loadWarped(const Entry& entry);
+    static bool copyDXF(const std::string& key, const std::string& outputPath);
+
+    static bool store(const std::string& key, const Entry& entry, const cv::Mat& warped);
+    static bool attachDXF(const std::string& key, const std::string& dxfPath);
+};
+
+} // namespace PrintTrace
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace PrintTrace {
+
+// Captures everything needed to reproduce a pipeline run offline: the exact
+// input bytes, the resolved parameters, the library version, per-stage
+// timings and the resulting contour. One compact binary archive (.ptrec) per run.
+class RunRecorder {
+public:
+    struct Record {
+        std::string libraryVersion;
+        std::string inputName;                  // File name of the original input (no directories)
+        std::vector<uchar> inputBytes;          // Encoded image exactly as read from disk
+        std::string params;                     // ParamCodec::encode of the resolved PrintTraceParams
+        int32_t targetStage = 7;
+        int32_t resultCode = 0;                 // PrintTraceResult
+        int64_t timestampMs = 0;                // Unix epoch
+        double totalMs = 0.0;
+        std::vector<std::pair<std::string, double>> stageTimingsMs;
+        std::vector<cv::Point> contour;         // Warped px
+        double pixelsPerMM = 0.0;
+    };
+
+    // Empty directory disables recording. Thread-safe.
+    static bool setDirectory(const std::string& directory);
+    static std::string directory();
+    static bool enabled();
+
+    // Writes <directory>/run_<time>_<pid>_<n>.ptrec atomically (temp file + rename)
+    static bool write(const Record& record, std::string* path = nullptr);
+
+    static bool writeFile(const Record& record, const std::string& path);
+    static bool readFile(const std::string& path, Record& record);
+
+    static bool readInputFile(const std::string& path, std::vector<uchar>& bytes);
+};
+
+} // namespace PrintTrace
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Renders synthetic lightbox photos with known ground truth so that speed
+// optimisations can be checked for accuracy without production images.
+class SceneGenerator {
+public:
+    struct SceneParams {
+        uint64_t seed = 1;
+
+        // Camera image
+        int imageWidth  = 4000;
+        int imageHeight = 3000;
+
+        // Lightbox placement
+        double lightboxWidthMM  = 162.0;
+        double lightboxHeightMM = 162.0;
+        double lightboxCoverage = 0.65;   // Lightbox size relative to the shorter image side
+        double maxRotationDeg   = 8.0;    // In-plane rotation of the lightbox
+        double maxPerspective   = 0.06;   // Corner jitter relative to lightbox size (homography strength)
+
+        // Lighting and sensor
+        double lightingGradient = 0.25;   // Max brightness fall-off across the frame (0 = flat)
+        double noiseSigma       = 3.0;    // Gaussian sensor noise in 8-bit levels
+        int    jpegQuality      = 88;     // JPEG round trip quality, 0 = lossless
+
+        // Objects
+        int    minParts          = 1;
+        int    maxParts          = 3;
+        double holeProbability   = 0.4;   // Chance that a part has a hole
+        double curvedProbability = 0.5;   // Chance that a part is a smooth blob instead of a polygon
+        double objectCoverage    = 0.45;  // Max part diameter relative to the shorter lightbox side
+        double edgeMarginMM      = 12.0;  // Keep parts this far from the lightbox edge
+    };
+
+    struct ObjectPart {
+        std::vector<cv::Point2d> outerMM;               // Outer boundary in lightbox mm
+        std::vector<std::vector<cv::Point2d>> holesMM;  // Holes in lightbox mm
+        bool curved = false;
+    };
+
+    struct Scene {
+        cv::Mat image;                          // BGR camera image (after noise/JPEG)
+        std::vector<uchar> encoded;             // Encoded file bytes (JPEG or PNG)
+        std::string encodedExtension;           // ".jpg" or ".png"
+        cv::Mat homography;                     // Lightbox mm -> image px, 3x3 CV_64F
+        std::vector<cv::Point2f> lightboxCorners; // TL, TR, BR, BL in image px
+        std::vector<ObjectPart> parts;
+        std::vector<cv::Point2d> outlineMM;     // Expected final outline (outer boundary of the largest part union)
+        double lightboxWidthMM  = 0.0;
+        double lightboxHeightMM = 0.0;
+        uint64_t seed = 0;
+    };
+
+    static Scene generate(const SceneParams& params);
+
+    // Ideal perspective-corrected lightbox at the given size (grayscale, no noise)
+    static cv::Mat renderLightbox(const Scene& scene, const cv::Size& size);
+
+    // Writes <imagePath> (encoded bytes) and a JSON ground-truth sidecar
+    static bool saveScene(const Scene& scene, const std::string& imagePath, const std::string& groundTruthPath);
+
+    // Reads a ground-truth sidecar; fills everything except image/encoded
+    static bool loadGroundTruth(const std::string& groundTruthPath, Scene& scene);
+
+private:
+    static ObjectPart makePart(cv::RNG& rng, const cv::Point2d& centerMM, double radiusMM, const SceneParams& params);
+    static std::vector<cv::Point2d> computeOutline(const std::vector<ObjectPart>& parts, double widthMM, double heightMM);
+};
+
+} // namespace PrintTrace
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "ImageProcessor.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace PrintTrace {
+
+// Persists the stage 1 result (warped grayscale lightbox, corners, homography,
+// pixels per mm) so re-tuning object detection over a batch can start at stage 2.
+// One .ptsnap file per input, named by a hash of the input bytes and of the
+// parameters stages 0-1 read (ImageProcessor::lightboxStageSignature), so a
+// snapshot is only reused when stage 1 would produce exactly the same result.
+class StageSnapshot {
+public:
+    // Empty directory disables snapshots. compress stores the warped image as a
+    // lossless PNG instead of raw pixels (smaller files, slower to load). Thread-safe.
+    static bool configure(const std::string& directory, bool compress);
+    static bool enabled();
+
+    // canonicalParams is lightboxStageSignature plus the library version
+    static std::string makeKey(const std::vector<uchar>& inputBytes, const std::string& canonicalParams);
+
+    // Rejects snapshots whose warped size does not match params
+    static bool load(const std::string& key, const ImageProcessor::ProcessingParams& params,
+                     ImageProcessor::LightboxStage& lightbox);
+    static bool save(const std::string& key, const ImageProcessor::LightboxStage& lightbox);
+
+    static bool writeFile(const ImageProcessor::LightboxStage& lightbox, const std::string& path, bool compress);
+    static bool readFile(const std::string& path, ImageProcessor::LightboxStage& lightbox);
+};
+
+} // namespace PrintTrace
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ImageProcessor.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace PrintTrace {
+
+// Predicts processing time from the image header and the parameters alone. Each
+// pipeline stage is modelled as a + b * x milliseconds, x being the megapixels the
+// stage works on (decoded input up to the lightbox, the warp after it), with a
+// separate line per variant that changes the work (corner detection mode,
+// merging, smoothing mode, ...). The lines are least-squares fits over the
+// stage timings of the runs this process has made, plus those stored in an
+// optional calibration file; variants with too few samples use built-in
+// defaults. Thread-safe.
+class TimeEstimator {
+public:
+    struct Features {
+        double decodedMP = 0.0;     // Decoded input, megapixels
+        double warpMP = 0.0;        // Warped lightbox, megapixels
+        int cornerDetectionMode = 0;
+        bool qualityGate = false;
+        bool merge = true;
+        bool autoThreshold = false;
+        int smoothingMode = -1;     // -1 = smoothing off
+        bool dilation = false;
+        bool debugOutput = false;
+    };
+
+    // Features of a run with these (already memory-planned) parameters
+    static Features describe(const cv::Size& sourceSize, const ImageProcessor::ProcessingParams& params);
+    // Plans the run the way the pipeline will, from the header only; false if unreadable
+    static bool describe(const std::string& path, const ImageProcessor::ProcessingParams& params, Features& features);
+
+    static double estimateSeconds(const Features& features);
+    static void record(const Features& features, const std::vector<std::pair<std::string, double>>& stageTimingsMs);
+
+    // Loads path (if it exists) as the calibration base; empty keeps the fit in memory only
+    static bool setCalibrationFile(const std::string& path);
+    // Merges the runs recorded since the last refresh into the calibration file,
+    // re-reading it first so several processes can share one file
+    static bool refresh();
+};
+
+} // namespace PrintTrace
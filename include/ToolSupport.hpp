@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+#include <streambuf>
+#include <vector>
+
+namespace PrintTrace {
+
+// Helpers shared by the benchmark and developer tools (not part of the library)
+
+// Discards everything written to it
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Library functions log unconditionally to std::cout; this silences it for the
+// lifetime of the scope, so timings measure the formatting but not terminal I/O
+class QuietScope {
+public:
+    QuietScope() : m_saved(std::cout.rdbuf(&m_null)) {}
+    ~QuietScope() { std::cout.rdbuf(m_saved); }
+    QuietScope(const QuietScope&) = delete;
+    QuietScope& operator=(const QuietScope&) = delete;
+private:
+    NullBuffer m_null;
+    std::streambuf* m_saved;
+};
+
+// Nearest-rank percentile, p in [0, 100]; 0 for no samples
+double percentile(std::vector<double> values, double p);
+
+} // namespace PrintTrace
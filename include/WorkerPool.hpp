@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PrintTrace {
+
+// Work-stealing thread pool shared by every parallel step of the pipeline. Each
+// worker owns a deque: it pops its own newest task and steals the oldest task of
+// another worker when idle. Threads that wait on the pool (TaskGraph::run) run
+// queued tasks of their own graph instead of blocking, so nested parallelism - a
+// graph started from inside a sweep or batch task - never adds threads beyond the
+// pool size, and a wait never picks up unrelated long-running work.
+class WorkerPool {
+public:
+    // threads <= 0 uses hardware threads - 1 (the waiting caller is the last one).
+    // Workers are restricted to the given CPUs when the platform supports it.
+    explicit WorkerPool(int threads = 0, const std::vector<int>& cpus = {});
+    // Finishes every queued task before the workers exit
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // The pool used by default. Replacing it is safe at any time: graphs already
+    // running hold the old pool until they finish.
+    static std::shared_ptr<WorkerPool> shared();
+    static void configureShared(int threads, const std::vector<int>& cpus = {});
+
+    // Cap on the tasks one TaskGraph keeps in flight (<= 0: no cap); bounds how
+    // much of the pool a single job can take
+    static void setJobParallelism(int maxParallel);
+    static int jobParallelism();
+
+    // owner tags the task for runOne; workers run tasks regardless of owner
+    void submit(std::function<void()> task, const void* owner = nullptr);
+
+    // Runs one queued task submitted with this owner on the calling thread; false
+    // if there was none
+    bool runOne(const void* owner);
+
+    int threadCount() const { return static_cast<int>(m_threads.size()); }
+    size_t queuedTasks() const { return m_pending; }
+
+private:
+    struct Task {
+        std::function<void()> run;
+        const void* owner = nullptr;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // owner == nullptr takes any task
+    bool take(size_t home, bool preferNewest, const void* owner, std::function<void()>& task);
+    void workerLoop(size_t index, const std::vector<int>& cpus);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_pending{0};
+    std::atomic<size_t> m_nextQueue{0};
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+};
+
+// Small DAG of tasks run on a WorkerPool. Tasks start as soon as the tasks they
+// depend on have finished, at most WorkerPool::jobParallelism() at a time; run()
+// blocks until all are done, helping the pool meanwhile. If a task throws, tasks
+// not yet started are skipped and run() rethrows the first exception.
+class TaskGraph {
+public:
+    using TaskId = size_t;
+
+    TaskId add(std::function<void()> task, std::initializer_list<TaskId> dependencies = {});
+    void run();
+    void run(WorkerPool& pool);
+
+private:
+    struct Node {
+        std::function<void()> task;
+        std::vector<TaskId> dependents;
+        int dependencyCount = 0;
+    };
+
+    void schedule(WorkerPool& pool, TaskId id);
+    void execute(WorkerPool& pool, TaskId id);
+
+    std::vector<Node> m_nodes;
+    std::unique_ptr<std::atomic<int>[]> m_waiting;
+    std::vector<TaskId> m_ready;        // Ready but held back by the parallelism cap
+    size_t m_inFlight = 0;
+    size_t m_maxInFlight = 0;
+    std::atomic<bool> m_failed{false};
+    std::exception_ptr m_error;
+    size_t m_remaining = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+};
+
+// Runs fn(i) for i in [0, count) with at most maxParallel calls in flight
+void parallelFor(size_t count, int maxParallel, const std::function<void(size_t)>& fn);
+
+} // namespace PrintTrace
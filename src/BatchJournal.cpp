@@ -0,0 +1,210 @@
+#include "BatchJournal.hpp"
+#include "ContentHash.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+// Line layout (tab-separated): PTJ1 input hash output status elapsed_ms timestamp shard checksum
+const char* const kVersionTag = "PTJ1";
+const size_t kFieldCount = 9;
+
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t fnv1a(const char* data, size_t size, uint64_t hash = kFnvOffset) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+string toHex(uint64_t v) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(v));
+    return buffer;
+}
+
+bool fromHex(const string& text, uint64_t& v) {
+    if (text.empty() || text.size() > 16) return false;
+    char* end = nullptr;
+    v = strtoull(text.c_str(), &end, 16);
+    return *end == '\0';
+}
+
+// Paths may contain anything; keep separators out of the fields
+string escapeField(const string& text) {
+    string out;
+    for (char c : text) {
+        switch (c) {
+            case '%': out += "%25"; break;
+            case '\t': out += "%09"; break;
+            case '\n': out += "%0A"; break;
+            case '\r': out += "%0D"; break;
+            default: out += c;
+        }
+    }
+    return out;
+}
+
+string unescapeField(const string& text) {
+    string out;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size()) {
+            out += static_cast<char>(strtol(text.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+vector<string> splitTabs(const string& line) {
+    vector<string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        if (tab == string::npos) {
+            fields.push_back(line.substr(start));
+            return fields;
+        }
+        fields.push_back(line.substr(start, tab - start));
+        start = tab + 1;
+    }
+}
+
+bool parseLine(const string& line, BatchJournal::Record& record) {
+    size_t lastTab = line.rfind('\t');
+    if (lastTab == string::npos) return false;
+    uint64_t checksum;
+    if (!fromHex(line.substr(lastTab + 1), checksum) || checksum != fnv1a(line.data(), lastTab)) return false;
+
+    vector<string> fields = splitTabs(line);
+    if (fields.size() != kFieldCount || fields[0] != kVersionTag) return false;
+
+    record.input = unescapeField(fields[1]);
+    if (!fromHex(fields[2], record.inputHash)) return false;
+    record.output = unescapeField(fields[3]);
+    record.status = static_cast<int32_t>(strtol(fields[4].c_str(), nullptr, 10));
+    record.elapsedMs = strtod(fields[5].c_str(), nullptr);
+    record.timestampMs = strtoll(fields[6].c_str(), nullptr, 10);
+    record.shard = unescapeField(fields[7]);
+    return true;
+}
+
+} // namespace
+
+BatchJournal::~BatchJournal() {
+    close();
+}
+
+bool BatchJournal::open(const string& path) {
+    close();
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (m_fd < 0) {
+        cerr << "[ERROR] Could not open batch journal: " << path << endl;
+        return false;
+    }
+
+    // A worker killed mid-write leaves a torn last line; terminate it so the
+    // next record starts on a line of its own
+    off_t size = ::lseek(m_fd, 0, SEEK_END);
+    char last = '\n';
+    if (size > 0 && ::pread(m_fd, &last, 1, size - 1) == 1 && last != '\n') {
+        if (::write(m_fd, "\n", 1) != 1) {
+            cerr << "[ERROR] Could not repair batch journal: " << path << endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BatchJournal::append(const Record& record) {
+    if (m_fd < 0) return false;
+
+    ostringstream line;
+    line.precision(6);
+    line << kVersionTag << '\t' << escapeField(record.input) << '\t' << toHex(record.inputHash) << '\t'
+         << escapeField(record.output) << '\t' << record.status << '\t' << fixed << record.elapsedMs << '\t'
+         << record.timestampMs << '\t' << escapeField(record.shard);
+    string text = line.str();
+    text += '\t' + toHex(fnv1a(text.data(), text.size())) + '\n';
+
+    // One write() per record: O_APPEND keeps concurrent appenders from interleaving
+    const char* p = text.data();
+    size_t remaining = text.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(m_fd, p, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            cerr << "[ERROR] Could not append to batch journal" << endl;
+            return false;
+        }
+        p += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    return ::fsync(m_fd) == 0;
+}
+
+void BatchJournal::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool BatchJournal::read(const string& path, vector<Record>& records, size_t* skipped) {
+    ifstream in(path);
+    if (!in) return false;
+
+    size_t bad = 0;
+    string line;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        Record record;
+        if (parseLine(line, record)) {
+            records.push_back(record);
+        } else {
+            bad++;
+        }
+    }
+    if (skipped) *skipped = bad;
+    return true;
+}
+
+uint64_t BatchJournal::hashString(const string& text) {
+    return fnv1a(text.data(), text.size());
+}
+
+bool BatchJournal::hashFile(const string& path, uint64_t& hash) {
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) return false;
+    streamoff size = in.tellg();
+    if (size < 0) return false;
+    // The pipeline decodes the whole image anyway; one buffer keeps XXH64 single-shot
+    string bytes(static_cast<size_t>(size), '\0');
+    in.seekg(0);
+    if (!in.read(&bytes[0], size)) return false;
+    hash = ContentHash::xxh64(bytes.data(), bytes.size());
+    return true;
+}
+
+bool BatchJournal::inShard(const string& relativePath, int index, int count) {
+    if (count <= 1) return true;
+    return static_cast<int>(hashString(relativePath) % static_cast<uint64_t>(count)) == index;
+}
+
+} // namespace PrintTrace
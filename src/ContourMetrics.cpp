@@ -0,0 +1,98 @@
+#include "ContourMetrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+vector<Point2d> ContourMetrics::resample(const vector<Point2d>& polygon, double stepMM) {
+    vector<Point2d> samples;
+    if (polygon.empty()) return samples;
+    for (size_t i = 0; i < polygon.size(); i++) {
+        const Point2d& a = polygon[i];
+        const Point2d& b = polygon[(i + 1) % polygon.size()];
+        double length = norm(b - a);
+        int steps = max(1, static_cast<int>(ceil(length / stepMM)));
+        for (int s = 0; s < steps; s++) {
+            samples.push_back(a + (b - a) * (static_cast<double>(s) / steps));
+        }
+    }
+    return samples;
+}
+
+double ContourMetrics::distanceToPolygon(const Point2d& point, const vector<Point2d>& polygon) {
+    double best = numeric_limits<double>::max();
+    for (size_t i = 0; i < polygon.size(); i++) {
+        const Point2d& a = polygon[i];
+        const Point2d& b = polygon[(i + 1) % polygon.size()];
+        Point2d ab = b - a;
+        double lengthSq = ab.dot(ab);
+        double t = lengthSq > 0.0 ? max(0.0, min(1.0, (point - a).dot(ab) / lengthSq)) : 0.0;
+        Point2d closest = a + ab * t;
+        Point2d d = point - closest;
+        best = min(best, d.dot(d));
+    }
+    return sqrt(best);
+}
+
+ContourMetrics::Distance ContourMetrics::compare(const vector<Point2d>& candidateMM,
+                                                 const vector<Point2d>& referenceMM,
+                                                 double sampleStepMM) {
+    Distance result;
+    if (candidateMM.size() < 3 || referenceMM.size() < 3) {
+        result.hausdorffMM = numeric_limits<double>::infinity();
+        result.meanMM = numeric_limits<double>::infinity();
+        return result;
+    }
+
+    vector<Point2d> candidateSamples = resample(candidateMM, sampleStepMM);
+    vector<Point2d> referenceSamples = resample(referenceMM, sampleStepMM);
+
+    double maxDist = 0.0, sumDist = 0.0;
+    for (const auto& p : candidateSamples) {
+        double d = distanceToPolygon(p, referenceMM);
+        maxDist = max(maxDist, d);
+        sumDist += d;
+    }
+    for (const auto& p : referenceSamples) {
+        double d = distanceToPolygon(p, candidateMM);
+        maxDist = max(maxDist, d);
+        sumDist += d;
+    }
+
+    result.hausdorffMM = maxDist;
+    result.meanMM = sumDist / static_cast<double>(candidateSamples.size() + referenceSamples.size());
+
+    vector<Point2f> candidateF(candidateMM.begin(), candidateMM.end());
+    vector<Point2f> referenceF(referenceMM.begin(), referenceMM.end());
+    double referenceArea = contourArea(referenceF);
+    result.areaRatio = referenceArea > 0.0 ? contourArea(candidateF) / referenceArea : 0.0;
+    return result;
+}
+
+vector<Point2d> ContourMetrics::pixelsToMM(const vector<Point>& contourPx,
+                                           int lightboxWidthPx, int lightboxHeightPx,
+                                           double lightboxWidthMM, double lightboxHeightMM) {
+    double mmPerPxX = lightboxWidthMM / max(1, lightboxWidthPx - 1);
+    double mmPerPxY = lightboxHeightMM / max(1, lightboxHeightPx - 1);
+    vector<Point2d> contourMM;
+    contourMM.reserve(contourPx.size());
+    for (const auto& p : contourPx) {
+        contourMM.emplace_back(p.x * mmPerPxX, p.y * mmPerPxY);
+    }
+    return contourMM;
+}
+
+vector<Point2d> ContourMetrics::pixelsToMM(const vector<Point>& contourPx, double pixelsPerMM) {
+    vector<Point2d> contourMM;
+    contourMM.reserve(contourPx.size());
+    for (const auto& p : contourPx) {
+        contourMM.emplace_back(p.x / pixelsPerMM, p.y / pixelsPerMM);
+    }
+    return contourMM;
+}
+
+} // namespace PrintTrace
@@ -0,0 +1,136 @@
+#include "FolderWatcher.hpp"
+#include <iostream>
+#include <thread>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace PrintTrace {
+
+FolderWatcher::FolderWatcher(function<bool(const filesystem::path&)> accept, double settleSeconds)
+    : m_accept(std::move(accept)), m_settle(settleSeconds) {
+#ifdef __linux__
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        cerr << "[WARN] inotify unavailable, falling back to rescanning watched folders" << endl;
+    }
+#endif
+}
+
+FolderWatcher::~FolderWatcher() {
+#ifdef __linux__
+    if (m_fd >= 0) close(m_fd);
+#endif
+}
+
+bool FolderWatcher::add(const string& directory) {
+    error_code ec;
+    if (!filesystem::is_directory(directory, ec)) {
+        cerr << "[ERROR] Not a directory: " << directory << endl;
+        return false;
+    }
+    size_t folder = m_folders.size();
+#ifdef __linux__
+    if (m_fd >= 0) {
+        // Writers that copy in place end with CLOSE_WRITE, atomic ones with MOVED_TO;
+        // CREATE/MODIFY restart the settle timer of a file still being written
+        int wd = inotify_add_watch(m_fd, directory.c_str(), IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            cerr << "[ERROR] Could not watch: " << directory << endl;
+            return false;
+        }
+        m_watches[wd] = folder;
+    }
+#endif
+    m_folders.push_back(directory);
+    scan(folder);
+    return true;
+}
+
+void FolderWatcher::touch(size_t folder, const filesystem::path& path) {
+    if (!m_accept(path)) return;
+    Pending& pending = m_pending[path];
+    pending.folder = folder;
+    pending.changed = chrono::steady_clock::now();
+}
+
+void FolderWatcher::scan(size_t folder) {
+    error_code ec;
+    for (filesystem::directory_iterator it(m_folders[folder], ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec) || !m_accept(it->path())) continue;
+        auto modified = it->last_write_time(ec);
+        auto seen = m_seen.find(it->path());
+        if (m_fd < 0 && seen != m_seen.end() && seen->second == modified) continue;
+        if (m_pending.count(it->path()) == 0) touch(folder, it->path());
+    }
+}
+
+void FolderWatcher::readEvents(int timeoutMs) {
+#ifdef __linux__
+    pollfd descriptor = {m_fd, POLLIN, 0};
+    if (::poll(&descriptor, 1, timeoutMs) <= 0) return;
+
+    alignas(inotify_event) char buffer[16384];
+    while (true) {
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) return;
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were dropped: fall back to one full rescan
+                for (size_t folder = 0; folder < m_folders.size(); folder++) scan(folder);
+                continue;
+            }
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end() || event->len == 0 || (event->mask & IN_ISDIR)) continue;
+            touch(watch->second, m_folders[watch->second] / event->name);
+        }
+    }
+#else
+    (void)timeoutMs;
+#endif
+}
+
+vector<FolderWatcher::Ready> FolderWatcher::poll(int timeoutMs) {
+    if (m_fd >= 0) {
+        // Wake early when a pending file may settle before the timeout
+        int wait = m_pending.empty() ? timeoutMs : min(timeoutMs, 100);
+        readEvents(wait);
+    } else {
+        this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+        for (size_t folder = 0; folder < m_folders.size(); folder++) scan(folder);
+    }
+
+    vector<Ready> ready;
+    auto now = chrono::steady_clock::now();
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        error_code ec;
+        uintmax_t size = filesystem::file_size(it->first, ec);
+        auto modified = ec ? filesystem::file_time_type() : filesystem::last_write_time(it->first, ec);
+        if (ec) {
+            it = m_pending.erase(it);       // Deleted or renamed away
+            continue;
+        }
+        Pending& pending = it->second;
+        if (size != pending.size || modified != pending.modified) {
+            pending.size = size;
+            pending.modified = modified;
+            pending.changed = now;
+        }
+        if (now - pending.changed >= m_settle && size > 0) {
+            ready.push_back({pending.folder, it->first});
+            if (m_fd < 0) m_seen[it->first] = modified;
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return ready;
+}
+
+} // namespace PrintTrace
@@ -1,21 +1,43 @@
 #include "ImageProcessor.hpp"
+#include "WorkerPool.hpp"
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <chrono>
 #include <cmath>
+#include <mutex>
+#include <set>
+#include <sstream>
 
 using namespace cv;
 using namespace std;
 
 namespace PrintTrace {
 
-Mat ImageProcessor::loadImage(const string& path) {
+Mat ImageProcessor::loadImage(const string& path, int decodeReduction) {
     if (path.empty()) {
         throw invalid_argument("Image path cannot be empty");
     }
     
-    cout << "[INFO] Loading image from: " << path << endl;
-    Mat img = imread(path);
+    int flags = IMREAD_COLOR;
+    switch (decodeReduction) {
+        case 2: flags = IMREAD_REDUCED_COLOR_2; break;
+        case 4: flags = IMREAD_REDUCED_COLOR_4; break;
+        case 8: flags = IMREAD_REDUCED_COLOR_8; break;
+        default: break;
+    }
+    
+    cout << "[INFO] Loading image from: " << path;
+    if (flags != IMREAD_COLOR) {
+        cout << " (1/" << decodeReduction << " scale)";
+    }
+    cout << endl;
+    Mat img = imread(path, flags);
     if (img.empty()) {
         cerr << "[ERROR] Could not load image from " << path << endl;
         cerr << "[ERROR] Please check that the file exists and is a valid image format" << endl;
@@ -30,6 +52,176 @@ Mat ImageProcessor::loadImage(const string& path) {
     return img;
 }
 
+namespace {
+
+uint32_t readBigEndian(const unsigned char* bytes, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++) value = (value << 8) | bytes[i];
+    return value;
+}
+
+bool readImageHeader(const string& path, Size& size, bool& jpeg) {
+    jpeg = false;
+    ifstream in(path, ios::binary);
+    unsigned char head[24] = {};
+    if (!in.read(reinterpret_cast<char*>(head), 2)) return false;
+
+    jpeg = head[0] == 0xFF && head[1] == 0xD8;
+    if (jpeg) {
+        // Walk the marker segments up to the first start-of-frame
+        while (in) {
+            int marker = in.get();
+            if (marker != 0xFF) return false;
+            while (marker == 0xFF) marker = in.get();
+            if (marker == EOF || marker == 0xD9 || marker == 0xDA) return false;
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+            unsigned char segment[7];
+            if (!in.read(reinterpret_cast<char*>(segment), 2)) return false;
+            int length = static_cast<int>(readBigEndian(segment, 2));
+            bool startOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+            if (startOfFrame) {
+                if (!in.read(reinterpret_cast<char*>(segment + 2), 5)) return false;
+                size = Size(static_cast<int>(readBigEndian(segment + 5, 2)), static_cast<int>(readBigEndian(segment + 3, 2)));
+                return size.width > 0 && size.height > 0;
+            }
+            if (length < 2) return false;
+            in.seekg(length - 2, ios::cur);
+        }
+        return false;
+    }
+
+    // PNG: signature, then the IHDR chunk
+    static const unsigned char kPngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (!in.read(reinterpret_cast<char*>(head + 2), 22) || memcmp(head, kPngSignature, 8) != 0 ||
+        memcmp(head + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+    size = Size(static_cast<int>(readBigEndian(head + 16, 4)), static_cast<int>(readBigEndian(head + 20, 4)));
+    return size.width > 0 && size.height > 0;
+}
+
+// Bytes per pixel of the buffers each stage keeps alive at its peak
+const double kSourceBytesPerPixel = 4.0;      // BGR source and its grayscale copy
+const double kWholeFrameBytesPerPixel = 15.0; // CLAHE, Lab and its planes, channel masks, morphology, contours
+const double kRaceBytesPerPixel = 24.0;       // All raced detectors, per pixel of the downscaled copy
+const double kRaceMaxSide = 1280.0;
+const double kWarpBytesPerPixel = 11.0;       // Warped image, object masks and morphology scratch
+const double kBaselineMB = 32.0;              // Code, OpenCV buffers and contour storage
+const int kMinWarpSide = 500;                 // PrintTraceParamRanges lightbox_*_px limits
+const int kMaxWarpSide = 8000;
+const double kWarpPixelsPerTolerance = 2.0;   // Keeps sub-pixel edge error well inside target_tolerance_mm
+const int kMinDecodedSide = 100;              // loadImage's lower limit
+
+const double kBytesPerMB = 1024.0 * 1024.0;
+
+// Peak of load + lightbox detection, held until the warp
+double lightboxStagePeakMB(const Size& source, const Size& decoded, bool nativeReduction,
+                           const ImageProcessor::ProcessingParams& params) {
+    double pixels = static_cast<double>(decoded.area());
+    // Only JPEG scales while decoding; other formats decode in full and resize
+    double load = nativeReduction ? 3.0 * pixels : 3.0 * source.area() + 3.0 * pixels;
+
+    double detect;
+    if (params.cornerDetectionMode == 1) {
+        double scale = min(1.0, kRaceMaxSide / max(decoded.width, decoded.height));
+        detect = kRaceBytesPerPixel * pixels * scale * scale;
+    } else if (params.tileMemoryLimitMB > 0) {
+        detect = min(kWholeFrameBytesPerPixel * pixels, params.tileMemoryLimitMB * kBytesPerMB);
+    } else {
+        // The scanline search costs next to nothing, but may fall back to the whole frame
+        detect = kWholeFrameBytesPerPixel * pixels;
+    }
+    return max(load + pixels, kSourceBytesPerPixel * pixels + detect) / kBytesPerMB;
+}
+
+// Peak of the object stages; the source is released once the warp is done
+double objectStagePeakMB(const Size& warp) {
+    return kWarpBytesPerPixel * static_cast<double>(warp.area()) / kBytesPerMB;
+}
+
+} // namespace
+
+bool ImageProcessor::probeImageSize(const string& path, Size& size) {
+    bool jpeg = false;
+    return readImageHeader(path, size, jpeg);
+}
+
+ImageProcessor::MemoryPlan ImageProcessor::resolveForImage(const string& path, ProcessingParams& params) {
+    if (params.maxMemoryMB <= 0 && params.targetToleranceMM <= 0.0) {
+        // Nothing to plan: only the header size, without planMemory's log line
+        MemoryPlan plan;
+        plan.decodeReduction = params.decodeReduction;
+        plan.warpSize = Size(params.lightboxWidthPx, params.lightboxHeightPx);
+        if (!probeImageSize(path, plan.sourceSize)) plan.sourceSize = Size();
+        return plan;
+    }
+    MemoryPlan plan = planMemory(path, params);
+    if (params.maxMemoryMB > 0 && plan.fits) {
+        params.decodeReduction = plan.decodeReduction;
+        params.lightboxWidthPx = plan.warpSize.width;
+        params.lightboxHeightPx = plan.warpSize.height;
+    }
+    return plan;
+}
+
+ImageProcessor::MemoryPlan ImageProcessor::planMemory(const string& path, const ProcessingParams& params) {
+    MemoryPlan plan;
+    plan.warpSize = Size(params.lightboxWidthPx, params.lightboxHeightPx);
+    if (params.targetToleranceMM > 0.0) {
+        // Tolerance mode sizes the warp after detection; plan for its largest outcome
+        double density = kWarpPixelsPerTolerance / params.targetToleranceMM;
+        plan.warpSize = Size(clamp(static_cast<int>(ceil(density * params.lightboxWidthMM)), kMinWarpSide, kMaxWarpSide),
+                             clamp(static_cast<int>(ceil(density * params.lightboxHeightMM)), kMinWarpSide, kMaxWarpSide));
+    }
+    Size requestedWarp = plan.warpSize;
+    bool jpeg = false;
+    if (!readImageHeader(path, plan.sourceSize, jpeg)) {
+        cout << "[WARN] Could not read image size from header, memory budget not applied" << endl;
+        plan.sourceSize = Size();
+        return plan;
+    }
+
+    double budget = params.maxMemoryMB;
+    double warpScale = 1.0;
+    while (true) {
+        Size decoded((plan.sourceSize.width + plan.decodeReduction - 1) / plan.decodeReduction,
+                     (plan.sourceSize.height + plan.decodeReduction - 1) / plan.decodeReduction);
+        double lightboxPeak = lightboxStagePeakMB(plan.sourceSize, decoded, jpeg, params);
+        double objectPeak = objectStagePeakMB(plan.warpSize);
+        plan.peakMB = kBaselineMB + max(lightboxPeak, objectPeak);
+        if (budget <= 0.0 || plan.peakMB <= budget) {
+            break;
+        }
+
+        // Shrink whichever side dominates; fall back to the other once it bottoms out
+        int nextReduction = plan.decodeReduction * 2;
+        bool canReduce = nextReduction <= 8 &&
+                         min(plan.sourceSize.width, plan.sourceSize.height) / nextReduction >= kMinDecodedSide;
+        Size nextWarp(static_cast<int>(requestedWarp.width * warpScale * 0.8),
+                      static_cast<int>(requestedWarp.height * warpScale * 0.8));
+        bool canShrink = min(nextWarp.width, nextWarp.height) >= kMinWarpSide;
+        if (canReduce && (lightboxPeak >= objectPeak || !canShrink)) {
+            plan.decodeReduction = nextReduction;
+        } else if (canShrink) {
+            warpScale *= 0.8;
+            plan.warpSize = nextWarp;
+        } else {
+            plan.fits = false;
+            break;
+        }
+    }
+
+    cout << "[INFO] Memory plan: " << plan.sourceSize.width << "x" << plan.sourceSize.height
+         << " source decoded at 1/" << plan.decodeReduction
+         << ", warp " << plan.warpSize.width << "x" << plan.warpSize.height
+         << ", estimated peak " << static_cast<int>(plan.peakMB + 0.5) << " MB";
+    if (budget > 0.0) {
+        cout << " of " << params.maxMemoryMB << " MB" << (plan.fits ? "" : " (does not fit)");
+    }
+    cout << endl;
+    return plan;
+}
+
 Mat ImageProcessor::convertToGrayscale(const Mat& img) {
     cout << "[INFO] Converting image to grayscale." << endl;
     Mat gray;
@@ -37,6 +229,135 @@ Mat ImageProcessor::convertToGrayscale(const Mat& img) {
     return gray;
 }
 
+namespace {
+
+const int kQualityThumbnailSide = 512;
+
+// A lightbox photo needs some dark surround and a lit lightbox somewhere in frame
+const int kMaxDarkLevel = 200;
+const int kMinBrightLevel = 80;
+
+// Bright quadrilateral test
+const double kMinLightboxFraction = 0.05;
+const double kMinLightboxRectFill = 0.7;
+const double kMinLightboxContrast = 40.0;
+
+int histogramPercentile(const Mat& hist, double total, double fraction) {
+    double target = total * fraction;
+    double seen = 0.0;
+    for (int level = 0; level < 256; level++) {
+        seen += hist.at<float>(level);
+        if (seen >= target) return level;
+    }
+    return 255;
+}
+
+} // namespace
+
+Mat ImageProcessor::loadQualityThumbnail(const string& path) {
+    // JPEG decodes at 1/8 scale straight from the DCT coefficients
+    Mat thumb = imread(path, IMREAD_REDUCED_GRAYSCALE_8);
+    if (thumb.empty()) {
+        return thumb;
+    }
+    // Too small: the 1/8 size tells which of 1/4, 1/2 or full decode is the cheapest that still reaches the side
+    int fullSide = max(thumb.cols, thumb.rows) * 8;
+    if (fullSide / 8 < kQualityThumbnailSide) {
+        int mode = fullSide / 4 >= kQualityThumbnailSide ? IMREAD_REDUCED_GRAYSCALE_4
+                 : fullSide / 2 >= kQualityThumbnailSide ? IMREAD_REDUCED_GRAYSCALE_2
+                 : IMREAD_GRAYSCALE;
+        thumb = imread(path, mode);
+    }
+    double scale = static_cast<double>(kQualityThumbnailSide) / max(thumb.cols, thumb.rows);
+    if (scale < 1.0) {
+        resize(thumb, thumb, Size(), scale, scale, INTER_AREA);
+    }
+    return thumb;
+}
+
+ImageProcessor::QualityReport ImageProcessor::assessImageQuality(const Mat& grayThumbnail, const ProcessingParams& params) {
+    QualityReport report;
+    if (grayThumbnail.empty()) {
+        return report;
+    }
+
+    // Sharpness: a light blur first keeps sensor noise from passing for detail
+    Mat smoothed, laplacian;
+    GaussianBlur(grayThumbnail, smoothed, Size(5, 5), 0.8);
+    Laplacian(smoothed, laplacian, CV_32F);
+    Scalar lapMean, lapStddev;
+    meanStdDev(laplacian, lapMean, lapStddev);
+    report.sharpness = lapStddev[0] * lapStddev[0];
+
+    // Exposure from the histogram tails
+    Mat hist;
+    int channels[] = {0};
+    int histSize[] = {256};
+    float range[] = {0.0f, 256.0f};
+    const float* ranges[] = {range};
+    calcHist(&grayThumbnail, 1, channels, Mat(), hist, 1, histSize, ranges);
+    double total = static_cast<double>(grayThumbnail.total());
+    report.darkLevel = histogramPercentile(hist, total, 0.05);
+    report.brightLevel = histogramPercentile(hist, total, 0.99);
+
+    // Lightbox presence: the largest bright region must stand out and be roughly quadrilateral
+    Mat bright, dark;
+    double otsu = threshold(grayThumbnail, bright, 0, 255, THRESH_BINARY | THRESH_OTSU);
+    bitwise_not(bright, dark);
+    double brightMean = mean(grayThumbnail, bright)[0];
+    double darkMean = mean(grayThumbnail, dark)[0];
+    if (brightMean - darkMean >= kMinLightboxContrast) {
+        morphologyEx(bright, bright, MORPH_OPEN, getStructuringElement(MORPH_RECT, Size(5, 5)));
+        vector<vector<Point>> contours;
+        findContours(bright, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
+        double bestArea = 0.0;
+        const vector<Point>* best = nullptr;
+        for (const auto& contour : contours) {
+            double area = contourArea(contour);
+            if (area > bestArea) {
+                bestArea = area;
+                best = &contour;
+            }
+        }
+        if (best) {
+            RotatedRect box = minAreaRect(*best);
+            double boxArea = static_cast<double>(box.size.width) * box.size.height;
+            if (boxArea > 0.0 && bestArea / boxArea >= kMinLightboxRectFill) {
+                report.lightboxFraction = bestArea / total;
+            }
+            pushDebugContour(grayThumbnail, *best, "quality_lightbox", params);
+        }
+    }
+    cout << "[INFO] Quality check: sharpness " << report.sharpness
+         << ", levels " << report.darkLevel << "-" << report.brightLevel
+         << " (Otsu " << otsu << "), lightbox " << report.lightboxFraction * 100.0 << "% of frame" << endl;
+    return report;
+}
+
+void ImageProcessor::checkImageQuality(const string& path, const ProcessingParams& params) {
+    Mat thumb = loadQualityThumbnail(path);
+    if (thumb.empty()) {
+        return;  // loadImage reports unreadable files
+    }
+    QualityReport report = assessImageQuality(thumb, params);
+
+    if (report.brightLevel < kMinBrightLevel) {
+        throw runtime_error("Image badly exposed: too dark (99th percentile level " +
+                            to_string(report.brightLevel) + ")");
+    }
+    if (report.darkLevel > kMaxDarkLevel) {
+        throw runtime_error("Image badly exposed: too bright (5th percentile level " +
+                            to_string(report.darkLevel) + ")");
+    }
+    if (report.sharpness < params.minSharpness) {
+        throw runtime_error("Image too blurry (sharpness " + to_string(report.sharpness) +
+                            ", minimum " + to_string(params.minSharpness) + ")");
+    }
+    if (report.lightboxFraction < kMinLightboxFraction) {
+        throw runtime_error("No lightbox visible in image");
+    }
+}
+
 // New streamlined corner detection pipeline methods
 
 Mat ImageProcessor::convertBGRToLab(const Mat& bgrImg) {
@@ -201,24 +522,8 @@ vector<Point2f> ImageProcessor::detectCornersFromContour(const Mat& mask, const
     
     vector<Point> paperContour = contours[maxIdx];
     
-    // Approximate contour to polygon
-    vector<Point> approx;
-    double perimeter = arcLength(paperContour, true);
-    double epsilon = 0.02 * perimeter; // Start with 2%
-    
-    // Try different epsilon values to get exactly 4 corners
-    for (int attempts = 0; attempts < 10; attempts++) {
-        approxPolyDP(paperContour, approx, epsilon, true);
-        
-        if (approx.size() == 4) {
-            break;
-        } else if (approx.size() > 4) {
-            epsilon += 0.01 * perimeter; // Increase epsilon for fewer points
-        } else {
-            epsilon -= 0.005 * perimeter; // Decrease epsilon for more points
-            if (epsilon <= 0.005 * perimeter) break;
-        }
-    }
+    // Fit the four sides directly
+    vector<Point2f> approx = fitQuadrilateral(paperContour);
     
     // Geometric sanity checks
     if (approx.size() == 4) {
@@ -238,14 +543,8 @@ vector<Point2f> ImageProcessor::detectCornersFromContour(const Mat& mask, const
             solidity > params.minSolidity && // Good rectangularity
             aspectRatio < params.maxAspectRatio) { // Reasonable aspect ratio
             
-            // Convert to Point2f
-            vector<Point2f> corners;
-            for (const Point& pt : approx) {
-                corners.emplace_back(static_cast<float>(pt.x), static_cast<float>(pt.y));
-            }
-            
             cout << "[INFO] Contour-based corner detection successful" << endl;
-            return corners;
+            return approx;
         } else {
             cout << "[WARN] Contour failed geometric sanity checks" << endl;
         }
@@ -538,6 +837,344 @@ vector<Point2f> ImageProcessor::detectLightboxCorners(const Mat& bgrImg, const P
     return corners;
 }
 
+vector<Point2f> ImageProcessor::detectCornersFromScanlines(const Mat& grayImg, const ProcessingParams& params) {
+    Mat gray = grayImg.channels() == 1 ? grayImg : convertToGrayscale(grayImg);
+    const int width = gray.cols;
+    const int height = gray.rows;
+    if (width < 16 || height < 16) return {};
+    
+    // Scanlines run from the centre outwards: side 0 top, 1 right, 2 bottom, 3 left.
+    // Positions cover the middle 60% of each side so corner regions stay out.
+    const int linesPerSide = 48;
+    const int stepX[4] = {0, 1, 0, -1};
+    const int stepY[4] = {-1, 0, 1, 0};
+    struct Scanline {
+        int side;
+        Point start;
+        vector<float> profile;
+    };
+    vector<Scanline> scanlines;
+    scanlines.reserve(4 * linesPerSide);
+    for (int side = 0; side < 4; side++) {
+        bool vertical = stepX[side] == 0;
+        int across = vertical ? width : height;
+        for (int i = 0; i < linesPerSide; i++) {
+            int offset = static_cast<int>(across * (0.2 + 0.6 * (i + 0.5) / linesPerSide));
+            Scanline line;
+            line.side = side;
+            line.start = vertical ? Point(offset, height / 2) : Point(width / 2, offset);
+            int length = vertical ? (stepY[side] < 0 ? line.start.y + 1 : height - line.start.y)
+                                  : (stepX[side] < 0 ? line.start.x + 1 : width - line.start.x);
+            line.profile.resize(length);
+            for (int k = 0; k < length; k++) {
+                line.profile[k] = gray.at<uchar>(line.start.y + k * stepY[side], line.start.x + k * stepX[side]);
+            }
+            scanlines.push_back(std::move(line));
+        }
+    }
+    
+    // Global levels: lightbox from the inner half of the profiles, surroundings from the outer 5%
+    vector<float> inner, outer;
+    for (const auto& line : scanlines) {
+        size_t n = line.profile.size();
+        inner.insert(inner.end(), line.profile.begin(), line.profile.begin() + n / 2);
+        outer.insert(outer.end(), line.profile.end() - max<size_t>(1, n / 20), line.profile.end());
+    }
+    auto percentile = [](vector<float>& values, double q) {
+        auto nth = values.begin() + static_cast<ptrdiff_t>(q * (values.size() - 1));
+        nth_element(values.begin(), nth, values.end());
+        return *nth;
+    };
+    float bright = percentile(inner, 0.9);
+    float dark = percentile(outer, 0.1);
+    if (bright - dark < 20.0f) {
+        cout << "[WARN] Scanline search: no contrast between lightbox and surroundings" << endl;
+        return {};
+    }
+    const float level = (bright + dark) / 2.0f;
+    const int halfWindow = max(2, min(width, height) / 800);
+    
+    vector<Point2f> samples[4];
+    vector<float> smoothed;
+    for (const auto& line : scanlines) {
+        const vector<float>& profile = line.profile;
+        int n = static_cast<int>(profile.size());
+        if (n < 4 * halfWindow + 3) continue;
+        
+        // Box-smoothed profile via a running sum
+        smoothed.assign(n, 0.0f);
+        float sum = 0.0f;
+        int count = 0;
+        for (int k = 0; k < n + halfWindow; k++) {
+            if (k < n) { sum += profile[k]; count++; }
+            if (k - 2 * halfWindow - 1 >= 0) { sum -= profile[k - 2 * halfWindow - 1]; count--; }
+            if (k - halfWindow >= 0) smoothed[k - halfWindow] = sum / count;
+        }
+        
+        // Outermost bright sample: the object and its shadow lie inside it
+        int last = n - 1;
+        while (last >= 0 && smoothed[last] < level) last--;
+        if (last < 0 || last >= n - 1 - halfWindow) continue;  // All dark, or lightbox runs off the frame
+        
+        // Strongest outward drop near the crossing, to sub-pixel by a parabola
+        int lo = max(1, last - 2 * halfWindow);
+        int hi = min(n - 2, last + 2 * halfWindow);
+        int best = -1;
+        float bestDrop = 0.0f;
+        for (int k = lo; k <= hi; k++) {
+            float drop = smoothed[k - 1] - smoothed[k + 1];
+            if (drop > bestDrop) {
+                bestDrop = drop;
+                best = k;
+            }
+        }
+        if (best < 0) continue;
+        float position = static_cast<float>(best);
+        if (best > 1 && best < n - 2) {
+            float left = smoothed[best - 2] - smoothed[best];
+            float right = smoothed[best] - smoothed[best + 2];
+            float curvature = left - 2.0f * bestDrop + right;
+            if (curvature < 0.0f) position += min(1.0f, max(-1.0f, 0.5f * (left - right) / curvature));
+        }
+        samples[line.side].emplace_back(line.start.x + position * stepX[line.side],
+                                        line.start.y + position * stepY[line.side]);
+    }
+    
+    // Per side: best line over all sample pairs (exhaustive RANSAC, deterministic at
+    // this size), then least squares over its inliers
+    const float inlierDistance = max(1.5f, 0.002f * max(width, height));
+    Vec4f lines[4];
+    for (int side = 0; side < 4; side++) {
+        const vector<Point2f>& points = samples[side];
+        if (points.size() < 6) {
+            cout << "[WARN] Scanline search: only " << points.size() << " edge samples on side " << side << endl;
+            return {};
+        }
+        vector<Point2f> bestInliers;
+        for (size_t a = 0; a < points.size(); a++) {
+            for (size_t b = a + 1; b < points.size(); b++) {
+                Point2f direction = points[b] - points[a];
+                float length = static_cast<float>(norm(direction));
+                if (length < 1.0f) continue;
+                int inliers = 0;
+                for (const Point2f& p : points) {
+                    Point2f d = p - points[a];
+                    if (fabs(d.x * direction.y - d.y * direction.x) / length <= inlierDistance) inliers++;
+                }
+                if (inliers <= static_cast<int>(bestInliers.size())) continue;
+                bestInliers.clear();
+                for (const Point2f& p : points) {
+                    Point2f d = p - points[a];
+                    if (fabs(d.x * direction.y - d.y * direction.x) / length <= inlierDistance) bestInliers.push_back(p);
+                }
+            }
+        }
+        if (bestInliers.size() < max<size_t>(6, points.size() * 2 / 5)) {
+            cout << "[WARN] Scanline search: side " << side << " is not straight ("
+                 << bestInliers.size() << "/" << points.size() << " inliers)" << endl;
+            return {};
+        }
+        fitLine(bestInliers, lines[side], DIST_L2, 0, 0.01, 0.01);
+    }
+    
+    // Corners where neighbouring sides meet: top/left, top/right, bottom/right, bottom/left
+    auto intersect = [](const Vec4f& a, const Vec4f& b, Point2f& corner) {
+        float cross = a[0] * b[1] - a[1] * b[0];
+        if (fabs(cross) < 0.2f) return false;
+        float t = ((b[2] - a[2]) * b[1] - (b[3] - a[3]) * b[0]) / cross;
+        corner = Point2f(a[2] + t * a[0], a[3] + t * a[1]);
+        return true;
+    };
+    const int cornerSides[4][2] = {{0, 3}, {0, 1}, {2, 1}, {2, 3}};
+    vector<Point2f> corners(4);
+    for (int c = 0; c < 4; c++) {
+        if (!intersect(lines[cornerSides[c][0]], lines[cornerSides[c][1]], corners[c])) return {};
+    }
+    
+    if (params.enableDebugOutput) {
+        Mat annotated;
+        cvtColor(gray, annotated, COLOR_GRAY2BGR);
+        for (const auto& side : samples) {
+            for (const Point2f& p : side) circle(annotated, Point(cvRound(p.x), cvRound(p.y)), 6, Scalar(0, 0, 255), 2);
+        }
+        vector<Point> outline;
+        for (const Point2f& corner : corners) outline.emplace_back(cvRound(corner.x), cvRound(corner.y));
+        polylines(annotated, vector<vector<Point>>{outline}, true, Scalar(0, 255, 0), 2);
+        pushDebugImage(annotated, "scanline_corners", params);
+    }
+    
+    cout << "[INFO] Scanline search found corners from " << scanlines.size() << " scanlines" << endl;
+    return corners;
+}
+
+double ImageProcessor::cornerConfidence(const vector<Point2f>& corners, const Mat& gradientMagnitude) {
+    if (corners.size() != 4 || gradientMagnitude.empty()) return 0.0;
+    
+    Scalar meanMagnitude, stdMagnitude;
+    meanStdDev(gradientMagnitude, meanMagnitude, stdMagnitude);
+    float edgeThreshold = static_cast<float>(max(10.0, meanMagnitude[0] + stdMagnitude[0]));
+    Rect bounds(0, 0, gradientMagnitude.cols, gradientMagnitude.rows);
+    
+    const int samplesPerSide = 64;
+    int supported = 0;
+    int total = 0;
+    for (size_t s = 0; s < 4; s++) {
+        Point2f a = corners[s];
+        Point2f side = corners[(s + 1) % 4] - a;
+        float length = static_cast<float>(norm(side));
+        if (length < 1.0f) continue;
+        Point2f normal(-side.y / length, side.x / length);
+        
+        // Skip the ends, where rounded or shadowed corners say little about the side
+        for (int k = 0; k < samplesPerSide; k++) {
+            Point2f p = a + side * (0.1f + 0.8f * (k + 0.5f) / samplesPerSide);
+            total++;
+            for (int offset = -2; offset <= 2; offset++) {
+                Point q(cvRound(p.x + normal.x * offset), cvRound(p.y + normal.y * offset));
+                if (bounds.contains(q) && gradientMagnitude.at<float>(q) >= edgeThreshold) {
+                    supported++;
+                    break;
+                }
+            }
+        }
+    }
+    return total > 0 ? static_cast<double>(supported) / total : 0.0;
+}
+
+vector<Point2f> ImageProcessor::raceCornerDetectors(const Mat& bgrImg, const ProcessingParams& params) {
+    auto raceStart = chrono::steady_clock::now();
+    
+    // Shared input: every detector works on the same downscaled colour image
+    const int maxSide = 1280;
+    double scale = min(1.0, static_cast<double>(maxSide) / max(bgrImg.cols, bgrImg.rows));
+    Mat color;
+    if (scale < 1.0) {
+        resize(bgrImg, color, Size(), scale, scale, INTER_AREA);
+    } else {
+        color = bgrImg;
+    }
+    if (color.channels() == 1) {
+        cvtColor(color, color, COLOR_GRAY2BGR);
+    }
+    
+    Mat gray = convertToGrayscale(color);
+    Mat gradX, gradY, gradient;
+    Sobel(gray, gradX, CV_32F, 1, 0, 3);
+    Sobel(gray, gradY, CV_32F, 0, 1, 3);
+    magnitude(gradX, gradY, gradient);
+    
+    // Detectors get private parameter copies: no shared debug stack, kernels scaled down
+    ProcessingParams local = params;
+    local.enableDebugOutput = false;
+    local.largeKernel = max(3, cvRound(params.largeKernel * scale) | 1);
+    
+    using Detector = function<vector<Point2f>(const Mat&, const ProcessingParams&, const atomic<bool>&)>;
+    const vector<pair<const char*, Detector>> detectors = {
+        {"scanline", [](const Mat& img, const ProcessingParams& p, const atomic<bool>&) -> vector<Point2f> {
+            return detectCornersFromScanlines(convertToGrayscale(img), p);
+        }},
+        {"boundary_fit", [](const Mat& img, const ProcessingParams& p, const atomic<bool>& cancelled) -> vector<Point2f> {
+            Mat normalized = normalizeLighting(convertToGrayscale(img), p);
+            if (cancelled) return {};
+            Mat edges = detectEdges(normalized, img, p);
+            if (cancelled) return {};
+            return fitQuadrilateral(findBoundaryContour(edges, p));
+        }},
+        {"lab_contour", [](const Mat& img, const ProcessingParams& p, const atomic<bool>& cancelled) -> vector<Point2f> {
+            Mat enhancedLab = applyCLAHEToL(convertBGRToLab(img), p);
+            Mat normalizedL = divisionNormalization(enhancedLab);
+            if (cancelled) return {};
+            Mat cleanMask = morphologicalCleanup(buildPaperMask(enhancedLab, normalizedL, p), p);
+            if (cancelled) return {};
+            return detectCornersFromContour(cleanMask, p);
+        }},
+        {"hough_lines", [](const Mat& img, const ProcessingParams& p, const atomic<bool>& cancelled) -> vector<Point2f> {
+            Mat normalizedL = divisionNormalization(applyCLAHEToL(convertBGRToLab(img), p));
+            if (cancelled) return {};
+            return detectCornersFromEdges(normalizedL, p);
+        }},
+    };
+    
+    struct Entry {
+        vector<Point2f> corners;
+        bool valid = false;
+        double confidence = 0.0;
+        double elapsedMs = 0.0;
+    };
+    vector<Entry> entries(detectors.size());
+    mutex raceMutex;
+    int winner = -1;
+    atomic<bool> cancelled{false};
+    
+    // First detector over the confidence bar wins and cancels the rest
+    TaskGraph race;
+    for (size_t d = 0; d < detectors.size(); d++) {
+        race.add([&, d]() {
+            auto start = chrono::steady_clock::now();
+            Entry entry;
+            try {
+                entry.corners = detectors[d].second(color, local, cancelled);
+            } catch (const exception& e) {
+                cout << "[WARN] Corner detector " << detectors[d].first << " failed: " << e.what() << endl;
+            }
+            if (entry.corners.size() == 4 && !cancelled) {
+                entry.corners = orderCorners(entry.corners);
+                entry.valid = validateCorners(entry.corners, color.size(), local);
+                entry.confidence = entry.valid ? cornerConfidence(entry.corners, gradient) : 0.0;
+            }
+            entry.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            lock_guard<mutex> lock(raceMutex);
+            if (winner < 0 && entry.valid && entry.confidence >= params.cornerMinConfidence) {
+                winner = static_cast<int>(d);
+                cancelled = true;
+            }
+            entries[d] = std::move(entry);
+        });
+    }
+    race.run();
+    
+    // Nobody cleared the bar: take the most confident valid result
+    if (winner < 0) {
+        for (size_t d = 0; d < entries.size(); d++) {
+            if (entries[d].valid && (winner < 0 || entries[d].confidence > entries[winner].confidence)) {
+                winner = static_cast<int>(d);
+            }
+        }
+    }
+    if (winner < 0) {
+        auto boundaryFit = find_if(detectors.begin(), detectors.end(),
+                                   [](const auto& detector) { return strcmp(detector.first, "boundary_fit") == 0; });
+        size_t fallback = static_cast<size_t>(boundaryFit - detectors.begin());
+        if (fallback < entries.size() && entries[fallback].corners.size() == 4) {
+            cout << "[WARN] No corner detector passed validation, using the unvalidated boundary fit" << endl;
+            winner = static_cast<int>(fallback);
+        }
+    }
+    if (winner < 0) {
+        throw runtime_error("Could not find 4 corners: every corner detector failed");
+    }
+    
+    double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - raceStart).count();
+    cout << "[INFO] Corner race won by " << detectors[winner].first << " (confidence "
+         << entries[winner].confidence << ", " << entries[winner].elapsedMs << "ms of "
+         << elapsedMs << "ms total)" << endl;
+    
+    if (params.enableDebugOutput) {
+        Mat annotated = color.clone();
+        vector<Point> outline;
+        for (const Point2f& corner : entries[winner].corners) outline.emplace_back(cvRound(corner.x), cvRound(corner.y));
+        polylines(annotated, vector<vector<Point>>{outline}, true, Scalar(0, 255, 0), 2);
+        pushDebugImage(annotated, "corner_race", params);
+    }
+    
+    vector<Point2f> corners = entries[winner].corners;
+    for (Point2f& corner : corners) {
+        corner.x = static_cast<float>(corner.x / scale);
+        corner.y = static_cast<float>(corner.y / scale);
+    }
+    return corners;
+}
+
 // Legacy method kept for compatibility
 Mat ImageProcessor::normalizeLighting(const Mat& grayImg, const ProcessingParams& params) {
     cout << "[INFO] Normalizing lighting using CLAHE (Contrast Limited Adaptive Histogram Equalization)" << endl;
@@ -553,6 +1190,28 @@ Mat ImageProcessor::normalizeLighting(const Mat& grayImg, const ProcessingParams
     return normalized;
 }
 
+Mat ImageProcessor::labPaperMask(const Mat& colorImg, const ProcessingParams& params) {
+    cout << "[INFO] Using LAB thresholding" << endl;
+    Mat lab; 
+    cvtColor(colorImg, lab, COLOR_BGR2Lab);
+    vector<Mat> ch(3); 
+    split(lab, ch);
+    Mat L = ch[0], A = ch[1], B = ch[2];
+
+    // The three channel tests are independent
+    Mat maskL, maskA, maskB;
+    TaskGraph graph;
+    graph.add([&] { threshold(L, maskL, params.labLThresh, 255, THRESH_BINARY); });
+    graph.add([&] { inRange(A, params.labAmin, params.labAmax, maskA); });
+    graph.add([&] { inRange(B, params.labBmin, params.labBmax, maskB); });
+    graph.run();
+
+    Mat paperMask;
+    bitwise_and(maskL, maskA, paperMask);
+    bitwise_and(paperMask, maskB, paperMask);
+    return paperMask;
+}
+
 Mat ImageProcessor::detectEdges(
     const Mat& grayImg,
     const Mat& colorImg,
@@ -561,25 +1220,16 @@ Mat ImageProcessor::detectEdges(
     // 1. Lab-based paper mask
     Mat paperMask;
     if (!colorImg.empty() && colorImg.channels() == 3) {
-        cout << "[INFO] Using LAB thresholding" << endl;
-        Mat lab; 
-        cvtColor(colorImg, lab, COLOR_BGR2Lab);
-        vector<Mat> ch(3); 
-        split(lab, ch);
-        Mat L = ch[0], A = ch[1], B = ch[2];
-
-        Mat maskL, maskA, maskB;
-        threshold(L, maskL, params.labLThresh, 255, THRESH_BINARY);
-        inRange(A, params.labAmin, params.labAmax, maskA);
-        inRange(B, params.labBmin, params.labBmax, maskB);
-
-        bitwise_and(maskL, maskA, paperMask);
-        bitwise_and(paperMask, maskB, paperMask);
+        paperMask = labPaperMask(colorImg, params);
     } else {
         cout << "[INFO] Falling back to Otsu Threshold" << endl;
         double otsu = threshold(grayImg, paperMask, 0, 255, THRESH_BINARY | THRESH_OTSU);
         threshold(grayImg, paperMask, otsu + params.otsuOffset, 255, THRESH_BINARY);
     }
+    return detectEdgesFromMask(paperMask, params);
+}
+
+Mat ImageProcessor::detectEdgesFromMask(const Mat& paperMask, const ProcessingParams& params) {
     pushDebugImage(paperMask, "mask_lab", params);
 
     // 2. Morphology + hole-fill to remove clutter
@@ -660,35 +1310,12 @@ Mat ImageProcessor::detectEdges(
     cout << "[INFO] Paper contour validation - Area fraction: " << areaFraction 
          << ", Solidity: " << solidity << endl;
     
-    // Primary approach: approxPolyDP preserves true border including perspective tilt
-    vector<Point> approx;
-    double perimeter = arcLength(paperContour, true);
-    double epsilon = 0.02 * perimeter; // Start with 2%
-    
-    // Try different epsilon values to get exactly 4 corners
-    vector<Point> bestApprox;
-    for (int attempts = 0; attempts < 10; attempts++) {
-        approxPolyDP(paperContour, approx, epsilon, true);
-        
-        if (approx.size() == 4) {
-            bestApprox = approx;
-            cout << "[INFO] Found 4-corner approximation with epsilon: " << epsilon << endl;
-            break;
-        } else if (approx.size() > 4) {
-            epsilon += 0.005 * perimeter; // Increase epsilon for fewer points
-        } else {
-            epsilon -= 0.002 * perimeter; // Decrease epsilon for more points
-            if (epsilon <= 0.005 * perimeter) break;
-        }
-    }
+    // Primary approach: per-side line fit preserves true border including perspective tilt
+    vector<Point2f> corners = fitQuadrilateral(paperContour);
     
     // Fallback: minAreaRect guarantees four corners when contour is broken
-    vector<Point2f> corners;
-    if (bestApprox.size() == 4) {
-        cout << "[INFO] Using approxPolyDP result (preserves true border)" << endl;
-        for (const Point& pt : bestApprox) {
-            corners.emplace_back(static_cast<float>(pt.x), static_cast<float>(pt.y));
-        }
+    if (corners.size() == 4) {
+        cout << "[INFO] Using quadrilateral fit (preserves true border)" << endl;
     } else {
         cout << "[INFO] Using minAreaRect fallback (guarantees 4 corners)" << endl;
         RotatedRect minRect = minAreaRect(paperContour);
@@ -701,7 +1328,7 @@ Mat ImageProcessor::detectEdges(
     Mat paperEdges = Mat::zeros(morph.size(), CV_8UC1);
     vector<Point> intCorners;
     for (const Point2f& corner : corners) {
-        intCorners.emplace_back(static_cast<int>(corner.x), static_cast<int>(corner.y));
+        intCorners.emplace_back(cvRound(corner.x), cvRound(corner.y));
     }
     
     // Draw the paper boundary
@@ -712,6 +1339,225 @@ Mat ImageProcessor::detectEdges(
     return paperEdges;
 }
 
+namespace {
+
+// Transient bytes per pixel of a mask stripe: Lab copy, its three planes, the
+// three channel masks, the combined mask and the morphology scratch
+const size_t kStripeBytesPerPixel = 11;
+const int kMinStripeRows = 16;
+
+// Connected components of a binary image fed one row at a time. Only the
+// foreground runs are kept, so memory follows the mask's outline rather
+// than its area. 8-connected, like findContours.
+class RunLabeler {
+public:
+    struct Run {
+        int row;
+        int start;
+        int end;    // Inclusive
+        int label;
+    };
+
+    void addRow(const uchar* pixels, int cols, int row) {
+        size_t rowBegin = m_runs.size();
+        for (int x = 0; x < cols;) {
+            if (!pixels[x]) {
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < cols && pixels[x]) x++;
+            m_runs.push_back({row, start, x - 1, -1});
+        }
+
+        // Merge with the overlapping runs of the previous row
+        bool adjacent = m_prevEnd > m_prevBegin && m_runs[m_prevBegin].row == row - 1;
+        size_t prev = m_prevBegin;
+        for (size_t i = rowBegin; i < m_runs.size(); i++) {
+            Run& run = m_runs[i];
+            if (adjacent) {
+                while (prev < m_prevEnd && m_runs[prev].end + 1 < run.start) prev++;
+                for (size_t j = prev; j < m_prevEnd && m_runs[j].start <= run.end + 1; j++) {
+                    if (run.label < 0) {
+                        run.label = m_runs[j].label;
+                    } else {
+                        unite(run.label, m_runs[j].label);
+                    }
+                }
+            }
+            if (run.label < 0) {
+                run.label = static_cast<int>(m_parent.size());
+                m_parent.push_back(run.label);
+            }
+        }
+        m_prevBegin = rowBegin;
+        m_prevEnd = m_runs.size();
+    }
+
+    // Outline of the component with the largest filled area (holes and notches
+    // closed row by row): left ends top to bottom, then right ends bottom to top
+    vector<Point> largestOutline(double& filledArea) {
+        size_t labels = m_parent.size();
+        vector<double> area(labels, 0.0);
+        vector<int> lastRow(labels, -1), rowMin(labels, 0), rowMax(labels, 0);
+        auto flush = [&](int root) {
+            if (lastRow[root] >= 0) area[root] += rowMax[root] - rowMin[root] + 1;
+        };
+        for (Run& run : m_runs) {
+            run.label = find(run.label);
+            int root = run.label;
+            if (lastRow[root] == run.row) {
+                rowMax[root] = run.end;
+                continue;
+            }
+            flush(root);
+            lastRow[root] = run.row;
+            rowMin[root] = run.start;
+            rowMax[root] = run.end;
+        }
+        int best = -1;
+        for (size_t root = 0; root < labels; root++) {
+            flush(static_cast<int>(root));
+            if (area[root] > 0.0 && (best < 0 || area[root] > area[best])) best = static_cast<int>(root);
+        }
+        filledArea = best < 0 ? 0.0 : area[best];
+
+        vector<Point> left, right;
+        for (const Run& run : m_runs) {
+            if (run.label != best) continue;
+            if (left.empty() || left.back().y != run.row) {
+                left.emplace_back(run.start, run.row);
+                right.emplace_back(run.end, run.row);
+            } else {
+                right.back().x = run.end;
+            }
+        }
+        left.insert(left.end(), right.rbegin(), right.rend());
+        return left;
+    }
+
+private:
+    int find(int label) {
+        while (m_parent[label] != label) {
+            m_parent[label] = m_parent[m_parent[label]];
+            label = m_parent[label];
+        }
+        return label;
+    }
+
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a != b) m_parent[max(a, b)] = min(a, b);
+    }
+
+    vector<Run> m_runs;
+    vector<int> m_parent;
+    size_t m_prevBegin = 0;
+    size_t m_prevEnd = 0;
+};
+
+} // namespace
+
+vector<Point2f> ImageProcessor::detectCornersStriped(const Mat& image, const ProcessingParams& params) {
+    bool useLab = image.channels() == 3;
+    int rows = image.rows;
+    int cols = image.cols;
+
+    // Open then close is four passes of the kernel radius, so a stripe needs
+    // that many rows of context on each side to match the full-frame result
+    int radius = params.largeKernel / 2;
+    int halo = 4 * radius;
+    size_t budget = static_cast<size_t>(params.tileMemoryLimitMB) * 1024 * 1024;
+    int stripeRows = static_cast<int>(budget / (static_cast<size_t>(cols) * kStripeBytesPerPixel)) - 2 * halo;
+    if (stripeRows < kMinStripeRows) {
+        cout << "[WARN] Tile memory limit " << params.tileMemoryLimitMB
+             << " MB is below one stripe of this image, using " << kMinStripeRows << " rows" << endl;
+        stripeRows = kMinStripeRows;
+    }
+    cout << "[INFO] Building lightbox mask in stripes of " << stripeRows << " rows (halo " << halo << ")" << endl;
+
+    // The grayscale fallback needs one global Otsu level, taken from a histogram pass
+    double grayLevel = 0.0;
+    if (!useLab) {
+        Mat hist;
+        int channels[] = {0};
+        int histSize[] = {256};
+        float range[] = {0.0f, 256.0f};
+        const float* ranges[] = {range};
+        calcHist(&image, 1, channels, Mat(), hist, 1, histSize, ranges);
+        double total = static_cast<double>(image.total());
+        // Otsu over the histogram: maximise the between-class variance
+        double sum = 0.0;
+        for (int i = 0; i < 256; i++) sum += i * hist.at<float>(i);
+        double sumBelow = 0.0, weightBelow = 0.0, bestVariance = -1.0;
+        for (int i = 0; i < 256; i++) {
+            weightBelow += hist.at<float>(i);
+            if (weightBelow == 0.0 || weightBelow == total) continue;
+            sumBelow += i * hist.at<float>(i);
+            double meanBelow = sumBelow / weightBelow;
+            double meanAbove = (sum - sumBelow) / (total - weightBelow);
+            double variance = weightBelow * (total - weightBelow) * (meanBelow - meanAbove) * (meanBelow - meanAbove);
+            if (variance > bestVariance) {
+                bestVariance = variance;
+                grayLevel = i;
+            }
+        }
+        grayLevel += params.otsuOffset;
+    }
+
+    Mat bigK = getStructuringElement(MORPH_RECT, Size(params.largeKernel, params.largeKernel));
+    RunLabeler labeler;
+    for (int y0 = 0; y0 < rows; y0 += stripeRows) {
+        int y1 = min(rows, y0 + stripeRows);
+        int top = max(0, y0 - halo);
+        int bottom = min(rows, y1 + halo);
+        Mat source = image.rowRange(top, bottom);
+
+        Mat mask;
+        if (useLab) {
+            Mat lab;
+            cvtColor(source, lab, COLOR_BGR2Lab);
+            vector<Mat> ch(3);
+            split(lab, ch);
+            lab.release();
+            Mat maskA, maskB;
+            threshold(ch[0], mask, params.labLThresh, 255, THRESH_BINARY);
+            inRange(ch[1], params.labAmin, params.labAmax, maskA);
+            inRange(ch[2], params.labBmin, params.labBmax, maskB);
+            bitwise_and(mask, maskA, mask);
+            bitwise_and(mask, maskB, mask);
+        } else {
+            threshold(source, mask, grayLevel, 255, THRESH_BINARY);
+        }
+        morphologyEx(mask, mask, MORPH_OPEN, bigK);
+        morphologyEx(mask, mask, MORPH_CLOSE, bigK);
+
+        for (int y = y0; y < y1; y++) {
+            labeler.addRow(mask.ptr<uchar>(y - top), cols, y);
+        }
+    }
+
+    double filledArea = 0.0;
+    vector<Point> outline = labeler.largestOutline(filledArea);
+    double areaFraction = filledArea / (static_cast<double>(rows) * cols);
+    cout << "[INFO] Striped mask: largest region covers " << areaFraction * 100.0 << "% of the frame" << endl;
+    if (outline.size() < 4 || areaFraction < 0.1) {
+        return {};
+    }
+
+    vector<Point2f> corners = fitQuadrilateral(outline);
+    if (corners.size() == 4) {
+        cout << "[INFO] Using quadrilateral fit on striped mask outline" << endl;
+    } else {
+        cout << "[INFO] Using minAreaRect fallback on striped mask outline" << endl;
+        Point2f rectCorners[4];
+        minAreaRect(outline).points(rectCorners);
+        corners.assign(rectCorners, rectCorners + 4);
+    }
+    return corners;
+}
+
 // New method specifically for lightbox boundary detection
 Mat ImageProcessor::detectLightboxBoundary(const Mat& grayImg, const ProcessingParams& params) {
     cout << "[INFO] Detecting lightbox boundary using intensity-based method" << endl;
@@ -776,22 +1622,24 @@ std::vector<cv::Point> ImageProcessor::findBoundaryContour(
 vector<Point2f> ImageProcessor::refineCorners(const vector<Point>& corners, 
                                              const Mat& grayImg, 
                                              const ProcessingParams& params) {
+    vector<Point2f> cornerFloat;
+    for (const auto& pt : corners) {
+        cornerFloat.emplace_back(static_cast<float>(pt.x), static_cast<float>(pt.y));
+    }
+    return refineCorners(cornerFloat, grayImg, params);
+}
+
+vector<Point2f> ImageProcessor::refineCorners(const vector<Point2f>& corners, 
+                                             const Mat& grayImg, 
+                                             const ProcessingParams& params) {
     if (!params.enableSubPixelRefinement || corners.size() != 4) {
         cout << "[INFO] Skipping sub-pixel refinement" << endl;
-        vector<Point2f> result;
-        for (const auto& pt : corners) {
-            result.emplace_back(static_cast<float>(pt.x), static_cast<float>(pt.y));
-        }
-        return result;
+        return corners;
     }
     
     cout << "[INFO] Refining corners with sub-pixel accuracy" << endl;
     
-    vector<Point2f> cornerFloat;
-    for (const auto& pt : corners) {
-        cornerFloat.emplace_back(static_cast<float>(pt.x), static_cast<float>(pt.y));
-    }
-    
+    vector<Point2f> cornerFloat = corners;
     TermCriteria criteria(TermCriteria::EPS + TermCriteria::MAX_ITER, 30, 0.1);
     cornerSubPix(grayImg, cornerFloat, 
                 Size(params.cornerWinSize, params.cornerWinSize),
@@ -826,7 +1674,10 @@ vector<Point> ImageProcessor::findObjectContour(const Mat& warpedImg, const Proc
     
     // Step 2: Collapse threshold logic - pick one method and run it once
     Mat binary;
-    if (params.useAdaptiveThreshold) {
+    if (params.autoThreshold) {
+        double autoThresh = selectAutoThreshold(gray, params);
+        threshold(gray, binary, autoThresh, 255, THRESH_BINARY_INV);
+    } else if (params.useAdaptiveThreshold) {
         if (params.verboseOutput) cout << "[INFO] Using adaptive threshold" << endl;
         adaptiveThreshold(gray, binary, 255, ADAPTIVE_THRESH_GAUSSIAN_C, THRESH_BINARY_INV, 21, 10);
     } else if (params.manualThreshold > 0.0) {
@@ -980,6 +1831,141 @@ vector<Point> ImageProcessor::findObjectContour(const Mat& warpedImg, const Proc
     return objectContour;
 }
 
+double ImageProcessor::selectAutoThreshold(const Mat& gray, const ProcessingParams& params) {
+    // Candidates are scored on a pyramid level; thresholds carry over unchanged
+    // because pyrDown preserves intensities
+    const int kMaxScoringSide = 1024;
+    const int kCandidateCount = 24;
+    const double kInstabilityWeight = 20.0;
+    
+    Mat small = gray;
+    double scale = 1.0;
+    while (max(small.cols, small.rows) > kMaxScoringSide) {
+        pyrDown(small, small);
+        scale *= 0.5;
+    }
+    
+    // One histogram for every candidate: candidate range, Otsu seed and foreground mass
+    vector<double> cumulative(257, 0.0);
+    {
+        vector<double> histogram(256, 0.0);
+        for (int y = 0; y < small.rows; y++) {
+            const uchar* row = small.ptr<uchar>(y);
+            for (int x = 0; x < small.cols; x++) histogram[row[x]] += 1.0;
+        }
+        for (int i = 0; i < 256; i++) cumulative[i + 1] = cumulative[i] + histogram[i];
+    }
+    const double total = cumulative[256];
+    
+    int lo = 0, hi = 255;
+    while (lo < 255 && cumulative[lo + 1] < 0.01 * total) lo++;
+    while (hi > lo && cumulative[hi] > 0.99 * total) hi--;
+    
+    // Otsu from the same histogram
+    int otsu = (lo + hi) / 2;
+    {
+        double sumAll = 0.0;
+        for (int i = 0; i < 256; i++) sumAll += i * (cumulative[i + 1] - cumulative[i]);
+        double sumBelow = 0.0, bestVariance = -1.0;
+        for (int t = 0; t < 255; t++) {
+            sumBelow += t * (cumulative[t + 1] - cumulative[t]);
+            double w0 = cumulative[t + 1], w1 = total - w0;
+            if (w0 <= 0.0 || w1 <= 0.0) continue;
+            double m0 = sumBelow / w0, m1 = (sumAll - sumBelow) / w1;
+            double variance = w0 * w1 * (m0 - m1) * (m0 - m1);
+            if (variance > bestVariance) {
+                bestVariance = variance;
+                otsu = t;
+            }
+        }
+    }
+    
+    vector<int> thresholds;
+    for (int i = 0; i < kCandidateCount; i++) {
+        thresholds.push_back(lo + (hi - lo) * i / max(1, kCandidateCount - 1));
+    }
+    thresholds.push_back(otsu);
+    sort(thresholds.begin(), thresholds.end());
+    thresholds.erase(unique(thresholds.begin(), thresholds.end()), thresholds.end());
+    
+    struct Candidate {
+        double area = 0.0;       // Main blob, pyramid px
+        double solidity = 0.0;
+        double coverage = 0.0;   // Main blob share of all foreground pixels
+        bool valid = false;
+    };
+    vector<Candidate> candidates(thresholds.size());
+    const double minArea = params.minContourArea * scale * scale;
+    
+    parallel_for_(Range(0, static_cast<int>(thresholds.size())), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            Mat binary, labels, stats, centroids;
+            threshold(small, binary, thresholds[i], 255, THRESH_BINARY_INV);
+            int count = connectedComponentsWithStats(binary, labels, stats, centroids, 8, CV_32S);
+            
+            int best = -1;
+            for (int c = 1; c < count; c++) {
+                if (best < 0 || stats.at<int>(c, CC_STAT_AREA) > stats.at<int>(best, CC_STAT_AREA)) best = c;
+            }
+            if (best < 0) continue;
+            
+            // A blob reaching every edge is the background leaking through, not the part
+            int x = stats.at<int>(best, CC_STAT_LEFT), y = stats.at<int>(best, CC_STAT_TOP);
+            int w = stats.at<int>(best, CC_STAT_WIDTH), h = stats.at<int>(best, CC_STAT_HEIGHT);
+            bool spansImage = x == 0 && y == 0 && x + w == small.cols && y + h == small.rows;
+            double area = stats.at<int>(best, CC_STAT_AREA);
+            if (spansImage || area < minArea || area > 0.9 * total) continue;
+            
+            vector<vector<Point>> contours;
+            findContours(labels == best, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
+            if (contours.empty()) continue;
+            const auto& outline = *max_element(contours.begin(), contours.end(),
+                [](const vector<Point>& a, const vector<Point>& b) { return a.size() < b.size(); });
+            vector<Point> hull;
+            convexHull(outline, hull);
+            double hullArea = contourArea(hull);
+            
+            Candidate& candidate = candidates[i];
+            candidate.area = area;
+            candidate.solidity = hullArea > 0.0 ? min(1.0, area / hullArea) : 0.0;
+            candidate.coverage = area / max(1.0, cumulative[thresholds[i] + 1]);
+            candidate.valid = true;
+        }
+    });
+    
+    // MSER-style stability: relative change of the main blob area per grey level
+    // across neighbouring candidates; stable regions barely grow as the threshold moves
+    int bestIdx = -1;
+    double bestScore = 0.0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (!candidates[i].valid) continue;
+        size_t prev = i > 0 && candidates[i - 1].valid ? i - 1 : i;
+        size_t next = i + 1 < candidates.size() && candidates[i + 1].valid ? i + 1 : i;
+        double instability = 0.0;
+        if (next != prev) {
+            instability = fabs(candidates[next].area - candidates[prev].area) /
+                          (candidates[i].area * (thresholds[next] - thresholds[prev]));
+        }
+        double score = candidates[i].solidity * candidates[i].coverage / (1.0 + kInstabilityWeight * instability);
+        if (score > bestScore) {
+            bestScore = score;
+            bestIdx = static_cast<int>(i);
+        }
+    }
+    
+    if (bestIdx < 0) {
+        cout << "[WARN] Auto threshold found no usable candidate, falling back to Otsu (" << otsu << ")" << endl;
+        return otsu;
+    }
+    
+    if (params.verboseOutput) {
+        cout << "[INFO] Auto threshold: " << thresholds[bestIdx] << " (score " << bestScore
+             << ", solidity " << candidates[bestIdx].solidity << ", coverage " << candidates[bestIdx].coverage
+             << ", " << thresholds.size() << " candidates in " << lo << "-" << hi << ", Otsu " << otsu << ")" << endl;
+    }
+    return thresholds[bestIdx];
+}
+
 vector<Point2f> ImageProcessor::refineContour(const vector<Point>& contour,
                                              const Mat& grayImg,
                                              const ProcessingParams& params) {
@@ -1293,6 +2279,283 @@ vector<Point> ImageProcessor::smoothContourMorphological(const vector<Point>& co
     return finalContour;
 }
 
+namespace {
+
+// Exact predicates on integer contour coordinates; every product below stays
+// far inside int64 for any image size OpenCV can hold
+int64_t orientation(const Point& o, const Point& a, const Point& b) {
+    return static_cast<int64_t>(a.x - o.x) * (b.y - o.y) - static_cast<int64_t>(a.y - o.y) * (b.x - o.x);
+}
+
+int signOf(int64_t v) {
+    return (v > 0) - (v < 0);
+}
+
+bool lexLess(const Point& a, const Point& b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// p is known to be collinear with ab
+bool withinBox(const Point& p, const Point& a, const Point& b) {
+    return min(a.x, b.x) <= p.x && p.x <= max(a.x, b.x) && min(a.y, b.y) <= p.y && p.y <= max(a.y, b.y);
+}
+
+bool segmentsTouch(const Point& a, const Point& b, const Point& c, const Point& d) {
+    int d1 = signOf(orientation(c, d, a));
+    int d2 = signOf(orientation(c, d, b));
+    int d3 = signOf(orientation(a, b, c));
+    int d4 = signOf(orientation(a, b, d));
+    if (d1 * d2 < 0 && d3 * d4 < 0) return true;
+    return (d1 == 0 && withinBox(a, c, d)) || (d2 == 0 && withinBox(b, c, d)) ||
+           (d3 == 0 && withinBox(c, a, b)) || (d4 == 0 && withinBox(d, a, b));
+}
+
+// Edge i runs from polygon[i] to polygon[i + 1] (wrapping). Neighbouring edges
+// share a vertex by construction and only conflict when they fold back onto
+// each other; any contact between other edges is a self-intersection.
+bool edgesConflict(const vector<Point>& polygon, size_t i, size_t j) {
+    size_t n = polygon.size();
+    if (j == (i + 1) % n || i == (j + 1) % n) {
+        size_t first = j == (i + 1) % n ? i : j;
+        const Point& a = polygon[first];
+        const Point& b = polygon[(first + 1) % n];
+        const Point& c = polygon[(first + 2) % n];
+        int64_t dot = static_cast<int64_t>(b.x - a.x) * (c.x - b.x) + static_cast<int64_t>(b.y - a.y) * (c.y - b.y);
+        return orientation(a, b, c) == 0 && dot < 0;
+    }
+    return segmentsTouch(polygon[i], polygon[(i + 1) % n], polygon[j], polygon[(j + 1) % n]);
+}
+
+// Shamos-Hoey sweep over the edges of a polygon without repeated consecutive
+// vertices. Events are processed in (x, y) order, which treats vertical edges
+// as if the sweep line were tilted slightly; the status holds the edges crossing
+// the sweep line ordered just after the current event point. Only edges that
+// become neighbours are tested, so a clean contour costs O(n log n), and the
+// sweep stops at the first conflict.
+class EdgeSweep {
+public:
+    explicit EdgeSweep(const vector<Point>& polygon)
+        : m_polygon(polygon), m_status(Order{this}) {}
+
+    bool findConflict(size_t& first, size_t& second) {
+        size_t n = m_polygon.size();
+        if (n < 3) return false;
+
+        // Start (left endpoint) and end events for every edge
+        vector<pair<Point, size_t>> events;
+        events.reserve(2 * n);
+        m_left.resize(n);
+        m_right.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            Point a = m_polygon[i];
+            Point b = m_polygon[(i + 1) % n];
+            if (lexLess(b, a)) swap(a, b);
+            m_left[i] = a;
+            m_right[i] = b;
+            events.emplace_back(a, i);
+            events.emplace_back(b, i + n);
+        }
+        sort(events.begin(), events.end(), [](const pair<Point, size_t>& a, const pair<Point, size_t>& b) {
+            return lexLess(a.first, b.first) || (a.first == b.first && a.second < b.second);
+        });
+
+        vector<Status::iterator> position(n, m_status.end());
+        vector<size_t> starting;
+        vector<size_t> atPoint;
+        for (size_t e = 0; e < events.size();) {
+            m_sweep = events[e].first;
+            starting.clear();
+            for (; e < events.size() && events[e].first == m_sweep; e++) {
+                if (events[e].second < n) starting.push_back(events[e].second);
+            }
+
+            // Edges ending at or passing through this point, then those starting here
+            auto range = m_status.equal_range(Probe{});
+            atPoint.assign(range.first, range.second);
+            atPoint.insert(atPoint.end(), starting.begin(), starting.end());
+            for (size_t a = 0; a < atPoint.size(); a++) {
+                for (size_t b = a + 1; b < atPoint.size(); b++) {
+                    if (edgesConflict(m_polygon, atPoint[a], atPoint[b])) {
+                        first = min(atPoint[a], atPoint[b]);
+                        second = max(atPoint[a], atPoint[b]);
+                        return true;
+                    }
+                }
+            }
+
+            // Without a conflict, only edges ending here can touch this point
+            m_status.erase(range.first, range.second);
+            for (size_t edge : starting) {
+                position[edge] = m_status.insert(edge).first;
+            }
+
+            pair<size_t, size_t> check[2];
+            size_t checks = 0;
+            if (starting.empty()) {
+                auto above = m_status.lower_bound(Probe{});
+                if (above != m_status.begin() && above != m_status.end()) {
+                    check[checks++] = {*prev(above), *above};
+                }
+            } else {
+                auto lowest = position[starting[0]];
+                auto highest = lowest;
+                for (size_t edge : starting) {
+                    if (m_status.key_comp()(*position[edge], *lowest)) lowest = position[edge];
+                    if (m_status.key_comp()(*highest, *position[edge])) highest = position[edge];
+                }
+                if (lowest != m_status.begin()) check[checks++] = {*prev(lowest), *lowest};
+                if (next(highest) != m_status.end()) check[checks++] = {*highest, *next(highest)};
+            }
+            for (size_t c = 0; c < checks; c++) {
+                if (edgesConflict(m_polygon, check[c].first, check[c].second)) {
+                    first = min(check[c].first, check[c].second);
+                    second = max(check[c].first, check[c].second);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Probe {};
+
+    // y of an edge on the sweep line as the fraction num / den (den > 0)
+    void heightAt(size_t edge, int64_t& num, int64_t& den) const {
+        const Point& a = m_left[edge];
+        const Point& b = m_right[edge];
+        if (a.x == b.x) {
+            num = min(max(m_sweep.y, a.y), b.y);
+            den = 1;
+            return;
+        }
+        den = b.x - a.x;
+        num = static_cast<int64_t>(a.y) * den + static_cast<int64_t>(m_sweep.x - a.x) * (b.y - a.y);
+    }
+
+    struct Order {
+        using is_transparent = void;
+        const EdgeSweep* sweep;
+
+        bool operator()(size_t a, size_t b) const {
+            if (a == b) return false;
+            int64_t na, da, nb, db;
+            sweep->heightAt(a, na, da);
+            sweep->heightAt(b, nb, db);
+            int64_t lhs = na * db;
+            int64_t rhs = nb * da;
+            if (lhs != rhs) return lhs < rhs;
+
+            // Edges meeting on the sweep line: order by slope, which is their
+            // order just past the event point (vertical edges last)
+            const Point& a0 = sweep->m_left[a];
+            const Point& a1 = sweep->m_right[a];
+            const Point& b0 = sweep->m_left[b];
+            const Point& b1 = sweep->m_right[b];
+            bool aVertical = a0.x == a1.x;
+            bool bVertical = b0.x == b1.x;
+            if (aVertical != bVertical) return bVertical;
+            if (!aVertical) {
+                int64_t slopeA = static_cast<int64_t>(a1.y - a0.y) * (b1.x - b0.x);
+                int64_t slopeB = static_cast<int64_t>(b1.y - b0.y) * (a1.x - a0.x);
+                if (slopeA != slopeB) return slopeA < slopeB;
+            }
+            return a < b;
+        }
+
+        bool operator()(size_t edge, Probe) const {
+            int64_t num, den;
+            sweep->heightAt(edge, num, den);
+            return num < static_cast<int64_t>(sweep->m_sweep.y) * den;
+        }
+
+        bool operator()(Probe, size_t edge) const {
+            int64_t num, den;
+            sweep->heightAt(edge, num, den);
+            return static_cast<int64_t>(sweep->m_sweep.y) * den < num;
+        }
+    };
+    using Status = set<size_t, Order>;
+
+    const vector<Point>& m_polygon;
+    vector<Point> m_left;
+    vector<Point> m_right;
+    Point m_sweep;
+    Status m_status;
+};
+
+vector<Point> removeRepeatedPoints(const vector<Point>& contour) {
+    vector<Point> polygon;
+    polygon.reserve(contour.size());
+    for (const Point& p : contour) {
+        if (polygon.empty() || !(polygon.back() == p)) polygon.push_back(p);
+    }
+    while (polygon.size() > 1 && polygon.front() == polygon.back()) polygon.pop_back();
+    return polygon;
+}
+
+// Where edges ab and cd meet: a shared endpoint when they touch, otherwise the
+// crossing rounded to the pixel grid
+Point contactPoint(const Point& a, const Point& b, const Point& c, const Point& d) {
+    int64_t da = orientation(c, d, a);
+    int64_t db = orientation(c, d, b);
+    if (da == 0 && withinBox(a, c, d)) return a;
+    if (db == 0 && withinBox(b, c, d)) return b;
+    if (orientation(a, b, c) == 0 && withinBox(c, a, b)) return c;
+    if (orientation(a, b, d) == 0 && withinBox(d, a, b)) return d;
+    double t = static_cast<double>(da) / static_cast<double>(da - db);
+    return Point(static_cast<int>(lround(a.x + t * (b.x - a.x))), static_cast<int>(lround(a.y + t * (b.y - a.y))));
+}
+
+} // namespace
+
+bool ImageProcessor::hasSelfIntersection(const vector<Point>& contour) {
+    vector<Point> polygon = removeRepeatedPoints(contour);
+    size_t first, second;
+    return EdgeSweep(polygon).findConflict(first, second);
+}
+
+vector<Point> ImageProcessor::repairSelfIntersections(const vector<Point>& contour) {
+    const size_t maxRepairs = 1000;
+    vector<Point> polygon = removeRepeatedPoints(contour);
+    size_t repairs = 0;
+    size_t i, j;
+    while (polygon.size() >= 3 && EdgeSweep(polygon).findConflict(i, j)) {
+        if (repairs == maxRepairs) {
+            cout << "[WARN] Gave up repairing self-intersections after " << repairs << " loops" << endl;
+            break;
+        }
+
+        size_t n = polygon.size();
+        if (j == i + 1 || (i == 0 && j == n - 1)) {
+            // Consecutive edges folding back on each other: drop the spike tip
+            polygon.erase(polygon.begin() + static_cast<ptrdiff_t>(j == i + 1 ? j : 0));
+        } else {
+            // Split at the contact point into the loop between the two edges and
+            // the rest of the contour; the outer boundary is the larger of the two
+            Point cut = contactPoint(polygon[i], polygon[i + 1], polygon[j], polygon[(j + 1) % n]);
+            vector<Point> loop(1, cut);
+            loop.insert(loop.end(), polygon.begin() + static_cast<ptrdiff_t>(i + 1),
+                        polygon.begin() + static_cast<ptrdiff_t>(j + 1));
+            vector<Point> rest(1, cut);
+            rest.insert(rest.end(), polygon.begin() + static_cast<ptrdiff_t>(j + 1), polygon.end());
+            rest.insert(rest.end(), polygon.begin(), polygon.begin() + static_cast<ptrdiff_t>(i + 1));
+            polygon = fabs(contourArea(loop)) > fabs(contourArea(rest)) ? std::move(loop) : std::move(rest);
+        }
+        polygon = removeRepeatedPoints(polygon);
+        repairs++;
+    }
+
+    if (repairs == 0) return contour;
+    if (polygon.size() < 3) {
+        cout << "[WARN] Self-intersection repair collapsed the contour, keeping the original" << endl;
+        return contour;
+    }
+    cout << "[INFO] Repaired " << repairs << " self-intersections. Original: " << contour.size()
+         << " points, Repaired: " << polygon.size() << " points" << endl;
+    return polygon;
+}
+
 bool ImageProcessor::validateContour(const vector<Point>& contour, const ProcessingParams& params) {
     cout << "[INFO] Validating contour for CAD suitability" << endl;
     
@@ -1318,16 +2581,10 @@ bool ImageProcessor::validateContour(const vector<Point>& contour, const Process
         }
     }
     
-    // Check for self-intersections (basic check)
-    if (contour.size() > 4) {
-        for (size_t i = 0; i < contour.size() - 1; i++) {
-            for (size_t j = i + 2; j < contour.size() - 1; j++) {
-                if (j == contour.size() - 1 && i == 0) continue; // Skip adjacent segments
-                
-                // Simple intersection check would go here
-                // For now, we'll skip this expensive check
-            }
-        }
+    // Self-intersecting outlines fail in the slicer, long after we could have said so
+    if (hasSelfIntersection(contour)) {
+        cout << "[ERROR] Contour intersects itself" << endl;
+        return false;
     }
     
     cout << "[INFO] Contour validation passed" << endl;
@@ -1490,21 +2747,24 @@ void ImageProcessor::flushDebugStack(const ProcessingParams& params) {
     string createDirCommand = "mkdir -p \"" + params.debugOutputPath + "\"";
     system(createDirCommand.c_str());
     
-    // Save all images with sequential numbering
-    for (size_t i = 0; i < params.debugImageStack.size(); i++) {
+    // Save all images with sequential numbering; encoding is independent per image
+    size_t count = params.debugImageStack.size();
+    vector<string> filenames(count);
+    vector<char> saved(count, 0);
+    parallelFor(count, static_cast<int>(count), [&](size_t i) {
         const auto& [image, name] = params.debugImageStack[i];
         
         // Format: 01_name.jpg, 02_name.jpg, etc.
         char indexStr[4];
         snprintf(indexStr, sizeof(indexStr), "%02zu", i + 1);
-        string filename = string(indexStr) + "_" + name + ".jpg";
-        string fullPath = params.debugOutputPath + filename;
-        
-        bool success = imwrite(fullPath, image);
-        if (success) {
-            cout << "[DEBUG] Saved: " << filename << endl;
+        filenames[i] = string(indexStr) + "_" + name + ".jpg";
+        saved[i] = imwrite(params.debugOutputPath + filenames[i], image);
+    });
+    for (size_t i = 0; i < count; i++) {
+        if (saved[i]) {
+            cout << "[DEBUG] Saved: " << filenames[i] << endl;
         } else {
-            cout << "[WARNING] Failed to save: " << filename << endl;
+            cout << "[WARNING] Failed to save: " << filenames[i] << endl;
         }
     }
     
@@ -1635,7 +2895,145 @@ vector<Point> ImageProcessor::approximatePolygon(const vector<Point>& contour, d
     return approx;
 }
 
+vector<Point2f> ImageProcessor::fitQuadrilateral(const vector<Point>& boundary) {
+    if (boundary.size() < 4) return {};
+    
+    // Resample the closed boundary at ~1px spacing so compressed chains
+    // (CHAIN_APPROX_SIMPLE) weight every side by its length
+    vector<Point2f> points;
+    for (size_t i = 0; i < boundary.size(); i++) {
+        Point2f a = boundary[i];
+        Point2f b = boundary[(i + 1) % boundary.size()];
+        int steps = max(1, cvCeil(norm(b - a)));
+        for (int s = 0; s < steps; s++) {
+            points.push_back(a + (b - a) * (static_cast<float>(s) / steps));
+        }
+    }
+    const size_t n = points.size();
+    if (n < 32) return {};
+    
+    // Directed tangent of each point over ~1% of the perimeter, in degrees
+    const size_t window = max<size_t>(2, n / 100);
+    vector<float> angles(n);
+    double folded[18] = {0.0};
+    for (size_t i = 0; i < n; i++) {
+        Point2f d = points[(i + window) % n] - points[(i + n - window) % n];
+        angles[i] = fastAtan2(d.y, d.x);
+        folded[static_cast<int>(angles[i] / 5.0f) % 18] += 1.0;  // Sides are ~90 degrees apart: fold them together
+    }
+    int peak = 0;
+    double peakVotes = -1.0;
+    for (int b = 0; b < 18; b++) {
+        double votes = folded[(b + 17) % 18] + folded[b] + folded[(b + 1) % 18];
+        if (votes > peakVotes) {
+            peakVotes = votes;
+            peak = b;
+        }
+    }
+    
+    auto angularDistance = [](double a, double b) {
+        return fabs(fmod(a - b + 540.0, 360.0) - 180.0);
+    };
+    
+    // Assign points to the nearest of four directions, then recentre each side on
+    // its mean direction (perspective skews sides away from exact right angles) and
+    // reassign tightly so corner rounding and the tangent window's blur drop out
+    double centers[4];
+    for (int m = 0; m < 4; m++) centers[m] = (peak + 0.5) * 5.0 + 90.0 * m;
+    vector<Point2f> sides[4];
+    for (int pass = 0; pass < 2; pass++) {
+        const double tolerance = pass == 0 ? 45.0 : 20.0;
+        double sumCos[4] = {0.0};
+        double sumSin[4] = {0.0};
+        for (auto& side : sides) side.clear();
+        for (size_t i = 0; i < n; i++) {
+            int best = 0;
+            for (int m = 1; m < 4; m++) {
+                if (angularDistance(angles[i], centers[m]) < angularDistance(angles[i], centers[best])) best = m;
+            }
+            if (angularDistance(angles[i], centers[best]) > tolerance) continue;
+            sides[best].push_back(points[i]);
+            sumCos[best] += cos(angles[i] * CV_PI / 180.0);
+            sumSin[best] += sin(angles[i] * CV_PI / 180.0);
+        }
+        for (int m = 0; m < 4; m++) {
+            if (sides[m].size() < n / 20) return {};
+            centers[m] = atan2(sumSin[m], sumCos[m]) * 180.0 / CV_PI;
+        }
+    }
+    
+    // Robust line per side; sides m and m + 1 are neighbours on a convex quad.
+    // Curved runs (rounded or circular outlines) fail the straightness check.
+    Vec4f lines[4];
+    for (int m = 0; m < 4; m++) {
+        fitLine(sides[m], lines[m], DIST_HUBER, 0, 0.01, 0.01);
+        const Vec4f& l = lines[m];
+        double deviation = 0.0;
+        float minT = 0.0f;
+        float maxT = 0.0f;
+        for (const Point2f& p : sides[m]) {
+            float dx = p.x - l[2];
+            float dy = p.y - l[3];
+            deviation += fabs(dx * l[1] - dy * l[0]);
+            float t = dx * l[0] + dy * l[1];
+            minT = min(minT, t);
+            maxT = max(maxT, t);
+        }
+        deviation /= sides[m].size();
+        if (deviation > max(2.0, 0.01 * (maxT - minT))) return {};
+    }
+    
+    Rect bounds = boundingRect(boundary);
+    float marginX = bounds.width * 0.25f;
+    float marginY = bounds.height * 0.25f;
+    vector<Point2f> corners;
+    for (int m = 0; m < 4; m++) {
+        const Vec4f& a = lines[m];
+        const Vec4f& b = lines[(m + 1) % 4];
+        float cross = a[0] * b[1] - a[1] * b[0];
+        if (fabs(cross) < 0.2f) return {};  // Neighbouring sides closer than ~12 degrees to parallel
+        float t = ((b[2] - a[2]) * b[1] - (b[3] - a[3]) * b[0]) / cross;
+        Point2f corner(a[2] + t * a[0], a[3] + t * a[1]);
+        if (corner.x < bounds.x - marginX || corner.x > bounds.x + bounds.width + marginX ||
+            corner.y < bounds.y - marginY || corner.y > bounds.y + bounds.height + marginY) {
+            return {};
+        }
+        corners.push_back(corner);
+    }
+    
+    if (!isContourConvex(corners)) return {};
+    return corners;
+}
+
 // New improved warpImage that works with Point2f and rectangular lightboxes
+Size ImageProcessor::chooseWarpSize(const vector<Point2f>& corners, const ProcessingParams& params) {
+    vector<Point2f> ordered = orderCorners(corners);
+    double top = norm(ordered[1] - ordered[0]);
+    double bottom = norm(ordered[2] - ordered[3]);
+    double left = norm(ordered[3] - ordered[0]);
+    double right = norm(ordered[2] - ordered[1]);
+    // Under perspective the nearer side is densest; beyond that the warp only interpolates
+    double sourceDensity = max(max(top, bottom) / params.lightboxWidthMM, max(left, right) / params.lightboxHeightMM);
+    double requiredDensity = kWarpPixelsPerTolerance / params.targetToleranceMM;
+    double density = min(sourceDensity, requiredDensity);
+    if (sourceDensity < requiredDensity) {
+        cout << "[WARN] Source offers " << sourceDensity << " px/mm on the lightbox; a "
+             << params.targetToleranceMM << " mm tolerance needs " << requiredDensity << " px/mm" << endl;
+    }
+
+    Size size(clamp(static_cast<int>(ceil(density * params.lightboxWidthMM)), kMinWarpSide, kMaxWarpSide),
+              clamp(static_cast<int>(ceil(density * params.lightboxHeightMM)), kMinWarpSide, kMaxWarpSide));
+    if (params.maxMemoryMB > 0) {
+        // planMemory stored the largest warp that fits the budget here
+        size.width = min(size.width, params.lightboxWidthPx);
+        size.height = min(size.height, params.lightboxHeightPx);
+    }
+    cout << "[INFO] Warp size " << size.width << "x" << size.height << " for " << params.targetToleranceMM
+         << " mm tolerance (source " << sourceDensity << " px/mm, warp "
+         << (size.width / params.lightboxWidthMM + size.height / params.lightboxHeightMM) / 2.0 << " px/mm)" << endl;
+    return size;
+}
+
 pair<Mat, double> ImageProcessor::warpImage(const Mat& originalImg, const vector<Point2f>& corners,
                                            const cv::Size& targetSize, double realWorldWidthMM, double realWorldHeightMM) {
     if (originalImg.empty()) {
@@ -1766,167 +3164,128 @@ vector<Point> ImageProcessor::processImageToContour(const string& inputPath) {
     return processImageToContour(inputPath, params);
 }
 
+namespace {
+
+// Appends per-stage timings to params.stageTimingsMs. Time spent in the
+// onStageBoundary hook (a batch job yielding to interactive work) is not
+// charged to the next stage.
+class StageClock {
+public:
+    explicit StageClock(const ImageProcessor::ProcessingParams& params)
+        : m_params(params), m_start(chrono::steady_clock::now()) {}
+
+    void end(const char* name) {
+        auto now = chrono::steady_clock::now();
+        m_params.stageTimingsMs.emplace_back(name, chrono::duration<double, milli>(now - m_start).count());
+        if (m_params.onStageBoundary) m_params.onStageBoundary(name);
+        m_start = m_params.onStageBoundary ? chrono::steady_clock::now() : now;
+    }
+
+private:
+    const ImageProcessor::ProcessingParams& m_params;
+    chrono::steady_clock::time_point m_start;
+};
+
+} // namespace
+
 std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::processImageToStage(
     const std::string& inputPath, 
     const ProcessingParams& params,
-    int target_stage
+    int target_stage,
+    LightboxStage* lightbox
 ) {
     cout << "[INFO] Processing image to stage " << target_stage << endl;
     
+    // Per-stage timings for benchmarks and the accuracy harness
+    params.stageTimingsMs.clear();
+    StageClock stages(params);
+    
+    // Reject unusable photos on a thumbnail before paying for the full decode
+    if (params.enableQualityGate) {
+        checkImageQuality(inputPath, params);
+        stages.end("quality");
+    }
+    
     // Stage 0: Load and convert to grayscale
-    Mat originalImg = loadImage(inputPath);
+    Mat originalImg = loadImage(inputPath, params.decodeReduction);
     Mat grayImg = convertToGrayscale(originalImg);
     
     // Save debug image for original
     pushDebugImage(originalImg, "original", params);
     pushDebugImage(grayImg, "grayscale", params);
+    stages.end("load");
     
     if (target_stage == 0) { // PRINT_TRACE_STAGE_LOADED
         return {grayImg.clone(), {}};
     }
     
     // Stage 1: Process to lightbox cropped (perspective correction)
-    // First we need to detect the lightbox boundary
-    Mat normalizedImg = normalizeLighting(grayImg, params);
-    pushDebugImage(normalizedImg, "normalized", params);
-    
-    Mat boundaryEdges = detectEdges(normalizedImg, originalImg, params);
-    pushDebugImage(boundaryEdges, "boundary_edges", params);
-    
-    vector<Point> boundaryContour = findBoundaryContour(boundaryEdges, params);
-    // Note: boundary contour visualization not yet converted to stack
-    
-    // Approximate to 4 corners with iterative refinement
-    vector<Point> corners;
-    bool found4Corners = false;
-    double epsilonFactor = 0.02;
-    
-    for (int attempts = 0; attempts < 10 && !found4Corners; attempts++) {
-        corners = approximatePolygon(boundaryContour, epsilonFactor);
-        if (corners.size() == 4) {
-            found4Corners = true;
-            cout << "[INFO] Found 4 corners with epsilon factor: " << epsilonFactor << endl;
+    vector<Point2f> refinedCorners;
+    if (params.cornerDetectionMode == 1) {
+        refinedCorners = refineCorners(raceCornerDetectors(originalImg, params), grayImg, params);
+    } else if (params.cornerDetectionMode == 2) {
+        vector<Point2f> corners = detectCornersFromScanlines(grayImg, params);
+        if (corners.size() == 4 && validateCorners(corners, grayImg.size(), params)) {
+            refinedCorners = refineCorners(corners, grayImg, params);
         } else {
-            epsilonFactor += 0.005;
-            cout << "[INFO] Attempt " << (attempts + 1) << ": Found " << corners.size() 
-                 << " corners, trying epsilon: " << epsilonFactor << endl;
+            cout << "[WARN] Scanline search failed, falling back to boundary fit" << endl;
         }
     }
-    
-    if (!found4Corners) {
-        cout << "[WARN] Could not find exactly 4 corners, trying fallback methods" << endl;
+    if (refinedCorners.empty() && params.tileMemoryLimitMB > 0) {
+        vector<Point2f> corners = detectCornersStriped(originalImg, params);
+        if (corners.size() != 4) {
+            throw runtime_error("Could not find 4 corners: no lightbox region in striped mask");
+        }
+        refinedCorners = refineCorners(corners, grayImg, params);
+    }
+    if (refinedCorners.empty()) {
+        // First we need to detect the lightbox boundary. The colour paper mask does not
+        // depend on the normalised gray, so the two run side by side
+        bool useLab = originalImg.channels() == 3;
+        Mat normalizedImg, paperMask;
+        TaskGraph graph;
+        graph.add([&] { normalizedImg = normalizeLighting(grayImg, params); });
+        if (useLab) {
+            graph.add([&] { paperMask = labPaperMask(originalImg, params); });
+        }
+        graph.run();
+        pushDebugImage(normalizedImg, "normalized", params);
         
-        // Fallback 1: Use convex hull
-        vector<Point> hull;
-        convexHull(boundaryContour, hull);
-        corners = approximatePolygon(hull, 0.02);
+        Mat boundaryEdges = useLab ? detectEdgesFromMask(paperMask, params)
+                                   : detectEdges(normalizedImg, originalImg, params);
+        pushDebugImage(boundaryEdges, "boundary_edges", params);
         
-        if (corners.size() != 4) {
-            // Fallback 2: Find actual corners using min/max coordinates from contour
-            // This is more accurate than bounding rectangle for non-axis-aligned rectangles
-            cout << "[INFO] Finding corners from contour extremes" << endl;
-            
-            // Find the four extreme points of the contour
-            auto minXPoint = *min_element(boundaryContour.begin(), boundaryContour.end(), 
-                [](const Point& a, const Point& b) { return a.x < b.x; });
-            auto maxXPoint = *max_element(boundaryContour.begin(), boundaryContour.end(), 
-                [](const Point& a, const Point& b) { return a.x < b.x; });
-            auto minYPoint = *min_element(boundaryContour.begin(), boundaryContour.end(), 
-                [](const Point& a, const Point& b) { return a.y < b.y; });
-            auto maxYPoint = *max_element(boundaryContour.begin(), boundaryContour.end(), 
-                [](const Point& a, const Point& b) { return a.y < b.y; });
-            
-            // Find the four corner candidates by combining extremes
-            vector<Point> cornerCandidates;
-            for (const Point& pt : boundaryContour) {
-                // Check if this point is close to being a corner (near extremes)
-                bool isCorner = false;
-                
-                // Top-left corner candidate (low x, low y)
-                if (abs(pt.x - minXPoint.x) < 50 && abs(pt.y - minYPoint.y) < 50) isCorner = true;
-                // Top-right corner candidate (high x, low y)  
-                else if (abs(pt.x - maxXPoint.x) < 50 && abs(pt.y - minYPoint.y) < 50) isCorner = true;
-                // Bottom-right corner candidate (high x, high y)
-                else if (abs(pt.x - maxXPoint.x) < 50 && abs(pt.y - maxYPoint.y) < 50) isCorner = true;
-                // Bottom-left corner candidate (low x, high y)
-                else if (abs(pt.x - minXPoint.x) < 50 && abs(pt.y - maxYPoint.y) < 50) isCorner = true;
-                
-                if (isCorner) {
-                    cornerCandidates.push_back(pt);
-                }
-            }
-            
-            if (cornerCandidates.size() >= 4) {
-                // Sort candidates to get the best 4 corners
-                // Sort by distance from center to get corner ordering
-                Point center(0, 0);
-                for (const Point& pt : cornerCandidates) {
-                    center.x += pt.x;
-                    center.y += pt.y;
-                }
-                center.x /= cornerCandidates.size();
-                center.y /= cornerCandidates.size();
-                
-                // Sort by angle from center to get proper ordering
-                sort(cornerCandidates.begin(), cornerCandidates.end(), 
-                     [center](const Point& a, const Point& b) {
-                         double angleA = atan2(a.y - center.y, a.x - center.x);
-                         double angleB = atan2(b.y - center.y, b.x - center.x);
-                         return angleA < angleB;
-                     });
-                
-                corners = {cornerCandidates[0], cornerCandidates[1], cornerCandidates[2], cornerCandidates[3]};
-                cout << "[INFO] Found " << cornerCandidates.size() << " corner candidates, using first 4" << endl;
-            } else {
-                // Alternative approach: Find the largest inscribed rectangle
-                // This works better for paper boundaries with complex edges
-                cout << "[INFO] Finding largest inscribed rectangle within paper boundary" << endl;
-                
-                // Find the inner bounds of the paper by looking for the largest clear rectangular area
-                // We'll do this by finding the min/max coordinates that have enough support
-                
-                vector<int> xCoords, yCoords;
-                for (const Point& pt : boundaryContour) {
-                    xCoords.push_back(pt.x);
-                    yCoords.push_back(pt.y);
-                }
-                
-                sort(xCoords.begin(), xCoords.end());
-                sort(yCoords.begin(), yCoords.end());
-                
-                // Use percentiles to find the inner rectangle bounds
-                // This filters out outlier points from noise
-                size_t xSize = xCoords.size();
-                size_t ySize = yCoords.size();
-                
-                int x1 = xCoords[xSize * 0.1];  // 10th percentile
-                int x2 = xCoords[xSize * 0.9];  // 90th percentile  
-                int y1 = yCoords[ySize * 0.1];  // 10th percentile
-                int y2 = yCoords[ySize * 0.9];  // 90th percentile
-                
-                corners = {
-                    Point(x1, y1),    // Top-left
-                    Point(x2, y1),    // Top-right  
-                    Point(x2, y2),    // Bottom-right
-                    Point(x1, y2)     // Bottom-left
-                };
-                
-                cout << "[INFO] Using inscribed rectangle from (" << x1 << "," << y1 
-                     << ") to (" << x2 << "," << y2 << ")" << endl;
-            }
+        vector<Point> boundaryContour = findBoundaryContour(boundaryEdges, params);
+        // Note: boundary contour visualization not yet converted to stack
+        
+        // Fit the four sides of the boundary; a rotated bounding rectangle is the only fallback
+        vector<Point2f> corners = fitQuadrilateral(boundaryContour);
+        if (corners.size() == 4) {
+            cout << "[INFO] Found 4 corners by quadrilateral fit" << endl;
         } else {
-            cout << "[INFO] Convex hull fallback successful" << endl;
+            if (boundaryContour.empty()) {
+                throw runtime_error("Could not find 4 corners: no lightbox boundary found");
+            }
+            cout << "[WARN] Boundary is not clearly four-sided, using minimum area rectangle" << endl;
+            Point2f rectCorners[4];
+            minAreaRect(boundaryContour).points(rectCorners);
+            corners.assign(rectCorners, rectCorners + 4);
         }
+        
+        // Refine corners with sub-pixel accuracy
+        refinedCorners = refineCorners(corners, normalizedImg, params);
     }
     
-    // Refine corners with sub-pixel accuracy
-    vector<Point2f> refinedCorners = refineCorners(corners, normalizedImg, params);
+    Size warpSize(params.lightboxWidthPx, params.lightboxHeightPx);
+    if (params.targetToleranceMM > 0.0) {
+        warpSize = chooseWarpSize(refinedCorners, params);
+    }
     
     // 5. Log warp dimensions
     cout << "[INFO] Warping from "
          << grayImg.cols << "x" << grayImg.rows 
          << " px to "
-         << params.lightboxWidthPx << "x" << params.lightboxHeightPx
+         << warpSize.width << "x" << warpSize.height
          << " px ("
          << params.lightboxWidthMM << "mm x " << params.lightboxHeightMM << "mm)"
          << endl;
@@ -1935,20 +3294,97 @@ std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::processImageToStage(
     auto [warpedImg, pixelsPerMM] = warpImage(
         grayImg,
         refinedCorners,
-        cv::Size(params.lightboxWidthPx, params.lightboxHeightPx),
+        warpSize,
         params.lightboxWidthMM,
         params.lightboxHeightMM
     );
     
     pushDebugImage(warpedImg, "perspective_corrected", params);
     
+    // Same corner order and destination rectangle as warpImage
+    LightboxStage localStage;
+    LightboxStage& stage = lightbox ? *lightbox : localStage;
+    vector<Point2f> ordered = orderCorners(refinedCorners);
+    vector<Point2f> dstPts{
+        Point2f(0.0f, 0.0f),
+        Point2f(static_cast<float>(warpSize.width - 1), 0.0f),
+        Point2f(static_cast<float>(warpSize.width - 1), static_cast<float>(warpSize.height - 1)),
+        Point2f(0.0f, static_cast<float>(warpSize.height - 1))
+    };
+    stage.warped = warpedImg;
+    stage.corners = ordered;
+    stage.homography = getPerspectiveTransform(ordered, dstPts);
+    stage.pixelsPerMM = pixelsPerMM;
+    stages.end("lightbox");
+    
     if (target_stage == 1) { // PRINT_TRACE_STAGE_LIGHTBOX_CROPPED
         return {warpedImg.clone(), {}};
     }
     
+    // Later stages only read the warp; free the source before they allocate
+    originalImg.release();
+    grayImg.release();
+    
+    return runStagesFromLightbox(stage, params, target_stage);
+}
+
+std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::processFromLightbox(
+    const LightboxStage& lightbox,
+    const ProcessingParams& params,
+    int target_stage
+) {
+    cout << "[INFO] Processing from lightbox stage to stage " << target_stage << endl;
+    
+    params.stageTimingsMs.clear();
+    if (lightbox.warped.empty()) {
+        throw invalid_argument("Lightbox stage has no warped image");
+    }
+    if (target_stage <= 1) {
+        return {lightbox.warped.clone(), {}};
+    }
+    return runStagesFromLightbox(lightbox, params, target_stage);
+}
+
+string ImageProcessor::lightboxStageSignature(const ProcessingParams& params) {
+    // Keep in step with the parameters read by loadImage .. warpImage
+    ostringstream text;
+    text.precision(17);
+    text << "lightbox=" << params.lightboxWidthPx << "x" << params.lightboxHeightPx
+         << "/" << params.lightboxWidthMM << "x" << params.lightboxHeightMM << "\n"
+         << "clahe=" << params.claheClipLimit << "/" << params.claheTileSize << "\n"
+         << "canny=" << params.cannyLower << "/" << params.cannyUpper << "/" << params.cannyAperture << "\n"
+         << "lab=" << params.labLThresh << "/" << params.labAmin << "/" << params.labAmax
+         << "/" << params.labBmin << "/" << params.labBmax << "\n"
+         << "otsuOffset=" << params.otsuOffset << "\n"
+         << "paperMask=" << params.largeKernel << "/" << params.holeAreaRatio << "\n"
+         << "subpixel=" << params.enableSubPixelRefinement << "/" << params.cornerWinSize
+         << "/" << params.cornerZeroZone << "\n"
+         << "cornerDetection=" << params.cornerDetectionMode << "\n"
+         << "qualityGate=" << params.enableQualityGate << "/" << params.minSharpness << "\n"
+         << "tileMemory=" << params.tileMemoryLimitMB << "\n"
+         << "decodeReduction=" << params.decodeReduction << "\n"
+         << "targetTolerance=" << params.targetToleranceMM << "\n";
+    // Racing also reads the confidence bar and the geometric checks of the detectors
+    if (params.cornerDetectionMode == 1) {
+        text << "cornerRace=" << params.cornerMinConfidence << "/" << params.minSolidity
+             << "/" << params.maxAspectRatio << "\n";
+    }
+    return text.str();
+}
+
+std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::runStagesFromLightbox(
+    const LightboxStage& lightbox,
+    const ProcessingParams& params,
+    int target_stage
+) {
+    StageClock stages(params);
+    
+    const Mat& warpedImg = lightbox.warped;
+    
     // Stage 2: Normalized (already done above, just return warped + normalized)
     Mat warpedNormalized = normalizeLighting(warpedImg, params);
     pushDebugImage(warpedNormalized, "warped_normalized", params);
+    stages.end("normalize");
     
     if (target_stage == 2) { // PRINT_TRACE_STAGE_NORMALIZED
         return {warpedNormalized.clone(), {}};
@@ -1958,7 +3394,7 @@ std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::processImageToStage(
     if (target_stage == 3) { // PRINT_TRACE_STAGE_BOUNDARY_DETECTED
         // Convert corners back to vector<Point> for consistency
         vector<Point> cornerPoints;
-        for (const auto& pt : refinedCorners) {
+        for (const auto& pt : lightbox.corners) {
             cornerPoints.emplace_back(static_cast<int>(pt.x), static_cast<int>(pt.y));
         }
         return {warpedImg.clone(), cornerPoints};
@@ -1967,20 +3403,36 @@ std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::processImageToStage(
     // Stage 4: Object detected
     vector<Point> objectContour = findObjectContour(warpedImg, params);
     pushDebugContour(warpedImg, objectContour, "object_contour", params);
+    stages.end("object");
     
     if (target_stage == 4) { // PRINT_TRACE_STAGE_OBJECT_DETECTED
         return {warpedImg.clone(), objectContour};
     }
     
+    return {warpedImg.clone(), processFromObjectContour(lightbox, objectContour, params, target_stage)};
+}
+
+vector<Point> ImageProcessor::processFromObjectContour(
+    const LightboxStage& lightbox,
+    const vector<Point>& objectContour,
+    const ProcessingParams& params,
+    int target_stage
+) {
+    StageClock stages(params);
+    
+    const Mat& warpedImg = lightbox.warped;
+    const double pixelsPerMM = lightbox.pixelsPerMM;
+    
     // Stage 5: Smoothed (if enabled)
     vector<Point> processedContour = objectContour;
     if (params.enableSmoothing) {
         processedContour = smoothContour(processedContour, params.smoothingAmountMM, pixelsPerMM, params);
         pushDebugContour(warpedImg, processedContour, "smoothed_contour", params);
     }
+    stages.end("smooth");
     
     if (target_stage == 5) { // PRINT_TRACE_STAGE_SMOOTHED
-        return {warpedImg.clone(), processedContour};
+        return processedContour;
     }
     
     // Stage 6: Dilated (if enabled)
@@ -1988,22 +3440,28 @@ std::pair<cv::Mat, std::vector<cv::Point>> ImageProcessor::processImageToStage(
         processedContour = dilateContour(processedContour, params.dilationAmountMM, pixelsPerMM, params);
         pushDebugContour(warpedImg, processedContour, "dilated_contour", params);
     }
+    stages.end("dilate");
     
     if (target_stage == 6) { // PRINT_TRACE_STAGE_DILATED
-        return {warpedImg.clone(), processedContour};
+        return processedContour;
     }
     
-    // Stage 7: Final (validate contour)
+    // Stage 7: Final (repair and validate contour)
+    if (params.repairSelfIntersections) {
+        processedContour = repairSelfIntersections(processedContour);
+    }
     if (!validateContour(processedContour, params)) {
         throw runtime_error("Final contour validation failed");
     }
     
     pushDebugContour(warpedImg, processedContour, "final_contour", params);
+    stages.end("validate");
     
     // Flush all debug images at the end
     flushDebugStack(params);
+    stages.end("debug_output");
     
-    return {warpedImg.clone(), processedContour};
+    return processedContour;
 }
 
 vector<Point> ImageProcessor::mergeNearbyContours(const vector<vector<Point>>& contours,
@@ -2026,8 +3484,12 @@ vector<Point> ImageProcessor::mergeNearbyContours(const vector<vector<Point>>& c
     
     cout << "[INFO] Found " << validContours.size() << " valid contours to merge" << endl;
     
-    // Create a mask to draw all contours
-    Mat mask = Mat::zeros(params.lightboxHeightPx, params.lightboxWidthPx, CV_8UC1);
+    // Create a mask to draw all contours (covers the contours, whatever the warp size)
+    Rect bounds = boundingRect(validContours[0]);
+    for (const auto& contour : validContours) {
+        bounds |= boundingRect(contour);
+    }
+    Mat mask = Mat::zeros(bounds.y + bounds.height + 1, bounds.x + bounds.width + 1, CV_8UC1);
     
     // Draw all valid contours on the mask
     for (size_t i = 0; i < validContours.size(); i++) {
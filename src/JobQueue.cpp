@@ -0,0 +1,239 @@
+#include "JobQueue.hpp"
+#include "Metrics.hpp"
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+// The job the current thread is running (restored when a preempted job resumes)
+struct CurrentJob {
+    JobQueue* queue = nullptr;
+    JobQueue::Priority priority = JobQueue::Priority::Batch;
+};
+thread_local CurrentJob t_job;
+
+} // namespace
+
+JobQueue& JobQueue::shared() {
+    // Never destroyed: jobs still queued at exit may finish during static destruction
+    static JobQueue* queue = new JobQueue();
+    return *queue;
+}
+
+JobQueue::~JobQueue() {
+    waitIdle();
+}
+
+JobQueue::JobId JobQueue::submit(function<void(JobId)> job, Priority priority, double memoryMB) {
+    JobId id;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        id = m_nextId++;
+        m_queues[static_cast<int>(priority)].push_back({id, priority, std::move(job), chrono::steady_clock::now(),
+                                                       max(0.0, memoryMB)});
+    }
+    dispatch();
+    return id;
+}
+
+void JobQueue::waitIdle() {
+    unique_lock<mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return queuedLocked() == 0 && m_running == 0 && m_preempted == 0; });
+}
+
+void JobQueue::setMaxConcurrent(int jobs) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_maxConcurrent = max(0, jobs);
+    }
+    dispatch();
+}
+
+int JobQueue::maxConcurrent() const {
+    lock_guard<mutex> lock(m_mutex);
+    return limitLocked();
+}
+
+void JobQueue::setScheduling(int batchAgingMs, bool preemptBatch) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_batchAging = chrono::milliseconds(max(0, batchAgingMs));
+        m_preemptBatch = preemptBatch;
+    }
+    dispatch();
+}
+
+void JobQueue::setMemoryBudget(double budgetMB) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_memoryBudgetMB = max(0.0, budgetMB);
+    }
+    dispatch();
+}
+
+double JobQueue::memoryBudget() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_memoryBudgetMB;
+}
+
+double JobQueue::admittedMemory() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_admittedMB;
+}
+
+size_t JobQueue::queued() const {
+    lock_guard<mutex> lock(m_mutex);
+    return queuedLocked();
+}
+
+size_t JobQueue::queued(Priority priority) const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_queues[static_cast<int>(priority)].size();
+}
+
+size_t JobQueue::running() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_running;
+}
+
+size_t JobQueue::preempted() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_preempted;
+}
+
+size_t JobQueue::queuedLocked() const {
+    return m_queues[0].size() + m_queues[1].size();
+}
+
+int JobQueue::limitLocked() const {
+    return m_maxConcurrent > 0 ? m_maxConcurrent : max(1, WorkerPool::shared()->threadCount());
+}
+
+bool JobQueue::fitsLocked(const Job& job) const {
+    // An oversized job still runs, alone, rather than waiting forever
+    return m_memoryBudgetMB <= 0.0 || (m_running == 0 && m_preempted == 0) ||
+           m_admittedMB + job.memoryMB <= m_memoryBudgetMB;
+}
+
+bool JobQueue::takeLocked(Job& job) {
+    if (static_cast<int>(m_running) >= limitLocked()) return false;
+    deque<Job>& interactive = m_queues[static_cast<int>(Priority::Interactive)];
+    deque<Job>& batch = m_queues[static_cast<int>(Priority::Batch)];
+
+    // Preempted batch jobs get their slots back before new batch jobs start
+    bool batchReady = !batch.empty() && m_preempted == 0;
+    if (interactive.empty() && !batchReady) return false;
+    auto now = chrono::steady_clock::now();
+    bool aged = batchReady && m_batchAging.count() > 0 && now - batch.front().submitted >= m_batchAging;
+    deque<Job>& source = interactive.empty() || aged ? batch : interactive;
+    // Strictly in order: letting smaller jobs overtake would starve large ones
+    if (!fitsLocked(source.front())) return false;
+
+    job = std::move(source.front());
+    source.pop_front();
+    m_running++;
+    m_admittedMB += job.memoryMB;
+    Metrics::recordJobWait(static_cast<int>(job.priority), chrono::duration<double>(now - job.submitted).count());
+    return true;
+}
+
+void JobQueue::dispatch() {
+    while (true) {
+        Job job;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (!takeLocked(job)) return;
+        }
+        if (!start(job)) execute(job, false);
+    }
+}
+
+bool JobQueue::start(Job& job) {
+    shared_ptr<WorkerPool> pool = WorkerPool::shared();
+    // No workers to hand the job to: the caller runs it
+    if (pool->threadCount() == 0) return false;
+    pool->submit([this, job = std::move(job)]() mutable { execute(job, true); });
+    return true;
+}
+
+void JobQueue::execute(Job& job, bool startNext) {
+    CurrentJob outer = t_job;
+    t_job = {this, job.priority};
+    try {
+        job.run(job.id);
+    } catch (const exception& e) {
+        cerr << "[ERROR] Job " << job.id << " failed: " << e.what() << endl;
+    } catch (...) {
+        cerr << "[ERROR] Job " << job.id << " failed" << endl;
+    }
+    t_job = outer;
+
+    // The next job is taken in the same critical section: once the queue looks
+    // idle, waitIdle() may return and the queue be destroyed
+    Job next;
+    bool haveNext = false;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running--;
+        m_admittedMB = max(0.0, m_admittedMB - job.memoryMB);
+        haveNext = startNext && takeLocked(next);
+        // Also wakes preempted jobs waiting for a slot
+        if (m_preempted > 0 || (queuedLocked() == 0 && m_running == 0)) m_idle.notify_all();
+    }
+    if (haveNext && !start(next)) execute(next, true);
+}
+
+void JobQueue::stageBoundary() {
+    if (t_job.queue && t_job.priority == Priority::Batch) t_job.queue->yieldSlot();
+}
+
+void JobQueue::yieldSlot() {
+    const deque<Job>& interactive = m_queues[static_cast<int>(Priority::Interactive)];
+    {
+        lock_guard<mutex> lock(m_mutex);
+        // Yielding only helps if the slot is what the interactive job lacks; this
+        // job's memory stays admitted while it waits
+        if (!m_preemptBatch || interactive.empty() || static_cast<int>(m_running) < limitLocked() ||
+            (m_memoryBudgetMB > 0.0 && m_admittedMB + interactive.front().memoryMB > m_memoryBudgetMB)) {
+            return;
+        }
+        m_running--;
+        m_preempted++;
+    }
+    Metrics::recordPreemption();
+
+    // Run the waiting interactive jobs on this thread, in the slot just given up:
+    // every pool worker may be inside a job, this one included. Nothing else runs
+    // here (takeLocked() holds batch jobs back while one is preempted, and pool
+    // tasks are left to their graphs). Resume once a slot is free and no interactive
+    // job that would fit is waiting for it; this job's buffers stay allocated meanwhile.
+    CurrentJob self = t_job;
+    while (true) {
+        Job job;
+        bool haveJob = false;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            bool interactiveWaiting = !interactive.empty() && fitsLocked(interactive.front());
+            if (!interactiveWaiting && static_cast<int>(m_running) < limitLocked()) {
+                m_preempted--;
+                m_running++;
+                break;
+            }
+            haveJob = takeLocked(job);
+            // A slot may also free up elsewhere, or another thread may take the job
+            if (!haveJob) m_idle.wait_for(lock, chrono::milliseconds(1));
+        }
+        if (haveJob) execute(job, false);
+    }
+    t_job = self;
+    // Batch jobs held back while this one waited may start if slots remain
+    dispatch();
+}
+
+} // namespace PrintTrace
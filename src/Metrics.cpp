@@ -0,0 +1,442 @@
+#include "Metrics.hpp"
+#include "JobQueue.hpp"
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+const double kBucketSeconds[] = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0};
+const size_t kBucketCount = sizeof(kBucketSeconds) / sizeof(kBucketSeconds[0]);
+
+// Stage names of ImageProcessor's stage timings; anything else is counted as "other"
+const char* const kStageNames[] = {"quality", "load", "lightbox", "normalize", "object",
+                                   "smooth", "dilate", "validate", "debug_output", "other"};
+const size_t kStageCount = sizeof(kStageNames) / sizeof(kStageNames[0]);
+const char* const kPriorityNames[JobQueue::kPriorityCount] = {"interactive", "batch"};
+
+const double kBytesPerMB = 1024.0 * 1024.0;
+
+// PrintTraceResult codes are 0 (success) and small negative numbers
+const int kResultSlots = 32;
+
+// One writer per counter (the owning thread, or the registry lock for the exited
+// total), so a relaxed load + store is enough and no bus-locked increment is needed
+struct Counter {
+    atomic<uint64_t> value{0};
+
+    void add(uint64_t n) { value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed); }
+    uint64_t get() const { return value.load(memory_order_relaxed); }
+};
+
+struct Histogram {
+    Counter buckets[kBucketCount + 1];  // Per bucket, not cumulative; the last one is +Inf
+    Counter count;
+    Counter sumMicros;
+
+    void observe(double seconds) {
+        size_t bucket = 0;
+        while (bucket < kBucketCount && seconds > kBucketSeconds[bucket]) bucket++;
+        buckets[bucket].add(1);
+        count.add(1);
+        sumMicros.add(static_cast<uint64_t>(llround(max(0.0, seconds) * 1e6)));
+    }
+
+    void addTo(Histogram& total) const {
+        for (size_t i = 0; i <= kBucketCount; i++) total.buckets[i].add(buckets[i].get());
+        total.count.add(count.get());
+        total.sumMicros.add(sumMicros.get());
+    }
+};
+
+struct alignas(64) Shard {
+    Counter images[kResultSlots];
+    Histogram imageSeconds;
+    Histogram stageSeconds[kStageCount];
+    Counter cacheHits;
+    Counter poolTasks;
+    Counter poolBusyMicros;
+    Histogram jobWaitSeconds[JobQueue::kPriorityCount];
+    Counter preemptions;
+
+    void addTo(Shard& total) const {
+        for (int i = 0; i < kResultSlots; i++) total.images[i].add(images[i].get());
+        imageSeconds.addTo(total.imageSeconds);
+        for (size_t i = 0; i < kStageCount; i++) stageSeconds[i].addTo(total.stageSeconds[i]);
+        total.cacheHits.add(cacheHits.get());
+        total.poolTasks.add(poolTasks.get());
+        total.poolBusyMicros.add(poolBusyMicros.get());
+        for (int i = 0; i < JobQueue::kPriorityCount; i++) jobWaitSeconds[i].addTo(total.jobWaitSeconds[i]);
+        total.preemptions.add(preemptions.get());
+    }
+};
+
+struct Registry {
+    mutex lock;
+    vector<Shard*> live;
+    Shard exited;
+};
+
+// Never destroyed: pool threads may exit during static destruction
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+struct ShardHandle {
+    Shard* shard = new Shard();
+
+    ShardHandle() {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.live.push_back(shard);
+    }
+
+    ~ShardHandle() {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        shard->addTo(r.exited);
+        r.live.erase(remove(r.live.begin(), r.live.end(), shard), r.live.end());
+        delete shard;
+    }
+};
+
+Shard& localShard() {
+    thread_local ShardHandle handle;
+    return *handle.shard;
+}
+
+void writeHistogram(ostream& out, const string& name, const string& labels, const Histogram& histogram) {
+    string prefix = labels.empty() ? "{" : "{" + labels + ",";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= kBucketCount; i++) {
+        cumulative += histogram.buckets[i].get();
+        out << name << "_bucket" << prefix << "le=\"";
+        if (i < kBucketCount) {
+            out << kBucketSeconds[i];
+        } else {
+            out << "+Inf";
+        }
+        out << "\"} " << cumulative << "\n";
+    }
+    string suffix = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << suffix << " " << histogram.sumMicros.get() / 1e6 << "\n";
+    out << name << "_count" << suffix << " " << histogram.count.get() << "\n";
+}
+
+void writeHeader(ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+// Background HTTP server and textfile writer
+class Exporter {
+public:
+    bool serve(const string& address) {
+        lock_guard<mutex> guard(m_lock);
+        stopServer();
+        if (address.empty()) return true;
+
+        int fd = openListener(address);
+        if (fd < 0) {
+            cerr << "[ERROR] Could not listen for metrics on: " << address << endl;
+            return false;
+        }
+        m_listenFd = fd;
+        m_serverStop = false;
+        m_server = thread([this, fd] { serverLoop(fd); });
+        cout << "[INFO] Serving metrics on " << address << endl;
+        return true;
+    }
+
+    bool writeFile(const string& path, double intervalSeconds) {
+        lock_guard<mutex> guard(m_lock);
+        stopWriter();
+        if (path.empty()) return true;
+        if (!writeSnapshot(path)) {
+            cerr << "[ERROR] Could not write metrics file: " << path << endl;
+            return false;
+        }
+        m_writerStop = false;
+        m_writer = thread([this, path, intervalSeconds] { writerLoop(path, max(intervalSeconds, 0.1)); });
+        return true;
+    }
+
+private:
+    int openListener(const string& address) {
+        if (address.rfind("unix:", 0) == 0) {
+            string path = address.substr(5);
+            sockaddr_un local = {};
+            if (path.empty() || path.size() >= sizeof(local.sun_path)) return -1;
+            local.sun_family = AF_UNIX;
+            strncpy(local.sun_path, path.c_str(), sizeof(local.sun_path) - 1);
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return -1;
+            unlink(path.c_str());
+            if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || listen(fd, 8) != 0) {
+                close(fd);
+                return -1;
+            }
+            m_unixPath = path;
+            return fd;
+        }
+
+        size_t colon = address.rfind(':');
+        if (colon == string::npos) return -1;
+        string host = colon == 0 ? "127.0.0.1" : address.substr(0, colon);
+        string port = address.substr(colon + 1);
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) return -1;
+        int fd = -1;
+        for (addrinfo* candidate = found; candidate && fd < 0; candidate = candidate->ai_next) {
+            fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (fd < 0) continue;
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) != 0 || listen(fd, 8) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        return fd;
+    }
+
+    void serverLoop(int fd) {
+        while (!m_serverStop) {
+            pollfd listener = {fd, POLLIN, 0};
+            if (poll(&listener, 1, 200) <= 0) continue;
+            int client = accept(fd, nullptr, nullptr);
+            if (client < 0) continue;
+            handleClient(client);
+            close(client);
+        }
+    }
+
+    // One request per connection; anything but GET /metrics (or /) gets a 404
+    void handleClient(int client) {
+#ifdef SO_NOSIGPIPE
+        int yes = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+        string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == string::npos && request.size() < 8192) {
+            pollfd readable = {client, POLLIN, 0};
+            if (poll(&readable, 1, 1000) <= 0) return;
+            ssize_t length = recv(client, buffer, sizeof(buffer), 0);
+            if (length <= 0) break;
+            request.append(buffer, static_cast<size_t>(length));
+        }
+
+        bool found = request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0 ||
+                     request.rfind("GET /metrics?", 0) == 0;
+        string body = found ? Metrics::render() : "Not found\n";
+        ostringstream response;
+        response << "HTTP/1.1 " << (found ? "200 OK" : "404 Not Found") << "\r\n"
+                 << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 << "Content-Length: " << body.size() << "\r\n"
+                 << "Connection: close\r\n\r\n"
+                 << body;
+        string text = response.str();
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        for (size_t sent = 0; sent < text.size();) {
+            ssize_t length = send(client, text.data() + sent, text.size() - sent, flags);
+            if (length <= 0) return;
+            sent += static_cast<size_t>(length);
+        }
+    }
+
+    void stopServer() {
+        if (!m_server.joinable()) return;
+        m_serverStop = true;
+        m_server.join();
+        close(m_listenFd);
+        m_listenFd = -1;
+        if (!m_unixPath.empty()) unlink(m_unixPath.c_str());
+        m_unixPath.clear();
+    }
+
+    static bool writeSnapshot(const string& path) {
+        string temp = path + ".tmp";
+        {
+            ofstream file(temp, ios::trunc);
+            if (!file) return false;
+            file << Metrics::render();
+            if (!file) return false;
+        }
+        return rename(temp.c_str(), path.c_str()) == 0;
+    }
+
+    // Rewrites the file every interval and once more when stopped
+    void writerLoop(const string& path, double intervalSeconds) {
+        unique_lock<mutex> lock(m_writerMutex);
+        while (!m_writerStop) {
+            m_writerWake.wait_for(lock, chrono::duration<double>(intervalSeconds), [this] { return m_writerStop; });
+            writeSnapshot(path);
+        }
+    }
+
+    void stopWriter() {
+        if (!m_writer.joinable()) return;
+        {
+            lock_guard<mutex> lock(m_writerMutex);
+            m_writerStop = true;
+        }
+        m_writerWake.notify_all();
+        m_writer.join();
+    }
+
+    mutex m_lock;                       // Serialises serve() and writeFile()
+
+    thread m_server;
+    atomic<bool> m_serverStop{false};
+    int m_listenFd = -1;
+    string m_unixPath;
+
+    thread m_writer;
+    mutex m_writerMutex;
+    condition_variable m_writerWake;
+    bool m_writerStop = false;
+};
+
+// Never destroyed: its threads keep running until the process exits
+Exporter& exporter() {
+    static Exporter* instance = new Exporter();
+    return *instance;
+}
+
+} // namespace
+
+void Metrics::recordImage(int32_t result, double seconds) {
+    Shard& shard = localShard();
+    shard.images[min(max(-result, 0), kResultSlots - 1)].add(1);
+    shard.imageSeconds.observe(seconds);
+}
+
+void Metrics::recordStages(const vector<pair<string, double>>& stageTimingsMs) {
+    Shard& shard = localShard();
+    for (const auto& [name, ms] : stageTimingsMs) {
+        size_t stage = 0;
+        while (stage + 1 < kStageCount && name != kStageNames[stage]) stage++;
+        shard.stageSeconds[stage].observe(ms / 1000.0);
+    }
+}
+
+void Metrics::recordCacheHit() {
+    localShard().cacheHits.add(1);
+}
+
+void Metrics::recordPoolTask(double busySeconds) {
+    Shard& shard = localShard();
+    shard.poolTasks.add(1);
+    shard.poolBusyMicros.add(static_cast<uint64_t>(llround(max(0.0, busySeconds) * 1e6)));
+}
+
+void Metrics::recordJobWait(int priority, double seconds) {
+    localShard().jobWaitSeconds[min(max(priority, 0), JobQueue::kPriorityCount - 1)].observe(seconds);
+}
+
+void Metrics::recordPreemption() {
+    localShard().preemptions.add(1);
+}
+
+string Metrics::render() {
+    Shard total;
+    {
+        Registry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.exited.addTo(total);
+        for (const Shard* shard : r.live) shard->addTo(total);
+    }
+    shared_ptr<WorkerPool> pool = WorkerPool::shared();
+    JobQueue& jobs = JobQueue::shared();
+
+    ostringstream out;
+    out.precision(12);
+    writeHeader(out, "printtrace_images_total", "counter", "Images processed, by PrintTraceResult code (0 = success)");
+    for (int slot = 0; slot < kResultSlots; slot++) {
+        if (slot == 0 || total.images[slot].get() > 0) {
+            out << "printtrace_images_total{code=\"" << -slot << "\"} " << total.images[slot].get() << "\n";
+        }
+    }
+    writeHeader(out, "printtrace_image_duration_seconds", "histogram", "Processing time per image");
+    writeHistogram(out, "printtrace_image_duration_seconds", "", total.imageSeconds);
+    writeHeader(out, "printtrace_stage_duration_seconds", "histogram", "Processing time per pipeline stage");
+    for (size_t stage = 0; stage < kStageCount; stage++) {
+        if (total.stageSeconds[stage].count.get() == 0) continue;
+        writeHistogram(out, "printtrace_stage_duration_seconds", string("stage=\"") + kStageNames[stage] + "\"",
+                       total.stageSeconds[stage]);
+    }
+    writeHeader(out, "printtrace_result_cache_hits_total", "counter", "Images answered from the result cache");
+    out << "printtrace_result_cache_hits_total " << total.cacheHits.get() << "\n";
+
+    writeHeader(out, "printtrace_jobs_queued", "gauge", "Asynchronous jobs waiting to start, by priority");
+    for (int priority = 0; priority < JobQueue::kPriorityCount; priority++) {
+        out << "printtrace_jobs_queued{priority=\"" << kPriorityNames[priority] << "\"} "
+            << jobs.queued(static_cast<JobQueue::Priority>(priority)) << "\n";
+    }
+    writeHeader(out, "printtrace_jobs_running", "gauge", "Asynchronous jobs running");
+    out << "printtrace_jobs_running " << jobs.running() << "\n";
+    writeHeader(out, "printtrace_jobs_preempted", "gauge", "Batch jobs paused at a stage boundary for interactive work");
+    out << "printtrace_jobs_preempted " << jobs.preempted() << "\n";
+    writeHeader(out, "printtrace_jobs_memory_bytes", "gauge", "Estimated peak memory of running and preempted jobs");
+    out << "printtrace_jobs_memory_bytes " << jobs.admittedMemory() * kBytesPerMB << "\n";
+    writeHeader(out, "printtrace_jobs_memory_budget_bytes", "gauge", "Admission budget for job memory (0 = unlimited)");
+    out << "printtrace_jobs_memory_budget_bytes " << jobs.memoryBudget() * kBytesPerMB << "\n";
+    writeHeader(out, "printtrace_job_queue_seconds", "histogram", "Time jobs waited in the queue before starting");
+    for (int priority = 0; priority < JobQueue::kPriorityCount; priority++) {
+        writeHistogram(out, "printtrace_job_queue_seconds", string("priority=\"") + kPriorityNames[priority] + "\"",
+                       total.jobWaitSeconds[priority]);
+    }
+    writeHeader(out, "printtrace_job_preemptions_total", "counter", "Times a batch job yielded its slot");
+    out << "printtrace_job_preemptions_total " << total.preemptions.get() << "\n";
+
+    writeHeader(out, "printtrace_pool_threads", "gauge", "Worker pool threads");
+    out << "printtrace_pool_threads " << pool->threadCount() << "\n";
+    writeHeader(out, "printtrace_pool_queued_tasks", "gauge", "Worker pool tasks waiting for a thread");
+    out << "printtrace_pool_queued_tasks " << pool->queuedTasks() << "\n";
+    writeHeader(out, "printtrace_pool_tasks_total", "counter", "Tasks started by worker pool threads");
+    out << "printtrace_pool_tasks_total " << total.poolTasks.get() << "\n";
+    writeHeader(out, "printtrace_pool_busy_seconds_total", "counter",
+                "Time spent running pool tasks; divide its rate by printtrace_pool_threads for utilisation");
+    out << "printtrace_pool_busy_seconds_total " << total.poolBusyMicros.get() / 1e6 << "\n";
+    return out.str();
+}
+
+bool Metrics::serve(const string& address) {
+    return exporter().serve(address);
+}
+
+bool Metrics::writeFilePeriodically(const string& path, double intervalSeconds) {
+    return exporter().writeFile(path, intervalSeconds);
+}
+
+} // namespace PrintTrace
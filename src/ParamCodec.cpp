@@ -0,0 +1,240 @@
+#include "ParamCodec.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+enum class FieldKind { Int32, Double, Bool };
+
+struct Field {
+    const char* name;
+    FieldKind kind;
+    size_t offset;
+};
+
+#define PRINT_TRACE_FIELD(name, kind) { #name, FieldKind::kind, offsetof(PrintTraceParams, name) }
+
+// Every PrintTraceParams field, grouped with the related ones rather than in struct
+// order (offsets come from offsetof). encode() and names() follow this order.
+const Field kFields[] = {
+    PRINT_TRACE_FIELD(lightbox_width_px, Int32),
+    PRINT_TRACE_FIELD(lightbox_height_px, Int32),
+    PRINT_TRACE_FIELD(lightbox_width_mm, Double),
+    PRINT_TRACE_FIELD(lightbox_height_mm, Double),
+    PRINT_TRACE_FIELD(pixels_per_mm, Double),
+    PRINT_TRACE_FIELD(canny_lower, Double),
+    PRINT_TRACE_FIELD(canny_upper, Double),
+    PRINT_TRACE_FIELD(canny_aperture, Int32),
+    PRINT_TRACE_FIELD(clahe_clip_limit, Double),
+    PRINT_TRACE_FIELD(clahe_tile_size, Int32),
+    PRINT_TRACE_FIELD(use_adaptive_threshold, Bool),
+    PRINT_TRACE_FIELD(manual_threshold, Double),
+    PRINT_TRACE_FIELD(threshold_offset, Double),
+    PRINT_TRACE_FIELD(auto_threshold, Bool),
+    PRINT_TRACE_FIELD(disable_morphology, Bool),
+    PRINT_TRACE_FIELD(morph_kernel_size, Int32),
+    PRINT_TRACE_FIELD(merge_nearby_contours, Bool),
+    PRINT_TRACE_FIELD(contour_merge_distance_mm, Double),
+    PRINT_TRACE_FIELD(min_contour_area, Double),
+    PRINT_TRACE_FIELD(min_solidity, Double),
+    PRINT_TRACE_FIELD(max_aspect_ratio, Double),
+    PRINT_TRACE_FIELD(polygon_epsilon_factor, Double),
+    PRINT_TRACE_FIELD(enable_subpixel_refinement, Bool),
+    PRINT_TRACE_FIELD(corner_win_size, Int32),
+    PRINT_TRACE_FIELD(corner_detection_mode, Int32),
+    PRINT_TRACE_FIELD(corner_min_confidence, Double),
+    PRINT_TRACE_FIELD(enable_quality_gate, Bool),
+    PRINT_TRACE_FIELD(min_sharpness, Double),
+    PRINT_TRACE_FIELD(tile_memory_limit_mb, Int32),
+    PRINT_TRACE_FIELD(max_memory_mb, Int32),
+    PRINT_TRACE_FIELD(target_tolerance_mm, Double),
+    PRINT_TRACE_FIELD(validate_closed_contour, Bool),
+    PRINT_TRACE_FIELD(min_perimeter, Double),
+    PRINT_TRACE_FIELD(repair_self_intersections, Bool),
+    PRINT_TRACE_FIELD(dilation_amount_mm, Double),
+    PRINT_TRACE_FIELD(enable_smoothing, Bool),
+    PRINT_TRACE_FIELD(smoothing_amount_mm, Double),
+    PRINT_TRACE_FIELD(smoothing_mode, Int32),
+    PRINT_TRACE_FIELD(enable_inpainting, Bool),
+    PRINT_TRACE_FIELD(enable_debug_output, Bool),
+};
+
+#undef PRINT_TRACE_FIELD
+
+const Field* findField(const string& name) {
+    for (const auto& field : kFields) {
+        if (name == field.name) return &field;
+    }
+    return nullptr;
+}
+
+string formatField(const PrintTraceParams& params, const Field& field) {
+    const char* base = reinterpret_cast<const char*>(&params) + field.offset;
+    char buffer[64];
+    switch (field.kind) {
+        case FieldKind::Int32: {
+            int32_t value;
+            memcpy(&value, base, sizeof(value));
+            snprintf(buffer, sizeof(buffer), "%d", value);
+            break;
+        }
+        case FieldKind::Double: {
+            double value;
+            memcpy(&value, base, sizeof(value));
+            snprintf(buffer, sizeof(buffer), "%.17g", value);   // Round-trip exact
+            break;
+        }
+        case FieldKind::Bool: {
+            bool value;
+            memcpy(&value, base, sizeof(value));
+            snprintf(buffer, sizeof(buffer), "%s", value ? "true" : "false");
+            break;
+        }
+    }
+    return buffer;
+}
+
+} // namespace
+
+string ParamCodec::encode(const PrintTraceParams& params) {
+    string text;
+    for (const auto& field : kFields) {
+        text += field.name;
+        text += '=';
+        text += formatField(params, field);
+        text += '\n';
+    }
+    return text;
+}
+
+bool ParamCodec::decode(const string& text, PrintTraceParams& params, string* error) {
+    print_trace_get_default_params(&params);
+    istringstream lines(text);
+    string line;
+    while (getline(lines, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t eq = line.find('=');
+        if (eq == string::npos || !set(params, line.substr(0, eq), line.substr(eq + 1))) {
+            if (error) *error = "Invalid parameter line: " + line;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParamCodec::set(PrintTraceParams& params, const string& name, const string& value) {
+    const Field* field = findField(name);
+    if (!field || value.empty()) return false;
+
+    char* base = reinterpret_cast<char*>(&params) + field->offset;
+    char* end = nullptr;
+    switch (field->kind) {
+        case FieldKind::Int32: {
+            long parsed = strtol(value.c_str(), &end, 10);
+            if (*end != '\0') return false;
+            int32_t v = static_cast<int32_t>(parsed);
+            memcpy(base, &v, sizeof(v));
+            return true;
+        }
+        case FieldKind::Double: {
+            double v = strtod(value.c_str(), &end);
+            if (*end != '\0') return false;
+            memcpy(base, &v, sizeof(v));
+            return true;
+        }
+        case FieldKind::Bool: {
+            bool v;
+            if (value == "true" || value == "1") v = true;
+            else if (value == "false" || value == "0") v = false;
+            else return false;
+            memcpy(base, &v, sizeof(v));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParamCodec::get(const PrintTraceParams& params, const string& name, string& value) {
+    const Field* field = findField(name);
+    if (!field) return false;
+    value = formatField(params, *field);
+    return true;
+}
+
+vector<string> ParamCodec::names() {
+    vector<string> result;
+    for (const auto& field : kFields) result.push_back(field.name);
+    return result;
+}
+
+ImageProcessor::ProcessingParams ParamCodec::toProcessingParams(const PrintTraceParams* params) {
+    ImageProcessor::ProcessingParams cpp_params;
+    if (params) {
+        // Convert lightbox dimensions to Size and scaling
+        cpp_params.lightboxWidthPx = params->lightbox_width_px;
+        cpp_params.lightboxHeightPx = params->lightbox_height_px;
+        cpp_params.lightboxWidthMM = params->lightbox_width_mm;
+        cpp_params.lightboxHeightMM = params->lightbox_height_mm;
+
+        // New CAD-optimized parameters
+        cpp_params.cannyLower = params->canny_lower;
+        cpp_params.cannyUpper = params->canny_upper;
+        cpp_params.cannyAperture = params->canny_aperture;
+
+        cpp_params.claheClipLimit = params->clahe_clip_limit;
+        cpp_params.claheTileSize = params->clahe_tile_size;
+
+        cpp_params.useAdaptiveThreshold = params->use_adaptive_threshold;
+        cpp_params.manualThreshold = params->manual_threshold;
+        cpp_params.thresholdOffset = params->threshold_offset;
+        cpp_params.autoThreshold = params->auto_threshold;
+
+        cpp_params.disableMorphology = params->disable_morphology;
+        cpp_params.morphKernelSize = params->morph_kernel_size;
+
+        cpp_params.mergeNearbyContours = params->merge_nearby_contours;
+        cpp_params.contourMergeDistanceMM = params->contour_merge_distance_mm;
+
+        cpp_params.minContourArea = params->min_contour_area;
+        cpp_params.minSolidity = params->min_solidity;
+        cpp_params.maxAspectRatio = params->max_aspect_ratio;
+
+        cpp_params.polygonEpsilonFactor = params->polygon_epsilon_factor;
+
+        cpp_params.enableSubPixelRefinement = params->enable_subpixel_refinement;
+        cpp_params.cornerWinSize = params->corner_win_size;
+        cpp_params.cornerDetectionMode = params->corner_detection_mode;
+        cpp_params.cornerMinConfidence = params->corner_min_confidence;
+
+        cpp_params.enableQualityGate = params->enable_quality_gate;
+        cpp_params.minSharpness = params->min_sharpness;
+
+        cpp_params.tileMemoryLimitMB = params->tile_memory_limit_mb;
+        cpp_params.maxMemoryMB = params->max_memory_mb;
+        cpp_params.targetToleranceMM = params->target_tolerance_mm;
+
+        cpp_params.validateClosedContour = params->validate_closed_contour;
+        cpp_params.minPerimeter = params->min_perimeter;
+        cpp_params.repairSelfIntersections = params->repair_self_intersections;
+
+        cpp_params.dilationAmountMM = params->dilation_amount_mm;
+
+        cpp_params.enableSmoothing = params->enable_smoothing;
+        cpp_params.smoothingAmountMM = params->smoothing_amount_mm;
+        cpp_params.smoothingMode = params->smoothing_mode;
+
+        cpp_params.enableInpainting = params->enable_inpainting;
+
+        cpp_params.enableDebugOutput = params->enable_debug_output;
+    }
+    return cpp_params;
+}
+
+} // namespace PrintTrace
@@ -0,0 +1,220 @@
+#include "ParameterSweep.hpp"
+#include "ParamCodec.hpp"
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <thread>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+// Shared prefix: stages 0-1 for one lightbox signature
+struct LightboxNode {
+    size_t firstRun;                        // Any run in this node supplies the parameters
+    ImageProcessor::LightboxStage lightbox;
+    string error;
+    double elapsedMs = 0.0;
+};
+
+// Shared prefix: stages 2-4 for one set of detection parameters
+struct ObjectNode {
+    size_t firstRun;
+    size_t lightboxNode;
+    vector<Point> objectContour;
+    string error;
+    double elapsedMs = 0.0;
+};
+
+// Fields only stages 5-7 read; everything else is treated as affecting detection
+const char* const kFinishFields[] = {
+    "enable_smoothing",
+    "smoothing_amount_mm",
+    "smoothing_mode",
+    "dilation_amount_mm",
+    "validate_closed_contour",
+    "min_perimeter",
+    "repair_self_intersections",
+    "enable_debug_output",
+};
+
+string objectSignature(const PrintTraceParams& params) {
+    PrintTraceParams defaults;
+    print_trace_get_default_params(&defaults);
+    PrintTraceParams masked = params;
+    for (const char* name : kFinishFields) {
+        string value;
+        if (ParamCodec::get(defaults, name, value)) ParamCodec::set(masked, name, value);
+    }
+    return ParamCodec::encode(masked);
+}
+
+double elapsedSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+bool ParameterSweep::expand(const PrintTraceParams& base, const vector<Axis>& axes,
+                            vector<PrintTraceParams>& combinations, string* error) {
+    combinations.assign(1, base);
+    for (const auto& axis : axes) {
+        if (axis.values.empty()) {
+            if (error) *error = "Sweep axis has no values: " + axis.name;
+            return false;
+        }
+        vector<PrintTraceParams> next;
+        next.reserve(combinations.size() * axis.values.size());
+        for (const auto& params : combinations) {
+            for (const auto& value : axis.values) {
+                PrintTraceParams combination = params;
+                if (!ParamCodec::set(combination, axis.name, value)) {
+                    if (error) *error = "Invalid sweep value " + axis.name + "=" + value;
+                    return false;
+                }
+                next.push_back(combination);
+            }
+        }
+        combinations = std::move(next);
+    }
+    return true;
+}
+
+bool ParameterSweep::run(const string& inputPath, const PrintTraceParams& base, const vector<Axis>& axes,
+                         int threads, vector<Run>& runs, Stats* stats, string* error) {
+    auto sweepStart = chrono::steady_clock::now();
+    if (threads <= 0) threads = static_cast<int>(max(1u, thread::hardware_concurrency()));
+
+    vector<PrintTraceParams> combinations;
+    if (!expand(base, axes, combinations, error)) return false;
+
+    runs.assign(combinations.size(), Run());
+    vector<ImageProcessor::ProcessingParams> cppParams(combinations.size());
+    vector<size_t> objectOf(combinations.size(), SIZE_MAX);
+    vector<LightboxNode> lightboxNodes;
+    vector<ObjectNode> objectNodes;
+    map<string, size_t> lightboxIndex;
+    map<string, size_t> objectIndex;
+
+    // Build the prefix tree; invalid combinations never enter it
+    for (size_t i = 0; i < combinations.size(); i++) {
+        Run& run = runs[i];
+        run.params = combinations[i];
+        run.params.enable_debug_output = false;
+        run.resultCode = print_trace_validate_params(&run.params);
+        if (run.resultCode != PRINT_TRACE_SUCCESS) continue;
+
+        cppParams[i] = ParamCodec::toProcessingParams(&run.params);
+        // Same decode scale and warp as a single run of this combination would use
+        if (!ImageProcessor::resolveForImage(inputPath, cppParams[i]).fits) {
+            run.resultCode = PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+            continue;
+        }
+        run.pixelsPerMM = (static_cast<double>(cppParams[i].lightboxWidthPx) / cppParams[i].lightboxWidthMM +
+                           static_cast<double>(cppParams[i].lightboxHeightPx) / cppParams[i].lightboxHeightMM) / 2.0;
+
+        string lightboxKey = ImageProcessor::lightboxStageSignature(cppParams[i]);
+        auto lightboxIt = lightboxIndex.find(lightboxKey);
+        if (lightboxIt == lightboxIndex.end()) {
+            lightboxIt = lightboxIndex.emplace(lightboxKey, lightboxNodes.size()).first;
+            lightboxNodes.push_back({i, {}, {}, 0.0});
+        }
+
+        string objectKey = lightboxKey + objectSignature(run.params);
+        auto objectIt = objectIndex.find(objectKey);
+        if (objectIt == objectIndex.end()) {
+            objectIt = objectIndex.emplace(objectKey, objectNodes.size()).first;
+            objectNodes.push_back({i, lightboxIt->second, {}, {}, 0.0});
+        }
+        objectOf[i] = objectIt->second;
+    }
+
+    cout << "[INFO] Sweep: " << combinations.size() << " combinations -> " << lightboxNodes.size()
+         << " lightbox, " << objectNodes.size() << " object detection runs on " << threads << " threads" << endl;
+
+    // Level 1: decode, boundary, warp
+    parallelFor(lightboxNodes.size(), threads, [&](size_t n) {
+        LightboxNode& node = lightboxNodes[n];
+        ImageProcessor::ProcessingParams params = cppParams[node.firstRun];
+        auto start = chrono::steady_clock::now();
+        try {
+            ImageProcessor::processImageToStage(inputPath, params, 1, &node.lightbox);
+        } catch (const exception& e) {
+            node.error = e.what();
+        }
+        node.elapsedMs = elapsedSince(start);
+    });
+
+    // Level 2: object detection fan-out
+    parallelFor(objectNodes.size(), threads, [&](size_t n) {
+        ObjectNode& node = objectNodes[n];
+        const LightboxNode& parent = lightboxNodes[node.lightboxNode];
+        if (!parent.error.empty()) {
+            node.error = parent.error;
+            return;
+        }
+        ImageProcessor::ProcessingParams params = cppParams[node.firstRun];
+        auto start = chrono::steady_clock::now();
+        try {
+            node.objectContour = ImageProcessor::processFromLightbox(parent.lightbox, params, 4).second;
+        } catch (const exception& e) {
+            node.error = e.what();
+        }
+        node.elapsedMs = elapsedSince(start);
+    });
+
+    // Level 3: smoothing / dilation / validation fan-out
+    parallelFor(runs.size(), threads, [&](size_t i) {
+        Run& run = runs[i];
+        if (objectOf[i] == SIZE_MAX) return;
+        const ObjectNode& node = objectNodes[objectOf[i]];
+        const LightboxNode& parent = lightboxNodes[node.lightboxNode];
+        run.elapsedMs = parent.elapsedMs + node.elapsedMs;
+        if (parent.lightbox.pixelsPerMM > 0.0) {
+            run.pixelsPerMM = parent.lightbox.pixelsPerMM;  // Tolerance-sized warps differ from the params
+        }
+        if (!node.error.empty()) {
+            run.resultCode = PRINT_TRACE_ERROR_PROCESSING_FAILED;
+            run.error = node.error;
+            return;
+        }
+
+        auto start = chrono::steady_clock::now();
+        try {
+            run.contour = ImageProcessor::processFromObjectContour(parent.lightbox, node.objectContour, cppParams[i], 7);
+            run.resultCode = PRINT_TRACE_SUCCESS;
+        } catch (const exception& e) {
+            run.resultCode = PRINT_TRACE_ERROR_PROCESSING_FAILED;
+            run.error = e.what();
+        }
+        run.elapsedMs += elapsedSince(start);
+
+        if (run.contour.size() >= 3 && run.pixelsPerMM > 0.0) {
+            double ppm2 = run.pixelsPerMM * run.pixelsPerMM;
+            double area = contourArea(run.contour);
+            vector<Point> hull;
+            convexHull(run.contour, hull);
+            double hullArea = contourArea(hull);
+            run.areaMM2 = area / ppm2;
+            run.perimeterMM = arcLength(run.contour, true) / run.pixelsPerMM;
+            run.solidity = hullArea > 0.0 ? area / hullArea : 0.0;
+        }
+    });
+
+    if (stats) {
+        stats->combinations = combinations.size();
+        stats->lightboxRuns = lightboxNodes.size();
+        stats->objectRuns = objectNodes.size();
+        stats->finishRuns = count_if(objectOf.begin(), objectOf.end(), [](size_t n) { return n != SIZE_MAX; });
+        stats->wallMs = elapsedSince(sweepStart);
+    }
+    return true;
+}
+
+} // namespace PrintTrace
@@ -1,69 +1,31 @@
 #include "PrintTraceAPI.h"
 #include "ImageProcessor.hpp"
 #include "DXFWriter.hpp"
+#include "ParamCodec.hpp"
+#include "RunRecorder.hpp"
+#include "ResultCache.hpp"
+#include "StageSnapshot.hpp"
+#include "ParameterSweep.hpp"
+#include "WorkerPool.hpp"
+#include "JobQueue.hpp"
+#include "Metrics.hpp"
+#include "TimeEstimator.hpp"
 #include <iostream>
 #include <fstream>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <mutex>
+#include <thread>
 
 using namespace PrintTrace;
 
 // Internal helper functions
 namespace {
     
-    // Convert C parameters to C++ parameters
-    ImageProcessor::ProcessingParams convertParams(const PrintTraceParams* params) {
-        ImageProcessor::ProcessingParams cpp_params;
-        if (params) {
-            // Convert lightbox dimensions to Size and scaling
-            cpp_params.lightboxWidthPx = params->lightbox_width_px;
-            cpp_params.lightboxHeightPx = params->lightbox_height_px;
-            cpp_params.lightboxWidthMM = params->lightbox_width_mm;
-            cpp_params.lightboxHeightMM = params->lightbox_height_mm;
-            
-            // New CAD-optimized parameters
-            cpp_params.cannyLower = params->canny_lower;
-            cpp_params.cannyUpper = params->canny_upper;
-            cpp_params.cannyAperture = params->canny_aperture;
-            
-            cpp_params.claheClipLimit = params->clahe_clip_limit;
-            cpp_params.claheTileSize = params->clahe_tile_size;
-            
-            cpp_params.useAdaptiveThreshold = params->use_adaptive_threshold;
-            cpp_params.manualThreshold = params->manual_threshold;
-            cpp_params.thresholdOffset = params->threshold_offset;
-            
-            cpp_params.disableMorphology = params->disable_morphology;
-            cpp_params.morphKernelSize = params->morph_kernel_size;
-            
-            cpp_params.mergeNearbyContours = params->merge_nearby_contours;
-            cpp_params.contourMergeDistanceMM = params->contour_merge_distance_mm;
-            
-            cpp_params.minContourArea = params->min_contour_area;
-            cpp_params.minSolidity = params->min_solidity;
-            cpp_params.maxAspectRatio = params->max_aspect_ratio;
-            
-            cpp_params.polygonEpsilonFactor = params->polygon_epsilon_factor;
-            
-            cpp_params.enableSubPixelRefinement = params->enable_subpixel_refinement;
-            cpp_params.cornerWinSize = params->corner_win_size;
-            
-            cpp_params.validateClosedContour = params->validate_closed_contour;
-            cpp_params.minPerimeter = params->min_perimeter;
-            
-            cpp_params.dilationAmountMM = params->dilation_amount_mm;
-            
-            cpp_params.enableSmoothing = params->enable_smoothing;
-            cpp_params.smoothingAmountMM = params->smoothing_amount_mm;
-            cpp_params.smoothingMode = params->smoothing_mode;
-            
-            cpp_params.enableInpainting = params->enable_inpainting;
-            
-            cpp_params.enableDebugOutput = params->enable_debug_output;
-        }
-        return cpp_params;
-    }
-    
     // Convert C++ contour to C contour
     void convertContour(const std::vector<cv::Point>& cpp_contour, double pixels_per_mm, PrintTraceContour* c_contour) {
         c_contour->point_count = static_cast<int32_t>(cpp_contour.size());
@@ -138,6 +100,12 @@ namespace {
             return PRINT_TRACE_ERROR_NO_BOUNDARY;
         } else if (what.find("No contours found for the object") != std::string::npos) {
             return PRINT_TRACE_ERROR_NO_OBJECT;
+        } else if (what.find("too blurry") != std::string::npos) {
+            return PRINT_TRACE_ERROR_IMAGE_BLURRY;
+        } else if (what.find("badly exposed") != std::string::npos) {
+            return PRINT_TRACE_ERROR_IMAGE_BAD_EXPOSURE;
+        } else if (what.find("No lightbox visible") != std::string::npos) {
+            return PRINT_TRACE_ERROR_NO_LIGHTBOX;
         }
         
         return PRINT_TRACE_ERROR_PROCESSING_FAILED;
@@ -176,6 +144,7 @@ void print_trace_get_default_params(PrintTraceParams* params) {
     params->use_adaptive_threshold = false;
     params->manual_threshold = 0.0;        // 0 = automatic
     params->threshold_offset = 0.0;        // No offset from auto threshold
+    params->auto_threshold = false;        // Opt-in candidate scoring
     
     // Morphological processing parameters
     params->disable_morphology = false;    // Enable morphological cleaning by default
@@ -197,9 +166,25 @@ void print_trace_get_default_params(PrintTraceParams* params) {
     params->enable_subpixel_refinement = true;
     params->corner_win_size = 5;
     
+    // Corner detection settings
+    params->corner_detection_mode = 0;
+    params->corner_min_confidence = 0.8;
+    
+    // Quality gate (opt-in)
+    params->enable_quality_gate = false;
+    params->min_sharpness = 10.0;
+    
+    // Whole-frame lightbox detection
+    params->tile_memory_limit_mb = 0;
+    params->max_memory_mb = 0;
+    
+    // Fixed warp size unless a tolerance is given
+    params->target_tolerance_mm = 0.0;
+    
     // Validation settings
     params->validate_closed_contour = true;
     params->min_perimeter = 100.0;
+    params->repair_self_intersections = true;
     
     // Tolerance/dilation settings
     params->dilation_amount_mm = 0.0;
@@ -272,6 +257,24 @@ void print_trace_get_param_ranges(PrintTraceParamRanges* ranges) {
     ranges->corner_win_size_min = 3;
     ranges->corner_win_size_max = 15;
     
+    // Corner detection ranges
+    ranges->corner_detection_mode_min = 0;
+    ranges->corner_detection_mode_max = 2;
+    ranges->corner_min_confidence_min = 0.0;
+    ranges->corner_min_confidence_max = 1.0;
+    
+    // Quality gate ranges
+    ranges->min_sharpness_min = 0.0;
+    ranges->min_sharpness_max = 200.0;
+    
+    // Large-image ranges
+    ranges->tile_memory_limit_mb_min = 0;
+    ranges->tile_memory_limit_mb_max = 4096;
+    ranges->max_memory_mb_min = 0;
+    ranges->max_memory_mb_max = 65536;
+    ranges->target_tolerance_mm_min = 0.0;
+    ranges->target_tolerance_mm_max = 5.0;
+    
     // Validation ranges
     ranges->min_perimeter_min = 50.0;
     ranges->min_perimeter_max = 2000.0;
@@ -394,6 +397,39 @@ PrintTraceResult print_trace_validate_params(const PrintTraceParams* params) {
         return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
     }
     
+    // Corner detection
+    if (params->corner_detection_mode < ranges.corner_detection_mode_min || 
+        params->corner_detection_mode > ranges.corner_detection_mode_max) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    
+    if (params->corner_min_confidence < ranges.corner_min_confidence_min || 
+        params->corner_min_confidence > ranges.corner_min_confidence_max) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    
+    // Quality gate
+    if (params->min_sharpness < ranges.min_sharpness_min || 
+        params->min_sharpness > ranges.min_sharpness_max) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    
+    // Large-image memory bound
+    if (params->tile_memory_limit_mb < ranges.tile_memory_limit_mb_min || 
+        params->tile_memory_limit_mb > ranges.tile_memory_limit_mb_max) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    
+    if (params->max_memory_mb < ranges.max_memory_mb_min || 
+        params->max_memory_mb > ranges.max_memory_mb_max) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    
+    if (params->target_tolerance_mm < ranges.target_tolerance_mm_min || 
+        params->target_tolerance_mm > ranges.target_tolerance_mm_max) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    
     // Validation parameters
     if (params->min_perimeter < ranges.min_perimeter_min || 
         params->min_perimeter > ranges.min_perimeter_max) {
@@ -420,6 +456,276 @@ PrintTraceResult print_trace_validate_params(const PrintTraceParams* params) {
     return PRINT_TRACE_SUCCESS;
 }
 
+PrintTraceResult print_trace_set_param(PrintTraceParams* params, const char* name, const char* value) {
+    if (!params || !name || !value) return PRINT_TRACE_ERROR_INVALID_INPUT;
+    return ParamCodec::set(*params, name, value) ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+}
+
+PrintTraceResult print_trace_plan_memory(
+    const char* input_path,
+    const PrintTraceParams* params,
+    PrintTraceMemoryPlan* plan
+) {
+    if (!input_path || !plan) return PRINT_TRACE_ERROR_INVALID_INPUT;
+    
+    PrintTraceParams default_params;
+    if (!params) {
+        print_trace_get_default_params(&default_params);
+        params = &default_params;
+    }
+    PrintTraceResult validation_result = print_trace_validate_params(params);
+    if (validation_result != PRINT_TRACE_SUCCESS) return validation_result;
+    
+    ImageProcessor::MemoryPlan cpp_plan = ImageProcessor::planMemory(input_path, ParamCodec::toProcessingParams(params));
+    plan->source_width = cpp_plan.sourceSize.width;
+    plan->source_height = cpp_plan.sourceSize.height;
+    plan->decode_reduction = cpp_plan.decodeReduction;
+    plan->lightbox_width_px = cpp_plan.warpSize.width;
+    plan->lightbox_height_px = cpp_plan.warpSize.height;
+    plan->estimated_peak_mb = cpp_plan.peakMB;
+    plan->fits = cpp_plan.fits;
+    return cpp_plan.fits ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+}
+
+namespace {
+    
+    // Shared body of the processing entry points. result_image may be null when the
+    // caller only needs the contour, which lets result cache hits skip decoding the
+    // cached warped image. cache_key receives the result cache key when the run was
+    // eligible for caching.
+    PrintTraceResult runPipelineStages(
+        const char* input_path,
+        const PrintTraceParams* params,
+        PrintTraceProcessingStage target_stage,
+        PrintTraceImageData* result_image,
+        PrintTraceContour* contour,
+        PrintTraceProgressCallback progress_callback,
+        PrintTraceErrorCallback error_callback,
+        void* user_data,
+        std::string* cache_key
+    ) {
+        // Initialize outputs
+        if (result_image) {
+            result_image->data = nullptr;
+            result_image->width = 0;
+            result_image->height = 0;
+            result_image->channels = 0;
+            result_image->bytes_per_row = 0;
+        }
+        
+        if (contour) {
+            contour->points = nullptr;
+            contour->point_count = 0;
+            contour->pixels_per_mm = 0.0;
+        }
+        
+        // Check file exists
+        std::ifstream file(input_path);
+        if (!file.good()) {
+            if (error_callback) {
+                error_callback(PRINT_TRACE_ERROR_FILE_NOT_FOUND, "Input file not found or not readable", user_data);
+            }
+            return PRINT_TRACE_ERROR_FILE_NOT_FOUND;
+        }
+        
+        // Validate parameters
+        PrintTraceParams default_params;
+        if (!params) {
+            print_trace_get_default_params(&default_params);
+            params = &default_params;
+        }
+        
+        PrintTraceResult validation_result = print_trace_validate_params(params);
+        if (validation_result != PRINT_TRACE_SUCCESS) {
+            if (error_callback) {
+                error_callback(validation_result, "Invalid processing parameters", user_data);
+            }
+            return validation_result;
+        }
+        
+        // Convert parameters
+        ImageProcessor::ProcessingParams cpp_params = ParamCodec::toProcessingParams(params);
+        // Lets a queued batch job give way to interactive work between stages
+        cpp_params.onStageBoundary = [](const char*) { JobQueue::stageBoundary(); };
+        
+        // Declared ahead of the try so a failure anywhere below is still recorded
+        bool recording = false;
+        bool caching = false;
+        bool snapshotting = false;
+        bool timing_known = false;
+        TimeEstimator::Features features;
+        RunRecorder::Record record;
+        auto run_start = std::chrono::steady_clock::now();
+        ImageProcessor::LightboxStage lightbox;
+        auto finishRun = [&](PrintTraceResult code) {
+            Metrics::recordStages(cpp_params.stageTimingsMs);
+            if (timing_known) {
+                // Tolerance mode picks the warp during stage 1
+                if (!lightbox.warped.empty()) features.warpMP = lightbox.warped.total() / 1e6;
+                TimeEstimator::record(features, cpp_params.stageTimingsMs);
+            }
+            if (!recording) return;
+            record.resultCode = static_cast<int32_t>(code);
+            record.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - run_start).count();
+            record.stageTimingsMs = cpp_params.stageTimingsMs;
+            RunRecorder::write(record);
+        };
+        
+        try {
+            // Fit decode and warp resolution to the memory budget before anything is keyed on them
+            ImageProcessor::MemoryPlan plan = ImageProcessor::resolveForImage(input_path, cpp_params);
+            if (!plan.fits) {
+                if (error_callback) {
+                    error_callback(PRINT_TRACE_ERROR_INVALID_PARAMETERS, "Memory budget too small for this image", user_data);
+                }
+                return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+            }
+            
+            // Only complete, debug-free runs are cached: intermediate stages are cheap to
+            // reach from a cached warp anyway, and debug runs exist for their side effects
+            recording = RunRecorder::enabled();
+            caching = ResultCache::enabled() && target_stage == PRINT_TRACE_STAGE_FINAL && !params->enable_debug_output;
+            snapshotting = StageSnapshot::enabled() && target_stage >= PRINT_TRACE_STAGE_LIGHTBOX_CROPPED &&
+                           !params->enable_debug_output;
+            std::vector<uchar> input_bytes;
+            if ((recording || caching || snapshotting) && !RunRecorder::readInputFile(input_path, input_bytes)) {
+                recording = false;
+                caching = false;
+                snapshotting = false;
+            }
+            std::string snapshot_key;
+            if (snapshotting) {
+                snapshot_key = StageSnapshot::makeKey(
+                    input_bytes, ImageProcessor::lightboxStageSignature(cpp_params) + print_trace_get_version());
+            }
+            
+            std::string key;
+            if (caching) {
+                key = ResultCache::makeKey(input_bytes, ParamCodec::encode(*params) + print_trace_get_version());
+                if (cache_key) *cache_key = key;
+            
+                ResultCache::Entry entry;
+                if (ResultCache::lookup(key, entry)) {
+                    cv::Mat warped = result_image ? ResultCache::loadWarped(entry) : cv::Mat();
+                    if (!result_image || !warped.empty()) {
+                        if (result_image) {
+                            convertMatToImageData(warped, result_image);
+                        }
+                        if (contour && !entry.contour.empty()) {
+                            convertContour(entry.contour, entry.pixelsPerMM, contour);
+                        }
+                        std::cout << "[INFO] Result cache hit: " << key << std::endl;
+                        Metrics::recordCacheHit();
+                        reportProgress(progress_callback, 1.0, "Loaded from result cache", user_data);
+                        return PRINT_TRACE_SUCCESS;
+                    }
+                }
+            }
+            
+            // Optional run recording: the archive holds the input bytes exactly as processed
+            if (recording) {
+                record.libraryVersion = print_trace_get_version();
+                record.inputName = std::filesystem::path(input_path).filename().string();
+                record.params = ParamCodec::encode(*params);
+                record.targetStage = static_cast<int32_t>(target_stage);
+                record.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                record.inputBytes = std::move(input_bytes);
+            }
+            // Stage timings also calibrate the processing-time estimate
+            timing_known = !plan.sourceSize.empty();
+            if (timing_known) features = TimeEstimator::describe(plan.sourceSize, cpp_params);
+            
+            std::string stage_name = print_trace_get_processing_stage_name(target_stage);
+            reportProgress(progress_callback, 0.0, ("Processing to stage: " + stage_name).c_str(), user_data);
+            
+            // Process to target stage, resuming after stage 1 when a snapshot of it exists
+            std::pair<cv::Mat, std::vector<cv::Point>> stage_result;
+            if (snapshotting && StageSnapshot::load(snapshot_key, cpp_params, lightbox)) {
+                reportProgress(progress_callback, 0.1, "Resuming from stage snapshot", user_data);
+                stage_result = ImageProcessor::processFromLightbox(lightbox, cpp_params, static_cast<int>(target_stage));
+            } else {
+                stage_result = ImageProcessor::processImageToStage(
+                    input_path, cpp_params, static_cast<int>(target_stage), &lightbox
+                );
+                if (snapshotting) {
+                    StageSnapshot::save(snapshot_key, lightbox);
+                }
+            }
+            auto& [result_mat, result_contour] = stage_result;
+            
+            reportProgress(progress_callback, 0.8, "Converting result data", user_data);
+            
+            // Convert result image
+            if (result_image) {
+                convertMatToImageData(result_mat, result_image);
+            }
+            
+            // Average pixels per mm of the warp actually used (tolerance mode sizes it per image)
+            double pixels_per_mm = lightbox.pixelsPerMM;
+            if (pixels_per_mm <= 0.0) {
+                double pixels_per_mm_width = static_cast<double>(cpp_params.lightboxWidthPx) / cpp_params.lightboxWidthMM;
+                double pixels_per_mm_height = static_cast<double>(cpp_params.lightboxHeightPx) / cpp_params.lightboxHeightMM;
+                pixels_per_mm = (pixels_per_mm_width + pixels_per_mm_height) / 2.0;
+            }
+            
+            // Convert contour if available and requested
+            if (contour && !result_contour.empty()) {
+                convertContour(result_contour, pixels_per_mm, contour);
+            }
+            
+            if (caching) {
+                ResultCache::Entry entry;
+                entry.contour = result_contour;
+                entry.pixelsPerMM = pixels_per_mm;
+                entry.corners = lightbox.corners;
+                entry.homography = lightbox.homography;
+                ResultCache::store(key, entry, lightbox.warped);
+            }
+            
+            record.contour = result_contour;
+            record.pixelsPerMM = pixels_per_mm;
+            finishRun(PRINT_TRACE_SUCCESS);
+            
+            reportProgress(progress_callback, 1.0, ("Processing to " + stage_name + " complete").c_str(), user_data);
+            
+            return PRINT_TRACE_SUCCESS;
+            
+        } catch (const std::invalid_argument& e) {
+            PrintTraceResult code = handleException(e, error_callback, user_data);
+            finishRun(code);
+            return code;
+        } catch (const std::runtime_error& e) {
+            PrintTraceResult code = handleException(e, error_callback, user_data);
+            finishRun(code);
+            return code;
+        } catch (const std::exception& e) {
+            PrintTraceResult code = handleException(e, error_callback, user_data);
+            finishRun(code);
+            return code;
+        }
+    }
+    
+    // Every processing entry point goes through here, so this is where images are counted
+    PrintTraceResult runPipeline(
+        const char* input_path,
+        const PrintTraceParams* params,
+        PrintTraceProcessingStage target_stage,
+        PrintTraceImageData* result_image,
+        PrintTraceContour* contour,
+        PrintTraceProgressCallback progress_callback,
+        PrintTraceErrorCallback error_callback,
+        void* user_data,
+        std::string* cache_key
+    ) {
+        auto start = std::chrono::steady_clock::now();
+        PrintTraceResult result = runPipelineStages(input_path, params, target_stage, result_image, contour,
+                                                    progress_callback, error_callback, user_data, cache_key);
+        Metrics::recordImage(result, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        return result;
+    }
+}
+
 PrintTraceResult print_trace_process_image_to_contour(
     const char* input_path,
     const PrintTraceParams* params,
@@ -428,28 +734,26 @@ PrintTraceResult print_trace_process_image_to_contour(
     PrintTraceErrorCallback error_callback,
     void* user_data
 ) {
-    // Simply delegate to print_trace_process_to_stage with FINAL stage
-    // This eliminates code duplication and ensures consistency
-    
-    PrintTraceImageData dummy_image = {nullptr, 0, 0, 0, 0};
+    if (!input_path) {
+        if (error_callback) {
+            error_callback(PRINT_TRACE_ERROR_INVALID_INPUT, "Invalid input parameters", user_data);
+        }
+        return PRINT_TRACE_ERROR_INVALID_INPUT;
+    }
     
-    PrintTraceResult result = print_trace_process_to_stage(
+    // Same pipeline as print_trace_process_to_stage with FINAL stage, minus the
+    // result image conversion nobody asked for
+    return runPipeline(
         input_path,
         params,
         PRINT_TRACE_STAGE_FINAL,
-        &dummy_image,
+        nullptr,
         contour,
         progress_callback,
         error_callback,
-        user_data
+        user_data,
+        nullptr
     );
-    
-    // Free the image data we don't need for this function
-    if (dummy_image.data) {
-        free(dummy_image.data);
-    }
-    
-    return result;
 }
 
 PrintTraceResult print_trace_process_to_stage(
@@ -469,80 +773,17 @@ PrintTraceResult print_trace_process_to_stage(
         return PRINT_TRACE_ERROR_INVALID_INPUT;
     }
     
-    // Initialize outputs
-    result_image->data = nullptr;
-    result_image->width = 0;
-    result_image->height = 0;
-    result_image->channels = 0;
-    result_image->bytes_per_row = 0;
-    
-    if (contour) {
-        contour->points = nullptr;
-        contour->point_count = 0;
-        contour->pixels_per_mm = 0.0;
-    }
-    
-    // Check file exists
-    std::ifstream file(input_path);
-    if (!file.good()) {
-        if (error_callback) {
-            error_callback(PRINT_TRACE_ERROR_FILE_NOT_FOUND, "Input file not found or not readable", user_data);
-        }
-        return PRINT_TRACE_ERROR_FILE_NOT_FOUND;
-    }
-    
-    // Validate parameters
-    PrintTraceParams default_params;
-    if (!params) {
-        print_trace_get_default_params(&default_params);
-        params = &default_params;
-    }
-    
-    PrintTraceResult validation_result = print_trace_validate_params(params);
-    if (validation_result != PRINT_TRACE_SUCCESS) {
-        if (error_callback) {
-            error_callback(validation_result, "Invalid processing parameters", user_data);
-        }
-        return validation_result;
-    }
-    
-    try {
-        std::string stage_name = print_trace_get_processing_stage_name(target_stage);
-        reportProgress(progress_callback, 0.0, ("Processing to stage: " + stage_name).c_str(), user_data);
-        
-        // Convert parameters
-        ImageProcessor::ProcessingParams cpp_params = convertParams(params);
-        
-        // Process to target stage
-        auto [result_mat, result_contour] = ImageProcessor::processImageToStage(
-            input_path, cpp_params, static_cast<int>(target_stage)
-        );
-        
-        reportProgress(progress_callback, 0.8, "Converting result data", user_data);
-        
-        // Convert result image
-        convertMatToImageData(result_mat, result_image);
-        
-        // Convert contour if available and requested
-        if (contour && !result_contour.empty()) {
-            // Calculate average pixels per mm for backward compatibility
-            double pixels_per_mm_width = static_cast<double>(cpp_params.lightboxWidthPx) / cpp_params.lightboxWidthMM;
-            double pixels_per_mm_height = static_cast<double>(cpp_params.lightboxHeightPx) / cpp_params.lightboxHeightMM;
-            double pixels_per_mm = (pixels_per_mm_width + pixels_per_mm_height) / 2.0;
-            convertContour(result_contour, pixels_per_mm, contour);
-        }
-        
-        reportProgress(progress_callback, 1.0, ("Processing to " + stage_name + " complete").c_str(), user_data);
-        
-        return PRINT_TRACE_SUCCESS;
-        
-    } catch (const std::invalid_argument& e) {
-        return handleException(e, error_callback, user_data);
-    } catch (const std::runtime_error& e) {
-        return handleException(e, error_callback, user_data);
-    } catch (const std::exception& e) {
-        return handleException(e, error_callback, user_data);
-    }
+    return runPipeline(
+        input_path,
+        params,
+        target_stage,
+        result_image,
+        contour,
+        progress_callback,
+        error_callback,
+        user_data,
+        nullptr
+    );
 }
 
 PrintTraceResult print_trace_save_contour_to_dxf(
@@ -603,18 +844,29 @@ PrintTraceResult print_trace_process_image_to_dxf(
     }
     
     PrintTraceContour contour = {nullptr, 0, 0.0};
+    std::string cache_key;
     
     // Process image to contour
-    PrintTraceResult result = print_trace_process_image_to_contour(
-        input_path, params, &contour, progress_callback, error_callback, user_data
+    PrintTraceResult result = runPipeline(
+        input_path, params, PRINT_TRACE_STAGE_FINAL, nullptr, &contour,
+        progress_callback, error_callback, user_data, &cache_key
     );
     
     if (result != PRINT_TRACE_SUCCESS) {
         return result;
     }
     
+    // A cached entry that already carries this DXF is copied rather than regenerated
+    if (!cache_key.empty() && ResultCache::copyDXF(cache_key, output_path)) {
+        print_trace_free_contour(&contour);
+        return PRINT_TRACE_SUCCESS;
+    }
+    
     // Save contour to DXF
     result = print_trace_save_contour_to_dxf(&contour, output_path, error_callback, user_data);
+    if (result == PRINT_TRACE_SUCCESS && !cache_key.empty()) {
+        ResultCache::attachDXF(cache_key, output_path);
+    }
     
     // Clean up
     print_trace_free_contour(&contour);
@@ -622,6 +874,160 @@ PrintTraceResult print_trace_process_image_to_dxf(
     return result;
 }
 
+PrintTraceResult print_trace_submit_dxf_job(
+    const char* input_path,
+    const char* output_path,
+    const PrintTraceParams* params,
+    PrintTraceJobPriority priority,
+    PrintTraceJobCallback callback,
+    void* user_data,
+    uint64_t* job_id
+) {
+    if (priority != PRINT_TRACE_PRIORITY_INTERACTIVE && priority != PRINT_TRACE_PRIORITY_BATCH) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    if (!input_path || !output_path) return PRINT_TRACE_ERROR_INVALID_INPUT;
+    
+    PrintTraceParams job_params;
+    if (params) {
+        job_params = *params;
+    } else {
+        print_trace_get_default_params(&job_params);
+    }
+    PrintTraceResult validation_result = print_trace_validate_params(&job_params);
+    if (validation_result != PRINT_TRACE_SUCCESS) return validation_result;
+    
+    // Header-only estimate for admission; an unreadable header counts as 0 and fails when the job runs
+    double memory_mb = ImageProcessor::planMemory(input_path, ParamCodec::toProcessingParams(&job_params)).peakMB;
+    
+    std::string input = input_path;
+    std::string output = output_path;
+    uint64_t submitted = JobQueue::shared().submit([=](uint64_t id) {
+        auto start = std::chrono::steady_clock::now();
+        PrintTraceResult result = print_trace_process_image_to_dxf(
+            input.c_str(), output.c_str(), &job_params, nullptr, nullptr, nullptr);
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (callback) {
+            callback(id, result, input.c_str(), output.c_str(), elapsed_ms, user_data);
+        }
+    }, priority == PRINT_TRACE_PRIORITY_INTERACTIVE ? JobQueue::Priority::Interactive : JobQueue::Priority::Batch,
+       memory_mb);
+    if (job_id) *job_id = submitted;
+    return PRINT_TRACE_SUCCESS;
+}
+
+void print_trace_wait_for_jobs(void) {
+    JobQueue::shared().waitIdle();
+}
+
+void print_trace_set_max_concurrent_jobs(int32_t jobs) {
+    JobQueue::shared().setMaxConcurrent(jobs);
+}
+
+void print_trace_configure_scheduler(const PrintTraceSchedulerConfig* config) {
+    if (!config) return;
+    JobQueue::shared().setScheduling(config->batch_aging_ms, config->preempt_batch);
+    JobQueue::shared().setMemoryBudget(config->memory_budget_mb);
+}
+
+PrintTraceResult print_trace_sweep(
+    const char* input_path,
+    const PrintTraceParams* base_params,
+    const PrintTraceSweepAxis* axes,
+    int32_t axis_count,
+    int32_t max_threads,
+    PrintTraceSweepResult** results,
+    int32_t* result_count,
+    PrintTraceErrorCallback error_callback,
+    void* user_data
+) {
+    if (!input_path || !results || !result_count || axis_count < 0 || (axis_count > 0 && !axes)) {
+        if (error_callback) {
+            error_callback(PRINT_TRACE_ERROR_INVALID_INPUT, "Invalid sweep parameters", user_data);
+        }
+        return PRINT_TRACE_ERROR_INVALID_INPUT;
+    }
+    *results = nullptr;
+    *result_count = 0;
+    
+    std::ifstream file(input_path);
+    if (!file.good()) {
+        if (error_callback) {
+            error_callback(PRINT_TRACE_ERROR_FILE_NOT_FOUND, "Input file not found or not readable", user_data);
+        }
+        return PRINT_TRACE_ERROR_FILE_NOT_FOUND;
+    }
+    
+    PrintTraceParams base;
+    if (base_params) {
+        base = *base_params;
+    } else {
+        print_trace_get_default_params(&base);
+    }
+    
+    // Axis values travel as ParamCodec text so integer and bool fields parse strictly
+    std::vector<ParameterSweep::Axis> sweep_axes;
+    for (int32_t a = 0; a < axis_count; a++) {
+        if (!axes[a].name || axes[a].value_count <= 0 || !axes[a].values) {
+            if (error_callback) {
+                error_callback(PRINT_TRACE_ERROR_INVALID_PARAMETERS, "Sweep axis without name or values", user_data);
+            }
+            return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+        }
+        ParameterSweep::Axis axis;
+        axis.name = axes[a].name;
+        for (int32_t v = 0; v < axes[a].value_count; v++) {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "%.17g", axes[a].values[v]);
+            axis.values.push_back(buffer);
+        }
+        sweep_axes.push_back(axis);
+    }
+    
+    std::vector<ParameterSweep::Run> runs;
+    try {
+        std::string error;
+        if (!ParameterSweep::run(input_path, base, sweep_axes, max_threads, runs, nullptr, &error)) {
+            if (error_callback) {
+                error_callback(PRINT_TRACE_ERROR_INVALID_PARAMETERS, error.c_str(), user_data);
+            }
+            return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+        }
+    } catch (const std::exception& e) {
+        return handleException(e, error_callback, user_data);
+    }
+    
+    *results = static_cast<PrintTraceSweepResult*>(calloc(runs.size(), sizeof(PrintTraceSweepResult)));
+    if (!*results && !runs.empty()) {
+        return PRINT_TRACE_ERROR_PROCESSING_FAILED;
+    }
+    for (size_t i = 0; i < runs.size(); i++) {
+        const ParameterSweep::Run& run = runs[i];
+        PrintTraceSweepResult& out = (*results)[i];
+        out.params = run.params;
+        out.result = static_cast<PrintTraceResult>(run.resultCode);
+        if (!run.error.empty()) {
+            // Same exception-to-code mapping as single runs, without a callback per combination
+            out.result = handleException(std::runtime_error(run.error), nullptr, nullptr);
+        }
+        convertContour(run.contour, run.pixelsPerMM, &out.contour);
+        out.area_mm2 = run.areaMM2;
+        out.perimeter_mm = run.perimeterMM;
+        out.solidity = run.solidity;
+        out.elapsed_ms = run.elapsedMs;
+    }
+    *result_count = static_cast<int32_t>(runs.size());
+    return PRINT_TRACE_SUCCESS;
+}
+
+void print_trace_free_sweep_results(PrintTraceSweepResult* results, int32_t result_count) {
+    if (!results) return;
+    for (int32_t i = 0; i < result_count; i++) {
+        print_trace_free_contour(&results[i].contour);
+    }
+    free(results);
+}
+
 void print_trace_free_contour(PrintTraceContour* contour) {
     if (contour && contour->points) {
         free(contour->points);
@@ -655,12 +1061,15 @@ const char* print_trace_get_error_message(PrintTraceResult error_code) {
         case PRINT_TRACE_ERROR_DXF_WRITE_FAILED: return "Failed to write DXF file - check output path permissions";
         case PRINT_TRACE_ERROR_INVALID_PARAMETERS: return "Invalid processing parameters - check parameter ranges";
         case PRINT_TRACE_ERROR_PROCESSING_FAILED: return "Image processing failed - see error callback for details";
+        case PRINT_TRACE_ERROR_IMAGE_BLURRY: return "Image too blurry - hold the camera steady and refocus";
+        case PRINT_TRACE_ERROR_IMAGE_BAD_EXPOSURE: return "Image badly exposed - check the lightbox is on and not washed out";
+        case PRINT_TRACE_ERROR_NO_LIGHTBOX: return "No lightbox visible - frame the whole lightbox with some surround";
         default: return "Unknown error";
     }
 }
 
 const char* print_trace_get_version(void) {
-    return "1.0.0";
+    return "2.0.0";
 }
 
 bool print_trace_is_valid_image_file(const char* file_path) {
@@ -675,22 +1084,114 @@ bool print_trace_is_valid_image_file(const char* file_path) {
 }
 
 double print_trace_estimate_processing_time(const char* image_path) {
+    return print_trace_estimate_processing_time_with_params(image_path, nullptr);
+}
+
+double print_trace_estimate_processing_time_with_params(const char* image_path, const PrintTraceParams* params) {
     if (!image_path) return -1.0;
     
-    try {
-        cv::Mat img = cv::imread(image_path);
-        if (img.empty()) return -1.0;
-        
-        // Rough estimation based on image size
-        int64_t pixels = static_cast<int64_t>(img.rows) * img.cols;
-        double base_time = 2.0; // Base time in seconds
-        double pixel_factor = static_cast<double>(pixels) / (1920.0 * 1080.0); // Normalize to 1080p
-        
-        return base_time * (0.5 + 0.5 * pixel_factor);
-        
-    } catch (...) {
-        return -1.0;
+    PrintTraceParams resolved;
+    if (params) {
+        resolved = *params;
+    } else {
+        print_trace_get_default_params(&resolved);
     }
+    if (print_trace_validate_params(&resolved) != PRINT_TRACE_SUCCESS) return -1.0;
+    
+    TimeEstimator::Features features;
+    if (!TimeEstimator::describe(image_path, ParamCodec::toProcessingParams(&resolved), features)) return -1.0;
+    return TimeEstimator::estimateSeconds(features);
+}
+
+PrintTraceResult print_trace_set_time_calibration(const char* path) {
+    return TimeEstimator::setCalibrationFile(path ? path : "") ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+PrintTraceResult print_trace_refresh_time_calibration(void) {
+    return TimeEstimator::refresh() ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+PrintTraceResult print_trace_set_recorder(const char* directory) {
+    return RunRecorder::setDirectory(directory ? directory : "") ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+PrintTraceResult print_trace_set_result_cache(const char* directory, uint64_t max_bytes) {
+    return ResultCache::configure(directory ? directory : "", max_bytes) ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+PrintTraceResult print_trace_set_stage_snapshots(const char* directory, bool compress) {
+    return StageSnapshot::configure(directory ? directory : "", compress) ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+int32_t print_trace_get_metrics(char* buffer, int32_t buffer_size) {
+    std::string text = Metrics::render();
+    if (buffer && buffer_size > 0) {
+        size_t copied = std::min(text.size(), static_cast<size_t>(buffer_size - 1));
+        memcpy(buffer, text.data(), copied);
+        buffer[copied] = '\0';
+    }
+    return static_cast<int32_t>(text.size());
+}
+
+PrintTraceResult print_trace_serve_metrics(const char* address) {
+    return Metrics::serve(address ? address : "") ? PRINT_TRACE_SUCCESS : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+PrintTraceResult print_trace_write_metrics_file(const char* path, double interval_seconds) {
+    return Metrics::writeFilePeriodically(path ? path : "", interval_seconds) ? PRINT_TRACE_SUCCESS
+                                                                             : PRINT_TRACE_ERROR_INVALID_INPUT;
+}
+
+namespace {
+    std::mutex g_threadConfigMutex;
+    PrintTraceThreadConfig g_threadConfig = {0, -1, 0, nullptr, 0};
+}
+
+void print_trace_get_thread_config(PrintTraceThreadConfig* config) {
+    if (!config) return;
+    std::lock_guard<std::mutex> lock(g_threadConfigMutex);
+    *config = g_threadConfig;
+    config->worker_threads = WorkerPool::shared()->threadCount();
+    // -1 left OpenCV's process-wide setting alone: report the value it actually uses
+    if (config->opencv_threads < 0) config->opencv_threads = cv::getNumThreads();
+    config->cpu_affinity = nullptr;
+    config->cpu_affinity_count = 0;
+}
+
+PrintTraceResult print_trace_configure_thread_pool(const PrintTraceThreadConfig* config) {
+    PrintTraceThreadConfig defaults = {0, 0, 0, nullptr, 0};
+    if (!config) config = &defaults;
+    
+    if (config->worker_threads < 0 || config->worker_threads > 1024 ||
+        config->opencv_threads < -1 || config->opencv_threads > 1024 ||
+        config->max_job_parallelism < 0 || config->max_job_parallelism > 1024 ||
+        config->cpu_affinity_count < 0 || (config->cpu_affinity_count > 0 && !config->cpu_affinity)) {
+        return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+    }
+    std::vector<int> cpus;
+    for (int32_t i = 0; i < config->cpu_affinity_count; i++) {
+        if (config->cpu_affinity[i] < 0) return PRINT_TRACE_ERROR_INVALID_PARAMETERS;
+        cpus.push_back(config->cpu_affinity[i]);
+    }
+    
+    std::lock_guard<std::mutex> lock(g_threadConfigMutex);
+    WorkerPool::configureShared(config->worker_threads, cpus);
+    WorkerPool::setJobParallelism(config->max_job_parallelism);
+    
+    // Pool threads and OpenCV's own threads compete for the same cores: by default
+    // give each concurrently running task (pool threads + caller) an equal share
+    int opencvThreads = config->opencv_threads;
+    if (opencvThreads == 0) {
+        int cores = cpus.empty() ? static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))
+                                 : static_cast<int>(cpus.size());
+        int tasks = WorkerPool::shared()->threadCount() + 1;
+        opencvThreads = std::max(1, cores / tasks);
+    }
+    if (opencvThreads > 0) cv::setNumThreads(opencvThreads);
+    
+    g_threadConfig = *config;
+    g_threadConfig.opencv_threads = opencvThreads > 0 ? opencvThreads : -1;
+    return PRINT_TRACE_SUCCESS;
 }
 
 const char* print_trace_get_processing_stage_name(PrintTraceProcessingStage stage) {
@@ -0,0 +1,406 @@
+#include "ResultCache.hpp"
+#include "ContentHash.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// result.bin: "PTRC" u32 format, f64 pixelsPerMM, 9 x f64 homography,
+// 4 x (f32, f32) corners, u32 point count, count x (i32, i32). Little-endian.
+const char kEntryMagic[4] = {'P', 'T', 'R', 'C'};
+const uint32_t kEntryFormat = 1;
+
+// Stop evicting once the cache is back under this fraction of its bound so a
+// full cache does not rescan on every store
+const double kEvictionTarget = 0.9;
+// Rescan the cache after this many local stores to pick up other processes' writes
+const int kRescanInterval = 64;
+// Abandoned temp directories (crashed writers) older than this are removed
+const auto kStaleTempAge = chrono::hours(1);
+
+mutex g_cacheMutex;
+string g_cacheDirectory;
+uint64_t g_cacheMaxBytes = 0;
+uint64_t g_approxBytes = 0;
+int g_storesSinceScan = 0;
+atomic<bool> g_cacheEnabled{false};
+atomic<uint64_t> g_tempCounter{0};
+
+string toHex(uint64_t v) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(v));
+    return buffer;
+}
+
+void putU32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putF32(string& out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU32(out, bits);
+}
+
+void putF64(string& out, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((bits >> (8 * i)) & 0xff));
+}
+
+class Reader {
+public:
+    Reader(const string& data) : m_data(data) {}
+    bool u32(uint32_t& v) {
+        if (m_pos + 4 > m_data.size()) return false;
+        v = 0;
+        for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(static_cast<uint8_t>(m_data[m_pos + i])) << (8 * i);
+        m_pos += 4;
+        return true;
+    }
+    bool f32(float& v) {
+        uint32_t bits;
+        if (!u32(bits)) return false;
+        memcpy(&v, &bits, sizeof(v));
+        return true;
+    }
+    bool f64(double& v) {
+        if (m_pos + 8 > m_data.size()) return false;
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++) bits |= static_cast<uint64_t>(static_cast<uint8_t>(m_data[m_pos + i])) << (8 * i);
+        m_pos += 8;
+        memcpy(&v, &bits, sizeof(v));
+        return true;
+    }
+    size_t remaining() const { return m_data.size() - m_pos; }
+    bool magic() {
+        if (m_data.size() < 4 || memcmp(m_data.data(), kEntryMagic, 4) != 0) return false;
+        m_pos = 4;
+        return true;
+    }
+private:
+    const string& m_data;
+    size_t m_pos = 0;
+};
+
+string serializeEntry(const ResultCache::Entry& entry) {
+    string out(kEntryMagic, sizeof(kEntryMagic));
+    putU32(out, kEntryFormat);
+    putF64(out, entry.pixelsPerMM);
+
+    Mat h = Mat::eye(3, 3, CV_64F);
+    if (entry.homography.rows == 3 && entry.homography.cols == 3) {
+        entry.homography.convertTo(h, CV_64F);
+    }
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) putF64(out, h.at<double>(r, c));
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        Point2f p = i < entry.corners.size() ? entry.corners[i] : Point2f(0.0f, 0.0f);
+        putF32(out, p.x);
+        putF32(out, p.y);
+    }
+
+    putU32(out, static_cast<uint32_t>(entry.contour.size()));
+    for (const auto& p : entry.contour) {
+        putU32(out, static_cast<uint32_t>(p.x));
+        putU32(out, static_cast<uint32_t>(p.y));
+    }
+    return out;
+}
+
+bool parseEntry(const string& data, ResultCache::Entry& entry) {
+    Reader reader(data);
+    uint32_t format;
+    if (!reader.magic() || !reader.u32(format) || format != kEntryFormat) return false;
+    if (!reader.f64(entry.pixelsPerMM)) return false;
+
+    entry.homography = Mat(3, 3, CV_64F);
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            if (!reader.f64(entry.homography.at<double>(r, c))) return false;
+        }
+    }
+
+    entry.corners.assign(4, Point2f());
+    for (auto& p : entry.corners) {
+        if (!reader.f32(p.x) || !reader.f32(p.y)) return false;
+    }
+
+    uint32_t count;
+    // Eight bytes per point: a corrupt count must not size the reservation
+    if (!reader.u32(count) || count > reader.remaining() / 8) return false;
+    entry.contour.clear();
+    entry.contour.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t x, y;
+        if (!reader.u32(x) || !reader.u32(y)) return false;
+        entry.contour.emplace_back(static_cast<int32_t>(x), static_cast<int32_t>(y));
+    }
+    return true;
+}
+
+bool readWholeFile(const fs::path& path, string& data) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+bool writeWholeFile(const fs::path& path, const string& data) {
+    ofstream out(path, ios::binary | ios::trunc);
+    if (!out) return false;
+    out.write(data.data(), static_cast<streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+string tempName(const string& stem) {
+    return stem + "." + to_string(getpid()) + "." + to_string(g_tempCounter++);
+}
+
+struct CacheLocation {
+    fs::path root;
+    uint64_t maxBytes = 0;
+};
+
+CacheLocation location() {
+    lock_guard<mutex> lock(g_cacheMutex);
+    return {g_cacheDirectory, g_cacheMaxBytes};
+}
+
+uint64_t directorySize(const fs::path& dir) {
+    uint64_t total = 0;
+    error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        error_code sizeEc;
+        uint64_t size = it->file_size(sizeEc);
+        if (!sizeEc) total += size;
+    }
+    return total;
+}
+
+// Removing through a rename keeps readers from seeing a half-deleted entry
+void removeEntry(const fs::path& root, const fs::path& entryDir) {
+    error_code ec;
+    fs::path doomed = root / "tmp" / tempName(entryDir.filename().string() + ".evict");
+    fs::rename(entryDir, doomed, ec);
+    fs::remove_all(ec ? entryDir : doomed, ec);
+}
+
+// Returns the cache size after eviction. Only one process evicts at a time; the
+// others skip and leave it to the lock holder.
+uint64_t evict(const CacheLocation& cache) {
+    struct Candidate {
+        fs::path path;
+        fs::file_time_type lastUsed;
+        uint64_t bytes;
+    };
+
+    string lockPath = (cache.root / ".lock").string();
+    int fd = open(lockPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return 0;
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    vector<Candidate> candidates;
+    uint64_t total = 0;
+    error_code ec;
+    for (fs::directory_iterator it(cache.root / "entries", ec), end; !ec && it != end; it.increment(ec)) {
+        error_code entryEc;
+        if (!it->is_directory(entryEc)) continue;
+        Candidate candidate{it->path(), fs::last_write_time(it->path(), entryEc), directorySize(it->path())};
+        if (entryEc) continue;
+        total += candidate.bytes;
+        candidates.push_back(candidate);
+    }
+
+    auto now = fs::file_time_type::clock::now();
+    for (fs::directory_iterator it(cache.root / "tmp", ec), end; !ec && it != end; it.increment(ec)) {
+        error_code tmpEc;
+        auto modified = fs::last_write_time(it->path(), tmpEc);
+        if (!tmpEc && now - modified > kStaleTempAge) fs::remove_all(it->path(), tmpEc);
+    }
+
+    if (cache.maxBytes > 0 && total > cache.maxBytes) {
+        uint64_t target = static_cast<uint64_t>(cache.maxBytes * kEvictionTarget);
+        sort(candidates.begin(), candidates.end(),
+             [](const Candidate& a, const Candidate& b) { return a.lastUsed < b.lastUsed; });
+        size_t evicted = 0;
+        for (const auto& candidate : candidates) {
+            if (total <= target) break;
+            removeEntry(cache.root, candidate.path);
+            total -= candidate.bytes;
+            evicted++;
+        }
+        if (evicted > 0) {
+            cout << "[INFO] Result cache evicted " << evicted << " entries ("
+                 << total / (1024 * 1024) << " MB retained)" << endl;
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return total;
+}
+
+} // namespace
+
+bool ResultCache::configure(const string& directory, uint64_t maxBytes) {
+    CacheLocation cache;
+    {
+        lock_guard<mutex> lock(g_cacheMutex);
+        if (!directory.empty()) {
+            error_code ec;
+            fs::create_directories(fs::path(directory) / "entries", ec);
+            fs::create_directories(fs::path(directory) / "tmp", ec);
+            if (ec || !fs::is_directory(fs::path(directory) / "entries")) {
+                cerr << "[ERROR] Could not create result cache directory: " << directory << endl;
+                return false;
+            }
+        }
+        g_cacheDirectory = directory;
+        g_cacheMaxBytes = maxBytes;
+        g_storesSinceScan = 0;
+        g_cacheEnabled = !directory.empty();
+        cache = {g_cacheDirectory, g_cacheMaxBytes};
+    }
+
+    if (!directory.empty()) {
+        uint64_t total = evict(cache);
+        lock_guard<mutex> lock(g_cacheMutex);
+        g_approxBytes = total;
+    }
+    return true;
+}
+
+bool ResultCache::enabled() {
+    return g_cacheEnabled.load();
+}
+
+string ResultCache::makeKey(const vector<uchar>& inputBytes, const string& canonicalParams) {
+    return toHex(ContentHash::xxh64(inputBytes.data(), inputBytes.size())) +
+           toHex(ContentHash::xxh64(canonicalParams.data(), canonicalParams.size()));
+}
+
+bool ResultCache::lookup(const string& key, Entry& entry) {
+    CacheLocation cache = location();
+    if (cache.root.empty()) return false;
+
+    fs::path entryDir = cache.root / "entries" / key;
+    string data;
+    if (!readWholeFile(entryDir / "result.bin", data)) return false;
+    if (!parseEntry(data, entry)) {
+        cerr << "[WARN] Discarding corrupt result cache entry: " << key << endl;
+        removeEntry(cache.root, entryDir);
+        return false;
+    }
+    entry.path = entryDir.string();
+
+    // Directory mtime doubles as the LRU timestamp
+    error_code ec;
+    fs::last_write_time(entryDir, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+Mat ResultCache::loadWarped(const Entry& entry) {
+    if (entry.path.empty()) return Mat();
+    return imread((fs::path(entry.path) / "warped.png").string(), IMREAD_GRAYSCALE);
+}
+
+bool ResultCache::copyDXF(const string& key, const string& outputPath) {
+    CacheLocation cache = location();
+    if (cache.root.empty()) return false;
+
+    fs::path source = cache.root / "entries" / key / "output.dxf";
+    error_code ec;
+    if (!fs::is_regular_file(source, ec)) return false;
+    fs::copy_file(source, outputPath, fs::copy_options::overwrite_existing, ec);
+    return !ec;
+}
+
+bool ResultCache::store(const string& key, const Entry& entry, const Mat& warped) {
+    CacheLocation cache = location();
+    if (cache.root.empty()) return false;
+
+    fs::path staging = cache.root / "tmp" / tempName(key);
+    fs::path entryDir = cache.root / "entries" / key;
+    error_code ec;
+    fs::create_directories(staging, ec);
+    if (ec) return false;
+
+    bool written = writeWholeFile(staging / "result.bin", serializeEntry(entry));
+    if (written && !warped.empty()) {
+        // Fastest zlib level: the cache favours write latency over a few extra bytes
+        written = imwrite((staging / "warped.png").string(), warped, {IMWRITE_PNG_COMPRESSION, 1});
+    }
+    if (!written) {
+        fs::remove_all(staging, ec);
+        cerr << "[WARN] Could not write result cache entry: " << key << endl;
+        return false;
+    }
+
+    uint64_t bytes = directorySize(staging);
+    fs::rename(staging, entryDir, ec);
+    if (ec) {
+        // Another writer published the same key first; theirs is equivalent
+        fs::remove_all(staging, ec);
+        return true;
+    }
+
+    bool rescan = false;
+    {
+        lock_guard<mutex> lock(g_cacheMutex);
+        g_approxBytes += bytes;
+        rescan = ++g_storesSinceScan >= kRescanInterval ||
+                 (cache.maxBytes > 0 && g_approxBytes > cache.maxBytes);
+        if (rescan) g_storesSinceScan = 0;
+    }
+    if (rescan) {
+        uint64_t total = evict(cache);
+        lock_guard<mutex> lock(g_cacheMutex);
+        if (total > 0) g_approxBytes = total;
+    }
+    return true;
+}
+
+bool ResultCache::attachDXF(const string& key, const string& dxfPath) {
+    CacheLocation cache = location();
+    if (cache.root.empty()) return false;
+
+    fs::path entryDir = cache.root / "entries" / key;
+    fs::path staging = entryDir / tempName("output.dxf");
+    error_code ec;
+    if (!fs::is_directory(entryDir, ec)) return false;
+    fs::copy_file(dxfPath, staging, fs::copy_options::overwrite_existing, ec);
+    if (!ec) fs::rename(staging, entryDir / "output.dxf", ec);
+    if (ec) {
+        fs::remove(staging, ec);
+        return false;
+    }
+
+    uint64_t bytes = fs::file_size(entryDir / "output.dxf", ec);
+    lock_guard<mutex> lock(g_cacheMutex);
+    if (!ec) g_approxBytes += bytes;
+    return true;
+}
+
+} // namespace PrintTrace
@@ -0,0 +1,263 @@
+#include "RunRecorder.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+// File layout: "PTREC\1\0\0" followed by sections of
+// [4-byte tag][u64 payload length][payload], all integers little-endian.
+// Unknown tags are skipped so newer archives stay readable.
+const char kMagic[8] = {'P', 'T', 'R', 'E', 'C', 1, 0, 0};
+
+mutex g_recorderMutex;
+string g_recorderDirectory;
+atomic<bool> g_recorderEnabled{false};
+atomic<uint64_t> g_recordCounter{0};
+
+void putU32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putU64(string& out, uint64_t v) {
+    for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putF64(string& out, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU64(out, bits);
+}
+
+void putSection(string& out, const char tag[4], const string& payload) {
+    out.append(tag, 4);
+    putU64(out, payload.size());
+    out += payload;
+}
+
+class Reader {
+public:
+    Reader(const char* data, size_t size) : m_data(data), m_size(size) {}
+    bool u32(uint32_t& v) {
+        if (4 > m_size - m_pos) return false;
+        v = 0;
+        for (int i = 0; i < 4; i++) v |= static_cast<uint32_t>(static_cast<uint8_t>(m_data[m_pos + i])) << (8 * i);
+        m_pos += 4;
+        return true;
+    }
+    bool u64(uint64_t& v) {
+        if (8 > m_size - m_pos) return false;
+        v = 0;
+        for (int i = 0; i < 8; i++) v |= static_cast<uint64_t>(static_cast<uint8_t>(m_data[m_pos + i])) << (8 * i);
+        m_pos += 8;
+        return true;
+    }
+    bool f64(double& v) {
+        uint64_t bits;
+        if (!u64(bits)) return false;
+        memcpy(&v, &bits, sizeof(v));
+        return true;
+    }
+    bool bytes(size_t n, const char*& p) {
+        // Not m_pos + n: a corrupt length could wrap around
+        if (n > m_size - m_pos) return false;
+        p = m_data + m_pos;
+        m_pos += n;
+        return true;
+    }
+    bool done() const { return m_pos >= m_size; }
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+string serialize(const RunRecorder::Record& record) {
+    string out(kMagic, sizeof(kMagic));
+    putSection(out, "VERS", record.libraryVersion);
+    putSection(out, "NAME", record.inputName);
+    putSection(out, "PARM", record.params);
+
+    string run;
+    putU32(run, static_cast<uint32_t>(record.targetStage));
+    putU32(run, static_cast<uint32_t>(record.resultCode));
+    putU64(run, static_cast<uint64_t>(record.timestampMs));
+    putF64(run, record.totalMs);
+    putSection(out, "STAG", run);
+
+    string timings;
+    putU32(timings, static_cast<uint32_t>(record.stageTimingsMs.size()));
+    for (const auto& [name, ms] : record.stageTimingsMs) {
+        putU32(timings, static_cast<uint32_t>(name.size()));
+        timings += name;
+        putF64(timings, ms);
+    }
+    putSection(out, "TIME", timings);
+
+    string contour;
+    putF64(contour, record.pixelsPerMM);
+    putU32(contour, static_cast<uint32_t>(record.contour.size()));
+    for (const auto& p : record.contour) {
+        putU32(contour, static_cast<uint32_t>(p.x));
+        putU32(contour, static_cast<uint32_t>(p.y));
+    }
+    putSection(out, "CONT", contour);
+
+    // Input last: readers that only need metadata can stop early
+    putSection(out, "INPT", string(record.inputBytes.begin(), record.inputBytes.end()));
+    return out;
+}
+
+bool parseSection(const string& tag, Reader& payload, const char* raw, size_t size, RunRecorder::Record& record) {
+    if (tag == "VERS") {
+        record.libraryVersion.assign(raw, size);
+    } else if (tag == "NAME") {
+        record.inputName.assign(raw, size);
+    } else if (tag == "PARM") {
+        record.params.assign(raw, size);
+    } else if (tag == "INPT") {
+        record.inputBytes.assign(reinterpret_cast<const uchar*>(raw), reinterpret_cast<const uchar*>(raw) + size);
+    } else if (tag == "STAG") {
+        uint32_t stage, code;
+        uint64_t timestamp;
+        if (!payload.u32(stage) || !payload.u32(code) || !payload.u64(timestamp) || !payload.f64(record.totalMs)) return false;
+        record.targetStage = static_cast<int32_t>(stage);
+        record.resultCode = static_cast<int32_t>(code);
+        record.timestampMs = static_cast<int64_t>(timestamp);
+    } else if (tag == "TIME") {
+        uint32_t count;
+        if (!payload.u32(count)) return false;
+        record.stageTimingsMs.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t length;
+            const char* name;
+            double ms;
+            if (!payload.u32(length) || !payload.bytes(length, name) || !payload.f64(ms)) return false;
+            record.stageTimingsMs.emplace_back(string(name, length), ms);
+        }
+    } else if (tag == "CONT") {
+        uint32_t count;
+        if (!payload.f64(record.pixelsPerMM) || !payload.u32(count)) return false;
+        record.contour.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t x, y;
+            if (!payload.u32(x) || !payload.u32(y)) return false;
+            record.contour.emplace_back(static_cast<int32_t>(x), static_cast<int32_t>(y));
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool RunRecorder::setDirectory(const string& directory) {
+    lock_guard<mutex> lock(g_recorderMutex);
+    if (!directory.empty()) {
+        error_code ec;
+        filesystem::create_directories(directory, ec);
+        if (ec || !filesystem::is_directory(directory)) {
+            cerr << "[ERROR] Could not create recorder directory: " << directory << endl;
+            return false;
+        }
+    }
+    g_recorderDirectory = directory;
+    g_recorderEnabled = !directory.empty();
+    return true;
+}
+
+string RunRecorder::directory() {
+    lock_guard<mutex> lock(g_recorderMutex);
+    return g_recorderDirectory;
+}
+
+bool RunRecorder::enabled() {
+    return g_recorderEnabled.load();
+}
+
+bool RunRecorder::write(const Record& record, string* path) {
+    string dir = directory();
+    if (dir.empty()) return false;
+
+    int64_t now = chrono::duration_cast<chrono::milliseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    string name = "run_" + to_string(now) + "_" + to_string(getpid()) + "_" +
+                  to_string(g_recordCounter++) + ".ptrec";
+    string target = (filesystem::path(dir) / name).string();
+
+    if (!writeFile(record, target)) return false;
+    if (path) *path = target;
+    cout << "[INFO] Recorded run to " << target << endl;
+    return true;
+}
+
+bool RunRecorder::writeFile(const Record& record, const string& path) {
+    string data = serialize(record);
+    string tmp = path + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out) {
+            cerr << "[ERROR] Could not write run archive: " << tmp << endl;
+            return false;
+        }
+        out.write(data.data(), static_cast<streamsize>(data.size()));
+        if (!out) {
+            cerr << "[ERROR] Could not write run archive: " << tmp << endl;
+            return false;
+        }
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (ec) {
+        filesystem::remove(tmp, ec);
+        cerr << "[ERROR] Could not finalize run archive: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool RunRecorder::readFile(const string& path, Record& record) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (data.size() < sizeof(kMagic) || memcmp(data.data(), kMagic, 5) != 0) {
+        cerr << "[ERROR] Not a PrintTrace run archive: " << path << endl;
+        return false;
+    }
+
+    record = Record();
+    Reader reader(data.data() + sizeof(kMagic), data.size() - sizeof(kMagic));
+    while (!reader.done()) {
+        const char* tag;
+        uint64_t length;
+        const char* payload;
+        if (!reader.bytes(4, tag) || !reader.u64(length) || !reader.bytes(static_cast<size_t>(length), payload)) {
+            cerr << "[ERROR] Truncated run archive: " << path << endl;
+            return false;
+        }
+        Reader sectionReader(payload, static_cast<size_t>(length));
+        if (!parseSection(string(tag, 4), sectionReader, payload, static_cast<size_t>(length), record)) {
+            cerr << "[ERROR] Corrupt section " << string(tag, 4) << " in " << path << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RunRecorder::readInputFile(const string& path, vector<uchar>& bytes) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    return true;
+}
+
+} // namespace PrintTrace
@@ -0,0 +1,370 @@
+#include "SceneGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+const int kSubPixelShift = 4;                // fillPoly fixed-point bits
+const double kSubPixelScale = 1 << kSubPixelShift;
+
+// Maps lightbox mm to raster pixels whose centres sit at integer coordinates
+vector<Point> toRaster(const vector<Point2d>& ptsMM, double pixelsPerMM) {
+    vector<Point> raster;
+    raster.reserve(ptsMM.size());
+    for (const auto& p : ptsMM) {
+        raster.emplace_back(static_cast<int>(lround((p.x * pixelsPerMM - 0.5) * kSubPixelScale)),
+                            static_cast<int>(lround((p.y * pixelsPerMM - 0.5) * kSubPixelScale)));
+    }
+    return raster;
+}
+
+void writePoints(FileStorage& fs, const string& key, const vector<Point2d>& pts) {
+    fs << key << "[";
+    for (const auto& p : pts) fs << p.x << p.y;
+    fs << "]";
+}
+
+vector<Point2d> readPoints(const FileNode& node) {
+    vector<Point2d> pts;
+    vector<double> flat;
+    for (const auto& value : node) flat.push_back(static_cast<double>(value));
+    for (size_t i = 0; i + 1 < flat.size(); i += 2) pts.emplace_back(flat[i], flat[i + 1]);
+    return pts;
+}
+
+} // namespace
+
+SceneGenerator::ObjectPart SceneGenerator::makePart(RNG& rng, const Point2d& centerMM, double radiusMM,
+                                                    const SceneParams& params) {
+    ObjectPart part;
+    part.curved = rng.uniform(0.0, 1.0) < params.curvedProbability;
+
+    if (part.curved) {
+        // Smooth blob: low-order Fourier perturbation of a circle, radius stays >= 0.55R
+        double amp[3], phase[3];
+        for (int k = 0; k < 3; k++) {
+            amp[k] = rng.uniform(0.0, 0.15);
+            phase[k] = rng.uniform(0.0, 2.0 * CV_PI);
+        }
+        const int samples = 180;
+        for (int i = 0; i < samples; i++) {
+            double theta = 2.0 * CV_PI * i / samples;
+            double r = 1.0;
+            for (int k = 0; k < 3; k++) r += amp[k] * cos((k + 2) * theta + phase[k]);
+            part.outerMM.emplace_back(centerMM.x + radiusMM * r * cos(theta),
+                                      centerMM.y + radiusMM * r * sin(theta));
+        }
+    } else {
+        // Star-shaped polygon with sorted angles, radius in [0.6R, R]
+        int vertices = rng.uniform(5, 13);
+        vector<double> angles;
+        for (int i = 0; i < vertices; i++) {
+            angles.push_back(2.0 * CV_PI * (i + rng.uniform(-0.3, 0.3)) / vertices);
+        }
+        sort(angles.begin(), angles.end());
+        for (double theta : angles) {
+            double r = radiusMM * rng.uniform(0.6, 1.0);
+            part.outerMM.emplace_back(centerMM.x + r * cos(theta), centerMM.y + r * sin(theta));
+        }
+    }
+
+    // Sparse stars can pinch well inside 0.5R, so check each hole against the
+    // outline and resample (or drop the hole) rather than let it cut the boundary
+    if (rng.uniform(0.0, 1.0) < params.holeProbability) {
+        vector<Point2f> outline(part.outerMM.begin(), part.outerMM.end());
+        const double marginMM = 0.05 * radiusMM;
+        double holeRadius = 0.0;
+        Point2d offset;
+        bool placed = false;
+        for (int attempt = 0; attempt < 10 && !placed; attempt++) {
+            holeRadius = radiusMM * rng.uniform(0.12, 0.25);
+            offset = Point2d(rng.uniform(-0.15, 0.15) * radiusMM, rng.uniform(-0.15, 0.15) * radiusMM);
+            Point2f holeCenter(static_cast<float>(centerMM.x + offset.x), static_cast<float>(centerMM.y + offset.y));
+            // Signed distance to the outline, positive inside
+            placed = pointPolygonTest(outline, holeCenter, true) >= holeRadius + marginMM;
+        }
+        if (placed) {
+            vector<Point2d> hole;
+            const int samples = 64;
+            for (int i = 0; i < samples; i++) {
+                double theta = 2.0 * CV_PI * i / samples;
+                hole.emplace_back(centerMM.x + offset.x + holeRadius * cos(theta),
+                                  centerMM.y + offset.y + holeRadius * sin(theta));
+            }
+            part.holesMM.push_back(hole);
+        }
+    }
+
+    return part;
+}
+
+vector<Point2d> SceneGenerator::computeOutline(const vector<ObjectPart>& parts, double widthMM, double heightMM) {
+    // Rasterise the union of all parts (holes filled, as the pipeline does) and trace
+    // the largest outer boundary
+    const double pixelsPerMM = 40.0;
+    Mat mask = Mat::zeros(static_cast<int>(ceil(heightMM * pixelsPerMM)),
+                          static_cast<int>(ceil(widthMM * pixelsPerMM)), CV_8UC1);
+    for (const auto& part : parts) {
+        vector<vector<Point>> poly{toRaster(part.outerMM, pixelsPerMM)};
+        fillPoly(mask, poly, Scalar(255), LINE_8, kSubPixelShift);
+    }
+
+    vector<vector<Point>> contours;
+    findContours(mask, contours, RETR_EXTERNAL, CHAIN_APPROX_NONE);
+    if (contours.empty()) return {};
+
+    auto largest = max_element(contours.begin(), contours.end(),
+        [](const vector<Point>& a, const vector<Point>& b) { return contourArea(a) < contourArea(b); });
+
+    vector<Point> simplified;
+    approxPolyDP(*largest, simplified, 0.5, true);
+
+    vector<Point2d> outline;
+    for (const auto& p : simplified) {
+        outline.emplace_back((p.x + 0.5) / pixelsPerMM, (p.y + 0.5) / pixelsPerMM);
+    }
+    return outline;
+}
+
+SceneGenerator::Scene SceneGenerator::generate(const SceneParams& params) {
+    if (params.imageWidth < 100 || params.imageHeight < 100 ||
+        params.lightboxWidthMM <= 0.0 || params.lightboxHeightMM <= 0.0) {
+        throw invalid_argument("Scene dimensions must be positive (image at least 100x100)");
+    }
+
+    RNG rng(params.seed);
+    Scene scene;
+    scene.seed = params.seed;
+    scene.lightboxWidthMM = params.lightboxWidthMM;
+    scene.lightboxHeightMM = params.lightboxHeightMM;
+
+    const double W = params.lightboxWidthMM, H = params.lightboxHeightMM;
+    const Size imageSize(params.imageWidth, params.imageHeight);
+
+    // 1. Objects in lightbox mm coordinates
+    int partCount = rng.uniform(params.minParts, params.maxParts + 1);
+    double maxRadius = 0.5 * params.objectCoverage * min(W, H);
+    for (int i = 0; i < partCount; i++) {
+        double radius = rng.uniform(0.35, 1.0) * maxRadius / sqrt(static_cast<double>(partCount));
+        double margin = params.edgeMarginMM + radius * 1.3;
+        if (2.0 * margin >= min(W, H)) radius = max(1.0, (0.5 * min(W, H) - params.edgeMarginMM) / 1.3 * 0.9);
+        margin = params.edgeMarginMM + radius * 1.3;
+        Point2d center(rng.uniform(margin, W - margin), rng.uniform(margin, H - margin));
+        scene.parts.push_back(makePart(rng, center, radius, params));
+    }
+    scene.outlineMM = computeOutline(scene.parts, W, H);
+
+    // 2. Homography: lightbox rectangle (mm) -> rotated, jittered quad in the image
+    double side = params.lightboxCoverage * min(imageSize.width, imageSize.height);
+    double scale = side / max(W, H);                    // image px per mm before perspective
+    double rotation = rng.uniform(-params.maxRotationDeg, params.maxRotationDeg) * CV_PI / 180.0;
+    Point2d center(imageSize.width * rng.uniform(0.45, 0.55), imageSize.height * rng.uniform(0.45, 0.55));
+
+    vector<Point2f> srcMM{Point2f(0, 0), Point2f(static_cast<float>(W), 0),
+                          Point2f(static_cast<float>(W), static_cast<float>(H)), Point2f(0, static_cast<float>(H))};
+    vector<Point2f> dstPx;
+    for (const auto& p : srcMM) {
+        double x = (p.x - W / 2.0) * scale, y = (p.y - H / 2.0) * scale;
+        double jitter = params.maxPerspective * side;
+        x += rng.uniform(-jitter, jitter);
+        y += rng.uniform(-jitter, jitter);
+        dstPx.emplace_back(static_cast<float>(center.x + x * cos(rotation) - y * sin(rotation)),
+                           static_cast<float>(center.y + x * sin(rotation) + y * cos(rotation)));
+    }
+    scene.lightboxCorners = dstPx;
+    scene.homography = getPerspectiveTransform(srcMM, dstPx);
+
+    // 3. Render the lightbox plane supersampled relative to its density in the image
+    double imagePixelsPerMM = scale;
+    double renderPPM = min(40.0, max(8.0, imagePixelsPerMM * 1.5));
+    Size planeSize(static_cast<int>(ceil(W * renderPPM)), static_cast<int>(ceil(H * renderPPM)));
+    Mat plane(planeSize, CV_8UC3, Scalar(246, 247, 245));
+    for (const auto& part : scene.parts) {
+        int level = rng.uniform(15, 70);
+        Scalar color(level + rng.uniform(-5, 6), level + rng.uniform(-5, 6), level + rng.uniform(-5, 6));
+        vector<vector<Point>> outer{toRaster(part.outerMM, renderPPM)};
+        fillPoly(plane, outer, color, LINE_AA, kSubPixelShift);
+        for (const auto& hole : part.holesMM) {
+            vector<vector<Point>> holePoly{toRaster(hole, renderPPM)};
+            fillPoly(plane, holePoly, Scalar(246, 247, 245), LINE_AA, kSubPixelShift);
+        }
+    }
+
+    // Anti-alias before the downsampling warp
+    double downsample = renderPPM / imagePixelsPerMM;
+    if (downsample > 1.2) {
+        GaussianBlur(plane, plane, Size(0, 0), 0.5 * downsample);
+    }
+
+    // Plane px -> mm (pixel centres at integer coordinates) -> image px
+    Mat planeToMM = (Mat_<double>(3, 3) << 1.0 / renderPPM, 0, 0.5 / renderPPM,
+                                           0, 1.0 / renderPPM, 0.5 / renderPPM,
+                                           0, 0, 1);
+    Mat planeToImage = scene.homography * planeToMM;
+
+    // 4. Background: dark bench with a mild colour cast, lightbox warped on top
+    int bench = rng.uniform(30, 80);
+    Mat image(imageSize, CV_8UC3, Scalar(bench + rng.uniform(-8, 9), bench + rng.uniform(-8, 9), bench + rng.uniform(-8, 9)));
+    warpPerspective(plane, image, planeToImage, imageSize, INTER_LINEAR, BORDER_TRANSPARENT);
+
+    // 5. Lighting gradient: linear ramp along a random direction plus vignette
+    Mat imageF;
+    image.convertTo(imageF, CV_32FC3);
+    if (params.lightingGradient > 0.0) {
+        double direction = rng.uniform(0.0, 2.0 * CV_PI);
+        double dx = cos(direction), dy = sin(direction);
+        double diag = sqrt(static_cast<double>(imageSize.width) * imageSize.width +
+                           static_cast<double>(imageSize.height) * imageSize.height);
+        Mat gain(imageSize, CV_32FC1);
+        for (int y = 0; y < imageSize.height; y++) {
+            float* row = gain.ptr<float>(y);
+            double ny = (y - imageSize.height / 2.0) / diag;
+            for (int x = 0; x < imageSize.width; x++) {
+                double nx = (x - imageSize.width / 2.0) / diag;
+                double ramp = 0.5 + (nx * dx + ny * dy);           // ~0..1 across the frame
+                double vignette = 2.0 * (nx * nx + ny * ny);       // 0 centre, ~0.5 corners
+                row[x] = static_cast<float>(1.0 - params.lightingGradient * (0.7 * ramp + 0.3 * vignette));
+            }
+        }
+        Mat gain3;
+        merge(vector<Mat>{gain, gain, gain}, gain3);
+        multiply(imageF, gain3, imageF);
+    }
+
+    // 6. Sensor noise
+    if (params.noiseSigma > 0.0) {
+        Mat noise(imageSize, CV_32FC3);
+        rng.fill(noise, RNG::NORMAL, Scalar::all(0.0), Scalar::all(params.noiseSigma));
+        imageF += noise;
+    }
+    imageF.convertTo(image, CV_8UC3);
+
+    // 7. Compression artefacts: keep the encoded bytes so callers see exactly what a camera would write
+    if (params.jpegQuality > 0) {
+        imencode(".jpg", image, scene.encoded, {IMWRITE_JPEG_QUALITY, params.jpegQuality});
+        scene.encodedExtension = ".jpg";
+        scene.image = imdecode(scene.encoded, IMREAD_COLOR);
+    } else {
+        imencode(".png", image, scene.encoded, {IMWRITE_PNG_COMPRESSION, 1});
+        scene.encodedExtension = ".png";
+        scene.image = image;
+    }
+
+    return scene;
+}
+
+Mat SceneGenerator::renderLightbox(const Scene& scene, const Size& size) {
+    double ppmX = size.width / scene.lightboxWidthMM;
+    double ppmY = size.height / scene.lightboxHeightMM;
+    double ppm = min(ppmX, ppmY);
+
+    Mat warped(size, CV_8UC1, Scalar(240));
+    for (const auto& part : scene.parts) {
+        vector<vector<Point>> outer{toRaster(part.outerMM, ppm)};
+        fillPoly(warped, outer, Scalar(35), LINE_AA, kSubPixelShift);
+        for (const auto& hole : part.holesMM) {
+            vector<vector<Point>> holePoly{toRaster(hole, ppm)};
+            fillPoly(warped, holePoly, Scalar(240), LINE_AA, kSubPixelShift);
+        }
+    }
+    return warped;
+}
+
+bool SceneGenerator::saveScene(const Scene& scene, const string& imagePath, const string& groundTruthPath) {
+    {
+        ofstream out(imagePath, ios::binary);
+        if (!out) {
+            cerr << "[ERROR] Could not write scene image: " << imagePath << endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(scene.encoded.data()), static_cast<streamsize>(scene.encoded.size()));
+    }
+
+    FileStorage fs(groundTruthPath, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+    if (!fs.isOpened()) {
+        cerr << "[ERROR] Could not write ground truth: " << groundTruthPath << endl;
+        return false;
+    }
+
+    fs << "seed" << to_string(scene.seed);
+    fs << "image_width" << scene.image.cols;
+    fs << "image_height" << scene.image.rows;
+    fs << "lightbox_width_mm" << scene.lightboxWidthMM;
+    fs << "lightbox_height_mm" << scene.lightboxHeightMM;
+
+    fs << "homography" << "[";
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) fs << scene.homography.at<double>(r, c);
+    }
+    fs << "]";
+
+    fs << "lightbox_corners_px" << "[";
+    for (const auto& p : scene.lightboxCorners) fs << p.x << p.y;
+    fs << "]";
+
+    writePoints(fs, "outline_mm", scene.outlineMM);
+
+    fs << "parts" << "[";
+    for (const auto& part : scene.parts) {
+        fs << "{";
+        fs << "curved" << (part.curved ? 1 : 0);
+        writePoints(fs, "outer_mm", part.outerMM);
+        fs << "holes_mm" << "[";
+        for (const auto& hole : part.holesMM) {
+            fs << "{";
+            writePoints(fs, "points", hole);
+            fs << "}";
+        }
+        fs << "]";
+        fs << "}";
+    }
+    fs << "]";
+    fs.release();
+    return true;
+}
+
+bool SceneGenerator::loadGroundTruth(const string& groundTruthPath, Scene& scene) {
+    FileStorage fs(groundTruthPath, FileStorage::READ);
+    if (!fs.isOpened()) return false;
+
+    scene.seed = stoull(fs["seed"].string().empty() ? string("0") : fs["seed"].string());
+    scene.lightboxWidthMM = static_cast<double>(fs["lightbox_width_mm"]);
+    scene.lightboxHeightMM = static_cast<double>(fs["lightbox_height_mm"]);
+
+    vector<double> h;
+    for (const auto& value : fs["homography"]) h.push_back(static_cast<double>(value));
+    if (h.size() == 9) {
+        scene.homography = Mat(3, 3, CV_64F);
+        for (int i = 0; i < 9; i++) scene.homography.at<double>(i / 3, i % 3) = h[i];
+    }
+
+    scene.lightboxCorners.clear();
+    for (const auto& p : readPoints(fs["lightbox_corners_px"])) {
+        scene.lightboxCorners.emplace_back(static_cast<float>(p.x), static_cast<float>(p.y));
+    }
+
+    scene.outlineMM = readPoints(fs["outline_mm"]);
+
+    scene.parts.clear();
+    for (const auto& node : fs["parts"]) {
+        ObjectPart part;
+        part.curved = static_cast<int>(node["curved"]) != 0;
+        part.outerMM = readPoints(node["outer_mm"]);
+        for (const auto& hole : node["holes_mm"]) {
+            part.holesMM.push_back(readPoints(hole["points"]));
+        }
+        scene.parts.push_back(part);
+    }
+
+    return !scene.outlineMM.empty();
+}
+
+} // namespace PrintTrace
@@ -0,0 +1,269 @@
+#include "StageSnapshot.hpp"
+#include "ResultCache.hpp"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// File layout (little-endian): "PTSNAP\1\0", u32 width, u32 height, u32 encoding,
+// f64 pixelsPerMM, 4 x (f32, f32) corners, 9 x f64 homography, u64 payload length,
+// payload. Raw payloads are width*height 8-bit pixels, row-major, so loading is a
+// single read straight into the Mat.
+const char kMagic[8] = {'P', 'T', 'S', 'N', 'A', 'P', 1, 0};
+const size_t kHeaderSize = sizeof(kMagic) + 3 * 4 + 8 + 8 * 4 + 9 * 8 + 8;
+
+enum PayloadEncoding : uint32_t {
+    kPayloadRaw = 0,
+    kPayloadPNG = 1
+};
+
+mutex g_snapshotMutex;
+string g_snapshotDirectory;
+bool g_snapshotCompress = false;
+atomic<bool> g_snapshotEnabled{false};
+atomic<uint64_t> g_snapshotCounter{0};
+
+void putU32(string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putU64(string& out, uint64_t v) {
+    for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void putF32(string& out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU32(out, bits);
+}
+
+void putF64(string& out, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    putU64(out, bits);
+}
+
+uint64_t getU64(const char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+    return v;
+}
+
+float getF32(const char* p) {
+    uint32_t bits = static_cast<uint32_t>(getU64(p, 4));
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+double getF64(const char* p) {
+    uint64_t bits = getU64(p, 8);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+string snapshotPath(const string& directory, const string& key) {
+    return (fs::path(directory) / (key + ".ptsnap")).string();
+}
+
+} // namespace
+
+bool StageSnapshot::configure(const string& directory, bool compress) {
+    lock_guard<mutex> lock(g_snapshotMutex);
+    if (!directory.empty()) {
+        error_code ec;
+        fs::create_directories(directory, ec);
+        if (ec || !fs::is_directory(directory)) {
+            cerr << "[ERROR] Could not create stage snapshot directory: " << directory << endl;
+            return false;
+        }
+    }
+    g_snapshotDirectory = directory;
+    g_snapshotCompress = compress;
+    g_snapshotEnabled = !directory.empty();
+    return true;
+}
+
+bool StageSnapshot::enabled() {
+    return g_snapshotEnabled.load();
+}
+
+string StageSnapshot::makeKey(const vector<uchar>& inputBytes, const string& canonicalParams) {
+    return ResultCache::makeKey(inputBytes, canonicalParams);
+}
+
+bool StageSnapshot::load(const string& key, const ImageProcessor::ProcessingParams& params,
+                         ImageProcessor::LightboxStage& lightbox) {
+    string directory;
+    {
+        lock_guard<mutex> lock(g_snapshotMutex);
+        directory = g_snapshotDirectory;
+    }
+    if (directory.empty()) return false;
+
+    string path = snapshotPath(directory, key);
+    error_code ec;
+    if (!fs::is_regular_file(path, ec)) return false;
+
+    if (!readFile(path, lightbox)) {
+        cerr << "[WARN] Discarding unreadable stage snapshot: " << path << endl;
+        fs::remove(path, ec);
+        return false;
+    }
+    // A tolerance-sized warp has no fixed size to check against
+    if (params.targetToleranceMM <= 0.0 &&
+        (lightbox.warped.cols != params.lightboxWidthPx || lightbox.warped.rows != params.lightboxHeightPx)) {
+        cerr << "[WARN] Stage snapshot size does not match parameters, ignoring: " << path << endl;
+        return false;
+    }
+    cout << "[INFO] Loaded stage snapshot " << path << endl;
+    return true;
+}
+
+bool StageSnapshot::save(const string& key, const ImageProcessor::LightboxStage& lightbox) {
+    string directory;
+    bool compress;
+    {
+        lock_guard<mutex> lock(g_snapshotMutex);
+        directory = g_snapshotDirectory;
+        compress = g_snapshotCompress;
+    }
+    if (directory.empty() || lightbox.warped.empty()) return false;
+    return writeFile(lightbox, snapshotPath(directory, key), compress);
+}
+
+bool StageSnapshot::writeFile(const ImageProcessor::LightboxStage& lightbox, const string& path, bool compress) {
+    Mat gray = lightbox.warped;
+    if (gray.type() != CV_8UC1) {
+        cerr << "[ERROR] Stage snapshots hold 8-bit grayscale images only" << endl;
+        return false;
+    }
+
+    vector<uchar> encoded;
+    if (compress && !imencode(".png", gray, encoded)) {
+        cerr << "[ERROR] Could not compress stage snapshot: " << path << endl;
+        return false;
+    }
+    if (!gray.isContinuous()) gray = gray.clone();
+    uint64_t payloadSize = compress ? encoded.size() : gray.total();
+
+    string header(kMagic, sizeof(kMagic));
+    putU32(header, static_cast<uint32_t>(gray.cols));
+    putU32(header, static_cast<uint32_t>(gray.rows));
+    putU32(header, compress ? kPayloadPNG : kPayloadRaw);
+    putF64(header, lightbox.pixelsPerMM);
+    for (size_t i = 0; i < 4; i++) {
+        Point2f p = i < lightbox.corners.size() ? lightbox.corners[i] : Point2f(0.0f, 0.0f);
+        putF32(header, p.x);
+        putF32(header, p.y);
+    }
+    Mat h = Mat::eye(3, 3, CV_64F);
+    if (lightbox.homography.rows == 3 && lightbox.homography.cols == 3) {
+        lightbox.homography.convertTo(h, CV_64F);
+    }
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) putF64(header, h.at<double>(r, c));
+    }
+    putU64(header, payloadSize);
+
+    // Unique temp name: concurrent batch workers may snapshot the same input
+    string tmp = path + "." + to_string(getpid()) + "." + to_string(g_snapshotCounter++) + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out) {
+            cerr << "[ERROR] Could not write stage snapshot: " << tmp << endl;
+            return false;
+        }
+        out.write(header.data(), static_cast<streamsize>(header.size()));
+        if (compress) {
+            out.write(reinterpret_cast<const char*>(encoded.data()), static_cast<streamsize>(encoded.size()));
+        } else {
+            out.write(reinterpret_cast<const char*>(gray.data), static_cast<streamsize>(payloadSize));
+        }
+        if (!out) {
+            error_code ec;
+            fs::remove(tmp, ec);
+            cerr << "[ERROR] Could not write stage snapshot: " << tmp << endl;
+            return false;
+        }
+    }
+    error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        cerr << "[ERROR] Could not finalize stage snapshot: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool StageSnapshot::readFile(const string& path, ImageProcessor::LightboxStage& lightbox) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+
+    char header[kHeaderSize];
+    if (!in.read(header, sizeof(header)) || memcmp(header, kMagic, 6) != 0) return false;
+
+    const char* p = header + sizeof(kMagic);
+    uint32_t width = static_cast<uint32_t>(getU64(p, 4));
+    uint32_t height = static_cast<uint32_t>(getU64(p + 4, 4));
+    uint32_t encoding = static_cast<uint32_t>(getU64(p + 8, 4));
+    p += 12;
+    lightbox.pixelsPerMM = getF64(p);
+    p += 8;
+    lightbox.corners.assign(4, Point2f());
+    for (auto& corner : lightbox.corners) {
+        corner.x = getF32(p);
+        corner.y = getF32(p + 4);
+        p += 8;
+    }
+    lightbox.homography = Mat(3, 3, CV_64F);
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            lightbox.homography.at<double>(r, c) = getF64(p);
+            p += 8;
+        }
+    }
+    uint64_t payloadSize = getU64(p, 8);
+
+    if (width == 0 || height == 0 || width > 65535 || height > 65535) return false;
+
+    if (encoding == kPayloadRaw) {
+        if (payloadSize != static_cast<uint64_t>(width) * height) return false;
+        lightbox.warped.create(static_cast<int>(height), static_cast<int>(width), CV_8UC1);
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(lightbox.warped.data),
+                                         static_cast<streamsize>(payloadSize)));
+    }
+    if (encoding == kPayloadPNG) {
+        // Bound the allocation by what the file actually holds
+        streampos payloadStart = in.tellg();
+        in.seekg(0, ios::end);
+        streampos fileEnd = in.tellg();
+        in.seekg(payloadStart);
+        if (payloadStart < 0 || fileEnd < payloadStart ||
+            payloadSize > static_cast<uint64_t>(fileEnd - payloadStart)) {
+            return false;
+        }
+        vector<uchar> encoded(static_cast<size_t>(payloadSize));
+        if (!in.read(reinterpret_cast<char*>(encoded.data()), static_cast<streamsize>(payloadSize))) return false;
+        lightbox.warped = imdecode(encoded, IMREAD_GRAYSCALE);
+        return !lightbox.warped.empty() &&
+               lightbox.warped.cols == static_cast<int>(width) && lightbox.warped.rows == static_cast<int>(height);
+    }
+    return false;
+}
+
+} // namespace PrintTrace
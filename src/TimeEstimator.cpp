@@ -0,0 +1,310 @@
+#include "TimeEstimator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+const char kFileHeader[] = "printtrace-time-calibration 1";
+
+// A variant needs this many runs before its own fit replaces the default
+const double kMinSamples = 3.0;
+// Older runs are down-weighted once a variant has this many, so the fit follows
+// hardware and library changes
+const double kMaxSamples = 1000.0;
+
+// Running sums for a least-squares line y = a + b * x (x in megapixels, y in ms)
+struct Sums {
+    double n = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+
+    void add(double x, double y) {
+        n += 1.0;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    void add(const Sums& other) {
+        n += other.n;
+        sx += other.sx;
+        sy += other.sy;
+        sxx += other.sxx;
+        sxy += other.sxy;
+    }
+    void subtract(const Sums& other) {
+        n -= other.n;
+        sx -= other.sx;
+        sy -= other.sy;
+        sxx -= other.sxx;
+        sxy -= other.sxy;
+    }
+    void scale(double factor) {
+        n *= factor;
+        sx *= factor;
+        sy *= factor;
+        sxx *= factor;
+        sxy *= factor;
+    }
+};
+
+struct Line {
+    double a = 0.0;
+    double b = 0.0;
+};
+
+// Uncalibrated defaults (ms, ms per megapixel), roughly a recent laptop core
+struct StageDefault {
+    const char* stage;
+    Line line;
+};
+const StageDefault kDefaults[] = {
+    {"quality", {15.0, 2.0}},
+    {"load", {5.0, 30.0}},
+    {"lightbox", {20.0, 60.0}},
+    {"normalize", {5.0, 40.0}},
+    {"object", {10.0, 60.0}},
+    {"smooth", {2.0, 3.0}},
+    {"dilate", {2.0, 3.0}},
+    {"validate", {1.0, 2.0}},
+    {"debug_output", {50.0, 150.0}},
+};
+
+// Stages in pipeline order, and whether they work on the decoded input (else the warp)
+struct StageInput {
+    const char* stage;
+    bool decoded;
+};
+const StageInput kStages[] = {
+    {"quality", true}, {"load", true}, {"lightbox", true}, {"normalize", false}, {"object", false},
+    {"smooth", false}, {"dilate", false}, {"validate", false}, {"debug_output", false},
+};
+
+mutex g_mutex;
+string g_path;
+map<string, Sums> g_base;       // From the calibration file
+map<string, Sums> g_pending;    // Recorded since the last refresh
+
+// Calibration key of a stage under these features; empty for stages the model ignores
+string variantKey(const string& stage, const TimeEstimator::Features& f) {
+    if (stage == "lightbox") return "lightbox/" + to_string(f.cornerDetectionMode);
+    if (stage == "object") return string("object") + (f.merge ? "/merge" : "") + (f.autoThreshold ? "/auto" : "");
+    if (stage == "smooth") return f.smoothingMode < 0 ? "smooth/off" : "smooth/" + to_string(f.smoothingMode);
+    if (stage == "dilate") return f.dilation ? "dilate" : "dilate/off";
+    if (stage == "debug_output") return f.debugOutput ? "debug_output" : "debug_output/off";
+    for (const auto& input : kStages) {
+        if (stage == input.stage) return stage;
+    }
+    return "";
+}
+
+double stageInputMP(const string& stage, const TimeEstimator::Features& f) {
+    for (const auto& input : kStages) {
+        if (stage == input.stage) return input.decoded ? f.decodedMP : f.warpMP;
+    }
+    return 0.0;
+}
+
+Line defaultLine(const string& key) {
+    if (key.size() > 4 && key.compare(key.size() - 4, 4, "/off") == 0) return {0.1, 0.0};
+    string stage = key.substr(0, key.find('/'));
+    for (const auto& entry : kDefaults) {
+        if (stage == entry.stage) return entry.line;
+    }
+    return {};
+}
+
+Line fit(const Sums& s, const Line& fallback) {
+    if (s.n < kMinSamples) return fallback;
+    double meanX = s.sx / s.n;
+    double meanY = s.sy / s.n;
+    double varX = s.sxx / s.n - meanX * meanX;
+    if (varX > 1e-6 * max(1.0, meanX * meanX)) {
+        double slope = (s.sxy / s.n - meanX * meanY) / varX;
+        if (slope >= 0.0) return {meanY - slope * meanX, slope};
+    }
+    // One image size only (or a noisy negative slope): keep the default's shape at the observed level
+    double predicted = fallback.a + fallback.b * meanX;
+    if (predicted <= 0.0) return {meanY, 0.0};
+    return {fallback.a * meanY / predicted, fallback.b * meanY / predicted};
+}
+
+bool readFile(const string& path, map<string, Sums>& sums) {
+    sums.clear();
+    ifstream in(path);
+    if (!in) return true;  // No calibration yet
+    string line;
+    bool sawHeader = false;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        if (!sawHeader) {
+            if (line != kFileHeader) {
+                cerr << "[ERROR] " << path << " is not a time calibration file" << endl;
+                return false;
+            }
+            sawHeader = true;
+            continue;
+        }
+        istringstream fields(line);
+        string key;
+        Sums s;
+        if (!(fields >> key >> s.n >> s.sx >> s.sy >> s.sxx >> s.sxy) || s.n < 0.0) {
+            cerr << "[ERROR] " << path << ": malformed line: " << line << endl;
+            return false;
+        }
+        sums[key].add(s);
+    }
+    return true;
+}
+
+bool writeFile(const string& path, const map<string, Sums>& sums) {
+    string temp = path + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream out(temp, ios::trunc);
+        if (!out) return false;
+        out.precision(17);
+        out << "# Stage timing sums: variant samples sum_x sum_y sum_xx sum_xy (x in megapixels, y in ms)\n";
+        out << kFileHeader << "\n";
+        for (const auto& [key, s] : sums) {
+            out << key << " " << s.n << " " << s.sx << " " << s.sy << " " << s.sxx << " " << s.sxy << "\n";
+        }
+        if (!out.flush()) {
+            remove(temp.c_str());
+            return false;
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+TimeEstimator::Features TimeEstimator::describe(const Size& sourceSize, const ImageProcessor::ProcessingParams& params) {
+    Features f;
+    int reduction = max(1, params.decodeReduction);
+    f.decodedMP = static_cast<double>((sourceSize.width + reduction - 1) / reduction) *
+                  ((sourceSize.height + reduction - 1) / reduction) / 1e6;
+    f.warpMP = static_cast<double>(params.lightboxWidthPx) * params.lightboxHeightPx / 1e6;
+    f.cornerDetectionMode = params.cornerDetectionMode;
+    f.qualityGate = params.enableQualityGate;
+    f.merge = params.mergeNearbyContours;
+    f.autoThreshold = params.autoThreshold;
+    f.smoothingMode = params.enableSmoothing ? params.smoothingMode : -1;
+    f.dilation = params.dilationAmountMM > 0.0;
+    f.debugOutput = params.enableDebugOutput;
+    return f;
+}
+
+bool TimeEstimator::describe(const string& path, const ImageProcessor::ProcessingParams& params, Features& features) {
+    ImageProcessor::ProcessingParams resolved = params;
+    ImageProcessor::MemoryPlan plan = ImageProcessor::resolveForImage(path, resolved);
+    if (plan.sourceSize.empty()) return false;
+    features = describe(plan.sourceSize, resolved);
+    // Tolerance mode sizes the warp after detection; cost it at the largest it may pick
+    if (params.targetToleranceMM > 0.0) features.warpMP = static_cast<double>(plan.warpSize.area()) / 1e6;
+    return true;
+}
+
+double TimeEstimator::estimateSeconds(const Features& features) {
+    lock_guard<mutex> lock(g_mutex);
+    double ms = 0.0;
+    for (const auto& input : kStages) {
+        string stage = input.stage;
+        if (stage == "quality" && !features.qualityGate) continue;
+        string key = variantKey(stage, features);
+        Sums s;
+        auto base = g_base.find(key);
+        if (base != g_base.end()) s.add(base->second);
+        auto pending = g_pending.find(key);
+        if (pending != g_pending.end()) s.add(pending->second);
+        Line line = fit(s, defaultLine(key));
+        ms += max(0.0, line.a + line.b * stageInputMP(stage, features));
+    }
+    return ms / 1000.0;
+}
+
+void TimeEstimator::record(const Features& features, const vector<pair<string, double>>& stageTimingsMs) {
+    lock_guard<mutex> lock(g_mutex);
+    for (const auto& [stage, ms] : stageTimingsMs) {
+        string key = variantKey(stage, features);
+        if (!key.empty()) g_pending[key].add(stageInputMP(stage, features), ms);
+    }
+}
+
+bool TimeEstimator::setCalibrationFile(const string& path) {
+    map<string, Sums> base;
+    if (!path.empty() && !readFile(path, base)) return false;
+    lock_guard<mutex> lock(g_mutex);
+    g_path = path;
+    g_base = std::move(base);
+    return true;
+}
+
+bool TimeEstimator::refresh() {
+    // Snapshot under the mutex; the file lock and I/O below may block on another
+    // process and must not stall record() and estimateSeconds() meanwhile
+    string path;
+    map<string, Sums> flushing;
+    map<string, Sums> merged;
+    {
+        lock_guard<mutex> lock(g_mutex);
+        path = g_path;
+        flushing = g_pending;
+        if (path.empty()) merged = g_base;
+    }
+
+    int lockFd = -1;
+    if (!path.empty()) {
+        // Serialise read-merge-write against other processes sharing the file
+        lockFd = open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lockFd >= 0) flock(lockFd, LOCK_EX);
+        if (!readFile(path, merged)) {
+            if (lockFd >= 0) close(lockFd);
+            return false;
+        }
+    }
+
+    for (const auto& [key, s] : flushing) merged[key].add(s);
+    for (auto& [key, s] : merged) {
+        if (s.n > kMaxSamples) s.scale(kMaxSamples / s.n);
+    }
+
+    bool written = path.empty() || writeFile(path, merged);
+    if (lockFd >= 0) {
+        flock(lockFd, LOCK_UN);
+        close(lockFd);
+    }
+    if (!written) {
+        cerr << "[ERROR] Could not write time calibration " << path << endl;
+        return false;
+    }
+
+    // Runs recorded while we were writing stay pending for the next refresh
+    lock_guard<mutex> lock(g_mutex);
+    if (g_path != path) return true;  // Switched files meanwhile; the new base stands
+    g_base = std::move(merged);
+    for (const auto& [key, s] : flushing) {
+        auto pending = g_pending.find(key);
+        if (pending == g_pending.end()) continue;
+        pending->second.subtract(s);
+        if (pending->second.n < 0.5) g_pending.erase(pending);
+    }
+    return true;
+}
+
+} // namespace PrintTrace
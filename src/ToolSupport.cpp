@@ -0,0 +1,16 @@
+#include "ToolSupport.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace PrintTrace {
+
+double percentile(vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(ceil(p / 100.0 * values.size()));
+    return values[min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+} // namespace PrintTrace
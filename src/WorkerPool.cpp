@@ -0,0 +1,311 @@
+#include "WorkerPool.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace PrintTrace {
+
+namespace {
+
+// Which pool (if any) the current thread works for, and its queue
+thread_local WorkerPool* t_pool = nullptr;
+thread_local size_t t_queue = 0;
+
+mutex g_sharedMutex;
+shared_ptr<WorkerPool> g_shared;
+atomic<int> g_jobParallelism{0};
+
+// A replaced pool may lose its last reference on one of its own workers, which
+// cannot join itself: such pools are parked here and destroyed by the next
+// reconfiguration or at exit
+struct RetiredPools {
+    mutex lock;
+    vector<WorkerPool*> pools;
+
+    ~RetiredPools() {
+        collect();
+    }
+
+    void collect() {
+        vector<WorkerPool*> done;
+        {
+            lock_guard<mutex> guard(lock);
+            for (auto it = pools.begin(); it != pools.end();) {
+                if (*it == t_pool) {
+                    ++it;
+                } else {
+                    done.push_back(*it);
+                    it = pools.erase(it);
+                }
+            }
+        }
+        for (WorkerPool* pool : done) delete pool;
+    }
+} g_retired;
+
+shared_ptr<WorkerPool> makeSharedPool(int threads, const vector<int>& cpus) {
+    return shared_ptr<WorkerPool>(new WorkerPool(threads, cpus), [](WorkerPool* pool) {
+        if (t_pool == pool) {
+            lock_guard<mutex> guard(g_retired.lock);
+            g_retired.pools.push_back(pool);
+        } else {
+            delete pool;
+        }
+    });
+}
+
+} // namespace
+
+WorkerPool::WorkerPool(int threads, const vector<int>& cpus) {
+    if (threads <= 0) {
+        threads = static_cast<int>(max(1u, thread::hardware_concurrency())) - 1;
+    }
+    size_t queues = max(1, threads);
+    for (size_t i = 0; i < queues; i++) {
+        m_queues.push_back(make_unique<Queue>());
+    }
+    m_threads.reserve(threads);
+    for (int i = 0; i < threads; i++) {
+        m_threads.emplace_back([this, i, cpus] { workerLoop(static_cast<size_t>(i), cpus); });
+    }
+#ifndef __linux__
+    if (!cpus.empty()) {
+        cerr << "[WARN] CPU affinity is not supported on this platform, ignoring it" << endl;
+    }
+#endif
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_threads) worker.join();
+}
+
+shared_ptr<WorkerPool> WorkerPool::shared() {
+    lock_guard<mutex> lock(g_sharedMutex);
+    if (!g_shared) g_shared = makeSharedPool(0, {});
+    return g_shared;
+}
+
+void WorkerPool::configureShared(int threads, const vector<int>& cpus) {
+    auto pool = makeSharedPool(threads, cpus);
+    shared_ptr<WorkerPool> previous;
+    {
+        lock_guard<mutex> lock(g_sharedMutex);
+        previous = std::move(g_shared);
+        g_shared = std::move(pool);
+    }
+    // previous drains and joins here unless a running graph still holds it
+    previous.reset();
+    g_retired.collect();
+}
+
+void WorkerPool::setJobParallelism(int maxParallel) {
+    g_jobParallelism = max(0, maxParallel);
+}
+
+int WorkerPool::jobParallelism() {
+    return g_jobParallelism;
+}
+
+void WorkerPool::submit(function<void()> task, const void* owner) {
+    // Workers keep their own follow-up tasks local; outside callers spread theirs
+    size_t index = t_pool == this ? t_queue : m_nextQueue++ % m_queues.size();
+    // Counted before it is published, so a thief's decrement in take() can never
+    // run first and wrap the counter; a worker woken early just retries
+    {
+        lock_guard<mutex> lock(m_sleepMutex);
+        m_pending++;
+    }
+    {
+        lock_guard<mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back({std::move(task), owner});
+    }
+    m_wake.notify_one();
+}
+
+bool WorkerPool::take(size_t home, bool preferNewest, const void* owner, function<void()>& task) {
+    auto matches = [owner](const Task& candidate) { return !owner || candidate.owner == owner; };
+    for (size_t k = 0; k < m_queues.size(); k++) {
+        Queue& queue = *m_queues[(home + k) % m_queues.size()];
+        lock_guard<mutex> lock(queue.mutex);
+        // Own queue: newest first (cache-warm); others: steal the oldest
+        auto found = queue.tasks.end();
+        if (k == 0 && preferNewest) {
+            auto last = find_if(queue.tasks.rbegin(), queue.tasks.rend(), matches);
+            if (last != queue.tasks.rend()) found = prev(last.base());
+        } else {
+            found = find_if(queue.tasks.begin(), queue.tasks.end(), matches);
+        }
+        if (found == queue.tasks.end()) continue;
+        task = std::move(found->run);
+        queue.tasks.erase(found);
+        m_pending--;
+        return true;
+    }
+    return false;
+}
+
+bool WorkerPool::runOne(const void* owner) {
+    function<void()> task;
+    bool member = t_pool == this;
+    if (!take(member ? t_queue : m_nextQueue.load() % m_queues.size(), member, owner, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void WorkerPool::workerLoop(size_t index, const vector<int>& cpus) {
+    t_pool = this;
+    t_queue = index;
+#ifdef __linux__
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0 && index == 0) {
+            cerr << "[WARN] Could not restrict worker threads to the requested CPUs" << endl;
+        }
+    }
+#else
+    (void)cpus;
+#endif
+    while (true) {
+        function<void()> task;
+        if (take(index, true, nullptr, task)) {
+            // Tasks a worker runs while helping inside this one are part of its time
+            auto start = chrono::steady_clock::now();
+            task();
+            Metrics::recordPoolTask(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+            continue;
+        }
+        unique_lock<mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return m_stop || m_pending > 0; });
+        if (m_stop && m_pending == 0) return;
+    }
+}
+
+TaskGraph::TaskId TaskGraph::add(function<void()> task, initializer_list<TaskId> dependencies) {
+    TaskId id = m_nodes.size();
+    m_nodes.push_back({std::move(task), {}, 0});
+    for (TaskId dependency : dependencies) {
+        m_nodes[dependency].dependents.push_back(id);
+        m_nodes[id].dependencyCount++;
+    }
+    return id;
+}
+
+void TaskGraph::run() {
+    // Holding the pool keeps it alive if it is reconfigured while we run
+    shared_ptr<WorkerPool> pool = WorkerPool::shared();
+    run(*pool);
+}
+
+void TaskGraph::run(WorkerPool& pool) {
+    if (m_nodes.empty()) return;
+
+    m_waiting.reset(new atomic<int>[m_nodes.size()]);
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+        m_waiting[i] = m_nodes[i].dependencyCount;
+    }
+    m_failed = false;
+    m_error = nullptr;
+    m_remaining = m_nodes.size();
+    m_ready.clear();
+    m_inFlight = 0;
+    m_maxInFlight = static_cast<size_t>(WorkerPool::jobParallelism());
+
+    for (TaskId id = 0; id < m_nodes.size(); id++) {
+        if (m_nodes[id].dependencyCount == 0) schedule(pool, id);
+    }
+
+    // Run our own queued tasks until every task has finished; the timed wait covers
+    // tasks that another thread took and is still running
+    while (true) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (m_remaining == 0) break;
+        }
+        if (!pool.runOne(this)) {
+            unique_lock<mutex> lock(m_mutex);
+            m_done.wait_for(lock, chrono::milliseconds(1), [this] { return m_remaining == 0; });
+        }
+    }
+
+    if (m_error) rethrow_exception(m_error);
+}
+
+void TaskGraph::schedule(WorkerPool& pool, TaskId id) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_maxInFlight > 0 && m_inFlight >= m_maxInFlight) {
+            m_ready.push_back(id);
+            return;
+        }
+        m_inFlight++;
+    }
+    pool.submit([this, &pool, id] { execute(pool, id); }, this);
+}
+
+void TaskGraph::execute(WorkerPool& pool, TaskId id) {
+    if (!m_failed) {
+        try {
+            m_nodes[id].task();
+        } catch (...) {
+            lock_guard<mutex> lock(m_mutex);
+            if (!m_error) m_error = current_exception();
+            m_failed = true;
+        }
+    }
+    for (TaskId dependent : m_nodes[id].dependents) {
+        if (--m_waiting[dependent] == 0) schedule(pool, dependent);
+    }
+
+    // Hand our slot to a task held back by the cap. Otherwise this is the last
+    // touch of the graph: run() may return as soon as the lock is released
+    bool startNext = false;
+    TaskId next = 0;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_ready.empty()) {
+            next = m_ready.front();
+            m_ready.erase(m_ready.begin());
+            startNext = true;
+        } else {
+            m_inFlight--;
+        }
+        if (--m_remaining == 0) m_done.notify_all();
+    }
+    if (startNext) pool.submit([this, &pool, next] { execute(pool, next); }, this);
+}
+
+void parallelFor(size_t count, int maxParallel, const function<void(size_t)>& fn) {
+    size_t lanes = min(count, static_cast<size_t>(max(maxParallel, 1)));
+    if (lanes <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+    atomic<size_t> next{0};
+    TaskGraph graph;
+    for (size_t lane = 0; lane < lanes; lane++) {
+        graph.add([&] {
+            for (size_t i = next++; i < count; i = next++) fn(i);
+        });
+    }
+    graph.run();
+}
+
+} // namespace PrintTrace
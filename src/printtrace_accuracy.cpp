@@ -0,0 +1,503 @@
+#include "ContourMetrics.hpp"
+#include "ImageProcessor.hpp"
+#include "PrintTraceAPI.h"
+#include "SceneGenerator.hpp"
+#include "ToolSupport.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+using namespace PrintTrace;
+
+namespace {
+
+struct Arguments {
+    string corpusDir;                          // Images with optional <stem>.json ground truth
+    int syntheticCount = 0;                    // Generate this many scenes instead of/in addition to a corpus
+    uint64_t seed = 1;
+    string goldenPath;                         // Compare against a golden run instead of ground truth
+    string writeGoldenPath;                    // Store this run's contours as a golden run
+    string outputPath;                         // JSON report
+    string baselinePath;                       // Earlier JSON report for regression checks
+    int iterations = 3;
+    int lightboxPx = 0;                        // 0 = library default
+    double lightboxWidthMM = 162.0;            // Used when an image has no ground truth
+    double lightboxHeightMM = 162.0;
+    double smoothingMM = -1.0;                 // < 0 = library default
+    double maxHausdorffMM = 1.0;
+    double maxMeanMM = 0.25;
+    double maxAccuracyRegressionMM = 0.05;
+    double maxLatencyRegressionPct = 10.0;
+    map<string, double> budgetsMs;             // Stage name (or "total") -> p95 budget
+    bool valid = true;
+};
+
+struct ImageResult {
+    string image;
+    string reference;                          // "ground_truth", "golden" or "none"
+    string error;
+    vector<Point2d> contourMM;
+    ContourMetrics::Distance distance;
+    bool accuracyOk = true;
+    map<string, double> stageMs;               // Median over iterations
+    double totalMs = 0.0;
+};
+
+Arguments parseArguments(int argc, char* argv[]) {
+    Arguments args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) {
+            args.corpusDir = argv[++i];
+        } else if (arg == "--synthetic" && i + 1 < argc) {
+            args.syntheticCount = max(0, stoi(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            args.seed = stoull(argv[++i]);
+        } else if (arg == "--golden" && i + 1 < argc) {
+            args.goldenPath = argv[++i];
+        } else if (arg == "--write-golden" && i + 1 < argc) {
+            args.writeGoldenPath = argv[++i];
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            args.outputPath = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            args.baselinePath = argv[++i];
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            args.iterations = max(1, stoi(argv[++i]));
+        } else if (arg == "--lightbox-px" && i + 1 < argc) {
+            args.lightboxPx = stoi(argv[++i]);
+        } else if (arg == "--lightbox-mm" && i + 1 < argc) {
+            string value = argv[++i];
+            size_t comma = value.find(',');
+            args.lightboxWidthMM = stod(value.substr(0, comma));
+            args.lightboxHeightMM = comma == string::npos ? args.lightboxWidthMM : stod(value.substr(comma + 1));
+        } else if (arg == "--smoothing-mm" && i + 1 < argc) {
+            args.smoothingMM = stod(argv[++i]);
+        } else if (arg == "--max-hausdorff" && i + 1 < argc) {
+            args.maxHausdorffMM = stod(argv[++i]);
+        } else if (arg == "--max-mean" && i + 1 < argc) {
+            args.maxMeanMM = stod(argv[++i]);
+        } else if (arg == "--max-accuracy-regression" && i + 1 < argc) {
+            args.maxAccuracyRegressionMM = stod(argv[++i]);
+        } else if (arg == "--max-latency-regression" && i + 1 < argc) {
+            args.maxLatencyRegressionPct = stod(argv[++i]);
+        } else if (arg == "--budget" && i + 1 < argc) {
+            string value = argv[++i];
+            size_t eq = value.find('=');
+            if (eq == string::npos) {
+                args.valid = false;
+            } else {
+                args.budgetsMs[value.substr(0, eq)] = stod(value.substr(eq + 1));
+            }
+        } else {
+            args.valid = false;
+        }
+    }
+    if (args.corpusDir.empty() && args.syntheticCount == 0) args.valid = false;
+    return args;
+}
+
+void printUsage(const char* progName) {
+    cout << "PrintTrace accuracy harness - contour accuracy and stage latency against thresholds\n"
+         << "\n"
+         << "Usage: " << progName << " (--corpus <dir> | --synthetic <n>) [options]\n"
+         << "\n"
+         << "Corpus:\n"
+         << "  --corpus <dir>                 Images; <stem>.json ground truth is used when present\n"
+         << "  --synthetic <n>                Generate n synthetic scenes (see printtrace_synth)\n"
+         << "  --seed <n>                     Seed of the first synthetic scene (default: 1)\n"
+         << "  --golden <file>                Compare against a golden run instead of ground truth\n"
+         << "  --write-golden <file>          Save this run's contours as a golden run\n"
+         << "\n"
+         << "Pipeline:\n"
+         << "  --iterations <n>               Runs per image, stage times are medians (default: 3)\n"
+         << "  --lightbox-px <px>             Warp size (default: library default)\n"
+         << "  --lightbox-mm <w>[,<h>]        Lightbox size for images without ground truth (default: 162)\n"
+         << "  --smoothing-mm <mm>            Smoothing amount (default: library default)\n"
+         << "\n"
+         << "Thresholds:\n"
+         << "  --max-hausdorff <mm>           Per-image Hausdorff limit (default: 1.0)\n"
+         << "  --max-mean <mm>                Per-image mean boundary distance limit (default: 0.25)\n"
+         << "  --budget <stage>=<ms>          p95 budget for a stage or 'total' (repeatable)\n"
+         << "  --baseline <report.json>       Earlier report to check for regressions\n"
+         << "  --max-accuracy-regression <mm> Allowed growth of the mean distance (default: 0.05)\n"
+         << "  --max-latency-regression <%>   Allowed slowdown of stage medians (default: 10)\n"
+         << "  -o, --output <file>            Write the combined JSON report\n"
+         << "\n"
+         << "Stages: load, lightbox, normalize, object, smooth, dilate, validate, debug_output\n"
+         << "\n"
+         << "Examples:\n"
+         << "  " << progName << " --synthetic 20 -o base.json\n"
+         << "  " << progName << " --synthetic 20 --lightbox-px 1620 --baseline base.json\n"
+         << "  " << progName << " --corpus photos --write-golden golden.json\n"
+         << "  " << progName << " --corpus photos --golden golden.json --budget lightbox=400 --budget total=900\n"
+         << endl;
+}
+
+map<string, vector<Point2d>> loadGolden(const string& path) {
+    map<string, vector<Point2d>> golden;
+    FileStorage fs(path, FileStorage::READ);
+    if (!fs.isOpened()) {
+        throw runtime_error("Could not open golden run: " + path);
+    }
+    for (const auto& entry : fs["images"]) {
+        vector<double> flat;
+        for (const auto& value : entry["contour_mm"]) flat.push_back(static_cast<double>(value));
+        vector<Point2d> contour;
+        for (size_t i = 0; i + 1 < flat.size(); i += 2) contour.emplace_back(flat[i], flat[i + 1]);
+        golden[entry["image"].string()] = contour;
+    }
+    return golden;
+}
+
+void writeGolden(const vector<ImageResult>& results, const string& path) {
+    FileStorage fs(path, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+    fs << "library_version" << string(print_trace_get_version());
+    fs << "images" << "[";
+    for (const auto& r : results) {
+        if (!r.error.empty()) continue;
+        fs << "{" << "image" << r.image << "contour_mm" << "[";
+        for (const auto& p : r.contourMM) fs << p.x << p.y;
+        fs << "]" << "}";
+    }
+    fs << "]";
+    fs.release();
+}
+
+vector<string> collectImages(const string& dir) {
+    vector<string> images;
+    for (const auto& entry : filesystem::directory_iterator(dir)) {
+        if (!entry.is_regular_file()) continue;
+        string ext = entry.path().extension().string();
+        transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" || ext == ".tiff" || ext == ".tif") {
+            images.push_back(entry.path().string());
+        }
+    }
+    sort(images.begin(), images.end());
+    return images;
+}
+
+ImageResult evaluateImage(const string& imagePath, const Arguments& args,
+                          const map<string, vector<Point2d>>& golden) {
+    ImageResult result;
+    result.image = filesystem::path(imagePath).filename().string();
+
+    // Reference outline: golden run wins over ground truth when both exist
+    vector<Point2d> reference;
+    SceneGenerator::Scene truth;
+    string truthPath = (filesystem::path(imagePath).parent_path() / filesystem::path(imagePath).stem()).string() + ".json";
+    bool hasTruth = filesystem::exists(truthPath) && SceneGenerator::loadGroundTruth(truthPath, truth);
+
+    ImageProcessor::ProcessingParams params;
+    params.lightboxWidthMM = hasTruth ? truth.lightboxWidthMM : args.lightboxWidthMM;
+    params.lightboxHeightMM = hasTruth ? truth.lightboxHeightMM : args.lightboxHeightMM;
+    if (args.lightboxPx > 0) {
+        params.lightboxWidthPx = args.lightboxPx;
+        params.lightboxHeightPx = args.lightboxPx;
+    }
+    if (args.smoothingMM >= 0.0) {
+        params.enableSmoothing = args.smoothingMM > 0.0;
+        params.smoothingAmountMM = args.smoothingMM;
+    }
+
+    if (!args.goldenPath.empty()) {
+        auto it = golden.find(result.image);
+        if (it != golden.end()) {
+            reference = it->second;
+            result.reference = "golden";
+        }
+    } else if (hasTruth) {
+        reference = truth.outlineMM;
+        result.reference = "ground_truth";
+    }
+    if (reference.empty()) result.reference = "none";
+
+    map<string, vector<double>> stageSamples;
+    vector<double> totals;
+    vector<Point> contourPx;
+    try {
+        for (int i = 0; i < args.iterations; i++) {
+            QuietScope quiet;
+            auto [warped, contour] = ImageProcessor::processImageToStage(imagePath, params, PRINT_TRACE_STAGE_FINAL);
+            contourPx = contour;
+            double total = 0.0;
+            for (const auto& [stage, ms] : params.stageTimingsMs) {
+                stageSamples[stage].push_back(ms);
+                total += ms;
+            }
+            totals.push_back(total);
+        }
+    } catch (const exception& e) {
+        result.error = e.what();
+        result.accuracyOk = false;
+        return result;
+    }
+
+    for (const auto& [stage, samples] : stageSamples) result.stageMs[stage] = percentile(samples, 50.0);
+    result.totalMs = percentile(totals, 50.0);
+
+    result.contourMM = ContourMetrics::pixelsToMM(contourPx, params.lightboxWidthPx, params.lightboxHeightPx,
+                                                  params.lightboxWidthMM, params.lightboxHeightMM);
+    if (!reference.empty()) {
+        result.distance = ContourMetrics::compare(result.contourMM, reference);
+        result.accuracyOk = result.distance.hausdorffMM <= args.maxHausdorffMM &&
+                            result.distance.meanMM <= args.maxMeanMM;
+    }
+    return result;
+}
+
+struct Summary {
+    int images = 0;
+    int errors = 0;
+    int accuracyFailures = 0;
+    int compared = 0;
+    double worstHausdorffMM = 0.0;
+    double meanDistanceMM = 0.0;               // Mean over images of the mean boundary distance
+    map<string, pair<double, double>> stageMs; // Stage -> (p50, p95) over images
+};
+
+Summary summarize(const vector<ImageResult>& results) {
+    Summary summary;
+    map<string, vector<double>> stageValues;
+    double sumMean = 0.0;
+    for (const auto& r : results) {
+        summary.images++;
+        if (!r.error.empty()) {
+            summary.errors++;
+            continue;
+        }
+        if (!r.accuracyOk) summary.accuracyFailures++;
+        if (r.reference != "none") {
+            summary.compared++;
+            summary.worstHausdorffMM = max(summary.worstHausdorffMM, r.distance.hausdorffMM);
+            sumMean += r.distance.meanMM;
+        }
+        for (const auto& [stage, ms] : r.stageMs) stageValues[stage].push_back(ms);
+        stageValues["total"].push_back(r.totalMs);
+    }
+    summary.meanDistanceMM = summary.compared > 0 ? sumMean / summary.compared : 0.0;
+    for (const auto& [stage, values] : stageValues) {
+        summary.stageMs[stage] = {percentile(values, 50.0), percentile(values, 95.0)};
+    }
+    return summary;
+}
+
+// Returns human-readable failures; empty when within budgets and baseline thresholds
+vector<string> checkThresholds(const Summary& summary, const Arguments& args) {
+    vector<string> failures;
+    if (summary.errors > 0) {
+        failures.push_back(to_string(summary.errors) + " image(s) failed to process");
+    }
+    if (summary.accuracyFailures > 0) {
+        failures.push_back(to_string(summary.accuracyFailures) + " image(s) outside accuracy limits");
+    }
+
+    for (const auto& [stage, budget] : args.budgetsMs) {
+        auto it = summary.stageMs.find(stage);
+        if (it == summary.stageMs.end()) {
+            failures.push_back("budget for unknown stage '" + stage + "'");
+        } else if (it->second.second > budget) {
+            ostringstream msg;
+            msg << fixed << setprecision(1) << stage << " p95 " << it->second.second << " ms exceeds budget " << budget << " ms";
+            failures.push_back(msg.str());
+        }
+    }
+
+    if (args.baselinePath.empty()) return failures;
+
+    FileStorage fs(args.baselinePath, FileStorage::READ);
+    if (!fs.isOpened()) {
+        failures.push_back("could not open baseline " + args.baselinePath);
+        return failures;
+    }
+
+    FileNode base = fs["summary"];
+    double baseMean = static_cast<double>(base["mean_distance_mm"]);
+    if (summary.meanDistanceMM - baseMean > args.maxAccuracyRegressionMM) {
+        ostringstream msg;
+        msg << fixed << setprecision(3) << "mean distance " << summary.meanDistanceMM << " mm regressed from "
+            << baseMean << " mm";
+        failures.push_back(msg.str());
+    }
+
+    // Ignore sub-millisecond differences, they are timer noise for the cheap stages
+    for (const auto& node : base["stages"]) {
+        string stage = node["name"].string();
+        double baseP50 = static_cast<double>(node["p50_ms"]);
+        auto it = summary.stageMs.find(stage);
+        if (it == summary.stageMs.end() || baseP50 <= 0.0) continue;
+        double delta = it->second.first - baseP50;
+        if (delta > 1.0 && delta / baseP50 * 100.0 > args.maxLatencyRegressionPct) {
+            ostringstream msg;
+            msg << fixed << setprecision(1) << stage << " p50 " << it->second.first << " ms regressed from "
+                << baseP50 << " ms (+" << delta / baseP50 * 100.0 << "%)";
+            failures.push_back(msg.str());
+        }
+    }
+    return failures;
+}
+
+void writeReport(const vector<ImageResult>& results, const Summary& summary,
+                 const vector<string>& failures, const Arguments& args, const string& path) {
+    FileStorage fs(path, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+    time_t now = time(nullptr);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fs << "library_version" << string(print_trace_get_version());
+    fs << "opencv_version" << string(CV_VERSION);
+    fs << "timestamp" << string(timestamp);
+    fs << "iterations" << args.iterations;
+    fs << "max_hausdorff_mm" << args.maxHausdorffMM;
+    fs << "max_mean_mm" << args.maxMeanMM;
+    fs << "passed" << (failures.empty() ? 1 : 0);
+
+    fs << "failures" << "[";
+    for (const auto& f : failures) fs << f;
+    fs << "]";
+
+    fs << "summary" << "{";
+    fs << "images" << summary.images;
+    fs << "errors" << summary.errors;
+    fs << "accuracy_failures" << summary.accuracyFailures;
+    fs << "compared" << summary.compared;
+    fs << "worst_hausdorff_mm" << summary.worstHausdorffMM;
+    fs << "mean_distance_mm" << summary.meanDistanceMM;
+    fs << "stages" << "[";
+    for (const auto& [stage, p] : summary.stageMs) {
+        fs << "{" << "name" << stage << "p50_ms" << p.first << "p95_ms" << p.second << "}";
+    }
+    fs << "]";
+    fs << "}";
+
+    fs << "images" << "[";
+    for (const auto& r : results) {
+        fs << "{";
+        fs << "image" << r.image;
+        fs << "reference" << r.reference;
+        fs << "error" << r.error;
+        fs << "accuracy_ok" << (r.accuracyOk ? 1 : 0);
+        fs << "hausdorff_mm" << r.distance.hausdorffMM;
+        fs << "mean_mm" << r.distance.meanMM;
+        fs << "area_ratio" << r.distance.areaRatio;
+        fs << "total_ms" << r.totalMs;
+        fs << "stages" << "{";
+        for (const auto& [stage, ms] : r.stageMs) fs << stage << ms;
+        fs << "}";
+        fs << "}";
+    }
+    fs << "]";
+    fs.release();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && (string(argv[1]) == "-h" || string(argv[1]) == "--help")) {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    Arguments args = parseArguments(argc, argv);
+    if (!args.valid) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    vector<string> images;
+    if (!args.corpusDir.empty()) {
+        images = collectImages(args.corpusDir);
+    }
+
+    filesystem::path syntheticDir;
+    if (args.syntheticCount > 0) {
+        syntheticDir = filesystem::temp_directory_path() / ("printtrace_accuracy_" + to_string(args.seed));
+        filesystem::create_directories(syntheticDir);
+        for (int i = 0; i < args.syntheticCount; i++) {
+            SceneGenerator::SceneParams sceneParams;
+            sceneParams.seed = args.seed + static_cast<uint64_t>(i);
+            SceneGenerator::Scene scene = SceneGenerator::generate(sceneParams);
+            char stem[32];
+            snprintf(stem, sizeof(stem), "scene_%05d", i);
+            string base = (syntheticDir / stem).string();
+            if (!SceneGenerator::saveScene(scene, base + scene.encodedExtension, base + ".json")) return 1;
+            images.push_back(base + scene.encodedExtension);
+        }
+    }
+
+    if (images.empty()) {
+        cerr << "[ERROR] No images to evaluate" << endl;
+        return 1;
+    }
+
+    map<string, vector<Point2d>> golden;
+    if (!args.goldenPath.empty()) {
+        try {
+            golden = loadGolden(args.goldenPath);
+        } catch (const exception& e) {
+            cerr << "[ERROR] " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    cout << "PrintTrace accuracy harness (libprinttrace v" << print_trace_get_version() << ", "
+         << images.size() << " images, " << args.iterations << " iterations)\n" << endl;
+    cout << left << setw(24) << "image" << setw(14) << "reference" << right << setw(14) << "hausdorff mm"
+         << setw(10) << "mean mm" << setw(12) << "total ms" << "  status" << endl;
+
+    vector<ImageResult> results;
+    for (const auto& imagePath : images) {
+        ImageResult r = evaluateImage(imagePath, args, golden);
+        cout << left << setw(24) << r.image << setw(14) << r.reference << right << fixed << setprecision(3);
+        if (r.error.empty() && r.reference != "none") {
+            cout << setw(14) << r.distance.hausdorffMM << setw(10) << r.distance.meanMM;
+        } else {
+            cout << setw(14) << "-" << setw(10) << "-";
+        }
+        cout << setw(12) << setprecision(1) << r.totalMs << "  "
+             << (!r.error.empty() ? "ERROR: " + r.error : (r.accuracyOk ? "ok" : "FAIL")) << endl;
+        results.push_back(r);
+    }
+
+    Summary summary = summarize(results);
+    vector<string> failures = checkThresholds(summary, args);
+
+    cout << "\nStage latency over images (median of " << args.iterations << " runs each):" << endl;
+    for (const auto& [stage, p] : summary.stageMs) {
+        cout << "  " << left << setw(14) << stage << right << fixed << setprecision(1)
+             << "p50 " << setw(9) << p.first << " ms   p95 " << setw(9) << p.second << " ms" << endl;
+    }
+    cout << setprecision(3) << "\nCompared " << summary.compared << " of " << summary.images
+         << " images: worst Hausdorff " << summary.worstHausdorffMM << " mm, mean distance "
+         << summary.meanDistanceMM << " mm" << endl;
+
+    if (!args.outputPath.empty()) {
+        writeReport(results, summary, failures, args, args.outputPath);
+        cout << "[INFO] Report written to " << args.outputPath << endl;
+    }
+    if (!args.writeGoldenPath.empty()) {
+        writeGolden(results, args.writeGoldenPath);
+        cout << "[INFO] Golden run written to " << args.writeGoldenPath << endl;
+    }
+    if (!syntheticDir.empty()) {
+        filesystem::remove_all(syntheticDir);
+    }
+
+    if (!failures.empty()) {
+        cout << "\nFAILED:" << endl;
+        for (const auto& f : failures) cout << "  - " << f << endl;
+        return 1;
+    }
+    cout << "\nPASSED" << endl;
+    return 0;
+}
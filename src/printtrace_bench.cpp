@@ -0,0 +1,987 @@
+#include "ImageProcessor.hpp"
+#include "PrintTraceAPI.h"
+#include "SceneGenerator.hpp"
+#include "ToolSupport.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace std;
+using namespace cv;
+using namespace PrintTrace;
+
+namespace {
+
+struct Arguments {
+    vector<int> megapixels = {1, 12, 48};      // Source photo resolutions
+    vector<int> lightboxSizes = {1620, 3240};  // Warp target sizes (square, px)
+    int iterations = 10;
+    int warmup = 2;
+    uint64_t seed = 42;
+    string filter;                             // Only run functions containing this substring
+    string outputPath;                         // .json or .csv, stdout summary only if empty
+    string comparePath;                        // Baseline JSON from an earlier run
+    string label;                              // Free-form tag, e.g. commit hash
+    double regressionThreshold = 10.0;         // Percent slowdown tolerated by --compare
+    bool listOnly = false;
+
+    // Throughput mode
+    bool throughput = false;
+    bool megapixelsGiven = false;
+    string corpusDir;                          // Real photos instead of synthetic scenes
+    int corpusImages = 8;                      // Synthetic scenes per throughput run
+    int passes = 2;                            // Corpus passes per configuration
+    vector<int> workers;                       // Concurrent pipelines, default 1,2,4..cores
+    vector<int> cvThreads;                     // cv::setNumThreads values, default 1,cores
+    bool probes = true;                        // Bandwidth/allocator/logging diagnostics
+    bool valid = true;
+};
+
+struct BenchResult {
+    string function;
+    string input;
+    int lightboxPx = 0;
+    int iterations = 0;
+    double medianMs = 0.0;
+    double p95Ms = 0.0;
+    double minMs = 0.0;
+    double meanMs = 0.0;
+};
+
+vector<int> parseIntList(const string& text) {
+    vector<int> values;
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(stoi(item));
+    }
+    return values;
+}
+
+Arguments parseArguments(int argc, char* argv[]) {
+    Arguments args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--megapixels" && i + 1 < argc) {
+            args.megapixels = parseIntList(argv[++i]);
+            args.megapixelsGiven = true;
+        } else if (arg == "--lightbox-px" && i + 1 < argc) {
+            args.lightboxSizes = parseIntList(argv[++i]);
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            args.iterations = max(1, stoi(argv[++i]));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            args.warmup = max(0, stoi(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            args.seed = stoull(argv[++i]);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            args.filter = argv[++i];
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            args.outputPath = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            args.comparePath = argv[++i];
+        } else if (arg == "--label" && i + 1 < argc) {
+            args.label = argv[++i];
+        } else if (arg == "--regression-threshold" && i + 1 < argc) {
+            args.regressionThreshold = stod(argv[++i]);
+        } else if (arg == "--list") {
+            args.listOnly = true;
+        } else if (arg == "--throughput") {
+            args.throughput = true;
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            args.corpusDir = argv[++i];
+        } else if (arg == "--images" && i + 1 < argc) {
+            args.corpusImages = max(1, stoi(argv[++i]));
+        } else if (arg == "--passes" && i + 1 < argc) {
+            args.passes = max(1, stoi(argv[++i]));
+        } else if (arg == "--workers" && i + 1 < argc) {
+            args.workers = parseIntList(argv[++i]);
+        } else if (arg == "--cv-threads" && i + 1 < argc) {
+            args.cvThreads = parseIntList(argv[++i]);
+        } else if (arg == "--no-probes") {
+            args.probes = false;
+        } else {
+            args.valid = false;
+        }
+    }
+    return args;
+}
+
+void printUsage(const char* progName) {
+    cout << "PrintTrace microbenchmarks - times every public ImageProcessor function\n"
+         << "\n"
+         << "Usage: " << progName << " [options]\n"
+         << "\n"
+         << "Options:\n"
+         << "  --megapixels <list>        Source resolutions in MP (default: 1,12,48)\n"
+         << "  --lightbox-px <list>       Warp target sizes in px (default: 1620,3240)\n"
+         << "  --iterations <n>           Timed iterations per case (default: 10)\n"
+         << "  --warmup <n>               Untimed warm-up iterations per case (default: 2)\n"
+         << "  --seed <n>                 Seed for the synthetic inputs (default: 42)\n"
+         << "  --filter <text>            Only run functions whose name contains <text>\n"
+         << "  -o, --output <file>        Write results as JSON (.json) or CSV (.csv)\n"
+         << "  --label <text>             Tag stored with the results, e.g. a commit hash\n"
+         << "  --compare <baseline.json>  Compare medians against an earlier JSON run\n"
+         << "  --regression-threshold <%> Slowdown that fails --compare (default: 10)\n"
+         << "  --list                     List benchmark cases without running them\n"
+         << "\n"
+         << "Throughput mode (concurrent end-to-end pipelines):\n"
+         << "  --throughput               Measure images/s instead of per-function latency\n"
+         << "  --corpus <dir>             Photos to process (default: synthetic scenes)\n"
+         << "  --images <n>               Synthetic scenes in the corpus (default: 8, at 12 MP\n"
+         << "                             unless --megapixels is given)\n"
+         << "  --passes <n>               Corpus passes per configuration (default: 2)\n"
+         << "  --workers <list>           Concurrent pipelines (default: 1,2,4,...,cores)\n"
+         << "  --cv-threads <list>        OpenCV thread counts to sweep (default: 1,cores)\n"
+         << "  --no-probes                Skip bandwidth/allocator/logging diagnostics\n"
+         << "\n"
+         << "Examples:\n"
+         << "  " << progName << " --megapixels 12 --filter Contour\n"
+         << "  " << progName << " -o base.json --label $(git rev-parse --short HEAD)\n"
+         << "  " << progName << " -o new.json --compare base.json\n"
+         << "  " << progName << " --throughput --workers 1,2,4,8 --cv-threads 1 -o scaling.json\n"
+         << endl;
+}
+
+// 4:3 frame with approximately the requested number of megapixels
+Size sizeForMegapixels(int megapixels) {
+    double height = sqrt(megapixels * 1.0e6 * 3.0 / 4.0);
+    int h = static_cast<int>(height) & ~7;
+    int w = (h * 4 / 3) & ~7;
+    return Size(w, h);
+}
+
+// Synthetic lightbox photo with a known object, rendered by SceneGenerator
+SceneGenerator::Scene makeSyntheticScene(const Size& size, uint64_t seed) {
+    SceneGenerator::SceneParams sceneParams;
+    sceneParams.seed = seed;
+    sceneParams.imageWidth = size.width;
+    sceneParams.imageHeight = size.height;
+    sceneParams.jpegQuality = 92;
+    return SceneGenerator::generate(sceneParams);
+}
+
+class BenchSuite {
+public:
+    explicit BenchSuite(const Arguments& args) : m_args(args) {}
+
+    void run(const string& name, const string& input, int lightboxPx, const function<void()>& body) {
+        if (!m_args.filter.empty() && name.find(m_args.filter) == string::npos) return;
+        if (m_args.listOnly) {
+            cout << name << " [" << input << (lightboxPx > 0 ? ", lightbox " + to_string(lightboxPx) + "px" : "") << "]" << endl;
+            return;
+        }
+
+        vector<double> samples;
+        samples.reserve(m_args.iterations);
+        bool failed = false;
+        {
+            QuietScope quiet;
+            try {
+                for (int i = 0; i < m_args.warmup; i++) body();
+                for (int i = 0; i < m_args.iterations; i++) {
+                    auto start = chrono::steady_clock::now();
+                    body();
+                    auto end = chrono::steady_clock::now();
+                    samples.push_back(chrono::duration<double, milli>(end - start).count());
+                }
+            } catch (const exception& e) {
+                failed = true;
+                m_failure = e.what();
+            }
+        }
+
+        if (failed) {
+            cerr << "[WARN] " << name << " [" << input << "] threw: " << m_failure << endl;
+            return;
+        }
+
+        sort(samples.begin(), samples.end());
+        BenchResult result;
+        result.function = name;
+        result.input = input;
+        result.lightboxPx = lightboxPx;
+        result.iterations = static_cast<int>(samples.size());
+        result.medianMs = percentile(samples, 50.0);
+        result.p95Ms = percentile(samples, 95.0);
+        result.minMs = samples.front();
+        double total = 0.0;
+        for (double s : samples) total += s;
+        result.meanMs = total / samples.size();
+        m_results.push_back(result);
+
+        cout << left << setw(34) << name << setw(8) << input
+             << right << setw(7) << (lightboxPx > 0 ? to_string(lightboxPx) : "-")
+             << fixed << setprecision(3)
+             << setw(12) << result.medianMs << setw(12) << result.p95Ms << endl;
+    }
+
+    const vector<BenchResult>& results() const { return m_results; }
+
+private:
+    const Arguments& m_args;
+    vector<BenchResult> m_results;
+    string m_failure;
+};
+
+string caseKey(const string& function, const string& input, int lightboxPx) {
+    return function + "|" + input + "|" + to_string(lightboxPx);
+}
+
+void writeJSON(const vector<BenchResult>& results, const Arguments& args, const string& path) {
+    FileStorage fs(path, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+    time_t now = time(nullptr);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fs << "library_version" << string(print_trace_get_version());
+    fs << "opencv_version" << string(CV_VERSION);
+    fs << "opencv_threads" << getNumThreads();
+    fs << "label" << args.label;
+    fs << "timestamp" << string(timestamp);
+    fs << "seed" << to_string(args.seed);
+    fs << "warmup" << args.warmup;
+    fs << "results" << "[";
+    for (const auto& r : results) {
+        fs << "{"
+           << "function" << r.function
+           << "input" << r.input
+           << "lightbox_px" << r.lightboxPx
+           << "iterations" << r.iterations
+           << "median_ms" << r.medianMs
+           << "p95_ms" << r.p95Ms
+           << "min_ms" << r.minMs
+           << "mean_ms" << r.meanMs
+           << "}";
+    }
+    fs << "]";
+    fs.release();
+}
+
+void writeCSV(const vector<BenchResult>& results, const string& path) {
+    ofstream out(path);
+    out << "function,input,lightbox_px,iterations,median_ms,p95_ms,min_ms,mean_ms\n";
+    out << fixed << setprecision(4);
+    for (const auto& r : results) {
+        out << r.function << "," << r.input << "," << r.lightboxPx << "," << r.iterations << ","
+            << r.medianMs << "," << r.p95Ms << "," << r.minMs << "," << r.meanMs << "\n";
+    }
+}
+
+// Returns the number of cases whose median regressed beyond the threshold
+int compareWithBaseline(const vector<BenchResult>& results, const Arguments& args) {
+    FileStorage fs(args.comparePath, FileStorage::READ);
+    if (!fs.isOpened()) {
+        cerr << "[ERROR] Could not open baseline: " << args.comparePath << endl;
+        return -1;
+    }
+
+    map<string, double> baseline;
+    FileNode entries = fs["results"];
+    for (const auto& entry : entries) {
+        string function = entry["function"].string();
+        string input = entry["input"].string();
+        int lightboxPx = static_cast<int>(entry["lightbox_px"]);
+        baseline[caseKey(function, input, lightboxPx)] = static_cast<double>(entry["median_ms"]);
+    }
+
+    cout << "\nComparison against " << args.comparePath << " (median, threshold "
+         << args.regressionThreshold << "%)" << endl;
+
+    int regressions = 0;
+    for (const auto& r : results) {
+        auto it = baseline.find(caseKey(r.function, r.input, r.lightboxPx));
+        if (it == baseline.end() || it->second <= 0.0) continue;
+
+        double deltaPct = (r.medianMs - it->second) / it->second * 100.0;
+        bool regressed = deltaPct > args.regressionThreshold;
+        if (regressed) regressions++;
+
+        cout << left << setw(34) << r.function << setw(8) << r.input
+             << right << setw(7) << (r.lightboxPx > 0 ? to_string(r.lightboxPx) : "-")
+             << fixed << setprecision(3)
+             << setw(12) << it->second << setw(12) << r.medianMs
+             << setw(9) << setprecision(1) << showpos << deltaPct << "%" << noshowpos
+             << (regressed ? "  REGRESSED" : "") << endl;
+    }
+    return regressions;
+}
+
+// Functions that only operate on the source photo
+void benchSourceFunctions(BenchSuite& suite, const Mat& photo, const string& photoPath,
+                          const string& input, const ImageProcessor::ProcessingParams& params) {
+    using IP = ImageProcessor;
+
+    // Intermediates are computed once so each case times exactly one function
+    Mat gray, lab, enhancedLab, normalizedL, paperMask, cleanMask, normalized, edges, binary;
+    vector<Point> boundaryContour, corners;
+    vector<Point2f> corners2f;
+    {
+        QuietScope quiet;
+        gray = IP::convertToGrayscale(photo);
+        lab = IP::convertBGRToLab(photo);
+        enhancedLab = IP::applyCLAHEToL(lab, params);
+        normalizedL = IP::divisionNormalization(enhancedLab);
+        paperMask = IP::buildPaperMask(enhancedLab, normalizedL, params);
+        cleanMask = IP::morphologicalCleanup(paperMask, params);
+        normalized = IP::normalizeLighting(gray, params);
+        edges = IP::detectEdges(normalized, photo, params);
+        boundaryContour = IP::findBoundaryContour(edges, params);
+        corners = IP::approximatePolygon(boundaryContour, 0.02);
+        corners2f = IP::refineCorners(corners, normalized, params);
+        binary = IP::thresholdImage(gray, 200);
+    }
+
+    suite.run("loadImage", input, 0, [&] { IP::loadImage(photoPath); });
+    suite.run("convertToGrayscale", input, 0, [&] { IP::convertToGrayscale(photo); });
+    suite.run("convertBGRToLab", input, 0, [&] { IP::convertBGRToLab(photo); });
+    suite.run("applyCLAHEToL", input, 0, [&] { IP::applyCLAHEToL(lab, params); });
+    suite.run("divisionNormalization", input, 0, [&] { IP::divisionNormalization(enhancedLab); });
+    suite.run("buildPaperMask", input, 0, [&] { IP::buildPaperMask(enhancedLab, normalizedL, params); });
+    suite.run("morphologicalCleanup", input, 0, [&] { IP::morphologicalCleanup(paperMask, params); });
+    suite.run("detectCornersFromContour", input, 0, [&] { IP::detectCornersFromContour(cleanMask, params); });
+    suite.run("detectCornersFromEdges", input, 0, [&] { IP::detectCornersFromEdges(normalizedL, params); });
+    suite.run("detectLightboxCorners", input, 0, [&] { IP::detectLightboxCorners(photo, params); });
+    suite.run("normalizeLighting", input, 0, [&] { IP::normalizeLighting(gray, params); });
+    suite.run("detectEdges", input, 0, [&] { IP::detectEdges(normalized, photo, params); });
+    suite.run("detectCornersStriped", input, 0, [&] {
+        IP::ProcessingParams striped = params;
+        striped.tileMemoryLimitMB = 64;
+        IP::detectCornersStriped(photo, striped);
+    });
+    suite.run("detectLightboxBoundary", input, 0, [&] { IP::detectLightboxBoundary(gray, params); });
+    suite.run("findBoundaryContour", input, 0, [&] { IP::findBoundaryContour(edges, params); });
+    suite.run("approximatePolygon", input, 0, [&] { IP::approximatePolygon(boundaryContour, 0.02); });
+    suite.run("fitQuadrilateral", input, 0, [&] { IP::fitQuadrilateral(boundaryContour); });
+    suite.run("refineCorners", input, 0, [&] { IP::refineCorners(corners, normalized, params); });
+    suite.run("orderCorners", input, 0, [&] { IP::orderCorners(corners2f); });
+    suite.run("validateCorners", input, 0, [&] { IP::validateCorners(corners2f, photo.size(), params); });
+    suite.run("thresholdImage", input, 0, [&] { IP::thresholdImage(gray, 200); });
+    suite.run("findLargestContour", input, 0, [&] { IP::findLargestContour(binary); });
+    suite.run("findMainContour", input, 0, [&] { IP::findMainContour(binary); });
+    suite.run("removeNoise", input, 0, [&] { IP::removeNoise(binary); });
+
+    // Legacy square warp overload
+    suite.run("warpImage(square)", input, 0, [&] {
+        vector<Point> approx(corners.begin(), corners.end());
+        IP::warpImage(gray, approx, 1620, params.lightboxWidthMM);
+    });
+}
+
+// Functions whose cost depends on the warp target size
+void benchLightboxFunctions(BenchSuite& suite, const Mat& gray, const vector<Point2f>& corners,
+                            const string& input, int lightboxPx, const SceneGenerator::Scene& scene,
+                            ImageProcessor::ProcessingParams params) {
+    using IP = ImageProcessor;
+    params.lightboxWidthPx = lightboxPx;
+    params.lightboxHeightPx = lightboxPx;
+    double pixelsPerMM = lightboxPx / params.lightboxWidthMM;
+
+    Mat warped = SceneGenerator::renderLightbox(scene, Size(lightboxPx, lightboxPx));
+    vector<Point> contour;
+    vector<vector<Point>> parts;
+    {
+        QuietScope quiet;
+        contour = IP::findObjectContour(warped, params);
+        Mat objectMask;
+        threshold(warped, objectMask, 128, 255, THRESH_BINARY_INV);
+        findContours(objectMask, parts, RETR_EXTERNAL, CHAIN_APPROX_NONE);
+    }
+
+    Size target(lightboxPx, lightboxPx);
+    suite.run("warpImage", input, lightboxPx, [&] {
+        IP::warpImage(gray, corners, target, params.lightboxWidthMM, params.lightboxHeightMM);
+    });
+    suite.run("validateWarpedImage", input, lightboxPx, [&] { IP::validateWarpedImage(warped, params); });
+    suite.run("findObjectContour", input, lightboxPx, [&] { IP::findObjectContour(warped, params); });
+    suite.run("mergeNearbyContours", input, lightboxPx, [&] {
+        IP::mergeNearbyContours(parts, params.contourMergeDistanceMM * pixelsPerMM, params);
+    });
+    suite.run("refineContour", input, lightboxPx, [&] { IP::refineContour(contour, warped, params); });
+    suite.run("smoothContour", input, lightboxPx, [&] {
+        IP::smoothContour(contour, params.smoothingAmountMM, pixelsPerMM, params);
+    });
+    suite.run("smoothContourMorphological", input, lightboxPx, [&] {
+        IP::smoothContourMorphological(contour, params.smoothingAmountMM, pixelsPerMM, params);
+    });
+    suite.run("smoothContourCurvatureBased", input, lightboxPx, [&] {
+        IP::smoothContourCurvatureBased(contour, params.smoothingAmountMM, pixelsPerMM, params);
+    });
+    suite.run("dilateContour", input, lightboxPx, [&] { IP::dilateContour(contour, 1.0, pixelsPerMM, params); });
+    suite.run("validateContour", input, lightboxPx, [&] { IP::validateContour(contour, params); });
+}
+
+// ---------------------------------------------------------------------------
+// Throughput mode
+// ---------------------------------------------------------------------------
+
+struct ThroughputResult {
+    int workers = 0;
+    int cvThreads = 0;
+    int images = 0;
+    int failures = 0;
+    double wallSeconds = 0.0;
+    double imagesPerSecond = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+    double peakRssMB = 0.0;
+    double cpuUtilisation = 0.0;               // CPU seconds / (wall seconds * cores)
+    double busyCores = 0.0;                    // CPU seconds / wall seconds
+};
+
+struct ProbeResult {
+    string probe;
+    int workers = 0;
+    double rate = 0.0;                         // Aggregate GB/s, Mops/s or images/s
+    string unit;
+};
+
+size_t currentRssBytes() {
+#if defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+        return info.resident_size;
+    }
+    return 0;
+#elif defined(__linux__)
+    long pages = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(statm);
+    }
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+double processCpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Samples RSS every few milliseconds; getrusage's ru_maxrss is a lifetime peak
+// and cannot be reset between configurations.
+class RssSampler {
+public:
+    RssSampler() : m_peak(currentRssBytes()), m_thread([this] {
+        while (!m_stop.load()) {
+            size_t rss = currentRssBytes();
+            size_t peak = m_peak.load();
+            while (rss > peak && !m_peak.compare_exchange_weak(peak, rss)) {}
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+    }) {}
+    ~RssSampler() { stop(); }
+    double stopAndPeakMB() { stop(); return m_peak.load() / (1024.0 * 1024.0); }
+private:
+    void stop() {
+        m_stop = true;
+        if (m_thread.joinable()) m_thread.join();
+    }
+    atomic<bool> m_stop{false};
+    atomic<size_t> m_peak;
+    thread m_thread;
+};
+
+// Routes stdout to /dev/null so the library's logging goes through the real
+// (locked) stdio path without flooding the terminal.
+class StdoutToDevNull {
+public:
+    StdoutToDevNull() {
+        cout.flush();
+        fflush(stdout);
+        m_saved = dup(STDOUT_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDOUT_FILENO);
+            close(devNull);
+        }
+    }
+    ~StdoutToDevNull() {
+        cout.flush();
+        fflush(stdout);
+        if (m_saved >= 0) {
+            dup2(m_saved, STDOUT_FILENO);
+            close(m_saved);
+        }
+    }
+private:
+    int m_saved = -1;
+};
+
+double nearestRank(vector<double> values, double q) {
+    if (values.empty()) return 0.0;
+    sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(ceil(q * values.size()));
+    return values[min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Runs `count` pipelines over the corpus with `workers` concurrent threads.
+// Logging is either discarded in-process (QuietScope) or sent through stdout.
+ThroughputResult runPipelines(const vector<string>& corpus, int workers, int cvThreads, int count,
+                              const ImageProcessor::ProcessingParams& params, bool logToStdout) {
+    setNumThreads(cvThreads);
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+
+    ThroughputResult result;
+    result.workers = workers;
+    result.cvThreads = cvThreads;
+    result.images = count;
+
+    vector<vector<double>> latencies(workers);
+    atomic<int> next{0};
+    atomic<int> failures{0};
+
+    unique_ptr<QuietScope> quiet;
+    unique_ptr<StdoutToDevNull> devNull;
+    if (logToStdout) {
+        devNull = make_unique<StdoutToDevNull>();
+    } else {
+        quiet = make_unique<QuietScope>();
+    }
+
+    RssSampler rss;
+    double cpuStart = processCpuSeconds();
+    auto wallStart = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&, w] {
+            ImageProcessor::ProcessingParams local = params;
+            for (int i = next++; i < count; i = next++) {
+                auto start = chrono::steady_clock::now();
+                try {
+                    ImageProcessor::processImageToStage(corpus[i % corpus.size()], local, PRINT_TRACE_STAGE_FINAL);
+                } catch (const exception&) {
+                    failures++;
+                }
+                latencies[w].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    result.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+    double cpuSeconds = processCpuSeconds() - cpuStart;
+    result.peakRssMB = rss.stopAndPeakMB();
+    quiet.reset();
+    devNull.reset();
+
+    vector<double> all;
+    for (const auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+    result.failures = failures.load();
+    result.imagesPerSecond = count / result.wallSeconds;
+    result.p50Ms = nearestRank(all, 0.50);
+    result.p95Ms = nearestRank(all, 0.95);
+    result.p99Ms = nearestRank(all, 0.99);
+    result.busyCores = cpuSeconds / result.wallSeconds;
+    result.cpuUtilisation = result.busyCores / max(1u, thread::hardware_concurrency());
+    return result;
+}
+
+// STREAM-style triad per worker on buffers well beyond the last-level cache share
+double probeMemoryBandwidth(int workers) {
+    const size_t n = 1 << 20;                  // 3 x 8 MB per worker
+    const int reps = 20;
+    vector<thread> threads;
+    atomic<bool> go{false};
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&] {
+            vector<double> a(n, 1.0), b(n, 2.0), c(n, 0.5);
+            while (!go.load()) this_thread::yield();
+            for (int r = 0; r < reps; r++) {
+                for (size_t i = 0; i < n; i++) a[i] = b[i] + 3.0 * c[i];
+                swap(a, b);
+            }
+            if (a[n / 2] < 0.0) cout << "";    // Keep the loop observable
+        });
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));   // Let workers finish allocating
+    auto start = chrono::steady_clock::now();
+    go = true;
+    for (auto& t : threads) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return workers * 3.0 * n * sizeof(double) * reps / seconds / 1e9;
+}
+
+// Image-sized and contour-sized allocate/release cycles, the pipeline's allocation mix
+double probeAllocator(int workers) {
+    const int cycles = 2000;
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&, w] {
+            RNG rng(static_cast<uint64_t>(w + 1));
+            for (int i = 0; i < cycles; i++) {
+                Mat image(512 + rng.uniform(0, 512), 1024, CV_8UC1);
+                image.data[0] = static_cast<uchar>(i);
+                vector<Point> contour(1000 + rng.uniform(0, 1000));
+                contour[0].x = image.data[0];
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return workers * 2.0 * cycles / seconds / 1e6;
+}
+
+vector<int> defaultWorkerCounts() {
+    int cores = static_cast<int>(max(1u, thread::hardware_concurrency()));
+    vector<int> counts;
+    for (int w = 1; w < cores; w *= 2) counts.push_back(w);
+    counts.push_back(cores);
+    return counts;
+}
+
+vector<string> prepareCorpus(const Arguments& args, vector<string>& tempFiles) {
+    vector<string> corpus;
+    if (!args.corpusDir.empty()) {
+        for (const auto& entry : filesystem::directory_iterator(args.corpusDir)) {
+            string ext = entry.path().extension().string();
+            transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (entry.is_regular_file() && (ext == ".jpg" || ext == ".jpeg" || ext == ".png")) {
+                corpus.push_back(entry.path().string());
+            }
+        }
+        sort(corpus.begin(), corpus.end());
+        return corpus;
+    }
+
+    int megapixels = args.megapixelsGiven ? args.megapixels.front() : 12;
+    Size size = sizeForMegapixels(megapixels);
+    for (int i = 0; i < args.corpusImages; i++) {
+        SceneGenerator::Scene scene = makeSyntheticScene(size, args.seed + static_cast<uint64_t>(i));
+        string path = (filesystem::temp_directory_path() /
+                       ("printtrace_throughput_" + to_string(i) + scene.encodedExtension)).string();
+        ofstream out(path, ios::binary);
+        out.write(reinterpret_cast<const char*>(scene.encoded.data()), static_cast<streamsize>(scene.encoded.size()));
+        corpus.push_back(path);
+        tempFiles.push_back(path);
+    }
+    return corpus;
+}
+
+// Scaling efficiency of rate(w) relative to w * rate(1)
+double efficiency(const map<int, double>& rates, int workers) {
+    auto base = rates.find(1);
+    auto at = rates.find(workers);
+    if (base == rates.end() || at == rates.end() || base->second <= 0.0) return 0.0;
+    return at->second / (workers * base->second);
+}
+
+void writeThroughputJSON(const vector<ThroughputResult>& results, const vector<ProbeResult>& probes,
+                         const vector<string>& diagnosis, const Arguments& args, const string& path) {
+    FileStorage fs(path, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+    time_t now = time(nullptr);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fs << "library_version" << string(print_trace_get_version());
+    fs << "opencv_version" << string(CV_VERSION);
+    fs << "hardware_threads" << static_cast<int>(thread::hardware_concurrency());
+    fs << "label" << args.label;
+    fs << "timestamp" << string(timestamp);
+    fs << "throughput" << "[";
+    for (const auto& r : results) {
+        fs << "{"
+           << "workers" << r.workers
+           << "cv_threads" << r.cvThreads
+           << "images" << r.images
+           << "failures" << r.failures
+           << "wall_s" << r.wallSeconds
+           << "images_per_s" << r.imagesPerSecond
+           << "p50_ms" << r.p50Ms
+           << "p95_ms" << r.p95Ms
+           << "p99_ms" << r.p99Ms
+           << "peak_rss_mb" << r.peakRssMB
+           << "cpu_utilisation" << r.cpuUtilisation
+           << "busy_cores" << r.busyCores
+           << "}";
+    }
+    fs << "]";
+    fs << "probes" << "[";
+    for (const auto& p : probes) {
+        fs << "{" << "probe" << p.probe << "workers" << p.workers << "rate" << p.rate << "unit" << p.unit << "}";
+    }
+    fs << "]";
+    fs << "diagnosis" << "[";
+    for (const auto& line : diagnosis) fs << line;
+    fs << "]";
+    fs.release();
+}
+
+void writeThroughputCSV(const vector<ThroughputResult>& results, const string& path) {
+    ofstream out(path);
+    out << "workers,cv_threads,images,failures,wall_s,images_per_s,p50_ms,p95_ms,p99_ms,peak_rss_mb,cpu_utilisation\n";
+    out << fixed << setprecision(4);
+    for (const auto& r : results) {
+        out << r.workers << "," << r.cvThreads << "," << r.images << "," << r.failures << "," << r.wallSeconds << ","
+            << r.imagesPerSecond << "," << r.p50Ms << "," << r.p95Ms << "," << r.p99Ms << ","
+            << r.peakRssMB << "," << r.cpuUtilisation << "\n";
+    }
+}
+
+int runThroughput(const Arguments& args, ImageProcessor::ProcessingParams params) {
+    int cores = static_cast<int>(max(1u, thread::hardware_concurrency()));
+    vector<int> workerCounts = args.workers.empty() ? defaultWorkerCounts() : args.workers;
+    vector<int> cvThreadCounts = args.cvThreads;
+    if (cvThreadCounts.empty()) {
+        cvThreadCounts = {1};
+        if (cores > 1) cvThreadCounts.push_back(cores);
+    }
+    params.lightboxWidthPx = args.lightboxSizes.front();
+    params.lightboxHeightPx = args.lightboxSizes.front();
+
+    vector<string> tempFiles;
+    vector<string> corpus = prepareCorpus(args, tempFiles);
+    if (corpus.empty()) {
+        cerr << "[ERROR] No images in corpus" << endl;
+        return 1;
+    }
+
+    int savedThreads = getNumThreads();
+    cout << "PrintTrace throughput (libprinttrace v" << print_trace_get_version() << ", OpenCV " << CV_VERSION
+         << ", " << cores << " hardware threads, " << corpus.size() << " images, lightbox "
+         << params.lightboxWidthPx << " px)\n" << endl;
+    cout << right << setw(8) << "workers" << setw(6) << "cv" << setw(10) << "img/s" << setw(9) << "speedup"
+         << setw(8) << "eff" << setw(10) << "p50 ms" << setw(10) << "p95 ms" << setw(10) << "p99 ms"
+         << setw(10) << "RSS MB" << setw(8) << "CPU%" << endl;
+
+    // Warm caches, lazy OpenCV initialisation and the allocator once
+    runPipelines(corpus, 1, cvThreadCounts.front(), 1, params, false);
+
+    vector<ThroughputResult> results;
+    map<int, map<int, double>> ratesByCv;      // cv threads -> workers -> images/s
+    for (int cvThreads : cvThreadCounts) {
+        for (int workers : workerCounts) {
+            int count = args.passes * max(static_cast<int>(corpus.size()), workers);
+            ThroughputResult r = runPipelines(corpus, workers, cvThreads, count, params, false);
+            ratesByCv[cvThreads][workers] = r.imagesPerSecond;
+            results.push_back(r);
+
+            double baseRate = ratesByCv[cvThreads].count(1) ? ratesByCv[cvThreads][1] : 0.0;
+            cout << setw(8) << workers << setw(6) << cvThreads << fixed << setprecision(2)
+                 << setw(10) << r.imagesPerSecond
+                 << setw(8) << (baseRate > 0 ? r.imagesPerSecond / baseRate : 0.0) << "x"
+                 << setw(8) << setprecision(0) << efficiency(ratesByCv[cvThreads], workers) * 100.0 << "%"
+                 << setprecision(1) << setw(10) << r.p50Ms << setw(10) << r.p95Ms << setw(10) << r.p99Ms
+                 << setw(10) << setprecision(0) << r.peakRssMB << setw(7) << r.cpuUtilisation * 100.0 << "%"
+                 << (r.failures > 0 ? "  (" + to_string(r.failures) + " failed)" : "") << endl;
+        }
+    }
+
+    // Where does scaling stop? First worker count whose gain is under half the ideal gain
+    const map<int, double>& rates = ratesByCv[cvThreadCounts.front()];
+    int knee = 0, previous = 0;
+    for (const auto& [workers, rate] : rates) {
+        if (previous > 0) {
+            double idealGain = static_cast<double>(workers) / previous - 1.0;
+            double actualGain = rate / rates.at(previous) - 1.0;
+            if (actualGain < 0.5 * idealGain) {
+                knee = workers;
+                break;
+            }
+        }
+        previous = workers;
+    }
+
+    vector<ProbeResult> probes;
+    vector<string> diagnosis;
+    int probeWorkers = knee > 0 ? knee : workerCounts.back();
+
+    if (args.probes) {
+        cout << "\nDiagnostics:" << endl;
+        map<int, double> bandwidth, allocator;
+        for (int workers : workerCounts) {
+            bandwidth[workers] = probeMemoryBandwidth(workers);
+            allocator[workers] = probeAllocator(workers);
+            probes.push_back({"memory_bandwidth", workers, bandwidth[workers], "GB/s"});
+            probes.push_back({"allocator", workers, allocator[workers], "Mops/s"});
+            cout << "  " << setw(3) << workers << " workers: triad " << fixed << setprecision(1) << setw(7)
+                 << bandwidth[workers] << " GB/s (" << setprecision(0) << efficiency(bandwidth, workers) * 100.0
+                 << "%), alloc " << setprecision(2) << setw(7) << allocator[workers] << " Mops/s ("
+                 << setprecision(0) << efficiency(allocator, workers) * 100.0 << "%)" << endl;
+        }
+
+        // Same configuration with logging discarded in-process vs written through stdout
+        int count = args.passes * max(static_cast<int>(corpus.size()), probeWorkers);
+        ThroughputResult quiet = runPipelines(corpus, probeWorkers, cvThreadCounts.front(), count, params, false);
+        ThroughputResult logged = runPipelines(corpus, probeWorkers, cvThreadCounts.front(), count, params, true);
+        probes.push_back({"logging_off", probeWorkers, quiet.imagesPerSecond, "images/s"});
+        probes.push_back({"logging_on", probeWorkers, logged.imagesPerSecond, "images/s"});
+        double loggingCost = quiet.imagesPerSecond > 0 ? 1.0 - logged.imagesPerSecond / quiet.imagesPerSecond : 0.0;
+        cout << "  logging at " << probeWorkers << " workers: " << fixed << setprecision(2) << quiet.imagesPerSecond
+             << " img/s discarded vs " << logged.imagesPerSecond << " img/s through stdout ("
+             << setprecision(0) << loggingCost * 100.0 << "% slower)" << endl;
+
+        if (knee == 0) {
+            diagnosis.push_back("Throughput scales across all measured worker counts");
+        } else {
+            ostringstream line;
+            line << "Scaling stops at " << knee << " workers (cv threads " << cvThreadCounts.front() << ")";
+            diagnosis.push_back(line.str());
+
+            const ThroughputResult* kneeResult = nullptr;
+            for (const auto& r : results) {
+                if (r.workers == knee && r.cvThreads == cvThreadCounts.front()) kneeResult = &r;
+            }
+            if (efficiency(bandwidth, knee) < 0.7) {
+                diagnosis.push_back("Memory bandwidth saturates at the same point (triad efficiency " +
+                                    to_string(static_cast<int>(efficiency(bandwidth, knee) * 100)) + "%)");
+            }
+            if (efficiency(allocator, knee) < 0.7) {
+                diagnosis.push_back("Allocator contention: allocation rate scales poorly (" +
+                                    to_string(static_cast<int>(efficiency(allocator, knee) * 100)) + "%)");
+            }
+            if (loggingCost > 0.1) {
+                diagnosis.push_back("Logging lock: stdout logging costs " + to_string(static_cast<int>(loggingCost * 100)) +
+                                    "% throughput");
+            }
+            if (kneeResult && kneeResult->busyCores < 0.8 * knee * cvThreadCounts.front()) {
+                ostringstream blocked;
+                blocked << "Workers are blocked part of the time (" << fixed << setprecision(1)
+                        << kneeResult->busyCores << " busy cores for " << knee << " workers)";
+                diagnosis.push_back(blocked.str());
+            }
+            if (diagnosis.size() == 1) {
+                diagnosis.push_back("No probe explains the knee; check core count vs. SMT siblings and thermal limits");
+            }
+        }
+
+        cout << "\nDiagnosis:" << endl;
+        for (const auto& line : diagnosis) cout << "  - " << line << endl;
+    }
+
+    setNumThreads(savedThreads);
+    for (const auto& path : tempFiles) filesystem::remove(path);
+
+    if (!args.outputPath.empty()) {
+        if (filesystem::path(args.outputPath).extension() == ".csv") {
+            writeThroughputCSV(results, args.outputPath);
+        } else {
+            writeThroughputJSON(results, probes, diagnosis, args, args.outputPath);
+        }
+        cout << "\n[INFO] Results written to " << args.outputPath << endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Arguments args = parseArguments(argc, argv);
+    if (!args.valid) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Debug image functions are no-ops unless debug output is enabled and are
+    // dominated by disk I/O when it is, so they are not part of the suite.
+    ImageProcessor::ProcessingParams params;
+    params.enableDebugOutput = false;
+    params.verboseOutput = false;
+
+    if (args.throughput) {
+        return runThroughput(args, params);
+    }
+
+    BenchSuite suite(args);
+    if (!args.listOnly) {
+        cout << "PrintTrace microbenchmarks (libprinttrace v" << print_trace_get_version()
+             << ", OpenCV " << CV_VERSION << ", " << getNumThreads() << " threads)" << endl;
+        cout << "Warm-up: " << args.warmup << ", iterations: " << args.iterations
+             << ", seed: " << args.seed << "\n" << endl;
+        cout << left << setw(34) << "function" << setw(8) << "input" << right << setw(7) << "lbox"
+             << setw(12) << "median ms" << setw(12) << "p95 ms" << endl;
+    }
+
+    filesystem::path tempDir = filesystem::temp_directory_path();
+
+    for (int megapixels : args.megapixels) {
+        Size size = sizeForMegapixels(megapixels);
+        string input = to_string(megapixels) + "MP";
+        SceneGenerator::Scene scene = makeSyntheticScene(size, args.seed + megapixels);
+        const Mat& photo = scene.image;
+
+        string photoPath = (tempDir / ("printtrace_bench_" + input + scene.encodedExtension)).string();
+        {
+            ofstream out(photoPath, ios::binary);
+            out.write(reinterpret_cast<const char*>(scene.encoded.data()), static_cast<streamsize>(scene.encoded.size()));
+        }
+
+        benchSourceFunctions(suite, photo, photoPath, input, params);
+
+        // Ground-truth corners keep the warp cases independent of detection quality
+        Mat gray;
+        const vector<Point2f>& corners = scene.lightboxCorners;
+        {
+            QuietScope quiet;
+            gray = ImageProcessor::convertToGrayscale(photo);
+        }
+
+        for (int lightboxPx : args.lightboxSizes) {
+            benchLightboxFunctions(suite, gray, corners, input, lightboxPx, scene, params);
+
+            ImageProcessor::ProcessingParams pipelineParams = params;
+            pipelineParams.lightboxWidthPx = lightboxPx;
+            pipelineParams.lightboxHeightPx = lightboxPx;
+            suite.run("processImageToStage", input, lightboxPx, [&] {
+                ImageProcessor::processImageToStage(photoPath, pipelineParams, PRINT_TRACE_STAGE_FINAL);
+            });
+        }
+
+        filesystem::remove(photoPath);
+    }
+
+    if (args.listOnly) return 0;
+
+    if (!args.outputPath.empty()) {
+        if (filesystem::path(args.outputPath).extension() == ".csv") {
+            writeCSV(suite.results(), args.outputPath);
+        } else {
+            writeJSON(suite.results(), args, args.outputPath);
+        }
+        cout << "\n[INFO] Results written to " << args.outputPath << endl;
+    }
+
+    if (!args.comparePath.empty()) {
+        int regressions = compareWithBaseline(suite.results(), args);
+        if (regressions != 0) {
+            cerr << "[ERROR] " << (regressions < 0 ? "Comparison failed" : to_string(regressions) + " case(s) regressed") << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
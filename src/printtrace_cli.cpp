@@ -1,10 +1,32 @@
 #include <PrintTraceAPI.h>
+#include "BatchJournal.hpp"
+#include "FolderWatcher.hpp"
+#include <atomic>
+#include <csignal>
 #include <iostream>
 #include <string>
 #include <fstream>
 #include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
 
 using namespace std;
+using PrintTrace::BatchJournal;
+using PrintTrace::FolderWatcher;
+
+// One --sweep axis as given on the command line
+struct SweepAxisArg {
+    string name;
+    vector<double> values;
+};
 
 struct Arguments {
     string inputPath;
@@ -16,6 +38,7 @@ struct Arguments {
     bool enableSmoothing = false;
     double smoothingMM = 0.2;
     int smoothingMode = 1;             // Default to curvature-based
+    bool noIntersectionRepair = false; // Fail on self-intersections instead of cutting loops
     
     // Lightbox dimension parameters (pixels are auto-calculated from MM)
     double lightboxWidthMM = 0.0;      // 0 = use default
@@ -26,6 +49,7 @@ struct Arguments {
     bool useAdaptiveThreshold = false;
     double manualThreshold = 0.0;      // 0 = auto
     double thresholdOffset = 0.0;      // Offset from auto threshold
+    bool autoThreshold = false;        // Score candidate thresholds instead of Otsu
     
     // Morphological processing parameters
     bool disableMorphology = false;    // Disable morphological cleaning
@@ -38,11 +62,92 @@ struct Arguments {
     // Edge detection parameters
     double cannyLower = 0.0;           // 0 = use default
     double cannyUpper = 0.0;           // 0 = use default
+    bool raceCorners = false;          // Run all corner detectors in parallel
+    bool scanlineCorners = false;      // Find the lightbox edges along sparse scanlines
+    double cornerConfidence = 0.0;     // 0 = use default
+    bool qualityGate = false;          // Reject unusable photos on a thumbnail first
+    double minSharpness = -1.0;        // < 0 = use default
+    int tileMemoryMB = 0;              // 0 = whole-frame lightbox detection
+    int maxMemoryMB = 0;               // 0 = no memory budget
+    double toleranceMM = 0.0;          // 0 = fixed warp size
     
     // Performance parameters
     bool enableInpainting = false;      // Enable inpainting for cleaner paper isolation
+    int poolThreads = -1;               // < 0 = library default thread pool
+    int cvThreads = 0;                  // 0 = split cores across pool threads
+    int jobParallelism = 0;             // 0 = no per-job cap
+    vector<int32_t> cpus;               // Pin pool threads to these CPUs (empty = any)
+    
+    // Diagnostics
+    string recordDir;                   // Record runs for printtrace_replay (empty = off)
+    string cacheDir;                    // Result cache directory (empty = off)
+    string timeCalibration;             // Processing-time calibration file (empty = off)
+    double cacheSizeMB = 1024.0;        // Result cache size bound
+    string metricsListen;               // Prometheus endpoint, host:port or unix:path (empty = off)
+    string metricsFile;                 // Textfile collector output (empty = off)
+    double metricsInterval = 15.0;      // Seconds between metrics file rewrites
+    
+    // Batch processing
+    string batchDir;                    // Process every image in this directory
+    string snapshotDir;                 // Stage 1 snapshots for re-tuning (empty = off)
+    bool snapshotCompress = false;      // Store snapshots as lossless PNG
+    vector<string> watchDirs;           // Watch mode: convert images as they arrive
+    vector<bool> watchInteractive;      // Per watchDirs entry: queue its jobs as interactive
+    int batchAgingSeconds = 10;         // Batch jobs waiting this long start ahead of interactive ones
+    bool preemptBatch = false;          // Batch jobs yield to interactive ones between stages
+    double watchMemoryMB = 0.0;         // Memory budget across concurrent conversions (0 = none)
+    double watchSettle = 1.0;           // Seconds a new file must stay unchanged
+    int watchJobs = 0;                  // Concurrent conversions, 0 = one per pool thread
+    int shardIndex = 0;                 // Process only inputs whose path hash falls in this shard
+    int shardCount = 1;
+    string journalPath;                 // Completion journal for resuming (empty = none)
+    
+    // Journal merging
+    string mergeOutput;                 // Merged CSV report (non-empty = merge mode)
+    vector<string> mergeJournals;
+    
+    // Parameter sweep
+    vector<SweepAxisArg> sweepAxes;     // Parameters to vary (empty = normal run)
+    int sweepThreads = 0;               // 0 = all hardware threads
+    string sweepOutput;                 // CSV table path (empty = stdout)
+    string sweepDxfDir;                 // Write one DXF per successful combination
 };
 
+// Parses "name=start:stop:step" or "name=v1,v2,..."
+bool parseSweepAxis(const string& spec, SweepAxisArg& axis) {
+    size_t eq = spec.find('=');
+    if (eq == string::npos || eq == 0 || eq + 1 >= spec.size()) return false;
+    axis.name = spec.substr(0, eq);
+    axis.values.clear();
+    string values = spec.substr(eq + 1);
+    try {
+        if (values.find(':') != string::npos) {
+            size_t c1 = values.find(':');
+            size_t c2 = values.find(':', c1 + 1);
+            if (c2 == string::npos) return false;
+            double start = stod(values.substr(0, c1));
+            double stop = stod(values.substr(c1 + 1, c2 - c1 - 1));
+            double step = stod(values.substr(c2 + 1));
+            if (step <= 0.0 || stop < start) return false;
+            // Index-based so accumulated rounding never drops the end point
+            int count = static_cast<int>(floor((stop - start) / step + 1e-9)) + 1;
+            if (count > 1000) return false;
+            for (int i = 0; i < count; i++) axis.values.push_back(start + i * step);
+        } else {
+            size_t pos = 0;
+            while (pos <= values.size()) {
+                size_t comma = values.find(',', pos);
+                if (comma == string::npos) comma = values.size();
+                axis.values.push_back(stod(values.substr(pos, comma - pos)));
+                pos = comma + 1;
+            }
+        }
+    } catch (const exception&) {
+        return false;
+    }
+    return !axis.values.empty();
+}
+
 Arguments parseArguments(int argc, char* argv[]) {
     Arguments args;
     
@@ -69,8 +174,12 @@ Arguments parseArguments(int argc, char* argv[]) {
             args.enableSmoothing = true; // Auto-enable when amount is specified
         } else if ((arg == "--smooth-mode") && (i + 1 < argc)) {
             args.smoothingMode = stoi(argv[++i]);
+        } else if (arg == "--no-intersection-repair") {
+            args.noIntersectionRepair = true;
         } else if (arg == "--adaptive-threshold") {
             args.useAdaptiveThreshold = true;
+        } else if (arg == "--auto-threshold") {
+            args.autoThreshold = true;
         } else if ((arg == "--manual-threshold") && (i + 1 < argc)) {
             args.manualThreshold = stod(argv[++i]);
         } else if ((arg == "--threshold-offset") && (i + 1 < argc)) {
@@ -93,13 +202,126 @@ Arguments parseArguments(int argc, char* argv[]) {
             args.cannyLower = stod(argv[++i]);
         } else if ((arg == "--canny-upper") && (i + 1 < argc)) {
             args.cannyUpper = stod(argv[++i]);
+        } else if (arg == "--race-corners") {
+            args.raceCorners = true;
+        } else if (arg == "--scanline-corners") {
+            args.scanlineCorners = true;
+        } else if ((arg == "--corner-confidence") && (i + 1 < argc)) {
+            args.cornerConfidence = stod(argv[++i]);
+            args.raceCorners = true; // Only meaningful when racing
+        } else if ((arg == "--tile-memory") && (i + 1 < argc)) {
+            args.tileMemoryMB = stoi(argv[++i]);
+        } else if ((arg == "--max-memory") && (i + 1 < argc)) {
+            args.maxMemoryMB = stoi(argv[++i]);
+        } else if ((arg == "--tolerance") && (i + 1 < argc)) {
+            args.toleranceMM = stod(argv[++i]);
+        } else if (arg == "--quality-gate") {
+            args.qualityGate = true;
+        } else if ((arg == "--min-sharpness") && (i + 1 < argc)) {
+            args.minSharpness = stod(argv[++i]);
+            args.qualityGate = true;
         } else if (arg == "--enable-inpainting") {
             args.enableInpainting = true;
+        } else if ((arg == "--threads") && (i + 1 < argc)) {
+            args.poolThreads = stoi(argv[++i]);
+        } else if ((arg == "--cv-threads") && (i + 1 < argc)) {
+            args.cvThreads = stoi(argv[++i]);
+            args.poolThreads = max(args.poolThreads, 0);
+        } else if ((arg == "--job-parallelism") && (i + 1 < argc)) {
+            args.jobParallelism = stoi(argv[++i]);
+            args.poolThreads = max(args.poolThreads, 0);
+        } else if ((arg == "--cpus") && (i + 1 < argc)) {
+            stringstream list(argv[++i]);
+            string cpu;
+            while (getline(list, cpu, ',')) {
+                if (!cpu.empty()) args.cpus.push_back(stoi(cpu));
+            }
+            args.poolThreads = max(args.poolThreads, 0);
+        } else if ((arg == "--record") && (i + 1 < argc)) {
+            args.recordDir = argv[++i];
+        } else if ((arg == "--cache") && (i + 1 < argc)) {
+            args.cacheDir = argv[++i];
+        } else if ((arg == "--time-calibration") && (i + 1 < argc)) {
+            args.timeCalibration = argv[++i];
+        } else if ((arg == "--cache-size-mb") && (i + 1 < argc)) {
+            args.cacheSizeMB = stod(argv[++i]);
+        } else if ((arg == "--metrics-listen") && (i + 1 < argc)) {
+            args.metricsListen = argv[++i];
+        } else if ((arg == "--metrics-file") && (i + 1 < argc)) {
+            args.metricsFile = argv[++i];
+        } else if ((arg == "--metrics-interval") && (i + 1 < argc)) {
+            args.metricsInterval = stod(argv[++i]);
+        } else if ((arg == "--watch" || arg == "--watch-interactive") && (i + 1 < argc)) {
+            args.watchDirs.push_back(argv[++i]);
+            args.watchInteractive.push_back(arg == "--watch-interactive");
+        } else if ((arg == "--batch-aging") && (i + 1 < argc)) {
+            args.batchAgingSeconds = stoi(argv[++i]);
+        } else if (arg == "--preempt") {
+            args.preemptBatch = true;
+        } else if ((arg == "--watch-memory") && (i + 1 < argc)) {
+            args.watchMemoryMB = stod(argv[++i]);
+        } else if ((arg == "--settle") && (i + 1 < argc)) {
+            args.watchSettle = stod(argv[++i]);
+        } else if ((arg == "--watch-jobs") && (i + 1 < argc)) {
+            args.watchJobs = stoi(argv[++i]);
+        } else if ((arg == "--batch") && (i + 1 < argc)) {
+            args.batchDir = argv[++i];
+        } else if ((arg == "--snapshot-dir") && (i + 1 < argc)) {
+            args.snapshotDir = argv[++i];
+        } else if (arg == "--snapshot-compress") {
+            args.snapshotCompress = true;
+        } else if ((arg == "--shard") && (i + 1 < argc)) {
+            string spec = argv[++i];
+            size_t slash = spec.find('/');
+            if (slash == string::npos) return args;
+            args.shardIndex = stoi(spec.substr(0, slash));
+            args.shardCount = stoi(spec.substr(slash + 1));
+            if (args.shardCount < 1 || args.shardIndex < 0 || args.shardIndex >= args.shardCount) {
+                cerr << "[ERROR] Invalid shard " << spec << " (expected i/n with 0 <= i < n)" << endl;
+                return args;
+            }
+        } else if ((arg == "--journal") && (i + 1 < argc)) {
+            args.journalPath = argv[++i];
+        } else if ((arg == "--merge-journals") && (i + 1 < argc)) {
+            args.mergeOutput = argv[++i];
+            while (i + 1 < argc) {
+                args.mergeJournals.push_back(argv[++i]);
+            }
+            args.valid = !args.mergeJournals.empty();
+            return args;
+        } else if ((arg == "--sweep") && (i + 1 < argc)) {
+            SweepAxisArg axis;
+            if (!parseSweepAxis(argv[++i], axis)) {
+                cerr << "[ERROR] Invalid sweep axis: " << argv[i] << endl;
+                return args;
+            }
+            args.sweepAxes.push_back(axis);
+        } else if ((arg == "--sweep-threads") && (i + 1 < argc)) {
+            args.sweepThreads = stoi(argv[++i]);
+        } else if ((arg == "--sweep-output") && (i + 1 < argc)) {
+            args.sweepOutput = argv[++i];
+        } else if ((arg == "--sweep-dxf-dir") && (i + 1 < argc)) {
+            args.sweepDxfDir = argv[++i];
         } else if (arg == "--help" || arg == "-h") {
             return args; // Will trigger usage display
         }
     }
 
+    if (!args.watchDirs.empty()) {
+        // Watch mode: outputs go next to each input
+        args.valid = args.inputPath.empty() && args.batchDir.empty() && args.outputPath.empty();
+        return args;
+    }
+    if (!args.batchDir.empty()) {
+        // Batch mode: -o names the output directory (default: next to each input)
+        args.valid = args.inputPath.empty();
+        return args;
+    }
+    if (args.shardCount > 1 || !args.journalPath.empty()) {
+        cerr << "[ERROR] --shard and --journal require --batch" << endl;
+        return args;
+    }
+
     if (args.inputPath.empty()) {
         return args;
     }
@@ -123,6 +345,7 @@ void printUsage(const char* progName) {
          << "Using libprinttrace v" << print_trace_get_version() << "\n"
          << "\n"
          << "Usage: " << progName << " -i <input_image> [-o <output_dxf>] [options]\n"
+         << "       " << progName << " --batch <input_dir> [-o <output_dir>] [options]\n"
          << "\n"
          << "Required:\n"
          << "  -i, --input   Input image file path\n"
@@ -133,6 +356,7 @@ void printUsage(const char* progName) {
          << "  -s, --smooth  Enable smoothing to remove small details for easier 3D printing\n"
          << "  --smooth-amount <mm>  Smoothing amount in millimeters (default: 0.2, enables smoothing)\n"
          << "  --smooth-mode <0|1>  Smoothing algorithm: 0=morphological (legacy), 1=curvature-based (default)\n"
+         << "  --no-intersection-repair  Fail on a self-intersecting outline instead of cutting the loops out\n"
          << "\n"
          << "Lightbox Setup (for non-square lightboxes):\n"
          << "  --lightbox-width-mm <mm>       Real-world lightbox width in mm (default: 162.0)\n"
@@ -140,9 +364,18 @@ void printUsage(const char* progName) {
          << "  --pixels-per-mm <ratio>        Pixels per millimeter ratio (default: 10.0)\n"
          << "  --canny-lower <1-200>          Edge detection lower threshold (default: 50, try 5-15 for paper)\n"
          << "  --canny-upper <10-400>         Edge detection upper threshold (default: 150, try 30-80 for paper)\n"
+         << "  --race-corners                 Run all lightbox corner detectors in parallel, first confident one wins\n"
+         << "  --scanline-corners             Find lightbox edges along sparse scanlines (fastest on very large photos)\n"
+         << "  --corner-confidence <0-1>      Edge support a raced detector needs to win early (default: 0.8)\n"
+         << "  --tile-memory <MB>             Detect the lightbox in stripes within this working memory (large scans)\n"
+         << "  --max-memory <MB>              Pick decode scale and warp resolution to stay within this peak memory\n"
+         << "  --tolerance <mm>               Size the warp for this outline tolerance instead of a fixed resolution\n"
+         << "  --quality-gate                 Reject blurred, badly exposed or lightbox-less photos from a thumbnail\n"
+         << "  --min-sharpness <0-200>        Sharpness the quality gate requires (default: 10, implies --quality-gate)\n"
          << "\n"
          << "Object Detection:\n"
          << "  --adaptive-threshold  Use adaptive thresholding instead of Otsu (better for uneven lighting)\n"
+         << "  --auto-threshold  Try many thresholds and keep the most stable outline (dark or reflective parts)\n"
          << "  --manual-threshold <0-255>  Manual threshold value (0 = auto, overrides Otsu)\n"
          << "  --threshold-offset <-50 to +50>  Adjust Otsu threshold by this amount (negative = more inclusive)\n"
          << "  --disable-morphology  Disable morphological cleaning (preserves more peripheral detail)\n"
@@ -152,6 +385,56 @@ void printUsage(const char* progName) {
          << "\n"
          << "Performance:\n"
          << "  --enable-inpainting  Enable inpainting for cleaner paper isolation (slower but better quality)\n"
+         << "  --threads <n>   Library worker threads (default: cores - 1)\n"
+         << "  --cv-threads <n>  OpenCV threads per task (default: cores split across workers, -1: OpenCV default)\n"
+         << "  --job-parallelism <n>  Parallel tasks per image (default: no cap)\n"
+         << "  --cpus <list>   Restrict worker threads to these CPUs, e.g. 0,1,2,3 (Linux)\n"
+         << "\n"
+         << "Diagnostics:\n"
+         << "  --record <dir>  Record input, parameters and timings for offline replay (printtrace_replay)\n"
+         << "  --cache <dir>   Reuse results for identical images and parameters (shared result cache)\n"
+         << "  --cache-size-mb <n>  Result cache size bound; least recently used entries are evicted (default: 1024)\n"
+         << "  --metrics-listen <addr>  Serve Prometheus metrics at http://<addr>/metrics (host:port, :port for\n"
+         << "                  localhost, or unix:<socket path>)\n"
+         << "  --metrics-file <file.prom>  Rewrite Prometheus metrics to a file for node-exporter's textfile\n"
+         << "                  collector, and once more on exit\n"
+         << "  --metrics-interval <s>  Seconds between metrics file rewrites (default: 15)\n"
+         << "  --time-calibration <file>  Fit the processing-time estimate to this machine: stage timings\n"
+         << "                  of every run are added to <file> (shared between processes; created if missing)\n"
+         << "\n"
+         << "Batch Processing:\n"
+         << "  --batch <dir>   Convert every image in <dir>; -o sets the output directory\n"
+         << "  --snapshot-dir <dir>  Save the perspective-corrected lightbox per image and reuse it on later\n"
+         << "                  runs, so re-tuning object detection skips decoding and boundary detection\n"
+         << "  --snapshot-compress  Store snapshots as lossless PNG (smaller, slower to load)\n"
+         << "  --shard <i>/<n>  Process only shard i of n (assignment by path hash, same on every machine)\n"
+         << "  --journal <file>  Append a crash-safe completion record per image; rerunning with the same\n"
+         << "                  journal skips images already converted (default with --shard:\n"
+         << "                  <output_dir>/journal-<i>-of-<n>.ptj)\n"
+         << "  --merge-journals <report.csv> <journal>...  Combine shard journals into one report\n"
+         << "\n"
+         << "Watch Folders:\n"
+         << "  --watch <dir>   Convert images as they arrive in <dir> (repeatable; runs until interrupted).\n"
+         << "                  Writes <name>.dxf and a <name>.status sidecar next to each image; images\n"
+         << "                  with an up-to-date sidecar are skipped. A printtrace.params file in <dir>\n"
+         << "                  (name=value lines) overrides parameters for that folder.\n"
+         << "  --settle <s>    Seconds a new file must stay unchanged before conversion (default: 1)\n"
+         << "  --watch-jobs <n>  Images converted at once (default: one per worker thread)\n"
+         << "  --watch-interactive <dir>  Like --watch, but its images are converted ahead of those\n"
+         << "                  from --watch folders\n"
+         << "  --batch-aging <s>  A --watch image waiting this long goes first anyway (default: 10, 0 = never)\n"
+         << "  --preempt       Pause running --watch conversions between stages while interactive ones wait\n"
+         << "  --watch-memory <MB>  Start conversions only while their estimated peaks fit in <MB>\n"
+         << "                  (per image: see --max-memory); the rest wait (default: no limit)\n"
+         << "\n"
+         << "Parameter Sweep (with -i):\n"
+         << "  --sweep <name>=<start>:<stop>:<step>  Vary a parameter over a range (repeatable)\n"
+         << "  --sweep <name>=<v1>,<v2>,...          Vary a parameter over a list of values\n"
+         << "                  Names are PrintTraceParams fields, e.g. threshold_offset, morph_kernel_size,\n"
+         << "                  smoothing_amount_mm. Shared stages run once; branches run in parallel.\n"
+         << "  --sweep-threads <n>  Worker threads (default: all cores)\n"
+         << "  --sweep-output <file.csv>  Write the result table to a file instead of stdout\n"
+         << "  --sweep-dxf-dir <dir>  Write one DXF per successful combination\n"
          << "\n"
          << "General:\n"
          << "  -v, --verbose Enable verbose output\n"
@@ -169,6 +452,7 @@ void printUsage(const char* progName) {
          << "  " << progName << " -i photo.jpg --threshold-offset -15  # More inclusive thresholding\n"
          << "  " << progName << " -i photo.jpg --manual-threshold 120  # Use specific threshold value\n"
          << "  " << progName << " -i photo.jpg --adaptive-threshold    # Better for uneven lighting\n"
+         << "  " << progName << " -i photo.jpg --auto-threshold        # No threshold tuning for dark/shiny parts\n"
          << "  " << progName << " -i photo.jpg --disable-morphology    # Preserve peripheral detail\n"
          << "  " << progName << " -i photo.jpg --morph-kernel-size 3   # Gentle morphological cleaning\n"
          << "  " << progName << " -i photo.jpg --disable-contour-merging # Use single largest contour only\n"
@@ -182,6 +466,16 @@ void printUsage(const char* progName) {
          << "  " << progName << " -i photo.jpg --pixels-per-mm 15.0  # Lower resolution (15 pixels per mm)\n"
          << "  " << progName << " -i photo.jpg --pixels-per-mm 25.0  # Higher resolution (25 pixels per mm)\n"
          << "\n"
+         << "Sweep Examples:\n"
+         << "  " << progName << " -i photo.jpg --sweep threshold_offset=-20:20:5 --sweep morph_kernel_size=3,5,7 \\\n"
+         << "      --sweep smoothing_amount_mm=0.2:1.0:0.2 --sweep-output sweep.csv\n"
+         << "\n"
+         << "Batch Examples:\n"
+         << "  " << progName << " --batch photos/ -o dxf/ --snapshot-dir snapshots/\n"
+         << "  " << progName << " --batch photos/ -o dxf/ --snapshot-dir snapshots/ --threshold-offset -10  # Re-tune from stage 2\n"
+         << "  " << progName << " --batch photos/ -o dxf/ --shard 0/4   # One of four workers; rerun to resume\n"
+         << "  " << progName << " --merge-journals report.csv dxf/journal-*-of-4.ptj\n"
+         << "\n"
          << "General:\n"
          << "  " << progName << " -i photo.jpg -v\n"
          << "  " << progName << " -i photo.jpg -d  # Saves debug images to ./debug/\n"
@@ -198,6 +492,447 @@ void errorCallback(PrintTraceResult error_code, const char* error_message, void*
     cerr << "[ERROR] Code " << error_code << ": " << error_message << endl;
 }
 
+bool isImageFile(const filesystem::path& path) {
+    string ext = path.extension().string();
+    transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".tif" || ext == ".tiff" || ext == ".bmp";
+}
+
+// Runs a parameter sweep on args.inputPath and prints the result table; returns the process exit code
+int runSweep(const Arguments& args, const PrintTraceParams& params) {
+    vector<PrintTraceSweepAxis> axes;
+    for (const auto& axis : args.sweepAxes) {
+        axes.push_back({axis.name.c_str(), axis.values.data(), static_cast<int32_t>(axis.values.size())});
+    }
+
+    if (!args.sweepDxfDir.empty()) {
+        error_code ec;
+        filesystem::create_directories(args.sweepDxfDir, ec);
+        if (ec) {
+            cerr << "[ERROR] Could not create sweep DXF directory: " << args.sweepDxfDir << endl;
+            return 1;
+        }
+    }
+
+    PrintTraceSweepResult* results = nullptr;
+    int32_t count = 0;
+    auto start = chrono::steady_clock::now();
+    PrintTraceResult result = print_trace_sweep(
+        args.inputPath.c_str(), &params, axes.data(), static_cast<int32_t>(axes.size()),
+        args.sweepThreads, &results, &count, errorCallback, nullptr
+    );
+    if (result != PRINT_TRACE_SUCCESS) {
+        cerr << "[ERROR] Sweep failed: " << print_trace_get_error_message(result) << endl;
+        return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream file;
+    if (!args.sweepOutput.empty()) {
+        file.open(args.sweepOutput);
+        if (!file) {
+            cerr << "[ERROR] Could not write sweep table: " << args.sweepOutput << endl;
+            print_trace_free_sweep_results(results, count);
+            return 1;
+        }
+    }
+    ostream& table = args.sweepOutput.empty() ? cout : file;
+
+    table << "combination";
+    for (const auto& axis : args.sweepAxes) table << "," << axis.name;
+    table << ",result,points,area_mm2,perimeter_mm,solidity,elapsed_ms,dxf\n";
+
+    int32_t succeeded = 0;
+    for (int32_t i = 0; i < count; i++) {
+        const PrintTraceSweepResult& r = results[i];
+        string dxfPath;
+        if (r.result == PRINT_TRACE_SUCCESS) {
+            succeeded++;
+            if (!args.sweepDxfDir.empty()) {
+                char name[32];
+                snprintf(name, sizeof(name), "sweep_%04d.dxf", i);
+                dxfPath = (filesystem::path(args.sweepDxfDir) / name).string();
+                if (print_trace_save_contour_to_dxf(&r.contour, dxfPath.c_str(), errorCallback, nullptr) != PRINT_TRACE_SUCCESS) {
+                    dxfPath.clear();
+                }
+            }
+        }
+
+        // Results come back with the first axis varying slowest
+        vector<double> values(args.sweepAxes.size());
+        int32_t rest = i;
+        for (size_t a = args.sweepAxes.size(); a-- > 0;) {
+            const vector<double>& axisValues = args.sweepAxes[a].values;
+            values[a] = axisValues[rest % static_cast<int32_t>(axisValues.size())];
+            rest /= static_cast<int32_t>(axisValues.size());
+        }
+
+        table << i;
+        for (double value : values) table << "," << value;
+        table << "," << (r.result == PRINT_TRACE_SUCCESS ? "ok" : print_trace_get_error_message(r.result))
+              << "," << r.contour.point_count << "," << r.area_mm2 << "," << r.perimeter_mm
+              << "," << r.solidity << "," << r.elapsed_ms << "," << dxfPath << "\n";
+    }
+    table.flush();
+
+    cout << "[INFO] Sweep complete: " << succeeded << "/" << count << " combinations succeeded in "
+         << seconds << "s" << endl;
+    if (!args.sweepOutput.empty()) {
+        cout << "[INFO] Table saved to: " << args.sweepOutput << endl;
+    }
+    print_trace_free_sweep_results(results, count);
+    return succeeded > 0 ? 0 : 1;
+}
+
+// Converts every image in args.batchDir; returns the process exit code
+int runBatch(const Arguments& args, const PrintTraceParams& params) {
+    error_code ec;
+    vector<filesystem::path> inputs;
+    size_t otherShards = 0;
+    for (filesystem::directory_iterator it(args.batchDir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file() || !isImageFile(it->path())) continue;
+        // Shards hash the path relative to the batch directory so every machine agrees
+        if (!BatchJournal::inShard(it->path().filename().generic_string(), args.shardIndex, args.shardCount)) {
+            otherShards++;
+            continue;
+        }
+        inputs.push_back(it->path());
+    }
+    if (ec) {
+        cerr << "[ERROR] Could not read batch directory: " << args.batchDir << endl;
+        return 1;
+    }
+    sort(inputs.begin(), inputs.end());
+    if (inputs.empty() && otherShards == 0) {
+        cerr << "[ERROR] No images found in: " << args.batchDir << endl;
+        return 1;
+    }
+
+    filesystem::path outputDir = args.outputPath.empty() ? filesystem::path(args.batchDir) : filesystem::path(args.outputPath);
+    if (!args.outputPath.empty()) {
+        filesystem::create_directories(args.outputPath, ec);
+        if (ec) {
+            cerr << "[ERROR] Could not create output directory: " << args.outputPath << endl;
+            return 1;
+        }
+    }
+
+    string shard = args.shardCount > 1 ? to_string(args.shardIndex) + "/" + to_string(args.shardCount) : "";
+    string journalPath = args.journalPath;
+    if (journalPath.empty() && args.shardCount > 1) {
+        journalPath = (outputDir / ("journal-" + to_string(args.shardIndex) + "-of-" +
+                                    to_string(args.shardCount) + ".ptj")).string();
+    }
+
+    // Last record per input wins; only successes for unchanged content are skipped
+    map<string, BatchJournal::Record> completed;
+    BatchJournal journal;
+    if (!journalPath.empty()) {
+        vector<BatchJournal::Record> records;
+        size_t torn = 0;
+        if (BatchJournal::read(journalPath, records, &torn)) {
+            for (const auto& record : records) completed[record.input] = record;
+            cout << "[INFO] Journal " << journalPath << ": " << records.size() << " records"
+                 << (torn > 0 ? " (" + to_string(torn) + " torn lines ignored)" : "") << endl;
+        }
+        if (!journal.open(journalPath)) {
+            return 1;
+        }
+    }
+
+    cout << "[INFO] Batch: " << inputs.size() << " images from " << args.batchDir;
+    if (!shard.empty()) cout << " (shard " << shard << ", " << otherShards << " in other shards)";
+    cout << endl;
+
+    auto start = chrono::steady_clock::now();
+    size_t failed = 0;
+    size_t skipped = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        string name = inputs[i].filename().generic_string();
+        filesystem::path output = outputDir / inputs[i].stem();
+        output += ".dxf";
+
+        uint64_t inputHash = 0;
+        if (!BatchJournal::hashFile(inputs[i].string(), inputHash)) {
+            cerr << "[" << (i + 1) << "/" << inputs.size() << "] " << name << " unreadable" << endl;
+            failed++;
+            continue;
+        }
+
+        auto done = completed.find(name);
+        if (done != completed.end() && done->second.status == PRINT_TRACE_SUCCESS &&
+            done->second.inputHash == inputHash && filesystem::exists(done->second.output, ec)) {
+            skipped++;
+            continue;
+        }
+
+        auto itemStart = chrono::steady_clock::now();
+        PrintTraceResult result = print_trace_process_image_to_dxf(
+            inputs[i].string().c_str(),
+            output.string().c_str(),
+            &params,
+            args.verbose ? progressCallback : nullptr,
+            args.verbose ? errorCallback : nullptr,
+            nullptr
+        );
+        double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - itemStart).count();
+
+        if (result == PRINT_TRACE_SUCCESS) {
+            cout << "[" << (i + 1) << "/" << inputs.size() << "] " << name << " -> " << output.string() << endl;
+        } else {
+            failed++;
+            cerr << "[" << (i + 1) << "/" << inputs.size() << "] " << name
+                 << " failed: " << print_trace_get_error_message(result) << endl;
+        }
+
+        if (!journalPath.empty()) {
+            BatchJournal::Record record;
+            record.input = name;
+            record.inputHash = inputHash;
+            record.output = output.string();
+            record.status = static_cast<int32_t>(result);
+            record.elapsedMs = elapsedMs;
+            record.timestampMs = chrono::duration_cast<chrono::milliseconds>(
+                chrono::system_clock::now().time_since_epoch()).count();
+            record.shard = shard;
+            if (!journal.append(record)) {
+                cerr << "[ERROR] Could not write journal record, stopping so progress is not lost: " << journalPath << endl;
+                return 1;
+            }
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "[INFO] Batch complete: " << (inputs.size() - failed - skipped) << " converted, " << skipped
+         << " already done, " << failed << " failed in " << seconds << "s" << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+namespace {
+
+const char* const kWatchProfileName = "printtrace.params";
+// Watch mode saves the time calibration this often, not only at exit
+const auto kWatchCalibrationInterval = chrono::minutes(5);
+
+volatile sig_atomic_t g_stopWatching = 0;
+
+void stopWatching(int) {
+    g_stopWatching = 1;
+}
+
+// Completion bookkeeping shared with the job callback (runs on worker threads)
+struct WatchState {
+    mutex logMutex;
+    atomic<size_t> converted{0};
+    atomic<size_t> failed{0};
+};
+
+filesystem::path statusPath(const filesystem::path& input) {
+    filesystem::path status = input;
+    return status.replace_extension(".status");
+}
+
+// An image is done if its sidecar was written after the image was last modified
+bool hasCurrentStatus(const filesystem::path& input) {
+    error_code ec;
+    auto statusTime = filesystem::last_write_time(statusPath(input), ec);
+    if (ec) return false;
+    auto inputTime = filesystem::last_write_time(input, ec);
+    return !ec && statusTime >= inputTime;
+}
+
+// "name=value" lines over the given parameters; '#' starts a comment
+bool loadParamProfile(const filesystem::path& path, PrintTraceParams& params) {
+    ifstream file(path);
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty()) continue;
+        size_t eq = line.find('=');
+        if (eq == string::npos ||
+            print_trace_set_param(&params, line.substr(0, eq).c_str(), line.substr(eq + 1).c_str()) != PRINT_TRACE_SUCCESS) {
+            cerr << "[ERROR] " << path.string() << ":" << lineNumber << ": invalid parameter: " << line << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Written to a temporary name and renamed, so readers never see a partial sidecar
+void writeStatusSidecar(const filesystem::path& input, const string& output, PrintTraceResult result, double elapsedMs) {
+    filesystem::path status = statusPath(input);
+    filesystem::path temp = status;
+    temp += ".tmp";
+    {
+        ofstream file(temp);
+        file << "input=" << input.filename().string() << "\n"
+             << "output=" << (result == PRINT_TRACE_SUCCESS ? filesystem::path(output).filename().string() : "") << "\n"
+             << "status=" << static_cast<int>(result) << "\n"
+             << "message=" << print_trace_get_error_message(result) << "\n"
+             << "elapsed_ms=" << elapsedMs << "\n"
+             << "finished_ms=" << chrono::duration_cast<chrono::milliseconds>(
+                    chrono::system_clock::now().time_since_epoch()).count() << "\n";
+    }
+    error_code ec;
+    filesystem::rename(temp, status, ec);
+}
+
+void watchJobDone(uint64_t jobId, PrintTraceResult result, const char* inputPath,
+                  const char* outputPath, double elapsedMs, void* userData) {
+    WatchState& state = *static_cast<WatchState*>(userData);
+    writeStatusSidecar(inputPath, outputPath, result, elapsedMs);
+    lock_guard<mutex> lock(state.logMutex);
+    if (result == PRINT_TRACE_SUCCESS) {
+        state.converted++;
+        cout << "[" << jobId << "] " << inputPath << " -> " << outputPath << " (" << (int)elapsedMs << "ms)" << endl;
+    } else {
+        state.failed++;
+        cerr << "[" << jobId << "] " << inputPath << " failed: " << print_trace_get_error_message(result) << endl;
+    }
+}
+
+} // namespace
+
+// Converts images as they appear in args.watchDirs until interrupted; returns the process exit code
+int runWatch(const Arguments& args, const PrintTraceParams& params) {
+    vector<PrintTraceParams> profiles;
+    FolderWatcher watcher(isImageFile, args.watchSettle);
+    for (const auto& directory : args.watchDirs) {
+        PrintTraceParams folderParams = params;
+        filesystem::path profile = filesystem::path(directory) / kWatchProfileName;
+        error_code ec;
+        if (filesystem::exists(profile, ec)) {
+            if (!loadParamProfile(profile, folderParams)) return 1;
+            PrintTraceResult validation = print_trace_validate_params(&folderParams);
+            if (validation != PRINT_TRACE_SUCCESS) {
+                cerr << "[ERROR] " << profile.string() << ": " << print_trace_get_error_message(validation) << endl;
+                return 1;
+            }
+            cout << "[INFO] " << directory << ": parameters from " << profile.string() << endl;
+        }
+        if (!watcher.add(directory)) return 1;
+        profiles.push_back(folderParams);
+        cout << "[INFO] Watching " << directory << (args.watchInteractive[profiles.size() - 1] ? " (interactive)" : "")
+             << endl;
+    }
+
+    print_trace_set_max_concurrent_jobs(args.watchJobs);
+    PrintTraceSchedulerConfig scheduler;
+    scheduler.batch_aging_ms = args.batchAgingSeconds * 1000;
+    scheduler.preempt_batch = args.preemptBatch;
+    scheduler.memory_budget_mb = args.watchMemoryMB;
+    print_trace_configure_scheduler(&scheduler);
+    signal(SIGINT, stopWatching);
+    signal(SIGTERM, stopWatching);
+
+    WatchState state;
+    size_t skipped = 0;
+    auto lastCalibration = chrono::steady_clock::now();
+    while (!g_stopWatching) {
+        if (!args.timeCalibration.empty() && chrono::steady_clock::now() - lastCalibration > kWatchCalibrationInterval) {
+            print_trace_refresh_time_calibration();
+            lastCalibration = chrono::steady_clock::now();
+        }
+        for (const auto& ready : watcher.poll(250)) {
+            if (hasCurrentStatus(ready.path)) {
+                skipped++;
+                continue;
+            }
+            filesystem::path output = ready.path;
+            output.replace_extension(".dxf");
+            PrintTraceResult result = print_trace_submit_dxf_job(ready.path.string().c_str(), output.string().c_str(),
+                                                                 &profiles[ready.folder],
+                                                                 args.watchInteractive[ready.folder]
+                                                                     ? PRINT_TRACE_PRIORITY_INTERACTIVE
+                                                                     : PRINT_TRACE_PRIORITY_BATCH,
+                                                                 watchJobDone, &state, nullptr);
+            if (result != PRINT_TRACE_SUCCESS) {
+                lock_guard<mutex> lock(state.logMutex);
+                cerr << "[ERROR] Could not queue " << ready.path.string() << ": " << print_trace_get_error_message(result) << endl;
+            }
+        }
+    }
+
+    cout << "[INFO] Stopping, waiting for running conversions" << endl;
+    print_trace_wait_for_jobs();
+    cout << "[INFO] Watch stopped: " << state.converted << " converted, " << skipped
+         << " already done, " << state.failed << " failed" << endl;
+    return 0;
+}
+
+// Adds this run's stage timings to the calibration file; passes exitCode through
+int saveCalibration(const Arguments& args, int exitCode) {
+    if (!args.timeCalibration.empty() && print_trace_refresh_time_calibration() != PRINT_TRACE_SUCCESS) {
+        cerr << "[WARN] Could not update time calibration: " << args.timeCalibration << endl;
+    }
+    return exitCode;
+}
+
+// Writes the final metrics snapshot and closes the endpoint; passes exitCode through
+int stopMetrics(int exitCode) {
+    print_trace_write_metrics_file(nullptr, 0.0);
+    print_trace_serve_metrics(nullptr);
+    return exitCode;
+}
+
+// Combines shard journals into one CSV report; returns the process exit code
+int runMerge(const Arguments& args) {
+    map<string, BatchJournal::Record> latest;
+    size_t recordCount = 0;
+    size_t reprocessed = 0;
+    for (const auto& path : args.mergeJournals) {
+        vector<BatchJournal::Record> records;
+        size_t torn = 0;
+        if (!BatchJournal::read(path, records, &torn)) {
+            cerr << "[ERROR] Could not read journal: " << path << endl;
+            return 1;
+        }
+        if (torn > 0) {
+            cerr << "[WARN] " << path << ": " << torn << " torn lines ignored" << endl;
+        }
+        recordCount += records.size();
+        for (const auto& record : records) {
+            auto it = latest.find(record.input);
+            if (it == latest.end()) {
+                latest.emplace(record.input, record);
+            } else {
+                reprocessed++;
+                if (record.timestampMs >= it->second.timestampMs) it->second = record;
+            }
+        }
+    }
+
+    ofstream out(args.mergeOutput);
+    if (!out) {
+        cerr << "[ERROR] Could not write report: " << args.mergeOutput << endl;
+        return 1;
+    }
+    out << "input,input_hash,output,status,result,elapsed_ms,timestamp_ms,shard\n";
+
+    size_t succeeded = 0;
+    double totalMs = 0.0;
+    for (const auto& [input, record] : latest) {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(record.inputHash));
+        bool ok = record.status == PRINT_TRACE_SUCCESS;
+        if (ok) succeeded++;
+        totalMs += record.elapsedMs;
+        out << "\"" << input << "\"," << hash << ",\"" << record.output << "\"," << record.status << ","
+            << (ok ? "ok" : print_trace_get_error_message(static_cast<PrintTraceResult>(record.status))) << ","
+            << record.elapsedMs << "," << record.timestampMs << "," << record.shard << "\n";
+    }
+
+    cout << "[INFO] Merged " << args.mergeJournals.size() << " journals (" << recordCount << " records, "
+         << reprocessed << " retries): " << latest.size() << " images, " << succeeded << " converted, "
+         << (latest.size() - succeeded) << " failed, " << totalMs / 1000.0 << "s of processing" << endl;
+    cout << "[INFO] Report saved to: " << args.mergeOutput << endl;
+    return succeeded == latest.size() ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
     Arguments args = parseArguments(argc, argv);
     
@@ -206,21 +941,30 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (!args.mergeOutput.empty()) {
+        return runMerge(args);
+    }
+
+    bool batch = !args.batchDir.empty() || !args.watchDirs.empty();
     if (args.verbose) {
         cout << "[INFO] PrintTrace CLI v" << print_trace_get_version() << endl;
-        cout << "[INFO] Processing: " << args.inputPath << " -> " << args.outputPath << endl;
+        if (!batch) {
+            cout << "[INFO] Processing: " << args.inputPath << " -> " << args.outputPath << endl;
+        }
     }
 
-    // Validate input file
-    if (!print_trace_is_valid_image_file(args.inputPath.c_str())) {
-        cerr << "[ERROR] Input file is not a valid image or does not exist: " << args.inputPath << endl;
-        return 1;
-    }
+    if (!batch) {
+        // Validate input file
+        if (!print_trace_is_valid_image_file(args.inputPath.c_str())) {
+            cerr << "[ERROR] Input file is not a valid image or does not exist: " << args.inputPath << endl;
+            return 1;
+        }
 
-    // Check if input file is readable
-    if (!std::ifstream(args.inputPath).good()) {
-        cerr << "[ERROR] Input file is not readable: " << args.inputPath << endl;
-        return 1;
+        // Check if input file is readable
+        if (!std::ifstream(args.inputPath).good()) {
+            cerr << "[ERROR] Input file is not readable: " << args.inputPath << endl;
+            return 1;
+        }
     }
 
     // Get default parameters
@@ -258,6 +1002,36 @@ int main(int argc, char* argv[]) {
         params.canny_upper = args.cannyUpper;
         cout << "[INFO] Canny upper threshold set to " << args.cannyUpper << endl;
     }
+    if (args.scanlineCorners && !args.raceCorners) {
+        params.corner_detection_mode = 2;
+        cout << "[INFO] Scanline lightbox edge search enabled" << endl;
+    }
+    if (args.raceCorners) {
+        params.corner_detection_mode = 1;
+        if (args.cornerConfidence > 0.0) {
+            params.corner_min_confidence = args.cornerConfidence;
+        }
+        cout << "[INFO] Racing corner detectors (confidence bar " << params.corner_min_confidence << ")" << endl;
+    }
+    if (args.tileMemoryMB > 0) {
+        params.tile_memory_limit_mb = args.tileMemoryMB;
+        cout << "[INFO] Striped lightbox detection within " << args.tileMemoryMB << " MB" << endl;
+    }
+    if (args.maxMemoryMB > 0) {
+        params.max_memory_mb = args.maxMemoryMB;
+        cout << "[INFO] Memory budget " << args.maxMemoryMB << " MB" << endl;
+    }
+    if (args.toleranceMM > 0.0) {
+        params.target_tolerance_mm = args.toleranceMM;
+        cout << "[INFO] Warp sized for " << args.toleranceMM << " mm tolerance" << endl;
+    }
+    if (args.qualityGate) {
+        params.enable_quality_gate = true;
+        if (args.minSharpness >= 0.0) {
+            params.min_sharpness = args.minSharpness;
+        }
+        cout << "[INFO] Quality gate enabled (minimum sharpness " << params.min_sharpness << ")" << endl;
+    }
     
     // Enable debug output if requested
     if (args.debug) {
@@ -280,12 +1054,22 @@ int main(int argc, char* argv[]) {
              << (args.smoothingMode == 0 ? "morphological" : "curvature-based") << " method" << endl;
     }
     
+    if (args.noIntersectionRepair) {
+        params.repair_self_intersections = false;
+        cout << "[INFO] Self-intersection repair disabled - intersecting outlines will fail validation" << endl;
+    }
+    
     // Set object detection parameters if requested
     if (args.useAdaptiveThreshold) {
         params.use_adaptive_threshold = true;
         cout << "[INFO] Using adaptive thresholding for object detection" << endl;
     }
     
+    if (args.autoThreshold) {
+        params.auto_threshold = true;
+        cout << "[INFO] Using automatic threshold selection for object detection" << endl;
+    }
+    
     if (args.manualThreshold > 0.0) {
         params.manual_threshold = args.manualThreshold;
         cout << "[INFO] Using manual threshold: " << args.manualThreshold << endl;
@@ -323,11 +1107,68 @@ int main(int argc, char* argv[]) {
         cout << "[INFO] Inpainting enabled for cleaner paper isolation (this may slow down processing)" << endl;
     }
 
+    if (args.poolThreads >= 0) {
+        PrintTraceThreadConfig threadConfig = {args.poolThreads, args.cvThreads, args.jobParallelism,
+                                               args.cpus.empty() ? nullptr : args.cpus.data(),
+                                               static_cast<int32_t>(args.cpus.size())};
+        if (print_trace_configure_thread_pool(&threadConfig) != PRINT_TRACE_SUCCESS) {
+            cerr << "[ERROR] Invalid thread pool configuration" << endl;
+            return 1;
+        }
+        print_trace_get_thread_config(&threadConfig);
+        cout << "[INFO] Thread pool: " << threadConfig.worker_threads << " workers, OpenCV threads: "
+             << threadConfig.opencv_threads << endl;
+    }
+
+    if (!args.metricsListen.empty() && print_trace_serve_metrics(args.metricsListen.c_str()) != PRINT_TRACE_SUCCESS) {
+        return 1;
+    }
+    if (!args.metricsFile.empty()) {
+        if (print_trace_write_metrics_file(args.metricsFile.c_str(), args.metricsInterval) != PRINT_TRACE_SUCCESS) {
+            return stopMetrics(1);
+        }
+        cout << "[INFO] Metrics file: " << args.metricsFile << endl;
+    }
+
+    if (!args.recordDir.empty()) {
+        if (print_trace_set_recorder(args.recordDir.c_str()) != PRINT_TRACE_SUCCESS) {
+            cerr << "[ERROR] Could not enable run recording in: " << args.recordDir << endl;
+            return stopMetrics(1);
+        }
+        cout << "[INFO] Recording run to " << args.recordDir << endl;
+    }
+
+    if (!args.cacheDir.empty()) {
+        uint64_t maxBytes = static_cast<uint64_t>(max(0.0, args.cacheSizeMB) * 1024.0 * 1024.0);
+        if (print_trace_set_result_cache(args.cacheDir.c_str(), maxBytes) != PRINT_TRACE_SUCCESS) {
+            cerr << "[ERROR] Could not enable result cache in: " << args.cacheDir << endl;
+            return stopMetrics(1);
+        }
+        cout << "[INFO] Result cache: " << args.cacheDir << endl;
+    }
+
+    if (!args.timeCalibration.empty()) {
+        if (print_trace_set_time_calibration(args.timeCalibration.c_str()) != PRINT_TRACE_SUCCESS) {
+            cerr << "[ERROR] Could not load time calibration: " << args.timeCalibration << endl;
+            return stopMetrics(1);
+        }
+        cout << "[INFO] Time calibration: " << args.timeCalibration << endl;
+    }
+
+    if (!args.snapshotDir.empty()) {
+        if (print_trace_set_stage_snapshots(args.snapshotDir.c_str(), args.snapshotCompress) != PRINT_TRACE_SUCCESS) {
+            cerr << "[ERROR] Could not enable stage snapshots in: " << args.snapshotDir << endl;
+            return stopMetrics(1);
+        }
+        cout << "[INFO] Stage snapshots: " << args.snapshotDir
+             << (args.snapshotCompress ? " (compressed)" : "") << endl;
+    }
+
     // Validate parameters
     PrintTraceResult validation_result = print_trace_validate_params(&params);
     if (validation_result != PRINT_TRACE_SUCCESS) {
         cerr << "[ERROR] Invalid default parameters: " << print_trace_get_error_message(validation_result) << endl;
-        return 1;
+        return stopMetrics(1);
     }
 
     if (args.verbose) {
@@ -337,7 +1178,9 @@ int main(int argc, char* argv[]) {
         cout << "  Canny edges: " << params.canny_lower << "-" << params.canny_upper << endl;
         cout << "  CLAHE clip limit: " << params.clahe_clip_limit << endl;
         cout << "  Object detection: ";
-        if (params.use_adaptive_threshold) {
+        if (params.auto_threshold) {
+            cout << "automatic threshold selection";
+        } else if (params.use_adaptive_threshold) {
             cout << "adaptive threshold";
         } else if (params.manual_threshold > 0.0) {
             cout << "manual threshold (" << params.manual_threshold << ")";
@@ -359,12 +1202,29 @@ int main(int argc, char* argv[]) {
         }
         cout << endl;
         
-        double estimated_time = print_trace_estimate_processing_time(args.inputPath.c_str());
-        if (estimated_time > 0) {
-            cout << "  Estimated time: " << (int)estimated_time << "s" << endl;
+        if (!batch) {
+            double estimated_time = print_trace_estimate_processing_time_with_params(args.inputPath.c_str(), &params);
+            if (estimated_time > 0) {
+                cout << "  Estimated time: " << round(estimated_time * 10.0) / 10.0 << "s" << endl;
+            }
         }
     }
 
+    if (!args.sweepAxes.empty()) {
+        if (batch) {
+            cerr << "[ERROR] --sweep works on a single image (-i), not with --batch or --watch" << endl;
+            return stopMetrics(1);
+        }
+        return stopMetrics(saveCalibration(args, runSweep(args, params)));
+    }
+
+    if (!args.watchDirs.empty()) {
+        return stopMetrics(saveCalibration(args, runWatch(args, params)));
+    }
+    if (batch) {
+        return stopMetrics(saveCalibration(args, runBatch(args, params)));
+    }
+
     // Process image to DXF
     PrintTraceResult result = print_trace_process_image_to_dxf(
         args.inputPath.c_str(),
@@ -378,10 +1238,10 @@ int main(int argc, char* argv[]) {
     if (result == PRINT_TRACE_SUCCESS) {
         cout << "[SUCCESS] Conversion completed successfully!" << endl;
         cout << "[INFO] Output saved to: " << args.outputPath << endl;
-        return 0;
+        return stopMetrics(saveCalibration(args, 0));
     } else {
         const char* error_msg = print_trace_get_error_message(result);
         cerr << "[ERROR] Processing failed: " << error_msg << endl;
-        return 1;
+        return stopMetrics(saveCalibration(args, 1));
     }
 }
\ No newline at end of file
@@ -0,0 +1,334 @@
+#include "ContourMetrics.hpp"
+#include "ImageProcessor.hpp"
+#include "ParamCodec.hpp"
+#include "PrintTraceAPI.h"
+#include "RunRecorder.hpp"
+#include "ToolSupport.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+using namespace PrintTrace;
+
+namespace {
+
+struct Arguments {
+    vector<string> archives;                   // .ptrec files or directories of them
+    int iterations = 3;
+    double maxHausdorffMM = 0.05;              // Contour drift tolerated
+    double maxSlowdownPct = 0.0;               // 0 = report timings only
+    string extractInputPath;                   // Write the recorded input and exit
+    bool showParams = false;
+    string outputPath;
+    bool valid = true;
+};
+
+struct ReplayResult {
+    string archive;
+    string recordedVersion;
+    bool recordedSuccess = false;
+    bool replaySuccess = false;
+    string replayError;
+    double recordedTotalMs = 0.0;
+    double replayTotalMs = 0.0;
+    vector<pair<string, double>> recordedStages;
+    map<string, double> replayStages;          // Median over iterations
+    size_t recordedPoints = 0;
+    size_t replayPoints = 0;
+    ContourMetrics::Distance distance;
+    bool contourOk = true;
+    bool timingOk = true;
+};
+
+Arguments parseArguments(int argc, char* argv[]) {
+    Arguments args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            args.iterations = max(1, stoi(argv[++i]));
+        } else if (arg == "--max-hausdorff" && i + 1 < argc) {
+            args.maxHausdorffMM = stod(argv[++i]);
+        } else if (arg == "--max-slowdown" && i + 1 < argc) {
+            args.maxSlowdownPct = stod(argv[++i]);
+        } else if (arg == "--extract-input" && i + 1 < argc) {
+            args.extractInputPath = argv[++i];
+        } else if (arg == "--show-params") {
+            args.showParams = true;
+        } else if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            args.outputPath = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-') {
+            args.archives.push_back(arg);
+        } else {
+            args.valid = false;
+        }
+    }
+    if (args.archives.empty()) args.valid = false;
+    return args;
+}
+
+void printUsage(const char* progName) {
+    cout << "PrintTrace replay - rerun recorded runs (.ptrec) with the current code\n"
+         << "\n"
+         << "Usage: " << progName << " <archive.ptrec|directory>... [options]\n"
+         << "\n"
+         << "Options:\n"
+         << "  --iterations <n>         Replays per archive, timings are medians (default: 3)\n"
+         << "  --max-hausdorff <mm>     Contour drift that fails the replay (default: 0.05)\n"
+         << "  --max-slowdown <%>       Total-time slowdown that fails the replay (default: off)\n"
+         << "  --extract-input <file>   Write the recorded input image of one archive and exit\n"
+         << "  --show-params            Print the recorded parameters\n"
+         << "  -o, --output <file>      Write a JSON report\n"
+         << "\n"
+         << "Archives are produced by print_trace_set_recorder() or 'printtrace --record <dir>'.\n"
+         << "\n"
+         << "Examples:\n"
+         << "  " << progName << " recordings/run_1718000000000_4242_0.ptrec\n"
+         << "  " << progName << " recordings --max-slowdown 20 -o replay.json\n"
+         << endl;
+}
+
+vector<string> expandArchives(const vector<string>& inputs) {
+    vector<string> archives;
+    for (const auto& input : inputs) {
+        if (filesystem::is_directory(input)) {
+            vector<string> found;
+            for (const auto& entry : filesystem::directory_iterator(input)) {
+                if (entry.path().extension() == ".ptrec") found.push_back(entry.path().string());
+            }
+            sort(found.begin(), found.end());
+            archives.insert(archives.end(), found.begin(), found.end());
+        } else {
+            archives.push_back(input);
+        }
+    }
+    return archives;
+}
+
+bool writeBytes(const string& path, const vector<uchar>& bytes) {
+    ofstream out(path, ios::binary);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<streamsize>(bytes.size()));
+    return static_cast<bool>(out);
+}
+
+ReplayResult replay(const string& archivePath, const RunRecorder::Record& record, const Arguments& args) {
+    ReplayResult result;
+    result.archive = filesystem::path(archivePath).filename().string();
+    result.recordedVersion = record.libraryVersion;
+    result.recordedSuccess = record.resultCode == PRINT_TRACE_SUCCESS;
+    result.recordedTotalMs = record.totalMs;
+    result.recordedStages = record.stageTimingsMs;
+    result.recordedPoints = record.contour.size();
+
+    PrintTraceParams cParams;
+    string decodeError;
+    if (!ParamCodec::decode(record.params, cParams, &decodeError)) {
+        result.replayError = decodeError;
+        result.contourOk = false;
+        return result;
+    }
+    ImageProcessor::ProcessingParams params = ParamCodec::toProcessingParams(&cParams);
+    params.enableDebugOutput = false;          // Debug images would dominate the timings
+
+    // Keep the original extension so the decoder sees the same container format
+    string extension = filesystem::path(record.inputName).extension().string();
+    filesystem::path inputPath = filesystem::temp_directory_path() /
+                                 ("printtrace_replay_" + to_string(record.timestampMs) + extension);
+    if (!writeBytes(inputPath.string(), record.inputBytes)) {
+        result.replayError = "Could not write replay input";
+        result.contourOk = false;
+        return result;
+    }
+
+    // Resolve decode and warp sizes exactly as the recorded run did (memory budget)
+    ImageProcessor::MemoryPlan plan;
+    {
+        QuietScope quiet;
+        plan = ImageProcessor::resolveForImage(inputPath.string(), params);
+    }
+    if (!plan.fits) {
+        filesystem::remove(inputPath);
+        result.replayError = "Memory budget too small for this image";
+        result.contourOk = false;
+        return result;
+    }
+
+    map<string, vector<double>> stageSamples;
+    vector<double> totals;
+    vector<Point> contour;
+    double pixelsPerMM = 0.0;
+    try {
+        for (int i = 0; i < args.iterations; i++) {
+            QuietScope quiet;
+            auto start = chrono::steady_clock::now();
+            ImageProcessor::LightboxStage lightbox;
+            auto [image, stageContour] = ImageProcessor::processImageToStage(inputPath.string(), params,
+                                                                             record.targetStage, &lightbox);
+            pixelsPerMM = lightbox.pixelsPerMM;
+            totals.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            contour = stageContour;
+            for (const auto& [stage, ms] : params.stageTimingsMs) stageSamples[stage].push_back(ms);
+        }
+        result.replaySuccess = true;
+    } catch (const exception& e) {
+        result.replayError = e.what();
+    }
+    filesystem::remove(inputPath);
+
+    for (const auto& [stage, samples] : stageSamples) result.replayStages[stage] = percentile(samples, 50.0);
+    result.replayTotalMs = percentile(totals, 50.0);
+    result.replayPoints = contour.size();
+
+    if (result.recordedSuccess != result.replaySuccess) {
+        result.contourOk = false;
+    } else if (!record.contour.empty() && !contour.empty()) {
+        // Each contour in its own run's scale: tolerance mode picks the warp per run
+        auto toMM = [&](const vector<Point>& points, double runPixelsPerMM) {
+            if (runPixelsPerMM > 0.0) return ContourMetrics::pixelsToMM(points, runPixelsPerMM);
+            return ContourMetrics::pixelsToMM(points, params.lightboxWidthPx, params.lightboxHeightPx,
+                                              params.lightboxWidthMM, params.lightboxHeightMM);
+        };
+        auto recordedMM = toMM(record.contour, record.pixelsPerMM);
+        auto replayMM = toMM(contour, pixelsPerMM);
+        result.distance = ContourMetrics::compare(replayMM, recordedMM);
+        result.contourOk = result.distance.hausdorffMM <= args.maxHausdorffMM;
+    }
+
+    if (args.maxSlowdownPct > 0.0 && result.recordedTotalMs > 0.0 && result.replaySuccess) {
+        double slowdown = (result.replayTotalMs - result.recordedTotalMs) / result.recordedTotalMs * 100.0;
+        result.timingOk = slowdown <= args.maxSlowdownPct;
+    }
+    return result;
+}
+
+void printResult(const ReplayResult& r) {
+    cout << "\n" << r.archive << " (recorded with v" << r.recordedVersion << ", replayed with v"
+         << print_trace_get_version() << ")" << endl;
+    cout << "  result:  recorded " << (r.recordedSuccess ? "success" : "failure") << ", replay "
+         << (r.replaySuccess ? "success" : "failure: " + r.replayError) << endl;
+
+    cout << "  " << left << setw(14) << "stage" << right << setw(14) << "recorded ms" << setw(12) << "replay ms"
+         << setw(10) << "delta" << endl;
+    for (const auto& [stage, recordedMs] : r.recordedStages) {
+        auto it = r.replayStages.find(stage);
+        cout << "  " << left << setw(14) << stage << right << fixed << setprecision(1) << setw(14) << recordedMs;
+        if (it != r.replayStages.end()) {
+            cout << setw(12) << it->second;
+            if (recordedMs > 0.0) cout << setw(9) << showpos << (it->second - recordedMs) / recordedMs * 100.0 << "%" << noshowpos;
+        } else {
+            cout << setw(12) << "-";
+        }
+        cout << endl;
+    }
+    cout << "  " << left << setw(14) << "total" << right << setw(14) << r.recordedTotalMs << setw(12) << r.replayTotalMs;
+    if (r.recordedTotalMs > 0.0) {
+        cout << setw(9) << showpos << (r.replayTotalMs - r.recordedTotalMs) / r.recordedTotalMs * 100.0 << "%" << noshowpos;
+    }
+    cout << (r.timingOk ? "" : "  SLOWER THAN ALLOWED") << endl;
+
+    cout << "  contour: " << r.recordedPoints << " -> " << r.replayPoints << " points";
+    if (r.recordedPoints > 0 && r.replayPoints > 0) {
+        cout << setprecision(3) << ", Hausdorff " << r.distance.hausdorffMM << " mm, mean " << r.distance.meanMM << " mm";
+    }
+    cout << (r.contourOk ? "" : "  CHANGED") << endl;
+}
+
+void writeReport(const vector<ReplayResult>& results, const string& path) {
+    FileStorage fs(path, FileStorage::WRITE | FileStorage::FORMAT_JSON);
+    fs << "library_version" << string(print_trace_get_version());
+    fs << "replays" << "[";
+    for (const auto& r : results) {
+        fs << "{";
+        fs << "archive" << r.archive;
+        fs << "recorded_version" << r.recordedVersion;
+        fs << "recorded_success" << (r.recordedSuccess ? 1 : 0);
+        fs << "replay_success" << (r.replaySuccess ? 1 : 0);
+        fs << "replay_error" << r.replayError;
+        fs << "recorded_total_ms" << r.recordedTotalMs;
+        fs << "replay_total_ms" << r.replayTotalMs;
+        fs << "hausdorff_mm" << r.distance.hausdorffMM;
+        fs << "mean_mm" << r.distance.meanMM;
+        fs << "contour_ok" << (r.contourOk ? 1 : 0);
+        fs << "timing_ok" << (r.timingOk ? 1 : 0);
+        fs << "stages" << "[";
+        for (const auto& [stage, recordedMs] : r.recordedStages) {
+            auto it = r.replayStages.find(stage);
+            fs << "{" << "name" << stage << "recorded_ms" << recordedMs
+               << "replay_ms" << (it != r.replayStages.end() ? it->second : -1.0) << "}";
+        }
+        fs << "]";
+        fs << "}";
+    }
+    fs << "]";
+    fs.release();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && (string(argv[1]) == "-h" || string(argv[1]) == "--help")) {
+        printUsage(argv[0]);
+        return 0;
+    }
+
+    Arguments args = parseArguments(argc, argv);
+    if (!args.valid) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    vector<string> archives = expandArchives(args.archives);
+    if (archives.empty()) {
+        cerr << "[ERROR] No .ptrec archives found" << endl;
+        return 1;
+    }
+
+    if (!args.extractInputPath.empty()) {
+        RunRecorder::Record record;
+        if (!RunRecorder::readFile(archives.front(), record)) return 1;
+        if (!writeBytes(args.extractInputPath, record.inputBytes)) {
+            cerr << "[ERROR] Could not write " << args.extractInputPath << endl;
+            return 1;
+        }
+        cout << "[INFO] Wrote " << record.inputBytes.size() << " bytes (" << record.inputName << ") to "
+             << args.extractInputPath << endl;
+        return 0;
+    }
+
+    vector<ReplayResult> results;
+    int failures = 0;
+    for (const auto& archive : archives) {
+        RunRecorder::Record record;
+        if (!RunRecorder::readFile(archive, record)) {
+            failures++;
+            continue;
+        }
+        if (args.showParams) {
+            cout << "\n" << archive << " parameters:\n" << record.params;
+        }
+        ReplayResult r = replay(archive, record, args);
+        printResult(r);
+        if (!r.contourOk || !r.timingOk) failures++;
+        results.push_back(r);
+    }
+
+    if (!args.outputPath.empty()) {
+        writeReport(results, args.outputPath);
+        cout << "\n[INFO] Report written to " << args.outputPath << endl;
+    }
+
+    if (failures > 0) {
+        cout << "\n" << failures << " of " << archives.size() << " replay(s) differ" << endl;
+        return 1;
+    }
+    cout << "\nAll " << archives.size() << " replay(s) match" << endl;
+    return 0;
+}
@@ -0,0 +1,843 @@
+#include "BatchJournal.hpp"
+#include "ImageProcessor.hpp"
+#include "JobQueue.hpp"
+#include "SceneGenerator.hpp"
+#include "ToolSupport.hpp"
+#include "WorkerPool.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cv;
+using namespace PrintTrace;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Failures print where they happened and fail the case; a case keeps going so
+// one run reports everything that is wrong
+int g_failures = 0;
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            cerr << "  " << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << endl; \
+            g_failures++;                                                                    \
+        }                                                                                    \
+    } while (0)
+
+// Fresh directory under the system temp dir, removed with the scope
+class TempDir {
+public:
+    explicit TempDir(const string& name)
+        : m_path(fs::temp_directory_path() / ("printtrace_tests_" + name + "_" + to_string(getpid()))) {
+        fs::remove_all(m_path);
+        fs::create_directories(m_path);
+    }
+    ~TempDir() {
+        error_code ec;
+        fs::remove_all(m_path, ec);
+    }
+    const fs::path& path() const { return m_path; }
+private:
+    fs::path m_path;
+};
+
+// Collects what the library logs to std::cout, for cases that check a reported value
+class CaptureOutput {
+public:
+    CaptureOutput() : m_saved(cout.rdbuf(m_text.rdbuf())) {}
+    ~CaptureOutput() { cout.rdbuf(m_saved); }
+    string text() const { return m_text.str(); }
+private:
+    ostringstream m_text;
+    streambuf* m_saved;
+};
+
+BatchJournal::Record makeRecord(const string& input, uint64_t hash) {
+    BatchJournal::Record record;
+    record.input = input;
+    record.inputHash = hash;
+    record.output = input + ".dxf";
+    record.elapsedMs = 12.5;
+    record.timestampMs = 1700000000000LL;
+    record.shard = "0/1";
+    return record;
+}
+
+// ---------------------------------------------------------------------------
+// BatchJournal
+
+void testJournalConcurrentAppend() {
+    TempDir dir("journal_concurrent");
+    string path = (dir.path() / "batch.ptj").string();
+    const int writers = 8;
+    const int recordsEach = 200;
+
+    // Separate processes, as shard workers sharing one journal would be
+    vector<pid_t> children;
+    for (int w = 0; w < writers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            BatchJournal journal;
+            if (!journal.open(path)) _exit(1);
+            for (int i = 0; i < recordsEach; i++) {
+                // Long paths so a torn or interleaved write would be easy to spot
+                string input = "writer" + to_string(w) + "/" + string(300, 'x') + "/image" + to_string(i) + ".jpg";
+                if (!journal.append(makeRecord(input, static_cast<uint64_t>(w) << 32 | i))) _exit(1);
+            }
+            _exit(0);
+        }
+        CHECK(pid > 0);
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    vector<BatchJournal::Record> records;
+    size_t skipped = 0;
+    CHECK(BatchJournal::read(path, records, &skipped));
+    CHECK(skipped == 0);
+    CHECK(records.size() == static_cast<size_t>(writers * recordsEach));
+    set<uint64_t> hashes;
+    for (const auto& record : records) hashes.insert(record.inputHash);
+    CHECK(hashes.size() == static_cast<size_t>(writers * recordsEach));
+}
+
+void testJournalTornWriteResume() {
+    TempDir dir("journal_torn");
+    string path = (dir.path() / "batch.ptj").string();
+
+    {
+        BatchJournal journal;
+        CHECK(journal.open(path));
+        for (int i = 0; i < 3; i++) CHECK(journal.append(makeRecord("image" + to_string(i) + ".jpg", i)));
+    }
+
+    // Cut the last record in half, as a worker killed inside write() would leave it
+    uintmax_t size = fs::file_size(path);
+    fs::resize_file(path, size - 20);
+
+    vector<BatchJournal::Record> records;
+    size_t skipped = 0;
+    CHECK(BatchJournal::read(path, records, &skipped));
+    CHECK(records.size() == 2);
+    CHECK(skipped == 1);
+
+    // Resuming terminates the torn line, so the next record parses on its own
+    {
+        BatchJournal journal;
+        CHECK(journal.open(path));
+        CHECK(journal.append(makeRecord("image2.jpg", 2)));
+        CHECK(journal.append(makeRecord("image3.jpg", 3)));
+    }
+    records.clear();
+    CHECK(BatchJournal::read(path, records, &skipped));
+    CHECK(skipped == 1);
+    CHECK(records.size() == 4);
+    map<string, uint64_t> latest;
+    for (const auto& record : records) latest[record.input] = record.inputHash;
+    CHECK(latest.size() == 4);
+    CHECK(latest["image2.jpg"] == 2);
+}
+
+void testJournalKilledWriter() {
+    TempDir dir("journal_killed");
+    string path = (dir.path() / "batch.ptj").string();
+
+    // Kill a writer at arbitrary points in its append loop, then resume each time
+    for (int round = 0; round < 20; round++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            BatchJournal journal;
+            if (!journal.open(path)) _exit(1);
+            for (int i = 0;; i++) journal.append(makeRecord("round" + to_string(round) + "/" + to_string(i), i));
+        }
+        CHECK(pid > 0);
+        this_thread::sleep_for(chrono::milliseconds(2 + round % 7));
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+
+        BatchJournal journal;
+        CHECK(journal.open(path));
+        CHECK(journal.append(makeRecord("resumed" + to_string(round), round)));
+    }
+
+    vector<BatchJournal::Record> records;
+    size_t skipped = 0;
+    CHECK(BatchJournal::read(path, records, &skipped));
+    // Each kill tears at most the record being written
+    CHECK(skipped <= 20);
+    size_t resumed = count_if(records.begin(), records.end(),
+                              [](const BatchJournal::Record& r) { return r.input.rfind("resumed", 0) == 0; });
+    CHECK(resumed == 20);
+}
+
+void testJournalHashFile() {
+    TempDir dir("journal_hash");
+    fs::path a = dir.path() / "a.bin", b = dir.path() / "b.bin", c = dir.path() / "c.bin";
+    string content(100000, '\0');
+    for (size_t i = 0; i < content.size(); i++) content[i] = static_cast<char>(i * 31 + 7);
+    ofstream(a, ios::binary) << content;
+    ofstream(b, ios::binary) << content;
+    content[content.size() / 2] ^= 1;
+    ofstream(c, ios::binary) << content;
+
+    uint64_t ha = 0, hb = 0, hc = 0, empty = 0;
+    CHECK(BatchJournal::hashFile(a.string(), ha));
+    CHECK(BatchJournal::hashFile(b.string(), hb));
+    CHECK(BatchJournal::hashFile(c.string(), hc));
+    CHECK(ha == hb);
+    CHECK(ha != hc);
+    ofstream(dir.path() / "empty.bin", ios::binary);
+    CHECK(BatchJournal::hashFile((dir.path() / "empty.bin").string(), empty));
+    CHECK(empty == 0xEF46DB3751D8E999ULL);  // XXH64 of no bytes, seed 0
+    CHECK(!BatchJournal::hashFile((dir.path() / "missing.bin").string(), empty));
+}
+
+// ---------------------------------------------------------------------------
+// Striped lightbox detection
+
+// Comb of teeth joined by one bar: its rows only join up at the bar, so the
+// labeller has to merge every tooth's label there
+void drawComb(Mat& image, RNG& rng, bool barAtBottom) {
+    int width = rng.uniform(150, 260);
+    int height = rng.uniform(100, 200);
+    int x = rng.uniform(0, image.cols - width);
+    int y = rng.uniform(0, image.rows - height);
+    int tooth = rng.uniform(8, 16);
+    int gap = rng.uniform(10, 20);    // Wider than the close kernel, so the teeth stay apart
+    int bar = rng.uniform(10, 20);
+    rectangle(image, Rect(x, barAtBottom ? y + height - bar : y, width, bar), Scalar(255), FILLED);
+    for (int left = x; left + tooth <= x + width; left += tooth + gap) {
+        rectangle(image, Rect(left, y, tooth, height), Scalar(255), FILLED);
+    }
+    rectangle(image, Rect(x + width - tooth, y, tooth, height), Scalar(255), FILLED);
+}
+
+void drawRandomShape(Mat& image, RNG& rng) {
+    Point center(rng.uniform(0, image.cols), rng.uniform(0, image.rows));
+    switch (rng.uniform(0, 3)) {
+        case 0: {
+            RotatedRect box(center, Size2f(rng.uniform(20.0f, 180.0f), rng.uniform(20.0f, 180.0f)),
+                            rng.uniform(0.0f, 180.0f));
+            Point2f corners[4];
+            box.points(corners);
+            vector<Point> polygon(corners, corners + 4);
+            fillConvexPoly(image, polygon, Scalar(255));
+            break;
+        }
+        case 1:
+            ellipse(image, center, Size(rng.uniform(10, 90), rng.uniform(10, 90)), rng.uniform(0.0, 180.0), 0, 360,
+                    Scalar(255), FILLED);
+            break;
+        default: {
+            // Two squares meeting only at a corner: one region under 8-connectivity
+            int side = rng.uniform(20, 70);
+            rectangle(image, Rect(center.x, center.y, side, side), Scalar(255), FILLED);
+            rectangle(image, Rect(center.x + side, center.y + side, side, side), Scalar(255), FILLED);
+            break;
+        }
+    }
+}
+
+// Per-label area with every row filled between its leftmost and rightmost
+// pixel, as the striped detector measures regions
+vector<double> rowFilledAreas(const Mat& labels, int count) {
+    vector<double> area(count, 0.0);
+    vector<int> rowMin(count), rowMax(count);
+    for (int y = 0; y < labels.rows; y++) {
+        fill(rowMin.begin(), rowMin.end(), -1);
+        const int* row = labels.ptr<int>(y);
+        for (int x = 0; x < labels.cols; x++) {
+            int label = row[x];
+            if (label == 0) continue;
+            if (rowMin[label] < 0) rowMin[label] = x;
+            rowMax[label] = x;
+        }
+        for (int label = 1; label < count; label++) {
+            if (rowMin[label] >= 0) area[label] += rowMax[label] - rowMin[label] + 1;
+        }
+    }
+    return area;
+}
+
+// The run-length labeller (fed 16-row stripes) picks the same region as OpenCV's
+// flood-fill labelling of the full-frame mask, and stripe size never changes the corners
+void testStripedLabelerMatchesFloodFill() {
+    RNG rng(66);
+    ImageProcessor::ProcessingParams params;
+    params.largeKernel = 5;
+    size_t withRegion = 0;
+    for (int scene = 0; scene < 80; scene++) {
+        Mat image = Mat::zeros(300, 400, CV_8UC1);
+        int shapes = rng.uniform(0, 6);
+        for (int s = 0; s < shapes; s++) drawRandomShape(image, rng);
+        if (scene % 4 != 3) drawComb(image, rng, scene % 2 == 0);
+
+        // Reference: the detector's mask on the whole frame (the image is binary,
+        // so its Otsu-plus-offset level lands at 100), labelled by OpenCV
+        Mat mask, labels, stats, centroids;
+        threshold(image, mask, 100, 255, THRESH_BINARY);
+        Mat kernel = getStructuringElement(MORPH_RECT, Size(params.largeKernel, params.largeKernel));
+        morphologyEx(mask, mask, MORPH_OPEN, kernel);
+        morphologyEx(mask, mask, MORPH_CLOSE, kernel);
+        int count = connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+        vector<double> area = rowFilledAreas(labels, count);
+        int best = 0;
+        double runnerUp = 0.0;
+        for (int label = 1; label < count; label++) {
+            if (area[label] > area[best]) {
+                runnerUp = area[best];
+                best = label;
+            } else {
+                runnerUp = max(runnerUp, area[label]);
+            }
+        }
+        double expectedPercent = area[best] / static_cast<double>(image.total()) * 100.0;
+
+        vector<Point2f> striped, whole;
+        string log;
+        {
+            CaptureOutput capture;
+            params.tileMemoryLimitMB = 0;       // Below one stripe: minimum-height stripes
+            striped = ImageProcessor::detectCornersStriped(image, params);
+            log = capture.text();
+        }
+        {
+            QuietScope quiet;
+            params.tileMemoryLimitMB = 64;      // The whole frame in one stripe
+            whole = ImageProcessor::detectCornersStriped(image, params);
+        }
+        CHECK(striped == whole);
+
+        const string marker = "largest region covers ";
+        size_t at = log.find(marker);
+        CHECK(at != string::npos);
+        if (at == string::npos) continue;
+        double reportedPercent = stod(log.substr(at + marker.size()));
+        if (fabs(reportedPercent - expectedPercent) > 1e-4 * max(1.0, expectedPercent)) {
+            cerr << "  scene " << scene << ": labeller " << reportedPercent << "%, flood fill " << expectedPercent
+                 << "%" << endl;
+        }
+        CHECK(fabs(reportedPercent - expectedPercent) <= 1e-4 * max(1.0, expectedPercent));
+
+        if (expectedPercent < 10.0) {
+            CHECK(striped.empty());
+            continue;
+        }
+        CHECK(striped.size() == 4);
+        if (striped.size() != 4 || runnerUp >= 0.99 * area[best]) continue;
+        withRegion++;
+        // The corners belong to the reference region
+        Point2f mean(0, 0);
+        for (const auto& corner : striped) mean += corner * 0.25f;
+        Rect box(stats.at<int>(best, CC_STAT_LEFT), stats.at<int>(best, CC_STAT_TOP),
+                 stats.at<int>(best, CC_STAT_WIDTH), stats.at<int>(best, CC_STAT_HEIGHT));
+        CHECK(mean.x >= box.x && mean.x <= box.x + box.width && mean.y >= box.y && mean.y <= box.y + box.height);
+    }
+    CHECK(withRegion > 40);
+}
+
+// ---------------------------------------------------------------------------
+// Scanline lightbox search
+
+// Corners found on synthetic photos sit on the generator's ground-truth corners
+void testScanlineCornersOnSyntheticScenes() {
+    const int sceneCount = 20;
+    int detected = 0;
+    double worstError = 0.0;
+    for (int i = 0; i < sceneCount; i++) {
+        SceneGenerator::SceneParams sceneParams;
+        sceneParams.seed = 6400 + i;
+        sceneParams.imageWidth = 1600;
+        sceneParams.imageHeight = 1200;
+        SceneGenerator::Scene scene = SceneGenerator::generate(sceneParams);
+        Mat gray;
+        cvtColor(scene.image, gray, COLOR_BGR2GRAY);
+
+        vector<Point2f> corners;
+        {
+            QuietScope quiet;
+            corners = ImageProcessor::detectCornersFromScanlines(gray, ImageProcessor::ProcessingParams());
+        }
+        if (corners.size() != 4) continue;
+        detected++;
+
+        // Within 1% of the lightbox side, in TL, TR, BR, BL order like the ground truth
+        double side = norm(scene.lightboxCorners[1] - scene.lightboxCorners[0]);
+        for (int k = 0; k < 4; k++) {
+            double error = norm(corners[k] - scene.lightboxCorners[k]);
+            worstError = max(worstError, error / side);
+            if (error > 0.01 * side) {
+                cerr << "  seed " << sceneParams.seed << ": corner " << k << " off by " << error << " px" << endl;
+            }
+            CHECK(error <= 0.01 * side);
+        }
+    }
+    // Sparse scanlines may miss on a hard scene, but not on most
+    CHECK(detected >= sceneCount * 9 / 10);
+    cout << "  " << detected << "/" << sceneCount << " detected, worst corner error "
+         << worstError * 100.0 << "% of the lightbox side" << endl;
+}
+
+// ---------------------------------------------------------------------------
+// Automatic threshold
+
+// Warped-lightbox views of synthetic scenes with reduced contrast, a lighting
+// ramp and noise: the chosen threshold must separate parts from background
+void testAutoThresholdOnSyntheticScenes() {
+    RNG rng(59);
+    const Size size(512, 512);
+    for (int i = 0; i < 24; i++) {
+        SceneGenerator::SceneParams sceneParams;
+        sceneParams.seed = 5900 + i;
+        sceneParams.imageWidth = 640;
+        sceneParams.imageHeight = 480;
+        SceneGenerator::Scene scene = SceneGenerator::generate(sceneParams);
+
+        // The ideal render holds parts at 35 and background at 240
+        Mat ideal = SceneGenerator::renderLightbox(scene, size);
+        Mat truth = ideal < 137;
+
+        double objectLevel = rng.uniform(40.0, 100.0);
+        double backgroundLevel = rng.uniform(180.0, 235.0);
+        double ramp = rng.uniform(0.0, 12.0);
+        Mat degraded(size, CV_32F);
+        for (int y = 0; y < size.height; y++) {
+            for (int x = 0; x < size.width; x++) {
+                double t = (ideal.at<uchar>(y, x) - 35.0) / 205.0;
+                degraded.at<float>(y, x) = static_cast<float>(objectLevel + t * (backgroundLevel - objectLevel) +
+                                                              ramp * (2.0 * x / size.width - 1.0));
+            }
+        }
+        Mat noise(size, CV_32F);
+        rng.fill(noise, RNG::NORMAL, 0.0, 4.0);
+        degraded += noise;
+        GaussianBlur(degraded, degraded, Size(3, 3), 0);
+        Mat gray;
+        degraded.convertTo(gray, CV_8U);
+
+        double level;
+        {
+            QuietScope quiet;
+            level = ImageProcessor::selectAutoThreshold(gray, ImageProcessor::ProcessingParams());
+        }
+        // THRESH_BINARY_INV as in findObjectContour: foreground at or below the threshold
+        Mat mask = gray <= level;
+        double intersection = countNonZero(mask & truth);
+        double unionArea = countNonZero(mask | truth);
+        double iou = unionArea > 0.0 ? intersection / unionArea : 0.0;
+        if (iou < 0.95) {
+            cerr << "  seed " << sceneParams.seed << ": threshold " << level << " between " << objectLevel
+                 << " and " << backgroundLevel << " gives IoU " << iou << endl;
+        }
+        CHECK(iou >= 0.95);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// WorkerPool and TaskGraph
+
+// Tasks queued by one worker are stolen by the idle others
+void testPoolWorkStealing() {
+    WorkerPool pool(4);
+    mutex idsMutex;
+    set<thread::id> ids;
+    atomic<int> ran{0};
+    atomic<bool> outerDone{false};
+    // Submitted from inside a worker, so every graph task lands on that worker's own queue
+    pool.submit([&] {
+        TaskGraph graph;
+        for (int i = 0; i < 64; i++) {
+            graph.add([&] {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                lock_guard<mutex> lock(idsMutex);
+                ids.insert(this_thread::get_id());
+                ran++;
+            });
+        }
+        graph.run(pool);
+        outerDone = true;
+    });
+    while (!outerDone) this_thread::sleep_for(chrono::milliseconds(1));
+    CHECK(ran == 64);
+    CHECK(ids.size() >= 2);
+}
+
+// Dependencies finish before their dependents start, at any pool size
+void testGraphDependencies() {
+    for (int threads : {0, 1, 4}) {
+        WorkerPool pool(threads);
+        for (int round = 0; round < 50; round++) {
+            TaskGraph graph;
+            vector<atomic<int>> finished(40);
+            atomic<int> violations{0};
+            vector<TaskGraph::TaskId> ids;
+            for (size_t i = 0; i < finished.size(); i++) {
+                auto body = [&, i] {
+                    // Node i depends on i / 2 and i / 3 (when different from i)
+                    if (i > 0 && (!finished[i / 2] || !finished[i / 3])) violations++;
+                    finished[i] = 1;
+                };
+                if (i == 0) {
+                    ids.push_back(graph.add(body));
+                } else if (i / 2 == i / 3) {
+                    ids.push_back(graph.add(body, {ids[i / 2]}));
+                } else {
+                    ids.push_back(graph.add(body, {ids[i / 2], ids[i / 3]}));
+                }
+            }
+            graph.run(pool);
+            CHECK(violations == 0);
+            CHECK(all_of(finished.begin(), finished.end(), [](const atomic<int>& f) { return f == 1; }));
+        }
+    }
+}
+
+// A throwing task skips everything not yet started and run() rethrows it
+void testGraphCancellation() {
+    WorkerPool pool(4);
+    {
+        TaskGraph graph;
+        atomic<int> dependentsRan{0};
+        auto failing = graph.add([] { throw runtime_error("first"); });
+        for (int i = 0; i < 20; i++) graph.add([&] { dependentsRan++; }, {failing});
+        bool caught = false;
+        try {
+            graph.run(pool);
+        } catch (const runtime_error& e) {
+            caught = string(e.what()) == "first";
+        }
+        CHECK(caught);
+        CHECK(dependentsRan == 0);
+    }
+    {
+        // With one task in flight, none of the independent tasks behind it start either
+        WorkerPool::setJobParallelism(1);
+        TaskGraph graph;
+        atomic<int> ran{0};
+        graph.add([&] {
+            ran++;
+            throw runtime_error("capped");
+        });
+        for (int i = 0; i < 20; i++) graph.add([&] { ran++; });
+        bool caught = false;
+        try {
+            graph.run(pool);
+        } catch (const runtime_error&) {
+            caught = true;
+        }
+        WorkerPool::setJobParallelism(0);
+        CHECK(caught);
+        CHECK(ran == 1);
+    }
+}
+
+// The per-graph cap bounds the tasks in flight, and the graph still completes
+void testGraphParallelismCap() {
+    WorkerPool pool(8);
+    WorkerPool::setJobParallelism(2);
+    TaskGraph graph;
+    atomic<int> live{0}, peak{0}, ran{0};
+    for (int i = 0; i < 40; i++) {
+        graph.add([&] {
+            int now = ++live;
+            int seen = peak;
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+            this_thread::sleep_for(chrono::microseconds(500));
+            live--;
+            ran++;
+        });
+    }
+    graph.run(pool);
+    WorkerPool::setJobParallelism(0);
+    CHECK(ran == 40);
+    CHECK(peak <= 2);
+}
+
+// Graphs started from inside graph tasks complete without extra threads, even
+// when every worker is waiting on an inner graph
+void testNestedGraphs() {
+    for (int threads : {1, 2, 4}) {
+        WorkerPool::configureShared(threads);
+        atomic<long> total{0};
+        parallelFor(8, 8, [&](size_t) {
+            parallelFor(8, 4, [&](size_t) {
+                parallelFor(4, 4, [&](size_t k) { total += static_cast<long>(k) + 1; });
+            });
+        });
+        CHECK(total == 8 * 8 * 10);
+    }
+    WorkerPool::configureShared(0);
+}
+
+// ---------------------------------------------------------------------------
+// JobQueue
+
+// Jobs must only start on a pool worker's top level (or in the slot of a
+// preempted job), never inside another job's graph wait
+void testJobQueueNoNestedJobs() {
+    static thread_local int t_waiting = 0;
+    for (int threads : {0, 2, 4}) {
+        WorkerPool::configureShared(threads);
+        JobQueue queue;
+        queue.setMaxConcurrent(max(1, threads) * 4);
+        queue.setScheduling(0, true);
+        atomic<int> done{0}, nested{0}, wrongSums{0};
+        for (int i = 0; i < 80; i++) {
+            auto priority = i % 5 == 0 ? JobQueue::Priority::Interactive : JobQueue::Priority::Batch;
+            queue.submit([&](JobQueue::JobId) {
+                if (t_waiting > 0) nested++;
+                for (int stage = 0; stage < 3; stage++) {
+                    atomic<long> sum{0};
+                    t_waiting++;
+                    parallelFor(16, 4, [&](size_t k) {
+                        this_thread::sleep_for(chrono::microseconds(50));
+                        sum += static_cast<long>(k);
+                    });
+                    t_waiting--;
+                    if (sum != 120) wrongSums++;
+                    JobQueue::stageBoundary();
+                }
+                done++;
+            }, priority);
+        }
+        queue.waitIdle();
+        CHECK(done == 80);
+        CHECK(nested == 0);
+        CHECK(wrongSums == 0);
+        CHECK(queue.preempted() == 0);
+    }
+    WorkerPool::configureShared(0);
+}
+
+// An interactive job overtakes running batch jobs at their next stage boundary
+void testJobQueuePreemption() {
+    WorkerPool::configureShared(2);
+    JobQueue queue;
+    queue.setMaxConcurrent(2);
+    queue.setScheduling(0, true);
+    atomic<bool> batchStarted{false}, interactiveDone{false};
+    atomic<int> batchStagesAfter{0};
+    for (int i = 0; i < 2; i++) {
+        queue.submit([&](JobQueue::JobId) {
+            batchStarted = true;
+            for (int stage = 0; stage < 200 && !interactiveDone; stage++) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                JobQueue::stageBoundary();
+            }
+            if (interactiveDone) batchStagesAfter++;
+        });
+    }
+    while (!batchStarted) this_thread::sleep_for(chrono::milliseconds(1));
+    this_thread::sleep_for(chrono::milliseconds(5));
+    auto submitted = chrono::steady_clock::now();
+    chrono::steady_clock::time_point finished;
+    queue.submit([&](JobQueue::JobId) {
+        finished = chrono::steady_clock::now();
+        interactiveDone = true;
+    }, JobQueue::Priority::Interactive);
+    queue.waitIdle();
+    CHECK(interactiveDone);
+    // Both slots were busy for another ~200 ms; preemption starts it within a stage
+    CHECK(finished - submitted < chrono::milliseconds(100));
+    CHECK(batchStagesAfter == 2);
+    WorkerPool::configureShared(0);
+}
+
+// ---------------------------------------------------------------------------
+// Self-intersection sweep
+
+// Reference for ImageProcessor::hasSelfIntersection: every pair of edges, O(n^2).
+// Same contract: repeated points are dropped first, touching counts, and
+// neighbouring edges only conflict when they fold back onto each other.
+int64_t cross(const Point& o, const Point& a, const Point& b) {
+    return static_cast<int64_t>(a.x - o.x) * (b.y - o.y) - static_cast<int64_t>(a.y - o.y) * (b.x - o.x);
+}
+
+bool onSegment(const Point& p, const Point& a, const Point& b) {
+    return cross(a, b, p) == 0 && min(a.x, b.x) <= p.x && p.x <= max(a.x, b.x) &&
+           min(a.y, b.y) <= p.y && p.y <= max(a.y, b.y);
+}
+
+bool closedSegmentsMeet(const Point& a, const Point& b, const Point& c, const Point& d) {
+    if (onSegment(a, c, d) || onSegment(b, c, d) || onSegment(c, a, b) || onSegment(d, a, b)) return true;
+    int64_t d1 = cross(c, d, a), d2 = cross(c, d, b), d3 = cross(a, b, c), d4 = cross(a, b, d);
+    return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+}
+
+vector<Point> withoutRepeats(const vector<Point>& contour) {
+    vector<Point> polygon;
+    for (const Point& p : contour) {
+        if (polygon.empty() || polygon.back() != p) polygon.push_back(p);
+    }
+    while (polygon.size() > 1 && polygon.front() == polygon.back()) polygon.pop_back();
+    return polygon;
+}
+
+bool bruteForceSelfIntersection(const vector<Point>& contour) {
+    vector<Point> polygon = withoutRepeats(contour);
+    size_t n = polygon.size();
+    if (n < 3) return false;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            const Point& a = polygon[i];
+            const Point& b = polygon[(i + 1) % n];
+            const Point& c = polygon[j];
+            const Point& d = polygon[(j + 1) % n];
+            if (j == i + 1 || (i == 0 && j == n - 1)) {
+                // Shared vertex; the two far ends
+                Point shared = j == i + 1 ? b : a;
+                Point p = j == i + 1 ? a : b;
+                Point q = j == i + 1 ? d : c;
+                int64_t dot = static_cast<int64_t>(p.x - shared.x) * (q.x - shared.x) +
+                              static_cast<int64_t>(p.y - shared.y) * (q.y - shared.y);
+                if (cross(shared, p, q) == 0 && dot > 0) return true;
+            } else if (closedSegmentsMeet(a, b, c, d)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void testSelfIntersectionFuzz() {
+    RNG rng(61);
+    size_t intersecting = 0, repaired = 0;
+    for (int iteration = 0; iteration < 20000; iteration++) {
+        // Small grids force collinear, touching and repeated points; large ones general crossings
+        bool coarse = iteration % 2 == 0;
+        int extent = coarse ? 6 : 1000;
+        int count = coarse ? rng.uniform(3, 12) : rng.uniform(3, 40);
+        vector<Point> contour;
+        for (int k = 0; k < count; k++) contour.emplace_back(rng.uniform(0, extent + 1), rng.uniform(0, extent + 1));
+
+        bool expected = bruteForceSelfIntersection(contour);
+        bool actual;
+        {
+            QuietScope quiet;
+            actual = ImageProcessor::hasSelfIntersection(contour);
+        }
+        if (actual != expected) {
+            cerr << "  sweep says " << actual << ", brute force " << expected << " for:";
+            for (const Point& p : contour) cerr << " (" << p.x << "," << p.y << ")";
+            cerr << endl;
+        }
+        CHECK(actual == expected);
+        if (!expected) continue;
+        intersecting++;
+
+        // A repaired contour is clean; one that could not be repaired comes back unchanged
+        vector<Point> result;
+        {
+            QuietScope quiet;
+            result = ImageProcessor::repairSelfIntersections(contour);
+        }
+        if (result == contour) continue;
+        repaired++;
+        CHECK(result.size() >= 3);
+        CHECK(!bruteForceSelfIntersection(result));
+    }
+    // Sanity: the generator exercises both outcomes
+    CHECK(intersecting > 1000);
+    CHECK(repaired > 1000);
+
+    // Simple polygons stay untouched
+    for (int iteration = 0; iteration < 2000; iteration++) {
+        int count = rng.uniform(3, 60);
+        vector<double> angles;
+        for (int k = 0; k < count; k++) angles.push_back(rng.uniform(0.0, 2.0 * CV_PI));
+        sort(angles.begin(), angles.end());
+        vector<Point> star;
+        for (double angle : angles) {
+            double radius = rng.uniform(200.0, 500.0);
+            star.emplace_back(static_cast<int>(lround(1000 + radius * cos(angle))),
+                              static_cast<int>(lround(1000 + radius * sin(angle))));
+        }
+        bool expected = bruteForceSelfIntersection(star);
+        QuietScope quiet;
+        CHECK(ImageProcessor::hasSelfIntersection(star) == expected);
+        if (!expected) CHECK(ImageProcessor::repairSelfIntersections(star) == star);
+    }
+}
+
+struct TestCase {
+    const char* name;
+    function<void()> run;
+};
+
+const vector<TestCase>& testCases() {
+    static const vector<TestCase> cases = {
+        {"journal_concurrent_append", testJournalConcurrentAppend},
+        {"journal_torn_write_resume", testJournalTornWriteResume},
+        {"journal_killed_writer", testJournalKilledWriter},
+        {"journal_hash_file", testJournalHashFile},
+        {"self_intersection_fuzz", testSelfIntersectionFuzz},
+        {"striped_labeler_flood_fill", testStripedLabelerMatchesFloodFill},
+        {"scanline_synthetic_scenes", testScanlineCornersOnSyntheticScenes},
+        {"auto_threshold_synthetic_scenes", testAutoThresholdOnSyntheticScenes},
+        {"pool_work_stealing", testPoolWorkStealing},
+        {"graph_dependencies", testGraphDependencies},
+        {"graph_cancellation", testGraphCancellation},
+        {"graph_parallelism_cap", testGraphParallelismCap},
+        {"graph_nested", testNestedGraphs},
+        {"jobqueue_no_nested_jobs", testJobQueueNoNestedJobs},
+        {"jobqueue_preemption", testJobQueuePreemption},
+    };
+    return cases;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    vector<string> selected(argv + 1, argv + argc);
+    if (selected.size() == 1 && (selected[0] == "-h" || selected[0] == "--help" || selected[0] == "--list")) {
+        cout << "Usage: " << argv[0] << " [case...]   (no arguments runs every case)\n\nCases:\n";
+        for (const auto& test : testCases()) cout << "  " << test.name << "\n";
+        return 0;
+    }
+    for (const auto& name : selected) {
+        bool known = any_of(testCases().begin(), testCases().end(),
+                            [&](const TestCase& test) { return name == test.name; });
+        if (!known) {
+            cerr << "[ERROR] Unknown test case: " << name << endl;
+            return 2;
+        }
+    }
+
+    int failedCases = 0;
+    for (const auto& test : testCases()) {
+        if (!selected.empty() && find(selected.begin(), selected.end(), test.name) == selected.end()) continue;
+        int before = g_failures;
+        auto start = chrono::steady_clock::now();
+        test.run();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        bool passed = g_failures == before;
+        if (!passed) failedCases++;
+        cout << (passed ? "[PASS] " : "[FAIL] ") << test.name << " (" << static_cast<int>(ms) << " ms)" << endl;
+    }
+    return failedCases == 0 ? 0 : 1;
+}